@@ -10,9 +10,16 @@ struct QualityMetrics {
     let banding: Double
 }
 
+struct SceneQuality {
+    let start: Double
+    let end: Double
+    let metrics: QualityMetrics
+}
+
 struct QualityAnalysis {
     let metrics: QualityMetrics
     let notes: [String]
+    var scenes: [SceneQuality] = []
     
     var summaryLines: [String] {
         var lines: [String] = []
@@ -24,6 +31,9 @@ struct QualityAnalysis {
             metrics.banding
         )
         lines.append(header)
+        if scenes.count > 1 {
+            lines.append("Quality scan → \(scenes.count) scenes detected")
+        }
         lines.append(contentsOf: notes)
         return lines
     }
@@ -193,7 +203,8 @@ private struct FrameStats {
 final class QualityAnalyzer {
     
     // MARK: - Preferred API (macOS 13+): async
-    func analyzeAsync(inputPath: String, maxSamples: Int = 12) async -> QualityAnalysis {
+    // maxSamples <= 0 lets the native analyzer pick its default spread.
+    func analyzeAsync(inputPath: String, maxSamples: Int = 0) async -> QualityAnalysis {
         guard FileManager.default.fileExists(atPath: inputPath) else {
             return QualityAnalysis(
                 metrics: QualityMetrics(noise: 0, blur: 0, blockiness: 0, banding: 0),
@@ -201,6 +212,40 @@ final class QualityAnalyzer {
             )
         }
         
+        // Native sampler covers the whole file and splits it into scenes
+        let native = await Task.detached(priority: .utility) {
+            Self.analyzeNative(inputPath: inputPath, maxSamples: maxSamples)
+        }.value
+        if let native { return native }
+        
+        return await analyzeWithReader(inputPath: inputPath, maxSamples: maxSamples > 0 ? maxSamples : 12)
+    }
+    
+    private static func analyzeNative(inputPath: String, maxSamples: Int) -> QualityAnalysis? {
+        var result = up60p_analysis()
+        guard up60p_analyze(inputPath, Int32(maxSamples), &result) == UP60P_OK else { return nil }
+        defer { up60p_free_analysis(&result) }
+        
+        var scenes: [SceneQuality] = []
+        for i in 0..<Int(result.scene_count) {
+            let s = result.scenes[i]
+            scenes.append(SceneQuality(start: s.start_time, end: s.end_time, metrics: QualityMetrics(s.metrics)))
+        }
+        let metrics = QualityMetrics(result.overall)
+        return QualityAnalysis(metrics: metrics, notes: notes(for: metrics), scenes: scenes)
+    }
+    
+    private static func notes(for m: QualityMetrics) -> [String] {
+        var notes: [String] = []
+        if m.noise > 0.12 { notes.append("High noise detected → prioritizing denoise.") }
+        if m.blockiness > 0.12 { notes.append("Blocking/ringing detected → enabling deblock/dering.") }
+        if m.banding > 0.08 { notes.append("Banding risk detected → enabling deband.") }
+        if m.blur > 0.10 { notes.append("Blur detected → gently boosting sharpen.") }
+        return notes
+    }
+    
+    // AVFoundation fallback when the bundled ffmpeg can't decode the input
+    private func analyzeWithReader(inputPath: String, maxSamples: Int) async -> QualityAnalysis {
         let url = URL(fileURLWithPath: inputPath)
         let asset = AVURLAsset(url: url)
         
@@ -232,7 +277,7 @@ final class QualityAnalyzer {
         }
         
         let outputSettings: [String: Any] = [
-            kCVPixelBufferPixelFormatTypeKey as String: kCVPixelFormatType_32BGRA
+            kCVPixelBufferPixelFormatTypeKey as String: kCVPixelFormatType_420YpCbCr8BiPlanarFullRange
         ]
         let output = AVAssetReaderTrackOutput(track: track, outputSettings: outputSettings)
         reader.add(output)
@@ -277,19 +322,12 @@ final class QualityAnalyzer {
         let banding = stats.map(\.banding).reduce(0, +) / Double(stats.count)
         
         let metrics = QualityMetrics(noise: noise, blur: blur, blockiness: blockiness, banding: banding)
-        
-        var notes: [String] = []
-        if noise > 0.12 { notes.append("High noise detected → prioritizing denoise.") }
-        if blockiness > 0.12 { notes.append("Blocking/ringing detected → enabling deblock/dering.") }
-        if banding > 0.08 { notes.append("Banding risk detected → enabling deband.") }
-        if blur > 0.10 { notes.append("Blur detected → gently boosting sharpen.") }
-        
-        return QualityAnalysis(metrics: metrics, notes: notes)
+        return QualityAnalysis(metrics: metrics, notes: Self.notes(for: metrics))
     }
     
     // MARK: - Backwards-compatible sync wrapper (blocks current thread)
     // Prefer switching your callers to analyzeAsync instead of using this.
-    func analyze(inputPath: String, maxSamples: Int = 12) -> QualityAnalysis {
+    func analyze(inputPath: String, maxSamples: Int = 0) -> QualityAnalysis {
         let sema = DispatchSemaphore(value: 0)
         var out = QualityAnalysis(
             metrics: QualityMetrics(noise: 0, blur: 0, blockiness: 0, banding: 0),
@@ -306,95 +344,30 @@ final class QualityAnalyzer {
     }
     
     // MARK: - Stats
+    // Luma plane straight into the native SIMD kernel, no RGB round trip
     private func computeStats(from buffer: CVPixelBuffer) -> FrameStats {
         CVPixelBufferLockBaseAddress(buffer, .readOnly)
         defer { CVPixelBufferUnlockBaseAddress(buffer, .readOnly) }
         
-        guard let base = CVPixelBufferGetBaseAddress(buffer) else {
+        guard let base = CVPixelBufferGetBaseAddressOfPlane(buffer, 0) else {
             return FrameStats(noise: 0, blur: 0, blockiness: 0, banding: 0)
         }
         
-        let width = CVPixelBufferGetWidth(buffer)
-        let height = CVPixelBufferGetHeight(buffer)
-        let bytesPerRow = CVPixelBufferGetBytesPerRow(buffer)
-        let pixelCount = width * height
-        let src = base.assumingMemoryBound(to: UInt8.self)
-        
-        var luma = [Float](repeating: 0, count: pixelCount)
-        for y in 0..<height {
-            for x in 0..<width {
-                let idx = y * bytesPerRow + x * 4
-                let b = Float(src[idx + 0])
-                let g = Float(src[idx + 1])
-                let r = Float(src[idx + 2])
-                let yVal = 0.299 * r + 0.587 * g + 0.114 * b
-                luma[y * width + x] = yVal
-            }
-        }
-        
-        var mean: Float = 0
-        var meanSquare: Float = 0
-        vDSP_meanv(luma, 1, &mean, vDSP_Length(pixelCount))
-        vDSP_measqv(luma, 1, &meanSquare, vDSP_Length(pixelCount))
-        let variance = max(0, meanSquare - mean * mean)
-        let noise = sqrt(variance) / 255.0
-        
-        // Simple sharpness proxy: average gradient magnitude (sparse sampling)
-        var gradSum: Float = 0
-        var gradCount: Int = 0
-        let step = max(1, min(4, width / 256))
-        for y in stride(from: 1, to: height - 1, by: step) {
-            for x in stride(from: 1, to: width - 1, by: step) {
-                let c = luma[y * width + x]
-                let gx = luma[y * width + (x + 1)] - c
-                let gy = luma[(y + 1) * width + x] - c
-                gradSum += abs(gx) + abs(gy)
-                gradCount += 1
-            }
-        }
-        let gradMean = gradCount > 0 ? gradSum / Float(gradCount) : 0
-        let blur = max(0, 0.12 - Double(gradMean) / 255.0) // higher grad → lower blur
-        
-        var boundaryDiff: Float = 0
-        var interiorDiff: Float = 0
-        var boundaryCount = 0
-        var interiorCount = 0
-        for y in stride(from: 0, to: height - 1, by: 2) {
-            for x in stride(from: 1, to: width - 1, by: 2) {
-                let idx = y * width + x
-                let delta = abs(luma[idx] - luma[idx - 1])
-                if x % 8 == 0 {
-                    boundaryDiff += delta
-                    boundaryCount += 1
-                } else {
-                    interiorDiff += delta
-                    interiorCount += 1
-                }
-            }
-        }
-        let boundaryMean = boundaryCount > 0 ? boundaryDiff / Float(boundaryCount) : 0
-        let interiorMean = interiorCount > 0 ? interiorDiff / Float(interiorCount) : 1
-        let blockiness = Double(max(0, boundaryMean - interiorMean)) / 64.0
-        
-        // Banding: ratio of near-flat gradients
-        var flatCount: Int = 0
-        var totalCount: Int = 0
-        for y in stride(from: 0, to: height - 1, by: 2) {
-            for x in stride(from: 0, to: width - 1, by: 2) {
-                let idx = y * width + x
-                let delta = abs(luma[idx] - luma[min(idx + 1, pixelCount - 1)])
-                if delta < 1.5 { flatCount += 1 }
-                totalCount += 1
-            }
-        }
-        let banding = totalCount > 0 ? Double(flatCount) / Double(totalCount) : 0
-        
-        return FrameStats(
-            noise: Double(noise),
-            blur: blur,
-            blockiness: min(1.0, blockiness),
-            banding: min(1.0, banding)
+        var m = up60p_quality_metrics()
+        up60p_analyze_plane(
+            base.assumingMemoryBound(to: UInt8.self),
+            Int32(CVPixelBufferGetWidthOfPlane(buffer, 0)),
+            Int32(CVPixelBufferGetHeightOfPlane(buffer, 0)),
+            CVPixelBufferGetBytesPerRowOfPlane(buffer, 0),
+            &m
         )
+        return FrameStats(noise: m.noise, blur: m.blur, blockiness: m.blockiness, banding: m.banding)
+    }
+}
+
+private extension QualityMetrics {
+    init(_ m: up60p_quality_metrics) {
+        self.init(noise: m.noise, blur: m.blur, blockiness: m.blockiness, banding: m.banding)
     }
 }
 
@@ -46,6 +46,9 @@ class UpscaleRunner: ObservableObject {
     @Published var etaString = "--:--"
     
     var videoDuration: Double = 0.0
+    // Concurrent jobs report separately; keyed by up60p_progress.job_id
+    var jobFractions: [Int32: Double] = [:]
+    var jobFps: [Int32: Double] = [:]
     
      var currentTask: Task<Void, Never>?
      var completionCheckTask: Task<Void, Never>?
@@ -138,6 +141,8 @@ class UpscaleRunner: ObservableObject {
         
         log = ""
         progress = 0.0
+        jobFractions = [:]
+        jobFps = [:]
         fpsString = "0"
         timeString = "0:00"
         etaString = "--:--"
@@ -265,6 +270,37 @@ class UpscaleRunner: ObservableObject {
             }
         }
         
+        if selectedEngine is Up60PEngine {
+            Up60PEngine.setProgressHandler { [weak self] p in
+                Task { @MainActor in
+                    guard let self = self, self.isRunning else { return }
+                    let seconds = Double(p.out_time_us) / 1_000_000
+                    // Total throughput of the jobs still encoding
+                    if p.finished {
+                        self.jobFps[p.job_id] = nil
+                    } else if p.fps >= 0 {
+                        self.jobFps[p.job_id] = p.fps
+                    }
+                    self.fpsString = String(format: "%.1f", self.jobFps.values.reduce(0, +))
+                    if self.videoDuration > 0 {
+                        let fraction = min(max(seconds, 0) / self.videoDuration, 1.0)
+                        self.jobFractions[p.job_id] = max(self.jobFractions[p.job_id] ?? 0, fraction)
+                        let mean = self.jobFractions.values.reduce(0, +) / Double(self.jobFractions.count)
+                        if mean > self.progress {
+                            self.progress = mean
+                        }
+                        self.timeString = FFmpegParser.formatTime(mean * self.videoDuration)
+                        let remaining = max(self.videoDuration * (1 - mean), 0)
+                        self.etaString = p.speed > 0 ? FFmpegParser.formatTime(remaining / p.speed) : "--:--"
+                    } else if seconds > 0 {
+                        self.timeString = FFmpegParser.formatTime(seconds)
+                    }
+                }
+            }
+        } else {
+            Up60PEngine.setProgressHandler(nil)
+        }
+        
         loadVideoDuration()
         
         currentTask?.cancel()
@@ -0,0 +1,159 @@
+#include "up60p_adaptive.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_filters.h"
+#include "up60p_segment.h"
+#include "up60p_probe.h"
+
+typedef struct {
+    double start, end;
+    SceneTier tier;
+} TierSpan;
+
+SceneTier scene_tier(const up60p_quality_metrics *m) {
+    SceneTier t;
+    t.denoise = m->grain < ADAPT_CLEAN_GRAIN ? 0 : m->grain < ADAPT_HEAVY_GRAIN ? 1 : 2;
+    t.deblock = m->blockiness >= ADAPT_CLEAN_BLOCK;
+    return t;
+}
+
+/* Only ever relaxes the user's chain: stages they turned off stay off. */
+void settings_for_tier(const Settings *base, SceneTier tier, Settings *out) {
+    *out = *base;
+    if (tier.denoise == 0) {
+        out->no_denoise = 1;
+    } else if (tier.denoise == 1) {
+        if (!strcmp(out->denoiser, "bm3d") || !strcmp(out->denoiser, "nlmeans")) {
+            safe_copy(out->denoiser, "hqdn3d", sizeof(out->denoiser));
+        }
+        out->use_denoise_2 = 0;
+    }
+    if (!tier.deblock) {
+        out->no_deblock = 1;
+        out->dering_active_2 = 0;
+    }
+}
+
+static bool same_tier(SceneTier a, SceneTier b) {
+    return a.denoise == b.denoise && a.deblock == b.deblock;
+}
+
+static SceneTier max_tier(SceneTier a, SceneTier b) {
+    return (SceneTier){ a.denoise > b.denoise ? a.denoise : b.denoise, a.deblock || b.deblock };
+}
+
+/* Collapses detected scenes into runs of equal tier. Runs shorter than
+   SEGMENT_MIN_SECONDS are folded into a neighbour with the stronger tier,
+   so a flash of noise never costs an extra segment. */
+static int plan_tier_spans(const up60p_analysis *a, TierSpan *spans) {
+    int n = 0;
+    for (int i = 0; i < a->scene_count; i++) {
+        const up60p_scene_metrics *sc = &a->scenes[i];
+        SceneTier t = scene_tier(&sc->metrics);
+        if (n > 0 && (same_tier(spans[n - 1].tier, t) || spans[n - 1].end - spans[n - 1].start < SEGMENT_MIN_SECONDS)) {
+            spans[n - 1].end = sc->end_time;
+            spans[n - 1].tier = max_tier(spans[n - 1].tier, t);
+            continue;
+        }
+        double start = n == 0 ? 0.0 : sc->start_time;
+        spans[n++] = (TierSpan){ start, sc->end_time, t };
+    }
+    while (n > 1 && spans[n - 1].end - spans[n - 1].start < SEGMENT_MIN_SECONDS) {
+        spans[n - 2].end = spans[n - 1].end;
+        spans[n - 2].tier = max_tier(spans[n - 2].tier, spans[n - 1].tier);
+        n--;
+    }
+    // Neighbours may have converged on the same tier after folding
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (m > 0 && same_tier(spans[m - 1].tier, spans[i].tier)) spans[m - 1].end = spans[i].end;
+        else spans[m++] = spans[i];
+    }
+    return m;
+}
+
+static const char *denoise_label(int level) {
+    return level == 0 ? "off" : level == 1 ? "light" : "full";
+}
+
+/* Scores every scene in a sampling pre-pass, then encodes each run of
+   similar scenes with its own chain through the segment runner. With
+   segments > 1 long runs are also split so the whole file still spreads
+   across that many jobs. */
+int process_adaptive(const char *in, const char *out, const char *ffmpeg,
+                     const char *vf, const char *threads) {
+    log_msg("Adaptive mode: scanning scenes...\n");
+    up60p_analysis an;
+    up60p_error err = up60p_analyze(in, 0, &an);
+    if (err == UP60P_ERR_CANCELLED || up60p_is_cancelled()) return -1;
+    if (err != UP60P_OK || an.scene_count == 0) {
+        log_msg("Adaptive mode: quality scan failed, running full chain\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    TierSpan *tiers = calloc((size_t)an.scene_count, sizeof(*tiers));
+    if (!tiers) { up60p_free_analysis(&an); return -1; }
+    int ntiers = plan_tier_spans(&an, tiers);
+    double duration = an.scenes[an.scene_count - 1].end_time;
+    up60p_free_analysis(&an);
+
+    bool relaxed = false;
+    for (int i = 0; i < ntiers; i++) relaxed |= tiers[i].tier.denoise < 2 || !tiers[i].tier.deblock;
+    if (!relaxed || duration <= 0) {
+        free(tiers);
+        log_msg("Adaptive mode: every scene needs the full chain\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    double piece = S.segments > 1 ? duration / S.segments : duration;
+    if (piece < SEGMENT_MIN_SECONDS) piece = SEGMENT_MIN_SECONDS;
+    int cap = 0;
+    for (int i = 0; i < ntiers; i++) cap += (int)((tiers[i].end - tiers[i].start) / piece + 0.5) + 1;
+
+    SegmentSpan *spans = calloc((size_t)cap, sizeof(*spans));
+    SB *chains = calloc((size_t)ntiers, sizeof(*chains));
+    if (!spans || !chains) { free(spans); free(chains); free(tiers); return -1; }
+
+    MediaProbe info;
+    probe_media(ffmpeg, in, false, &info);
+    probe_free(&info);
+    double overlap = temporal_overlap_frames(vf) / (info.fps > 0 ? info.fps : 25.0);
+
+    Settings *scene = malloc(sizeof(*scene));
+    if (!scene) { free(spans); free(chains); free(tiers); return -1; }
+
+    int n = 0;
+    char msg[192];
+    for (int i = 0; i < ntiers; i++) {
+        settings_for_tier(&S, tiers[i].tier, scene);
+        build_filter_chain_from(scene, &chains[i], false);
+
+        snprintf(msg, sizeof(msg), "Adaptive: %.1fs-%.1fs denoise=%s deblock=%s\n",
+                 tiers[i].start, tiers[i].end, denoise_label(tiers[i].tier.denoise),
+                 tiers[i].tier.deblock ? "on" : "off");
+        log_msg(msg);
+
+        double len = tiers[i].end - tiers[i].start;
+        int parts = (int)(len / piece + 0.5);
+        if (parts < 1) parts = 1;
+        for (int p = 0; p < parts && n < cap; p++) {
+            double start = tiers[i].start + len * p / parts;
+            double end = tiers[i].start + len * (p + 1) / parts;
+            bool last = i == ntiers - 1 && p == parts - 1;
+            spans[n++] = (SegmentSpan){
+                .start = start, .end = last ? -1.0 : end,
+                .pre = start < overlap ? start : overlap, .post = last ? 0.0 : overlap,
+                .vf = chains[i].buf
+            };
+        }
+    }
+    free(scene);
+
+    int result = run_segments(in, out, ffmpeg, vf, spans, n, threads);
+
+    for (int i = 0; i < ntiers; i++) free(chains[i].buf);
+    free(chains);
+    free(spans);
+    free(tiers);
+    return result;
+}
@@ -0,0 +1,26 @@
+#ifndef UP60P_ADAPTIVE_H
+#define UP60P_ADAPTIVE_H
+
+#include "up60p_common.h"
+
+/* Denoise tiers go by grain (noise sigma / 255): under ~2 levels of 255 a
+   scene skips denoise, past ~6 it gets the configured denoisers. Deblock
+   stays on well below the 0.12 blockiness QualityAnalyzer.swift reports
+   as blocking, since leaving it off where it's needed costs more. */
+#define ADAPT_CLEAN_GRAIN 0.008
+#define ADAPT_HEAVY_GRAIN 0.025
+#define ADAPT_CLEAN_BLOCK 0.04
+
+typedef struct {
+    int denoise;      /* 0 = off, 1 = cheap hqdn3d, 2 = configured denoisers */
+    bool deblock;
+} SceneTier;
+
+SceneTier scene_tier(const up60p_quality_metrics *m);
+void settings_for_tier(const Settings *base, SceneTier tier, Settings *out);
+
+/* Returns SEGMENT_FALLBACK when every scene needs the full chain anyway. */
+int process_adaptive(const char *in, const char *out, const char *ffmpeg,
+                     const char *vf, const char *threads);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef UP60P_ANALYZE_H
+#define UP60P_ANALYZE_H
+
+#include "up60p_common.h"
+
+#define ANALYZE_DEFAULT_SAMPLES 120
+
+/* Coarse luma thumbnail used to split the sampled frames into scenes */
+#define SCENE_THUMB_W 32
+#define SCENE_THUMB_H 18
+#define SCENE_CUT_DIFF 24      /* mean abs thumbnail difference, 0..255 */
+
+/* Raw sums from one plane; kept integral so strips can be merged exactly */
+typedef struct {
+    uint64_t sum, sumsq, pixels;
+    uint64_t hdiff, vdiff, diffs;
+    uint64_t edge_diff, edges;     /* horizontal steps that cross an 8px block edge */
+    uint64_t flat;
+} PlaneStats;
+
+void plane_stats(const uint8_t *y, int width, int height, ptrdiff_t stride, PlaneStats *st);
+void metrics_from_stats(const PlaneStats *st, up60p_quality_metrics *m);
+
+#define GRAIN_BLOCK 8
+
+/* up60p_quality_metrics.grain of one plane */
+double plane_grain(const uint8_t *y, int width, int height, ptrdiff_t stride);
+
+void plane_thumbnail(const uint8_t *y, int width, int height, ptrdiff_t stride,
+                     uint8_t thumb[SCENE_THUMB_W * SCENE_THUMB_H]);
+int thumbnail_distance(const uint8_t *a, const uint8_t *b);
+
+#endif
@@ -0,0 +1,71 @@
+#include "up60p_arena.h"
+
+#define ARENA_BLOCK_MIN 4096
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+    ArenaBlock *next;
+    size_t size, used;
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+void *arena_alloc(Arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    ArenaBlock *b = a->head;
+    if (!b || b->size - b->used < size) {
+        // Blocks double with use, so a job that builds a lot settles into
+        // a handful of mallocs
+        size_t want = b ? b->size * 2 : ARENA_BLOCK_MIN;
+        if (want < size) want = size;
+        b = malloc(sizeof(*b) + want);
+        if (!b) return NULL;
+        b->next = a->head;
+        b->size = want;
+        b->used = 0;
+        a->head = b;
+    }
+    void *p = b->data + b->used;
+    b->used += size;
+    a->used += size;
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(Arena *a, const char *s, size_t n) {
+    char *d = arena_alloc(a, n + 1);
+    if (d) memcpy(d, s, n);
+    return d;
+}
+
+char *arena_strdup(Arena *a, const char *s) {
+    return arena_strndup(a, s, strlen(s));
+}
+
+char *arena_vprintf(Arena *a, const char *fmt, va_list ap) {
+    va_list again;
+    va_copy(again, ap);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    char *d = n >= 0 ? arena_alloc(a, (size_t)n + 1) : NULL;
+    if (d) vsnprintf(d, (size_t)n + 1, fmt, again);
+    va_end(again);
+    return d;
+}
+
+char *arena_printf(Arena *a, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char *d = arena_vprintf(a, fmt, ap);
+    va_end(ap);
+    return d;
+}
+
+void arena_free(Arena *a) {
+    ArenaBlock *b = a->head;
+    while (b) {
+        ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+    a->head = NULL;
+    a->used = 0;
+}
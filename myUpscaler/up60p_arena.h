@@ -0,0 +1,25 @@
+#ifndef UP60P_ARENA_H
+#define UP60P_ARENA_H
+
+#include "up60p_common.h"
+
+/* Bump allocator for everything a job builds and throws away together:
+   filter graphs, their parameters and the strings they render to. Zero
+   initialised it is empty; nothing is freed until arena_free. */
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct {
+    ArenaBlock *head;
+    size_t used;              /* bytes handed out, for diagnostics */
+} Arena;
+
+/* NULL only when out of memory; memory is 16-byte aligned and zeroed */
+void *arena_alloc(Arena *a, size_t size);
+char *arena_strdup(Arena *a, const char *s);
+char *arena_strndup(Arena *a, const char *s, size_t n);
+/* Formats straight into the arena, any length */
+char *arena_printf(Arena *a, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+char *arena_vprintf(Arena *a, const char *fmt, va_list ap);
+void arena_free(Arena *a);
+
+#endif
@@ -0,0 +1,291 @@
+#include "up60p_bench.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_filters.h"
+
+typedef struct {
+    const char *name;
+    void (*build)(const Settings *s, FilterGraph *vf);
+    bool whole;                   /* brings its own format conversion */
+} BenchCase;
+
+/* Strength the user configured for this builder, or its own default */
+static const char *own_strength(const char *method, const char *name, const char *strength,
+                                const char *fallback) {
+    return !strcmp(method, name) ? strength : fallback;
+}
+
+static void case_baseline(const Settings *s, FilterGraph *vf) { (void)s; (void)vf; }
+static void case_hqdn3d(const Settings *s, FilterGraph *vf) {
+    build_hqdn3d_filter(vf, own_strength(s->denoiser, "hqdn3d", s->denoise_strength, ""));
+}
+static void case_nlmeans(const Settings *s, FilterGraph *vf) {
+    build_nlmeans_filter(vf, own_strength(s->denoiser, "nlmeans", s->denoise_strength, ""));
+}
+static void case_atadenoise(const Settings *s, FilterGraph *vf) {
+    build_atadenoise_filter(vf, own_strength(s->denoiser, "atadenoise", s->denoise_strength, ""));
+}
+static void case_bm3d(const Settings *s, FilterGraph *vf) {
+    build_bm3d_filter(vf, own_strength(s->denoiser, "bm3d", s->denoise_strength, ""));
+}
+static void case_deblock(const Settings *s, FilterGraph *vf) {
+    build_deblock_filter(vf, s->deblock_mode, s->deblock_thresh);
+}
+static void case_deband(const Settings *s, FilterGraph *vf) {
+    build_deband_filter(vf, "deband", own_strength(s->deband_method, "deband", s->deband_strength, "0.015"),
+                        s->f3kdb_range, s->f3kdb_y, s->f3kdb_cbcr);
+}
+static void case_f3kdb(const Settings *s, FilterGraph *vf) {
+    build_deband_filter(vf, "f3kdb", "", s->f3kdb_range, s->f3kdb_y, s->f3kdb_cbcr);
+}
+static void case_gradfun(const Settings *s, FilterGraph *vf) {
+    build_deband_filter(vf, "gradfun", own_strength(s->deband_method, "gradfun", s->deband_strength, "1.2"),
+                        "", "", "");
+}
+static void case_mi_dup(const Settings *s, FilterGraph *vf) { build_minterpolate_filter(vf, s->fps, "dup"); }
+static void case_mi_blend(const Settings *s, FilterGraph *vf) { build_minterpolate_filter(vf, s->fps, "blend"); }
+static void case_mi_mci(const Settings *s, FilterGraph *vf) { build_minterpolate_filter(vf, s->fps, "mci"); }
+
+/* The scale stage exactly as build_filter_stages emits it */
+static void scaler_stage(const Settings *s, const char *scaler, FilterGraph *vf) {
+    Settings t = *s;
+    safe_copy(t.scaler, scaler, sizeof(t.scaler));
+    FilterGraph pre, post;
+    fg_init(&pre, vf->arena);
+    fg_init(&post, vf->arena);
+    build_filter_stages(&t, &pre, vf, &post, false);
+}
+static void case_zscale(const Settings *s, FilterGraph *vf) { scaler_stage(s, "zscale", vf); }
+static void case_lanczos(const Settings *s, FilterGraph *vf) { scaler_stage(s, "lanczos", vf); }
+static void case_full_chain(const Settings *s, FilterGraph *vf) { build_filter_graph(s, vf, false); }
+
+// baseline stays first: every other case is also reported net of it
+static const BenchCase bench_cases[] = {
+    { "baseline",          case_baseline,   false },
+    { "hqdn3d",            case_hqdn3d,     false },
+    { "nlmeans",           case_nlmeans,    false },
+    { "atadenoise",        case_atadenoise, false },
+    { "bm3d",              case_bm3d,       false },
+    { "deblock",           case_deblock,    false },
+    { "deband",            case_deband,     false },
+    { "deband_f3kdb",      case_f3kdb,      false },
+    { "gradfun",           case_gradfun,    false },
+    { "minterpolate_dup",  case_mi_dup,     false },
+    { "minterpolate_blend", case_mi_blend,  false },
+    { "minterpolate_mci",  case_mi_mci,     false },
+    { "zscale",            case_zscale,     false },
+    { "lanczos",           case_lanczos,    false },
+    { "full_chain",        case_full_chain, true },
+};
+
+/* lavfi sources, fixed seeds so every release renders the same pixels.
+   %1$d/%2$d are width/height, %3$d/%4$d an eighth of them. */
+static const struct { const char *name, *source; } bench_clips[] = {
+    { "noise",    "color=c=0x808080:s=%1$dx%2$d:r=24,noise=alls=24:allf=t+u:all_seed=1" },
+    { "gradient", "gradients=s=%1$dx%2$d:r=24:speed=0.02:seed=1" },
+    { "blocky",   "testsrc2=s=%3$dx%4$d:r=24,scale=%1$d:%2$d:flags=neighbor" },
+    { "motion",   "testsrc2=s=%1$dx%2$d:r=24" },
+};
+
+static bool name_selected(const char *list, const char *name) {
+    if (!list || !*list) return true;
+    size_t n = strlen(name);
+    for (const char *p = list; *p; ) {
+        while (*p == ',' || *p == ' ') p++;
+        const char *end = p;
+        while (*end && *end != ',') end++;
+        const char *last = end;
+        while (last > p && last[-1] == ' ') last--;
+        if ((size_t)(last - p) == n && !strncmp(p, name, n)) return true;
+        p = end;
+    }
+    return false;
+}
+
+void bench_parse_line(const char *line, void *ctx) {
+    BenchUsage *u = ctx;
+    const char *b = strstr(line, "bench:");
+    if (!b) {
+        if (*line) safe_copy(u->last, line, sizeof(u->last));
+        return;
+    }
+    double ut, st, rt;
+    long long kb;
+    if (sscanf(b, "bench: utime=%lfs stime=%lfs rtime=%lfs", &ut, &st, &rt) == 3) {
+        u->utime = ut;
+        u->stime = st;
+        u->rtime = rt;
+        u->seen = true;
+    } else if (sscanf(b, "bench: maxrss=%lld", &kb) == 1) {
+        u->maxrss_kb = kb;
+    }
+}
+
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Lossless FFV1 render of one clip, reused by later benchmarks */
+static bool render_clip(const char *ffmpeg, int clip, const char *dir, int w, int h, int frames,
+                        char *path, size_t size) {
+    snprintf(path, size, "%s/%s_%dx%d_%d.mkv", dir, bench_clips[clip].name, w, h, frames);
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_size > 0) return true;
+
+    char source[256], count[16], part[PATH_MAX + 8];
+    snprintf(source, sizeof(source), bench_clips[clip].source, w, h, w / 8 > 2 ? w / 8 : 2,
+             h / 8 > 2 ? h / 8 : 2);
+    snprintf(count, sizeof(count), "%d", frames);
+    snprintf(part, sizeof(part), "%s.part", path);
+    char *argv[] = {
+        (char*)ffmpeg, "-hide_banner", "-loglevel", "error", "-nostats", "-y",
+        "-f", "lavfi", "-i", source, "-frames:v", count,
+        "-c:v", "ffv1", "-pix_fmt", "yuv420p", "-f", "matroska", part, NULL
+    };
+    if (execute_ffmpeg_capture(argv, NULL, NULL) != 0 || rename(part, path) != 0) {
+        unlink(part);
+        return false;
+    }
+    return true;
+}
+
+static int default_threads(int *out, int max) {
+    int cores = up60p_cpu_count(), n = 0;
+    for (int t = 1; t < cores && n < max - 1; t *= 2) out[n++] = t;
+    out[n++] = cores;
+    return n;
+}
+
+up60p_error up60p_benchmark(const up60p_options *opts, const up60p_bench_config *config,
+                            char **json_out) {
+    if (!opts || !json_out) return UP60P_ERR_INVALID_OPTIONS;
+    *json_out = NULL;
+    const char *ffmpeg = get_bundled_ffmpeg_path();
+    if (!ffmpeg) return UP60P_ERR_FFMPEG_NOT_FOUND;
+
+    up60p_bench_config cfg = {0};
+    if (config) cfg = *config;
+    int w = cfg.width > 0 ? cfg.width & ~1 : BENCH_DEFAULT_WIDTH;
+    int h = cfg.height > 0 ? cfg.height & ~1 : BENCH_DEFAULT_HEIGHT;
+    int frames = cfg.frames > 0 ? cfg.frames : BENCH_DEFAULT_FRAMES;
+    if (w < 16 || h < 16) return UP60P_ERR_INVALID_OPTIONS;
+
+    int threads[ARR_LEN(cfg.threads)], nthreads = 0;
+    for (int i = 0; i < ARR_LEN(cfg.threads) && cfg.threads[i] > 0; i++) threads[nthreads++] = cfg.threads[i];
+    if (nthreads == 0) nthreads = default_threads(threads, ARR_LEN(threads));
+
+    char dir[PATH_MAX];
+    if (cfg.work_dir && *cfg.work_dir) safe_copy(dir, cfg.work_dir, sizeof(dir));
+    else {
+        const char *tmp = getenv("TMPDIR");
+        snprintf(dir, sizeof(dir), "%s/up60p-bench", tmp && *tmp ? tmp : "/tmp");
+    }
+    mkdir_p(dir);
+
+    up60p_reset_cancel();
+    Settings s;
+    settings_from_up60p_options(&s, opts);
+    // The runs see these options too, for as long as the cases take; the
+    // caller's own settings come back afterwards
+    Settings caller = S;
+    S = s;
+    // Cases time the filters on the CPU; a device graph would need the device
+    s.hw_resident = 0;
+    safe_copy(s.encoder, "auto", sizeof(s.encoder));
+    // Cases convert like the real chain does after optimization, so the
+    // baseline carries the same conversion cost
+    Arena arena = {0};
+    FilterGraph chain;
+    fg_init(&chain, &arena);
+    build_filter_graph(&s, &chain, false);
+    const FilterParam *prefix = fg_is(chain.head, "format") ? fg_positional(chain.head, 0) : NULL;
+
+    SB json = {0};
+    sb_fmt(&json, "{\n  \"version\": 1,\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n"
+                  "  \"cores\": %d,\n  \"runs\": [", w, h, frames, up60p_cpu_count());
+    up60p_error err = UP60P_OK;
+    bool first_run = true;
+
+    for (int c = 0; c < ARR_LEN(bench_clips) && err == UP60P_OK; c++) {
+        if (!name_selected(cfg.clips, bench_clips[c].name)) continue;
+        char clip[PATH_MAX];
+        if (!render_clip(ffmpeg, c, dir, w, h, frames, clip, sizeof(clip))) {
+            log_msg("Benchmark: could not render the synthetic clips (lavfi missing?)\n");
+            err = UP60P_ERR_IO;
+            break;
+        }
+        double base_cpu[ARR_LEN(threads)] = {0};
+
+        for (int k = 0; k < ARR_LEN(bench_cases) && err == UP60P_OK; k++) {
+            const BenchCase *bc = &bench_cases[k];
+            if (k > 0 && !name_selected(cfg.cases, bc->name)) continue;
+            FilterGraph g;
+            fg_init(&g, &arena);
+            if (!bc->whole && prefix) fg_text(fg_add(&g, "format"), NULL, prefix->text);
+            bc->build(&s, &g);
+            SB vf = {0};
+            fg_render(&g, &vf);
+            double first_fps = 0;
+
+            for (int t = 0; t < nthreads; t++) {
+                if (up60p_is_cancelled()) { err = UP60P_ERR_CANCELLED; break; }
+                char nt[16];
+                snprintf(nt, sizeof(nt), "%d", threads[t]);
+                char *argv[] = {
+                    (char*)ffmpeg, "-hide_banner", "-nostats", "-benchmark",
+                    "-threads", nt, "-i", clip, "-filter_threads", nt,
+                    "-an", "-vf", vf.buf, "-f", "null", "-", NULL
+                };
+                BenchUsage u = { .seen = false };
+                double t0 = bench_now();
+                int rc = execute_ffmpeg_capture(argv, bench_parse_line, &u);
+                double wall = u.seen && u.rtime > 0 ? u.rtime : bench_now() - t0;
+                bool ok = rc == 0 && !up60p_is_cancelled();
+
+                double fps = ok && wall > 0 ? frames / wall : 0;
+                double cpu = ok ? (u.utime + u.stime) / frames : 0;
+                if (k == 0) base_cpu[t] = cpu;
+                if (t == 0) first_fps = fps;
+
+                sb_append(&json, first_run ? "\n    {" : ",\n    {");
+                first_run = false;
+                sb_append(&json, "\"case\": ");
+                sb_json_string(&json, bc->name);
+                sb_fmt(&json, ", \"clip\": \"%s\", \"threads\": %d, \"ok\": %s, \"exit\": %d, ",
+                       bench_clips[c].name, threads[t], ok ? "true" : "false", rc);
+                sb_fmt(&json, "\"fps\": %.3f, \"wall_s\": %.3f, \"cpu_s_per_frame\": %.6f, ",
+                       fps, wall, cpu);
+                if (k > 0 && base_cpu[t] > 0 && ok) sb_fmt(&json, "\"net_cpu_s_per_frame\": %.6f, ", cpu - base_cpu[t]);
+                sb_fmt(&json, "\"peak_rss_mb\": %.1f, \"speedup\": %.3f, \"filter\": ",
+                       u.maxrss_kb / 1024.0, first_fps > 0 ? fps / first_fps : 0.0);
+                sb_json_string(&json, vf.buf ? vf.buf : "");
+                sb_append(&json, "}");
+
+                char msg[512];
+                if (ok) snprintf(msg, sizeof(msg), "Benchmark: %s on %s, %d threads: %.1f fps, %.1f ms CPU/frame, %.0f MB\n",
+                                 bc->name, bench_clips[c].name, threads[t], fps, cpu * 1e3, u.maxrss_kb / 1024.0);
+                else snprintf(msg, sizeof(msg), "Benchmark: %s on %s, %d threads failed (%d): %s\n",
+                              bc->name, bench_clips[c].name, threads[t], rc, u.last);
+                log_msg(msg);
+            }
+            free(vf.buf);
+        }
+    }
+    sb_append(&json, "\n  ]\n}\n");
+    arena_free(&arena);
+    S = caller;
+
+    if (err != UP60P_OK) {
+        free(json.buf);
+        return err;
+    }
+    *json_out = json.buf;
+    return UP60P_OK;
+}
+
+void up60p_free_benchmark(char *json) {
+    free(json);
+}
@@ -0,0 +1,22 @@
+#ifndef UP60P_BENCH_H
+#define UP60P_BENCH_H
+
+#include "up60p_common.h"
+
+#define BENCH_DEFAULT_WIDTH 640
+#define BENCH_DEFAULT_HEIGHT 360
+#define BENCH_DEFAULT_FRAMES 48
+
+/* What ffmpeg -benchmark reports for one run */
+typedef struct {
+    double utime, stime, rtime;   /* seconds */
+    long long maxrss_kb;
+    bool seen;
+    char last[256];               /* last other stderr line, for failures */
+} BenchUsage;
+
+/* Line sink for execute_ffmpeg_capture; understands both the "kB" and
+   "KiB" spellings of maxrss */
+void bench_parse_line(const char *line, void *ctx);
+
+#endif
@@ -0,0 +1,274 @@
+#include "up60p_cache.h"
+#include "up60p_utils.h"
+#include <pthread.h>
+#include <sys/ioctl.h>
+#if defined(__APPLE__)
+#include <sys/clonefile.h>
+#elif defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+#define XXH_P1 11400714785074694791ULL
+#define XXH_P2 14029467366897019727ULL
+#define XXH_P3 1609587929392839161ULL
+#define XXH_P4 9650029242287828579ULL
+#define XXH_P5 2870177450012600261ULL
+
+static pthread_mutex_t evict_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned tmp_counter;
+
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t read64(const uint8_t *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint32_t read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+static inline uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    return rotl64(acc, 31) * XXH_P1;
+}
+
+static inline uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+/* XXH64, little-endian reads (every target we ship on) */
+uint64_t xxh64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = data, *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p)); p += 8;
+            v2 = xxh_round(v2, read64(p)); p += 8;
+            v3 = xxh_round(v3, read64(p)); p += 8;
+            v4 = xxh_round(v4, read64(p)); p += 8;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1); h = xxh_merge(h, v2); h = xxh_merge(h, v3); h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += (uint64_t)len;
+    for (; p + 8 <= end; p += 8) h = rotl64(h ^ xxh_round(0, read64(p)), 27) * XXH_P1 + XXH_P4;
+    if (p + 4 <= end) { h = rotl64(h ^ ((uint64_t)read32(p) * XXH_P1), 23) * XXH_P2 + XXH_P3; p += 4; }
+    for (; p < end; p++) h = rotl64(h ^ (*p * XXH_P5), 11) * XXH_P1;
+    h ^= h >> 33; h *= XXH_P2;
+    h ^= h >> 29; h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+bool hash_file_sampled(const char *path, uint64_t *out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    uint8_t *buf = malloc(CACHE_SAMPLE_BLOCK);
+    if (fstat(fd, &st) != 0 || !buf) { free(buf); close(fd); return false; }
+
+    uint64_t size = (uint64_t)st.st_size;
+    uint64_t h = xxh64(&size, sizeof(size), 0);
+    bool ok = true;
+    // Small files are hashed whole, large ones by head, tail and strided blocks
+    bool whole = size <= (uint64_t)CACHE_SAMPLE_BLOCK * (CACHE_SAMPLE_COUNT + 2);
+    int blocks = whole ? (int)((size + CACHE_SAMPLE_BLOCK - 1) / CACHE_SAMPLE_BLOCK) : CACHE_SAMPLE_COUNT + 1;
+    for (int i = 0; i < blocks && ok; i++) {
+        off_t off;
+        if (whole) off = (off_t)i * CACHE_SAMPLE_BLOCK;
+        else if (i == CACHE_SAMPLE_COUNT) off = (off_t)(size - CACHE_SAMPLE_BLOCK);
+        else off = (off_t)(size / CACHE_SAMPLE_COUNT * (uint64_t)i);
+        ssize_t n = pread(fd, buf, CACHE_SAMPLE_BLOCK, off);
+        if (n < 0) ok = false;
+        else h = xxh64(buf, (size_t)n, h);
+    }
+    free(buf);
+    close(fd);
+    if (ok) *out = h;
+    return ok;
+}
+
+/* x265 params without pools=, which only sizes its thread pools to the
+   job's CPU share */
+static void append_x265_params(SB *canon, const char *params) {
+    const char *sep = "";
+    while (*params) {
+        size_t n = strcspn(params, ":");
+        if (strncmp(params, "pools=", 6)) {
+            sb_fmt(canon, "%s%.*s", sep, (int)n, params);
+            sep = ":";
+        }
+        params += n;
+        if (*params) params++;
+    }
+}
+
+bool cache_key(const char *in, const char *out, char *const args[], const char *extra,
+               char *key, size_t key_size) {
+    uint64_t content;
+    if (!hash_file_sampled(in, &content)) return false;
+
+    SB canon = {0};
+    for (int i = 1; args[i]; i++) {
+        const char *a = args[i];
+        if (!strcmp(a, "-i") || !strcmp(a, "-threads") || !strcmp(a, "-loglevel")) { if (args[i + 1]) i++; continue; }
+        if (!strcmp(a, "-y") || !strcmp(a, "-stats") || !strcmp(a, "-nostats") || !strcmp(a, "-hide_banner")) continue;
+        if (out && !strcmp(a, out)) continue;
+        if (!strcmp(a, "-x265-params") && args[i + 1]) {
+            // Left out whole when pools= was all there was
+            SB params = {0};
+            append_x265_params(&params, args[++i]);
+            if (params.len) {
+                sb_append(&canon, a);
+                sb_append(&canon, "\x1f");
+                sb_append(&canon, params.buf);
+                sb_append(&canon, "\x1f");
+            }
+            free(params.buf);
+            continue;
+        }
+        sb_append(&canon, a);
+        sb_append(&canon, "\x1f");
+    }
+    if (extra) sb_append(&canon, extra);
+    uint64_t recipe = canon.buf ? xxh64(canon.buf, canon.len, 0) : 0;
+    free(canon.buf);
+
+    snprintf(key, key_size, "%016llx%016llx", (unsigned long long)content, (unsigned long long)recipe);
+    return true;
+}
+
+static bool clone_file(const char *src, const char *dst) {
+#if defined(__APPLE__)
+    return clonefile(src, dst, 0) == 0;
+#elif defined(__linux__) && defined(FICLONE)
+    int in = open(src, O_RDONLY);
+    if (in < 0) return false;
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool ok = out >= 0 && ioctl(out, FICLONE, in) == 0;
+    if (out >= 0) close(out);
+    close(in);
+    if (!ok) unlink(dst);
+    return ok;
+#else
+    (void)src; (void)dst;
+    return false;
+#endif
+}
+
+static bool copy_file(const char *src, const char *dst) {
+    int in = open(src, O_RDONLY);
+    if (in < 0) return false;
+    int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) { close(in); return false; }
+    char buf[1 << 16];
+    bool ok = true;
+    ssize_t n;
+    while (ok && (n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) { if (errno == EINTR) continue; ok = false; break; }
+        for (ssize_t w = 0; w < n; ) {
+            ssize_t m = write(out, buf + w, (size_t)(n - w));
+            if (m < 0) { if (errno == EINTR) continue; ok = false; break; }
+            w += m;
+        }
+    }
+    close(in);
+    if (close(out) != 0) ok = false;
+    if (!ok) unlink(dst);
+    return ok;
+}
+
+/* Reflink keeps the two names independent at no cost where the filesystem
+   supports it, and a copy always works. Never a hardlink: the next
+   ffmpeg -y to the output truncates it in place, entry and all. */
+static bool materialize(const char *src, const char *dst) {
+    unlink(dst);
+    return clone_file(src, dst) || copy_file(src, dst);
+}
+
+bool cache_lookup(const char *dir, const char *key, const char *ext, char *path, size_t size) {
+    snprintf(path, size, "%s/%s.%s", dir, key, ext);
+    if (access(path, R_OK) != 0) return false;
+    utimensat(AT_FDCWD, path, NULL, 0);    // mtime doubles as last-use time
+    return true;
+}
+
+bool cache_fetch(const char *dir, const char *key, const char *ext, const char *out) {
+    char entry[PATH_MAX];
+    return cache_lookup(dir, key, ext, entry, sizeof(entry)) && materialize(entry, out);
+}
+
+typedef struct {
+    char *path;
+    off_t size;
+    time_t used;
+} CacheEntry;
+
+static int by_last_use(const void *a, const void *b) {
+    time_t x = ((const CacheEntry*)a)->used, y = ((const CacheEntry*)b)->used;
+    return (x > y) - (x < y);
+}
+
+static void cache_evict(const char *dir, int max_mb) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    CacheEntry *items = NULL;
+    int count = 0, cap = 0;
+    off_t total = 0;
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.' || strstr(e->d_name, ".tmp")) continue;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        if (count == cap) {
+            cap = cap ? cap * 2 : 64;
+            CacheEntry *tmp = realloc(items, (size_t)cap * sizeof(*tmp));
+            if (!tmp) break;
+            items = tmp;
+        }
+        items[count++] = (CacheEntry){ strdup(path), st.st_size, st.st_mtime };
+        total += st.st_size;
+    }
+    closedir(d);
+
+    off_t limit = (off_t)max_mb << 20;
+    if (total > limit) {
+        qsort(items, (size_t)count, sizeof(*items), by_last_use);
+        for (int i = 0; i < count && total > limit; i++) {
+            if (items[i].path && unlink(items[i].path) == 0) total -= items[i].size;
+        }
+    }
+    for (int i = 0; i < count; i++) free(items[i].path);
+    free(items);
+}
+
+void cache_temp_path(const char *dir, const char *key, const char *ext, char *path, size_t size) {
+    mkdir_p(dir);
+    snprintf(path, size, "%s/%s.tmp%d.%u.%s", dir, key, (int)getpid(),
+             __atomic_fetch_add(&tmp_counter, 1, __ATOMIC_RELAXED), ext);
+}
+
+bool cache_publish(const char *dir, const char *key, const char *ext, const char *tmp, int max_mb) {
+    char entry[PATH_MAX];
+    snprintf(entry, sizeof(entry), "%s/%s.%s", dir, key, ext);
+    // Published with rename so a concurrent fetch never sees a partial entry
+    if (rename(tmp, entry) != 0) {
+        unlink(tmp);
+        return false;
+    }
+    pthread_mutex_lock(&evict_lock);
+    cache_evict(dir, max_mb > 0 ? max_mb : CACHE_DEFAULT_MB);
+    pthread_mutex_unlock(&evict_lock);
+    return true;
+}
+
+void cache_store(const char *dir, const char *key, const char *ext, const char *out, int max_mb) {
+    char tmp[PATH_MAX];
+    cache_temp_path(dir, key, ext, tmp, sizeof(tmp));
+    if (!materialize(out, tmp)) {
+        unlink(tmp);
+        return;
+    }
+    cache_publish(dir, key, ext, tmp, max_mb);
+}
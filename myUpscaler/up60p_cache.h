@@ -0,0 +1,38 @@
+#ifndef UP60P_CACHE_H
+#define UP60P_CACHE_H
+
+#include "up60p_common.h"
+
+#define CACHE_DEFAULT_MB 20480
+#define CACHE_SAMPLE_BLOCK (64 * 1024)
+#define CACHE_SAMPLE_COUNT 16
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+
+/* Sampled content hash: size, head, tail and CACHE_SAMPLE_COUNT evenly
+   strided blocks. Returns false if the file can't be read. */
+bool hash_file_sampled(const char *path, uint64_t *out);
+
+/* Hash of the input content plus every argument that shapes the output.
+   Paths, thread counts (x265's pools= included) and logging flags are
+   left out so the same job from another folder or batch size still hits. */
+bool cache_key(const char *in, const char *out, char *const args[], const char *extra,
+               char *key, size_t key_size);
+
+/* Materializes a cached result at out (reflink or copy). */
+bool cache_fetch(const char *dir, const char *key, const char *ext, const char *out);
+
+/* Adds out to the cache and evicts least recently used entries beyond max_mb. */
+void cache_store(const char *dir, const char *key, const char *ext, const char *out, int max_mb);
+
+/* Path of the entry for key if there is one, marked as just used */
+bool cache_lookup(const char *dir, const char *key, const char *ext, char *path, size_t size);
+
+/* A private name in dir for writing an entry in place; eviction skips it */
+void cache_temp_path(const char *dir, const char *key, const char *ext, char *path, size_t size);
+
+/* Renames a finished cache_temp_path file into the cache, then evicts as
+   cache_store does. The temp file is removed if it can't be published. */
+bool cache_publish(const char *dir, const char *key, const char *ext, const char *tmp, int max_mb);
+
+#endif
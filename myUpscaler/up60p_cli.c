@@ -0,0 +1,584 @@
+/* Headless front end for render hosts, around up60p_init / up60p_process_path.
+   Only built with UP60P_CLI defined, so the app target never sees a main():
+
+     cc -std=gnu17 -O2 -DUP60P_CLI -pthread -ImyUpscaler/upscaler myUpscaler/up60p_*.c -lm -o up60p
+
+   Jobs come from the command line or a JSONL manifest, one object per line:
+
+     {"id": "ep01", "input": "/media/ep01.mkv", "options": {"scaler": "zscale", "crf": "18", "use10": 1}}
+
+   Keys besides id/input/options are taken as option overrides too. Each job
+   runs in its own process, so a crash takes down only that job and its
+   slot's cores can be pinned (topology_pin_process), and every finished
+   file produces one JSON record on stdout or --results.
+   wall_s counts from the start of the manifest job, so files of a directory
+   job report when each one finished. */
+#ifdef UP60P_CLI
+
+#include "up60p_common.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_topology.h"
+#include <stddef.h>
+
+#define CLI_MAX_LINE (64 * 1024)
+
+typedef struct {
+    char id[128];
+    char input[PATH_MAX];
+    up60p_options opts;
+    bool threads_set;
+    char error[256];          /* manifest problem; the job is reported, not run */
+    pid_t pid;
+    int slot;                 /* which of the concurrent jobs' CPU shares it runs on */
+} CliJob;
+
+typedef struct {
+    CliJob *items;
+    int count, cap;
+} CliJobList;
+
+/* ---- up60p_options by name ---- */
+
+typedef struct {
+    const char *name;
+    size_t offset;
+    size_t size;              /* 0 = int field */
+} CliOption;
+
+#define OPT_S(f) { #f, offsetof(up60p_options, f), sizeof(((up60p_options*)0)->f) }
+#define OPT_I(f) { #f, offsetof(up60p_options, f), 0 }
+
+static const CliOption cli_options[] = {
+    OPT_S(codec), OPT_S(crf), OPT_S(preset), OPT_S(fps), OPT_S(scale_factor),
+    OPT_S(scaler), OPT_S(ai_backend), OPT_S(ai_model), OPT_S(ai_model_type), OPT_S(dnn_backend),
+    OPT_S(pipe_cmd),
+    OPT_S(denoiser), OPT_S(denoise_strength), OPT_S(deblock_mode), OPT_S(deblock_thresh),
+    OPT_I(dering_active), OPT_S(dering_strength),
+    OPT_S(sharpen_method), OPT_S(sharpen_strength), OPT_S(usm_radius), OPT_S(usm_amount),
+    OPT_S(usm_threshold),
+    OPT_S(deband_method), OPT_S(deband_strength), OPT_S(f3kdb_range), OPT_S(f3kdb_y), OPT_S(f3kdb_cbcr),
+    OPT_S(grain_strength),
+    OPT_S(denoiser_2), OPT_S(denoise_strength_2), OPT_S(deblock_mode_2), OPT_S(deblock_thresh_2),
+    OPT_I(dering_active_2), OPT_S(dering_strength_2),
+    OPT_S(sharpen_method_2), OPT_S(sharpen_strength_2), OPT_S(usm_radius_2), OPT_S(usm_amount_2),
+    OPT_S(usm_threshold_2),
+    OPT_S(deband_method_2), OPT_S(deband_strength_2), OPT_S(f3kdb_range_2), OPT_S(f3kdb_y_2),
+    OPT_S(f3kdb_cbcr_2), OPT_S(grain_strength_2),
+    OPT_I(use_denoise_2), OPT_I(use_deblock_2), OPT_I(use_dering_2), OPT_I(use_sharpen_2),
+    OPT_I(use_deband_2), OPT_I(use_grain_2),
+    OPT_S(mi_mode), OPT_S(eq_contrast), OPT_S(eq_brightness), OPT_S(eq_saturation),
+    OPT_S(x265_params), OPT_S(target_metric), OPT_S(target_score), OPT_S(max_bitrate),
+    OPT_I(two_pass),
+    OPT_S(outdir), OPT_S(audio_bitrate), OPT_S(threads), OPT_S(movflags), OPT_S(cache_dir),
+    OPT_I(cache_max_mb), OPT_S(stage_cache_dir), OPT_I(stage_cache_mb),
+    OPT_S(watch_index), OPT_I(watch_settle),
+    OPT_I(use10), OPT_I(preview), OPT_I(max_jobs), OPT_I(mem_budget_mb), OPT_I(segments),
+    OPT_I(resume_seconds), OPT_I(adaptive), OPT_I(no_optimize), OPT_I(fused_post),
+    OPT_I(native_frc), OPT_I(no_image_batch), OPT_I(no_cpu_pin),
+    OPT_I(no_deblock), OPT_I(no_denoise), OPT_I(no_decimate), OPT_I(no_interpolate),
+    OPT_I(no_sharpen), OPT_I(no_deband), OPT_I(no_eq), OPT_I(no_grain), OPT_I(pci_safe_mode),
+    OPT_S(hwaccel), OPT_S(encoder), OPT_I(hw_resident), OPT_S(hw_device), OPT_S(backend),
+};
+
+static bool set_option(CliJob *job, const char *key, const char *value) {
+    for (int i = 0; i < ARR_LEN(cli_options); i++) {
+        const CliOption *o = &cli_options[i];
+        if (strcmp(o->name, key)) continue;
+        char *field = (char*)&job->opts + o->offset;
+        if (o->size) {
+            if (strlen(value) >= o->size) {
+                snprintf(job->error, sizeof(job->error), "value for %s is longer than %zu bytes", key, o->size - 1);
+                return false;
+            }
+            safe_copy(field, value, o->size);
+        } else {
+            char *end;
+            long v = strtol(value, &end, 10);
+            if (!strcmp(value, "true")) v = 1;
+            else if (!strcmp(value, "false")) v = 0;
+            else if (!*value || *end) {
+                snprintf(job->error, sizeof(job->error), "%s needs an integer, got \"%.64s\"", key, value);
+                return false;
+            }
+            *(int*)field = (int)v;
+        }
+        if (!strcmp(key, "threads")) job->threads_set = true;
+        return true;
+    }
+    snprintf(job->error, sizeof(job->error), "unknown option \"%.64s\"", key);
+    return false;
+}
+
+/* ---- Just enough JSON for one manifest line ---- */
+
+typedef struct {
+    const char *p;
+} JsonIn;
+
+static void json_ws(JsonIn *j) {
+    while (*j->p == ' ' || *j->p == '\t' || *j->p == '\r' || *j->p == '\n') j->p++;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* A string, number, boolean (as 1/0) or null (as "") */
+static bool json_scalar(JsonIn *j, char *out, size_t size) {
+    json_ws(j);
+    size_t n = 0;
+    if (*j->p == '"') {
+        j->p++;
+        while (*j->p && *j->p != '"') {
+            unsigned cp = (unsigned char)*j->p++;
+            bool unicode = false;
+            if (cp == '\\') {
+                char e = *j->p++;
+                switch (e) {
+                    case 'n': cp = '\n'; break;
+                    case 't': cp = '\t'; break;
+                    case 'r': cp = '\r'; break;
+                    case 'b': cp = '\b'; break;
+                    case 'f': cp = '\f'; break;
+                    case 'u': {
+                        unicode = true;
+                        cp = 0;
+                        for (int i = 0; i < 4; i++) {
+                            int d = hex_digit(*j->p);
+                            if (d < 0) return false;
+                            cp = cp * 16 + (unsigned)d;
+                            j->p++;
+                        }
+                        break;
+                    }
+                    case '"': case '\\': case '/': cp = (unsigned char)e; break;
+                    default: return false;
+                }
+            }
+            // Raw bytes pass through; \u escapes become UTF-8 (no surrogate pairs)
+            char enc[3];
+            int len = 1;
+            if (!unicode || cp < 0x80) enc[0] = (char)cp;
+            else if (cp < 0x800) { enc[0] = (char)(0xC0 | cp >> 6); enc[1] = (char)(0x80 | (cp & 0x3F)); len = 2; }
+            else { enc[0] = (char)(0xE0 | cp >> 12); enc[1] = (char)(0x80 | (cp >> 6 & 0x3F)); enc[2] = (char)(0x80 | (cp & 0x3F)); len = 3; }
+            if (n + (size_t)len >= size) return false;
+            memcpy(out + n, enc, (size_t)len);
+            n += (size_t)len;
+        }
+        if (*j->p != '"') return false;
+        j->p++;
+        out[n] = 0;
+        return true;
+    }
+    if (!strncmp(j->p, "true", 4)) { j->p += 4; safe_copy(out, "1", size); return true; }
+    if (!strncmp(j->p, "false", 5)) { j->p += 5; safe_copy(out, "0", size); return true; }
+    if (!strncmp(j->p, "null", 4)) { j->p += 4; safe_copy(out, "", size); return true; }
+    while (*j->p && strchr("+-.0123456789eE", *j->p)) {
+        if (n + 1 >= size) return false;
+        out[n++] = *j->p++;
+    }
+    out[n] = 0;
+    return n > 0;
+}
+
+/* Members of an object; nested objects only for "options" at the top */
+static bool json_job_object(JsonIn *j, CliJob *job, bool top) {
+    json_ws(j);
+    if (*j->p++ != '{') return false;
+    json_ws(j);
+    if (*j->p == '}') { j->p++; return true; }
+    for (;;) {
+        char key[64], value[PATH_MAX];
+        if (!json_scalar(j, key, sizeof(key))) return false;
+        json_ws(j);
+        if (*j->p++ != ':') return false;
+        json_ws(j);
+        if (top && !strcmp(key, "options") && *j->p == '{') {
+            if (!json_job_object(j, job, false)) return false;
+        } else {
+            if (!json_scalar(j, value, sizeof(value))) return false;
+            if (top && !strcmp(key, "input")) safe_copy(job->input, value, sizeof(job->input));
+            else if (top && !strcmp(key, "id")) safe_copy(job->id, value, sizeof(job->id));
+            else if (!*job->error) set_option(job, key, value);
+        }
+        json_ws(j);
+        if (*j->p == ',') { j->p++; continue; }
+        if (*j->p == '}') { j->p++; return true; }
+        return false;
+    }
+}
+
+/* ---- Job list ---- */
+
+/* --set goes over everything else a job was given, manifest options included */
+static void apply_sets(CliJob *job, const char **sets, int nsets) {
+    for (int i = 0; i < nsets && !*job->error; i++) {
+        char key[64];
+        const char *eq = strchr(sets[i], '=');
+        snprintf(key, sizeof(key), "%.*s", (int)(eq - sets[i]), sets[i]);
+        set_option(job, key, eq + 1);
+    }
+}
+
+static CliJob *add_job(CliJobList *l, const up60p_options *base) {
+    if (l->count == l->cap) {
+        int cap = l->cap ? l->cap * 2 : 16;
+        CliJob *items = realloc(l->items, (size_t)cap * sizeof(*items));
+        if (!items) return NULL;
+        l->items = items;
+        l->cap = cap;
+    }
+    CliJob *job = &l->items[l->count++];
+    memset(job, 0, sizeof(*job));
+    job->opts = *base;
+    job->pid = -1;
+    snprintf(job->id, sizeof(job->id), "%d", l->count);
+    return job;
+}
+
+static bool read_manifest(const char *path, CliJobList *l, const up60p_options *base,
+                          const char **sets, int nsets) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!f) {
+        fprintf(stderr, "up60p: cannot open manifest %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    char *line = malloc(CLI_MAX_LINE);
+    int lineno = 0;
+    while (line && fgets(line, CLI_MAX_LINE, f)) {
+        lineno++;
+        JsonIn j = { line };
+        json_ws(&j);
+        if (!*j.p || *j.p == '#') continue;
+        CliJob *job = add_job(l, base);
+        if (!job) break;
+        if (!json_job_object(&j, job, true) && !*job->error)
+            snprintf(job->error, sizeof(job->error), "manifest line %d is not a JSON object", lineno);
+        else if (!*job->input && !*job->error)
+            snprintf(job->error, sizeof(job->error), "manifest line %d has no input", lineno);
+        apply_sets(job, sets, nsets);
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return true;
+}
+
+/* ---- Result records ---- */
+
+static int results_fd = STDOUT_FILENO;
+
+static const char *status_name(up60p_error e) {
+    switch (e) {
+        case UP60P_OK: return "ok";
+        case UP60P_ERR_INVALID_OPTIONS: return "invalid_options";
+        case UP60P_ERR_FFMPEG_NOT_FOUND: return "ffmpeg_not_found";
+        case UP60P_ERR_IO: return "io";
+        case UP60P_ERR_INTERNAL: return "internal";
+        case UP60P_ERR_CANCELLED: return "cancelled";
+    }
+    return "internal";
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* One line per write() so records from concurrent jobs never interleave */
+static void write_record(const CliJob *job, const char *input, const char *output, const char *status,
+                         int exit_code, double wall, long long frames, const char *error) {
+    SB r = {0};
+    sb_append(&r, "{\"id\": ");
+    sb_json_string(&r, job->id);
+    sb_append(&r, ", \"input\": ");
+    sb_json_string(&r, input);
+    sb_append(&r, ", \"output\": ");
+    if (output) sb_json_string(&r, output);
+    else sb_append(&r, "null");
+    struct stat st;
+    long long bytes = output && stat(output, &st) == 0 ? (long long)st.st_size : -1;
+    sb_fmt(&r, ", \"status\": \"%s\", \"exit_code\": %d, \"wall_s\": %.3f, \"frames\": %lld, "
+               "\"fps\": %.3f, \"output_bytes\": %lld",
+           status, exit_code, wall, frames, wall > 0 && frames > 0 ? frames / wall : 0.0, bytes);
+    if (error) {
+        sb_append(&r, ", \"error\": ");
+        sb_json_string(&r, error);
+    }
+    sb_append(&r, "}\n");
+    const char *p = r.buf;
+    size_t left = r.len;
+    while (left > 0) {
+        ssize_t w = write(results_fd, p, left);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) break;
+        p += w;
+        left -= (size_t)w;
+    }
+    free(r.buf);
+}
+
+/* ---- Child side: one job, possibly a directory of files ---- */
+
+static CliJob *child_job;
+static double child_start;
+static long long *child_frames;   /* finished frames per up60p job id */
+static int child_frames_len;
+static int child_records;
+static bool child_failed;
+static bool quiet;
+static bool watch_mode;             /* inputs are directories watched until stopped */
+
+static void child_log(const char *msg) {
+    if (quiet) return;
+    fprintf(stderr, "[%s] %s", child_job->id, msg);
+}
+
+// Several ffmpeg children can serve one job (segments, adaptive scenes);
+// each reports its own final frame count
+static void child_progress(const up60p_progress *p) {
+    if (!p->finished || p->frame <= 0 || p->job_id < 0) return;
+    if (p->job_id >= child_frames_len) {
+        int len = p->job_id + 16;
+        long long *f = realloc(child_frames, (size_t)len * sizeof(*f));
+        if (!f) return;
+        memset(f + child_frames_len, 0, (size_t)(len - child_frames_len) * sizeof(*f));
+        child_frames = f;
+        child_frames_len = len;
+    }
+    child_frames[p->job_id] += p->frame;
+}
+
+static void child_result(const up60p_job_result *r) {
+    long long frames = r->job_id >= 0 && r->job_id < child_frames_len ? child_frames[r->job_id] : 0;
+    write_record(child_job, r->input_path, r->output_path, status_name(r->status), r->exit_code,
+                 now_s() - child_start, frames, NULL);
+    // Watch batches number their files from 0 again
+    if (frames) child_frames[r->job_id] = 0;
+    child_records++;
+    if (r->status != UP60P_OK) child_failed = true;
+}
+
+static void child_signal(int sig) {
+    (void)sig;
+    up60p_request_cancel();
+}
+
+static void run_child_job(CliJob *job, int workers) {
+    // Each job process gets its own cores; its ffmpeg children and any
+    // directory workers inside it split those further
+    if (workers > 1 && !job->opts.no_cpu_pin) topology_pin_process(job->slot, workers);
+    child_job = job;
+    child_start = now_s();
+    struct sigaction sa = { .sa_handler = child_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    up60p_set_job_callback(child_result);
+    up60p_set_progress_callback(child_progress);
+    global_log_cb = child_log;
+    up60p_error e = watch_mode ? up60p_watch_path(job->input, &job->opts)
+                               : up60p_process_path(job->input, &job->opts);
+    if (child_records == 0 && (!watch_mode || e != UP60P_OK)) {
+        write_record(job, job->input, NULL, status_name(e != UP60P_OK ? e : UP60P_ERR_IO), -1,
+                     now_s() - child_start, 0, e == UP60P_ERR_INVALID_OPTIONS ? "input not found" : NULL);
+        child_failed = true;
+    }
+    up60p_shutdown();
+    fflush(stderr);
+    _exit(child_failed || e != UP60P_OK ? 1 : 0);
+}
+
+/* ---- Parent side ---- */
+
+static volatile sig_atomic_t stop_requested;
+
+static void parent_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: up60p [options] INPUT...\n"
+            "       up60p [options] --manifest FILE|-\n"
+            "  -j, --jobs N          files restored at once (default: by core count)\n"
+            "  -s, --set KEY=VALUE   option override for every job (repeatable)\n"
+            "  -m, --manifest FILE   JSONL jobs: {\"input\": ..., \"id\": ..., \"options\": {...}}\n"
+            "  -o, --results FILE    append result records here instead of stdout\n"
+            "      --ffmpeg PATH     ffmpeg binary to run\n"
+            "  -n, --dry-run         log the ffmpeg commands without running them\n"
+            "  -w, --watch           keep restoring files as they land in the INPUT directories\n"
+            "                        until stopped (see watch_settle, watch_index)\n"
+            "  -q, --quiet           no engine log on stderr\n"
+            "      --list-options    print option names and defaults\n");
+}
+
+static void list_options(const up60p_options *o) {
+    for (int i = 0; i < ARR_LEN(cli_options); i++) {
+        const char *field = (const char*)o + cli_options[i].offset;
+        if (cli_options[i].size) printf("%s=%s\n", cli_options[i].name, field);
+        else printf("%s=%d\n", cli_options[i].name, *(const int*)field);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *manifest = NULL, *results = NULL, *ffmpeg = NULL;
+    const char **sets = calloc((size_t)argc, sizeof(*sets));
+    const char **inputs = calloc((size_t)argc, sizeof(*inputs));
+    int nsets = 0, ninputs = 0, jobs = 0;
+    bool dry_run = false, list = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        bool more = i + 1 < argc;
+        if ((!strcmp(a, "-j") || !strcmp(a, "--jobs")) && more) jobs = atoi(argv[++i]);
+        else if ((!strcmp(a, "-s") || !strcmp(a, "--set")) && more) {
+            if (!strchr(argv[i + 1], '=')) { usage(); return 2; }
+            sets[nsets++] = argv[++i];
+        }
+        else if ((!strcmp(a, "-m") || !strcmp(a, "--manifest")) && more) manifest = argv[++i];
+        else if ((!strcmp(a, "-o") || !strcmp(a, "--results")) && more) results = argv[++i];
+        else if (!strcmp(a, "--ffmpeg") && more) ffmpeg = argv[++i];
+        else if (!strcmp(a, "-n") || !strcmp(a, "--dry-run")) dry_run = true;
+        else if (!strcmp(a, "-q") || !strcmp(a, "--quiet")) quiet = true;
+        else if (!strcmp(a, "-w") || !strcmp(a, "--watch")) watch_mode = true;
+        else if (!strcmp(a, "--list-options")) list = true;
+        else if (!strcmp(a, "-h") || !strcmp(a, "--help")) { usage(); return 0; }
+        else if (a[0] == '-' && a[1]) { usage(); return 2; }
+        else inputs[ninputs++] = a;
+    }
+    if (ffmpeg && up60p_set_ffmpeg_path(ffmpeg) != UP60P_OK) {
+        fprintf(stderr, "up60p: %s is not executable\n", ffmpeg);
+        return 2;
+    }
+    if (up60p_init(NULL, NULL) != UP60P_OK) return 2;
+    up60p_set_dry_run(dry_run);
+
+    up60p_options base;
+    up60p_default_options(&base);
+    if (list) {
+        list_options(&base);
+        return 0;
+    }
+
+    CliJobList list_jobs = {0};
+    if (manifest && !read_manifest(manifest, &list_jobs, &base, sets, nsets)) return 2;
+    for (int i = 0; i < ninputs; i++) {
+        CliJob *job = add_job(&list_jobs, &base);
+        if (!job) continue;
+        safe_copy(job->input, inputs[i], sizeof(job->input));
+        apply_sets(job, sets, nsets);
+    }
+    if (list_jobs.count == 0) {
+        usage();
+        return 2;
+    }
+    if (results) {
+        results_fd = open(results, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (results_fd < 0) {
+            fprintf(stderr, "up60p: cannot open %s: %s\n", results, strerror(errno));
+            return 2;
+        }
+    }
+
+    // Same split as a directory batch: jobs share the cores evenly unless
+    // they set their own thread count
+    int per_job = 0;
+    int workers = up60p_plan_workers(jobs, atoi(base.threads), list_jobs.count, &per_job);
+    // Watches never finish, so none of them can wait for a slot
+    if (watch_mode) workers = list_jobs.count;
+    if (workers > 1) {
+        for (int i = 0; i < list_jobs.count; i++) {
+            if (!list_jobs.items[i].threads_set)
+                snprintf(list_jobs.items[i].opts.threads, sizeof(list_jobs.items[i].opts.threads), "%d", per_job);
+        }
+    }
+    if (!quiet) fprintf(stderr, "up60p: %d jobs, %d at once\n", list_jobs.count, workers);
+
+    struct sigaction sa = { .sa_handler = parent_signal };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+
+    int next = 0, running = 0;
+    bool failed = false, stopping = false;
+    double *started = calloc((size_t)list_jobs.count, sizeof(*started));
+    bool *busy = calloc((size_t)workers, sizeof(*busy));
+    while (next < list_jobs.count || running > 0) {
+        while (!stop_requested && running < workers && next < list_jobs.count) {
+            CliJob *job = &list_jobs.items[next++];
+            if (*job->error) {
+                write_record(job, job->input, NULL, "invalid_options", -1, 0, 0, job->error);
+                failed = true;
+                continue;
+            }
+            job->slot = 0;
+            while (busy && job->slot < workers - 1 && busy[job->slot]) job->slot++;
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid == 0) run_child_job(job, workers);
+            if (pid < 0) {
+                write_record(job, job->input, NULL, "internal", -1, 0, 0, strerror(errno));
+                failed = true;
+                continue;
+            }
+            job->pid = pid;
+            if (busy) busy[job->slot] = true;
+            started[job - list_jobs.items] = now_s();
+            running++;
+        }
+        if (stop_requested && !stopping) {
+            stopping = true;
+            for (int i = 0; i < list_jobs.count; i++) {
+                if (list_jobs.items[i].pid > 0) kill(list_jobs.items[i].pid, SIGTERM);
+            }
+        }
+        if (running == 0) {
+            // Stopped before these started; they still get a record each
+            for (; next < list_jobs.count; next++) {
+                CliJob *job = &list_jobs.items[next];
+                write_record(job, job->input, NULL, "cancelled", -1, 0, 0, NULL);
+                failed = true;
+            }
+            break;
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (int i = 0; i < list_jobs.count; i++) {
+            CliJob *job = &list_jobs.items[i];
+            if (job->pid != pid) continue;
+            job->pid = -1;
+            if (busy) busy[job->slot] = false;
+            running--;
+            if (WIFSIGNALED(status)) {
+                char why[64];
+                snprintf(why, sizeof(why), "killed by signal %d", WTERMSIG(status));
+                write_record(job, job->input, NULL, "internal", -1, now_s() - started[i], 0, why);
+            }
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed = true;
+            break;
+        }
+    }
+
+    free(started);
+    free(busy);
+    free(list_jobs.items);
+    free(sets);
+    free(inputs);
+    if (results_fd != STDOUT_FILENO) close(results_fd);
+    up60p_shutdown();
+    return stop_requested ? 130 : failed ? 1 : 0;
+}
+
+#endif
@@ -23,9 +23,11 @@
 #include <sys/select.h>
 #include <limits.h>
 
-#include <mach-o/dyld.h>
 #include "up60p.h"
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
 #include "Up60PBridging.h"
+#endif
 
 
 #ifndef PATH_MAX
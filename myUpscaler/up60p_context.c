@@ -0,0 +1,140 @@
+#include "up60p_context.h"
+#include "up60p_utils.h"
+
+static up60p_context process_ctx = { .cb_lock = PTHREAD_MUTEX_INITIALIZER };
+static __thread up60p_context *thread_ctx;
+
+static pthread_once_t defaults_once = PTHREAD_ONCE_INIT;
+static int live_contexts;
+
+up60p_context *current_context(void) {
+    return thread_ctx ? thread_ctx : &process_ctx;
+}
+
+up60p_context *set_current_context(up60p_context *ctx) {
+    up60p_context *prev = thread_ctx;
+    thread_ctx = ctx;
+    return prev;
+}
+
+Settings *current_settings(void) {
+    return &current_context()->settings;
+}
+
+int context_count(void) {
+    return __atomic_load_n(&live_contexts, __ATOMIC_RELAXED);
+}
+
+// global_log_cb predates contexts and is still assigned directly
+up60p_log_callback context_log_cb(const up60p_context *ctx) {
+    return ctx == &process_ctx ? global_log_cb : ctx->log_cb;
+}
+
+typedef struct {
+    void *(*fn)(void *);
+    void *arg;
+    up60p_context *ctx;
+} ThreadStart;
+
+static void *thread_start(void *arg) {
+    ThreadStart t = *(ThreadStart*)arg;
+    free(arg);
+    thread_ctx = t.ctx;
+    return t.fn(t.arg);
+}
+
+int context_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg) {
+    ThreadStart *t = malloc(sizeof(*t));
+    if (!t) return ENOMEM;
+    *t = (ThreadStart){ fn, arg, thread_ctx };
+    int err = pthread_create(thread, NULL, thread_start, t);
+    if (err) free(t);
+    return err;
+}
+
+/* DEF, which every context starts from, for hosts that never call
+   up60p_init. A job may already be running in the process-wide context,
+   so its S is left alone, and what up60p_init set stays as it is. */
+static void load_defaults(void) {
+    if (*DEF.codec) return;
+    Settings d;
+    default_settings(&d);
+    if (!*CONFIG_DIR) init_paths();
+    DEF = d;
+}
+
+/* ---- Public API ---- */
+
+up60p_context *up60p_context_create(up60p_log_callback log_cb) {
+    pthread_once(&defaults_once, load_defaults);
+    up60p_context *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return NULL;
+    ctx->settings = DEF;
+    ctx->log_cb = log_cb;
+    pthread_mutex_init(&ctx->cb_lock, NULL);
+    __atomic_add_fetch(&live_contexts, 1, __ATOMIC_RELAXED);
+    return ctx;
+}
+
+void up60p_context_destroy(up60p_context *ctx) {
+    if (!ctx) return;
+    __atomic_sub_fetch(&live_contexts, 1, __ATOMIC_RELAXED);
+    pthread_mutex_destroy(&ctx->cb_lock);
+    free(ctx);
+}
+
+/* The setters and runs are the context-free calls, made with ctx current */
+#define IN_CONTEXT(ctx, call) do {                          \
+        up60p_context *prev_ = set_current_context(ctx);    \
+        call;                                               \
+        set_current_context(prev_);                         \
+    } while (0)
+
+up60p_error up60p_context_set_ffmpeg_path(up60p_context *ctx, const char *path) {
+    if (!ctx) return UP60P_ERR_INVALID_OPTIONS;
+    up60p_error e;
+    IN_CONTEXT(ctx, e = up60p_set_ffmpeg_path(path));
+    return e;
+}
+
+void up60p_context_set_dry_run(up60p_context *ctx, int enable) {
+    if (ctx) ctx->dry_run = enable;
+}
+
+void up60p_context_set_job_callback(up60p_context *ctx, up60p_job_callback cb) {
+    if (ctx) ctx->job_cb = cb;
+}
+
+void up60p_context_set_progress_callback(up60p_context *ctx, up60p_progress_callback cb) {
+    if (ctx) ctx->progress_cb = cb;
+}
+
+void up60p_context_set_upscaler(up60p_context *ctx, up60p_upscale_fn fn, void *user) {
+    if (!ctx) return;
+    ctx->upscale_user = user;
+    ctx->upscale_fn = fn;
+}
+
+up60p_error up60p_context_process_path(up60p_context *ctx, const char *input_path,
+                                       const up60p_options *opts) {
+    if (!ctx) return UP60P_ERR_INVALID_OPTIONS;
+    up60p_error e;
+    IN_CONTEXT(ctx, e = up60p_process_path(input_path, opts));
+    return e;
+}
+
+up60p_error up60p_context_watch_path(up60p_context *ctx, const char *dir, const up60p_options *opts) {
+    if (!ctx) return UP60P_ERR_INVALID_OPTIONS;
+    up60p_error e;
+    IN_CONTEXT(ctx, e = up60p_watch_path(dir, opts));
+    return e;
+}
+
+/* Only touch a sig_atomic_t, so signal handlers may call them */
+void up60p_context_cancel(up60p_context *ctx) {
+    if (ctx) ctx->cancelled = 1;
+}
+
+void up60p_request_cancel(void) {
+    process_ctx.cancelled = 1;
+}
@@ -0,0 +1,44 @@
+#ifndef UP60P_CONTEXT_H
+#define UP60P_CONTEXT_H
+
+#include "up60p_common.h"
+#include "up60p_settings.h"
+#include <pthread.h>
+
+/* Everything one job reads and writes besides its arguments. The up60p_*
+   calls without a context run in a process-wide one; the up60p_context_*
+   calls make theirs current on the calling thread, and threads started
+   with context_thread_create carry it along. */
+struct up60p_context {
+    Settings settings;
+    char ffmpeg_path[PATH_MAX];         /* resolved on first use, "" = not yet */
+    int dry_run;
+    up60p_log_callback log_cb;          /* the process-wide context uses global_log_cb */
+    up60p_job_callback job_cb;
+    up60p_progress_callback progress_cb;
+    up60p_upscale_fn upscale_fn;
+    void *upscale_user;
+    pthread_mutex_t cb_lock;            /* a job's workers share its callbacks */
+    volatile sig_atomic_t cancelled;
+    unsigned notes_logged;              /* LogNote bits already said, see log_once */
+    int batch_workers;                  /* concurrent jobs of the running batch */
+};
+
+/* The calling thread's context, the process-wide one unless set */
+up60p_context *current_context(void);
+
+/* Makes ctx current on this thread (NULL = the process-wide one) and
+   returns what was, for the caller to put back. */
+up60p_context *set_current_context(up60p_context *ctx);
+
+up60p_log_callback context_log_cb(const up60p_context *ctx);
+
+/* Contexts created and not yet destroyed; while there are any, jobs may
+   run side by side in one process */
+int context_count(void);
+
+/* pthread_create for threads working on the caller's job: they start in
+   the caller's context. Returns 0 or an errno value. */
+int context_thread_create(pthread_t *thread, void *(*fn)(void *), void *arg);
+
+#endif
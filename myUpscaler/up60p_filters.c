@@ -0,0 +1,394 @@
+#include "up60p_filters.h"
+#include "up60p_settings.h"
+#include "up60p_graph.h"
+
+void build_hqdn3d_filter(FilterGraph *g, const char *strength_str) {
+    double strength = parse_strength(strength_str);
+    if (strength <= 0) strength = 4.0;
+    
+    
+    double luma_spatial = strength;
+    if (luma_spatial < 1.0) luma_spatial = 1.0;
+    if (luma_spatial > 10.0) luma_spatial = 10.0;
+    
+    
+    double chroma_spatial = luma_spatial * 0.75;
+    double luma_tmp = luma_spatial * 1.5;
+    double chroma_tmp = luma_tmp * 0.75;
+    
+    FilterNode *n = fg_add(g, "hqdn3d");
+    fg_num(n, NULL, luma_spatial, 2);
+    fg_num(n, NULL, chroma_spatial, 2);
+    fg_num(n, NULL, luma_tmp, 2);
+    fg_num(n, NULL, chroma_tmp, 2);
+}
+
+
+void build_nlmeans_filter(FilterGraph *g, const char *strength_str) {
+    double strength = parse_strength(strength_str);
+    if (strength <= 0) strength = 1.0;
+    
+    
+    if (strength < 1.0) strength = 1.0;
+    if (strength > 30.0) strength = 30.0;
+    
+    
+    int patch_size = 7;
+    if (strength > 5.0) patch_size = 9;
+    if (strength > 10.0) patch_size = 11;
+    if (strength > 15.0) patch_size = 13;
+    if (strength > 20.0) patch_size = 15;
+    
+    
+    int research_size = 15;
+    if (strength > 5.0) research_size = 17;
+    if (strength > 10.0) research_size = 19;
+    if (strength > 15.0) research_size = 21;
+    if (strength > 20.0) research_size = 23;
+    if (strength > 25.0) research_size = 25;
+    
+    FilterNode *n = fg_add(g, "nlmeans");
+    fg_num(n, "s", strength, 2);
+    fg_int(n, "p", patch_size);
+    fg_int(n, "r", research_size);
+}
+
+
+void build_atadenoise_filter(FilterGraph *g, const char *strength_str) {
+    double strength = parse_strength(strength_str);
+    if (strength <= 0) strength = 9.0;
+    
+    
+    double threshold = strength;
+    if (threshold < 1.0) threshold = 1.0;
+    if (threshold > 20.0) threshold = 20.0;
+    
+    
+    
+    double param_a = 0.01 + (threshold / 20.0) * 0.03;
+    double param_b = 0.02 + (threshold / 20.0) * 0.06;
+    
+    FilterNode *n = fg_add(g, "atadenoise");
+    fg_num(n, "s", threshold, 2);
+    fg_num(n, "0a", param_a, 3);
+    fg_num(n, "0b", param_b, 3);
+}
+
+
+void build_dering_filter(FilterGraph *g, const char *strength_str) {
+    double dstr = parse_strength(strength_str);
+    if (dstr <= 0) dstr = 0.5;
+    double luma = dstr * 8.0;
+    double chroma = luma * 0.75;
+    double luma_tmp = luma * 1.5;
+    double chroma_tmp = luma_tmp * 0.75;
+    if (luma > 15.0) luma = 15.0;
+    FilterNode *n = fg_add(g, "hqdn3d");
+    fg_num(n, NULL, luma, 2);
+    fg_num(n, NULL, chroma, 2);
+    fg_num(n, NULL, luma_tmp, 2);
+    fg_num(n, NULL, chroma_tmp, 2);
+}
+
+void build_bm3d_filter(FilterGraph *g, const char *strength_str) {
+    FilterNode *n = fg_add(g, "bm3d");
+    if (!strcmp(strength_str, "auto")) {
+        fg_text(n, "estim", "final");
+        fg_int(n, "planes", 1);
+        return;
+    }
+    double sigma = parse_strength(strength_str);
+    if (sigma <= 0) sigma = 2.5;
+    if (sigma > 20.0) sigma = 20.0;
+    fg_num(n, "sigma", sigma, 2);
+    fg_text(n, "estim", "basic");
+    fg_int(n, "planes", 1);
+}
+
+/* method is gradfun, f3kdb (emulated with deband's thresholds) or deband */
+void build_deband_filter(FilterGraph *g, const char *method, const char *strength,
+                         const char *f3kdb_range, const char *f3kdb_y, const char *f3kdb_cbcr) {
+    if (!strcmp(method, "gradfun")) fg_text(fg_add(g, "gradfun"), NULL, strength);
+    else if (!strcmp(method, "f3kdb")) {
+        
+        double y = atof(f3kdb_y);
+        double cb = atof(f3kdb_cbcr);
+        double range = atof(f3kdb_range);
+        
+        double thr_y = y > 0 ? y / 2000.0 : 0.03;
+        double thr_c = cb > 0 ? cb / 2000.0 : 0.015;
+        
+        if (thr_y > 0.5) thr_y = 0.5;
+        if (thr_c > 0.5) thr_c = 0.5;
+        if (thr_y < 0.001) thr_y = 0.001;
+        
+        int r = (int)range;
+        if (r < 1) r = 16;
+        
+        FilterNode *n = fg_add(g, "deband");
+        fg_num(n, "1thr", thr_y, 5);
+        fg_num(n, "2thr", thr_c, 5);
+        fg_num(n, "3thr", thr_c, 5);
+        fg_int(n, "range", r);
+        fg_int(n, "blur", 0);
+    } else {
+        FilterNode *n = fg_add(g, "deband");
+        fg_text(n, "1thr", strength);
+        fg_int(n, "b", 1);
+    }
+}
+
+/* fps "source" or "lock" keeps the input rate */
+void build_minterpolate_filter(FilterGraph *g, const char *fps, const char *mi_mode) {
+    FilterNode *n = fg_add(g, "minterpolate");
+    if (strcmp(fps, "source") && strcmp(fps, "lock")) fg_text(n, "fps", fps);
+    fg_text(n, "mi_mode", mi_mode);
+    fg_text(n, "mc_mode", "aobmc");
+    fg_text(n, "me_mode", "bidir");
+    fg_int(n, "vsbmc", 1);
+}
+
+/* thresh as written, e.g. "alpha=0.1:beta=0.05" */
+void build_deblock_filter(FilterGraph *g, const char *mode, const char *thresh) {
+    FilterNode *n = fg_add(g, "deblock");
+    fg_text(n, "filter", mode);
+    fg_int(n, "block", 8);
+    fg_parse_params(n, thresh);
+}
+
+
+const char *output_pix_fmt(void) {
+    const char *pix = S.use10 ? "yuv420p10le" : "yuv420p";
+    if (S.use10 && (!strcmp(S.encoder,"nvenc") || !strcmp(S.encoder,"hevc_nvenc"))) pix="p010le";
+    if (S.pci_safe_mode) pix = "yuv420p";
+    return pix;
+}
+
+/* Trailing output-size arguments of the stock scalers, even dimensions */
+static void scaled_size(FilterNode *n, const char *wkey, const char *hkey, const char *factor) {
+    fg_textf(n, wkey, "trunc(iw*%s/2)*2", factor);
+    fg_textf(n, hkey, "trunc(ih*%s/2)*2", factor);
+}
+
+static void build_sharpen(FilterGraph *g, const char *method, const char *strength,
+                          const char *radius, const char *amount) {
+    if (!strcmp(method, "unsharp")) {
+        FilterNode *n = fg_add(g, "unsharp");
+        fg_text(n, NULL, radius);
+        fg_text(n, NULL, radius);
+        fg_text(n, NULL, amount);
+    } else {
+        fg_text(fg_add(g, "cas"), "strength", strength);
+    }
+}
+
+static void build_denoiser(FilterGraph *g, const char *denoiser, const char *strength) {
+    if (!strcmp(denoiser, "bm3d")) build_bm3d_filter(g, strength);
+    else if (!strcmp(denoiser, "hqdn3d")) build_hqdn3d_filter(g, strength);
+    else if (!strcmp(denoiser, "nlmeans")) build_nlmeans_filter(g, strength);
+    else if (!strcmp(denoiser, "atadenoise")) build_atadenoise_filter(g, strength);
+}
+
+/* The chain split around the scaler: pre runs at source size, scale is
+   the scaler itself, post at output size. All three share one arena. */
+void build_filter_stages(const Settings *s, FilterGraph *pre, FilterGraph *scale, FilterGraph *post, bool img) {
+    if (!img) {
+        fg_text(fg_add(pre, "format"), NULL, s->pci_safe_mode ? "yuv420p" : "yuv444p16le");
+        if (!s->no_decimate) {
+            fg_text(fg_add(pre, "mpdecimate"), "hi", "64*12");
+            fg_text(fg_add(pre, "setpts"), NULL, "PTS");
+        }
+    }
+    
+    if (!s->no_deblock) {
+        build_deblock_filter(pre, s->deblock_mode, s->deblock_thresh);
+    }
+    
+    if (!s->no_denoise) {
+        build_denoiser(pre, s->denoiser, s->denoise_strength);
+    }
+    
+    if (!img && !s->no_interpolate) {
+        build_minterpolate_filter(pre, s->fps, s->mi_mode);
+    }
+    
+    FilterNode *n;
+    if (!strcmp(s->scaler, "zscale")) {
+        n = fg_add(scale, "zscale");
+        scaled_size(n, "w", "h", s->scale_factor);
+        fg_text(n, "filter", "lanczos");
+        fg_text(n, "dither", "error_diffusion");
+    } else if (!strcmp(s->scaler, "ai") && !strcmp(s->ai_backend, "sr")) {
+        n = fg_add(scale, "sr");
+        fg_text(n, "dnn_backend", s->dnn_backend);
+        fg_textf(n, "model", "'%s'", s->ai_model);
+        if (!strcmp(s->ai_model_type, "srcnn")) fg_text(n, "scale_factor", s->scale_factor);
+    } else if (!strcmp(s->scaler, "ai") && strcmp(s->ai_backend, "pipe")) {
+        n = fg_add(scale, "dnn_processing");
+        fg_text(n, "dnn_backend", s->dnn_backend);
+        fg_textf(n, "model", "'%s'", s->ai_model);
+        fg_text(n, "input", "x");
+        fg_text(n, "output", "y");
+    } else if (!strcmp(s->scaler, "hw") && !strcmp(s->hwaccel, "cuda")) {
+        scaled_size(fg_add(scale, "scale_npp"), NULL, NULL, s->scale_factor);
+    } else {
+        // ai "pipe" gets this as a stand-in when the chain runs as one
+        // graph; pipe mode replaces it
+        n = fg_add(scale, "scale");
+        scaled_size(n, NULL, NULL, s->scale_factor);
+        fg_text(n, "flags", !strcmp(s->scaler, "hw") ? "lanczos" : "lanczos+accurate_rnd");
+    }
+    
+    // With post_fused the first sharpen and deband, grain and the limiter
+    // run natively on the upscaled frame (see up60p_post.c)
+    if (!s->no_sharpen && !s->post_fused) {
+        build_sharpen(post, s->sharpen_method, s->sharpen_strength, s->usm_radius, s->usm_amount);
+    }
+    
+    if (!s->no_deband && !s->post_fused) {
+        build_deband_filter(post, s->deband_method, s->deband_strength,
+                            s->f3kdb_range, s->f3kdb_y, s->f3kdb_cbcr);
+    }
+    if (s->use_dering_2 && s->dering_active_2) {
+        build_dering_filter(post, s->dering_strength_2);
+    }
+    
+    if (s->use_denoise_2 && !s->no_denoise) {
+        build_denoiser(post, s->denoiser_2, s->denoise_strength_2);
+    }
+    
+    if (s->use_sharpen_2 && !s->no_sharpen) {
+        build_sharpen(post, s->sharpen_method_2, s->sharpen_strength_2, s->usm_radius_2, s->usm_amount_2);
+    }
+    
+    if (s->use_deband_2 && !s->no_deband) {
+        build_deband_filter(post, s->deband_method_2, s->deband_strength_2,
+                            s->f3kdb_range_2, s->f3kdb_y_2, s->f3kdb_cbcr_2);
+    }
+    if (!s->no_grain && !s->post_fused) {
+        n = fg_add(post, "noise");
+        fg_text(n, "alls", s->use_grain_2 ? s->grain_strength_2 : s->grain_strength);
+        fg_text(n, "allf", "t");
+    }
+    
+    if (!img) {
+        fg_text(fg_add(post, "format"), NULL, output_pix_fmt());
+        // The fused pass clamps RGB to 0..max, which the limited-range
+        // YUV conversion maps into the legal video range
+        if (!s->post_fused) {
+            bool deep = s->use10 && !s->pci_safe_mode;
+            n = fg_add(post, "limiter");
+            fg_int(n, "min", deep ? 64 : 16);
+            fg_int(n, "max", deep ? 940 : 235);
+            fg_int(n, "planes", 15);
+        }
+        fg_int(fg_add(post, "setsar"), NULL, 1);
+    }
+}
+
+/* Everything process_file hands to -vf, in order. Takes the settings
+   explicitly so callers can build variants of the chain (per-scene
+   overrides) without touching the shared S. VAAPI/QSV jobs get the chain
+   placed on the device (see hw_plan). */
+void build_filter_graph(const Settings *s, FilterGraph *g, bool img) {
+    FilterGraph scale, post;
+    fg_init(&scale, g->arena);
+    fg_init(&post, g->arena);
+    build_filter_stages(s, g, &scale, &post, img);
+    fg_splice(g, &scale);
+    fg_splice(g, &post);
+    if (!s->no_optimize) optimize_filter_chain(g, img);
+    HwPlan hw;
+    if (hw_plan(s, img, &hw)) place_hw_filters(g, &hw);
+}
+
+/* The same rendered, without a trailing comma */
+void build_filter_chain_from(const Settings *s, SB *vf, bool img) {
+    Arena arena = {0};
+    FilterGraph g;
+    fg_init(&g, &arena);
+    build_filter_graph(s, &g, img);
+    fg_render(&g, vf);
+    arena_free(&arena);
+}
+
+void build_filter_chain(SB *vf, bool img) {
+    build_filter_chain_from(&S, vf, img);
+}
+
+
+char *pick_video_encoder(void) {
+    char *cod = "libx264";
+    if (!strcmp(S.codec, "hevc")) {
+        if (!strcmp(S.encoder, "nvenc")) cod = "hevc_nvenc"; else if (!strcmp(S.encoder, "qsv")) cod = "hevc_qsv"; else if (!strcmp(S.encoder, "vaapi")) cod = "hevc_vaapi"; else cod = "libx265";
+    } else { if (!strcmp(S.encoder, "nvenc")) cod = "h264_nvenc"; else if (!strcmp(S.encoder, "qsv")) cod = "h264_qsv"; else if (!strcmp(S.encoder, "vaapi")) cod = "h264_vaapi"; }
+    return cod;
+}
+
+/* Appends -c:v ... -x265-params to args starting at a and returns the new count.
+   x265_fixed receives the ':'-separated x265 params and must outlive args.
+   pix NULL leaves the format to the graph (device surfaces). */
+int append_video_encoder_args(char **args, int a, char *cod, const char *pix, const char *threads,
+                              char *x265_fixed, size_t x265_size) {
+    return append_video_encoder_args_rc(args, a, cod, pix, threads, NULL, x265_fixed, x265_size);
+}
+
+int append_video_encoder_args_rc(char **args, int a, char *cod, const char *pix, const char *threads,
+                                 const RateControl *rc, char *x265_fixed, size_t x265_size) {
+    args[a++] = "-c:v"; args[a++] = cod;
+    if (strstr(cod, "hevc") || strstr(cod, "265")) { args[a++] = "-tag:v"; args[a++] = "hvc1"; }
+    if (pix) { args[a++] = "-pix_fmt"; args[a++] = (char*)pix; }
+    if (threads && *threads) { args[a++] = "-threads"; args[a++] = (char*)threads; }
+    
+    if (!strstr(cod, "vaapi")) {
+        args[a++] = "-preset"; args[a++] = S.preset;
+        if (rc && rc->bitrate) { args[a++] = "-b:v"; args[a++] = (char*)rc->bitrate; }
+        else { args[a++] = "-crf"; args[a++] = rc && rc->crf ? (char*)rc->crf : S.crf; }
+    }
+    if (rc && rc->maxrate) {
+        args[a++] = "-maxrate"; args[a++] = (char*)rc->maxrate;
+        args[a++] = "-bufsize"; args[a++] = (char*)(rc->bufsize ? rc->bufsize : rc->maxrate);
+    }
+    // x265 takes its two-pass settings through -x265-params below
+    if (rc && rc->pass && strcmp(cod, "libx265")) {
+        args[a++] = "-pass"; args[a++] = (char*)rc->pass;
+        args[a++] = "-passlogfile"; args[a++] = (char*)rc->passlog;
+    }
+    // x265 otherwise builds a pool bound to each NUMA node out of every CPU
+    // on it, whatever -threads says; pools=N keeps it to this job's share
+    bool pools = threads && atoi(threads) > 0 && !strstr(S.x265_params, "pools");
+    if (!strcmp(cod, "libx265") && (*S.x265_params || (rc && rc->pass) || pools)) {
+        safe_copy(x265_fixed, S.x265_params, x265_size);
+        
+        for (char *p = x265_fixed; *p; p++) {
+            if (*p == ',') {
+                char *next = p + 1;
+                while (*next == ' ' || *next == '\t') next++;
+                int is_param_separator = 0;
+                char *check = next;
+                while (*check && *check != ',' && *check != ':') {
+                    if (*check == '=') {
+                        is_param_separator = 1;
+                        break;
+                    }
+                    check++;
+                }
+                if (is_param_separator) {
+                    *p = ':';
+                }
+                
+            }
+        }
+        if (pools) {
+            size_t n = strlen(x265_fixed);
+            snprintf(x265_fixed + n, x265_size - n, "%spools=%d", n ? ":" : "", atoi(threads));
+        }
+        if (rc && rc->pass) {
+            size_t n = strlen(x265_fixed);
+            snprintf(x265_fixed + n, x265_size - n, "%spass=%s:stats=%s", n ? ":" : "", rc->pass, rc->passlog);
+        }
+        args[a++] = "-x265-params";
+        args[a++] = x265_fixed;
+    }
+    return a;
+}
@@ -0,0 +1,40 @@
+#ifndef UP60P_FILTERS_H
+#define UP60P_FILTERS_H
+
+#include "up60p_common.h"
+#include "up60p_utils.h"
+#include "up60p_graph.h"
+
+void build_hqdn3d_filter(FilterGraph *g, const char *strength_str);
+void build_nlmeans_filter(FilterGraph *g, const char *strength_str);
+void build_atadenoise_filter(FilterGraph *g, const char *strength_str);
+void build_dering_filter(FilterGraph *g, const char *strength_str);
+void build_deblock_filter(FilterGraph *g, const char *mode, const char *thresh);
+void build_bm3d_filter(FilterGraph *g, const char *strength_str);
+void build_minterpolate_filter(FilterGraph *g, const char *fps, const char *mi_mode);
+void build_deband_filter(FilterGraph *g, const char *method, const char *strength,
+                         const char *f3kdb_range, const char *f3kdb_y, const char *f3kdb_cbcr);
+
+void build_filter_stages(const Settings *s, FilterGraph *pre, FilterGraph *scale, FilterGraph *post, bool img);
+void build_filter_graph(const Settings *s, FilterGraph *g, bool img);
+void build_filter_chain(SB *vf, bool img);
+void build_filter_chain_from(const Settings *s, SB *vf, bool img);
+
+const char *output_pix_fmt(void);
+char *pick_video_encoder(void);
+int append_video_encoder_args(char **args, int a, char *cod, const char *pix, const char *threads,
+                              char *x265_fixed, size_t x265_size);
+
+/* Rate control for one encode, overriding S.crf. Strings must outlive args. */
+typedef struct {
+    const char *crf;              /* NULL = S.crf */
+    const char *bitrate;          /* ABR target instead of crf */
+    const char *maxrate, *bufsize;
+    const char *pass;             /* "1" / "2" for two-pass, NULL = single */
+    const char *passlog;          /* stats file prefix for two-pass */
+} RateControl;
+
+int append_video_encoder_args_rc(char **args, int a, char *cod, const char *pix, const char *threads,
+                                 const RateControl *rc, char *x265_fixed, size_t x265_size);
+
+#endif
@@ -0,0 +1,377 @@
+#include "up60p_frc.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include <math.h>
+
+#define FRC_PIXELS (FRC_BLOCK * FRC_SCALE)   /* block side in source pixels */
+#define FRC_BAND_ROWS 32
+
+/* Mean absolute luma difference per analysis pixel. A frame is a repeat
+   when no block moves past DUP_HI and at most DUP_SHARE of them past
+   DUP_LO, the same test as mpdecimate=hi=64*12 on a coarser grid. */
+#define DUP_HI 12
+#define DUP_LO 5
+#define DUP_SHARE 0.33
+/* Vectors whose block still differs by TRUST_GOOD or less are used as is;
+   by TRUST_BAD or more they fall back to a plain blend */
+#define TRUST_GOOD 6.0f
+#define TRUST_BAD 20.0f
+/* Mean residual after motion search, or share of untrusted blocks, that
+   marks a scene cut: nothing lines up, so the whole frame is blended */
+#define CUT_MEAN 18.0
+#define CUT_SHARE 0.6
+
+struct FrameRateConverter {
+    int width, height, bpp;
+    double in_fps, out_fps;
+    int lw, lh, bw, bh;         // analysis plane, block grid
+    uint8_t *frame[2];          // last kept frame (A) and the next one (B), packed
+    uint8_t *luma[2];
+    uint8_t *out;
+    int a;                      // which of frame/luma holds A
+    bool have_a, have_field, cut;
+    int drops;
+    long long in_index, a_index, out_index;
+    int16_t *mv;                // per block: A sample = B position + vector
+    uint32_t *sad0;             // zero-vector SAD from the repeat check
+    float *trust;
+    int *col_block, *col_next;  // per source column: block centre left of it and right
+    float *col_weight;
+    WorkerPool *pool;
+    FrcStats stats;
+};
+
+bool frc_enabled(const Settings *s) {
+    if (!s->native_frc || s->no_interpolate || s->preview) return false;
+    if (!strcmp(s->mi_mode, "mci")) return true;
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Native frame-rate conversion off: mi_mode=%s, using minterpolate\n", s->mi_mode);
+    log_once(NOTE_FRC_OFF, msg);
+    return false;
+}
+
+FrameRateConverter *frc_create(int width, int height, int bytes_per_pixel,
+                               double in_fps, double out_fps, int threads) {
+    if (width < 2 * FRC_PIXELS || height < 2 * FRC_PIXELS) return NULL;
+    if ((bytes_per_pixel != 3 && bytes_per_pixel != 6) || in_fps <= 0 || out_fps <= 0) return NULL;
+    FrameRateConverter *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    f->width = width;
+    f->height = height;
+    f->bpp = bytes_per_pixel;
+    f->in_fps = in_fps;
+    f->out_fps = out_fps;
+    f->lw = width / FRC_SCALE;
+    f->lh = height / FRC_SCALE;
+    f->bw = (f->lw + FRC_BLOCK - 1) / FRC_BLOCK;
+    f->bh = (f->lh + FRC_BLOCK - 1) / FRC_BLOCK;
+    size_t bytes = (size_t)width * height * bytes_per_pixel, blocks = (size_t)f->bw * f->bh;
+    bool ok = true;
+    for (int i = 0; i < 2; i++) {
+        f->frame[i] = malloc(bytes);
+        f->luma[i] = malloc((size_t)f->lw * f->lh);
+        ok = ok && f->frame[i] && f->luma[i];
+    }
+    f->out = malloc(bytes);
+    f->mv = calloc(blocks * 2, sizeof(*f->mv));
+    f->sad0 = malloc(blocks * sizeof(*f->sad0));
+    f->trust = malloc(blocks * sizeof(*f->trust));
+    f->col_block = malloc((size_t)width * sizeof(int));
+    f->col_next = malloc((size_t)width * sizeof(int));
+    f->col_weight = malloc((size_t)width * sizeof(float));
+    f->pool = pool_create(threads > 0 ? threads : up60p_cpu_count());
+    if (!ok || !f->out || !f->mv || !f->sad0 || !f->trust || !f->col_block || !f->col_next ||
+        !f->col_weight || !f->pool) {
+        frc_destroy(f);
+        return NULL;
+    }
+    for (int x = 0; x < width; x++) {
+        float fx = (x + 0.5f) / FRC_PIXELS - 0.5f;
+        if (fx < 0) fx = 0;
+        if (fx > f->bw - 1) fx = (float)(f->bw - 1);
+        f->col_block[x] = (int)fx;
+        f->col_next[x] = f->col_block[x] + 1 < f->bw ? f->col_block[x] + 1 : f->col_block[x];
+        f->col_weight[x] = fx - f->col_block[x];
+    }
+    return f;
+}
+
+void frc_destroy(FrameRateConverter *f) {
+    if (!f) return;
+    for (int i = 0; i < 2; i++) {
+        free(f->frame[i]);
+        free(f->luma[i]);
+    }
+    free(f->out);
+    free(f->mv);
+    free(f->sad0);
+    free(f->trust);
+    free(f->col_block);
+    free(f->col_next);
+    free(f->col_weight);
+    pool_destroy(f->pool);
+    free(f);
+}
+
+void frc_get_stats(const FrameRateConverter *f, FrcStats *stats) {
+    *stats = f->stats;
+}
+
+typedef struct {
+    FrameRateConverter *f;
+    const up60p_frame *src;
+    uint8_t *luma;
+} AnalyseJob;
+
+/* Box-averaged BT.601 luma at 1/FRC_SCALE size; deep frames use the high
+   byte, which is plenty for matching */
+static void analyse_band(int band, void *ctx) {
+    AnalyseJob *j = ctx;
+    const FrameRateConverter *f = j->f;
+    int step = f->bpp / 3, rows = FRC_BAND_ROWS / FRC_SCALE;
+    int y1 = (band + 1) * rows < f->lh ? (band + 1) * rows : f->lh;
+    for (int ly = band * rows; ly < y1; ly++) {
+        uint8_t *dst = j->luma + (size_t)ly * f->lw;
+        for (int lx = 0; lx < f->lw; lx++) {
+            unsigned sum = 0;
+            for (int dy = 0; dy < FRC_SCALE; dy++) {
+                const uint8_t *p = j->src->data + (ptrdiff_t)(ly * FRC_SCALE + dy) * j->src->stride +
+                                   (size_t)lx * FRC_SCALE * f->bpp + (step - 1);
+                for (int dx = 0; dx < FRC_SCALE; dx++, p += f->bpp) {
+                    sum += 77u * p[0] + 150u * p[step] + 29u * p[2 * step];
+                }
+            }
+            dst[lx] = (uint8_t)((sum + 2048) >> 12);
+        }
+    }
+}
+
+static inline int clampi(int v, int lo, int hi) { return v < lo ? lo : v > hi ? hi : v; }
+
+static int block_pixels(const FrameRateConverter *f, int bx, int by) {
+    int w = f->lw - bx * FRC_BLOCK, h = f->lh - by * FRC_BLOCK;
+    return (w < FRC_BLOCK ? w : FRC_BLOCK) * (h < FRC_BLOCK ? h : FRC_BLOCK);
+}
+
+/* Block of B at (bx, by) against A shifted by (vx, vy), edges clamped */
+static uint32_t block_sad(const FrameRateConverter *f, const uint8_t *a, const uint8_t *b,
+                          int bx, int by, int vx, int vy) {
+    int x0 = bx * FRC_BLOCK, y0 = by * FRC_BLOCK;
+    int x1 = x0 + FRC_BLOCK < f->lw ? x0 + FRC_BLOCK : f->lw;
+    int y1 = y0 + FRC_BLOCK < f->lh ? y0 + FRC_BLOCK : f->lh;
+    uint32_t s = 0;
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *rb = b + (size_t)y * f->lw;
+        const uint8_t *ra = a + (size_t)clampi(y + vy, 0, f->lh - 1) * f->lw;
+        for (int x = x0; x < x1; x++) s += (uint32_t)abs(rb[x] - ra[clampi(x + vx, 0, f->lw - 1)]);
+    }
+    return s;
+}
+
+static bool is_repeat(FrameRateConverter *f, const uint8_t *a, const uint8_t *b) {
+    int busy = 0, blocks = f->bw * f->bh;
+    bool moved = false;
+    for (int by = 0; by < f->bh; by++) {
+        for (int bx = 0; bx < f->bw; bx++) {
+            int i = by * f->bw + bx, n = block_pixels(f, bx, by);
+            f->sad0[i] = block_sad(f, a, b, bx, by, 0, 0);
+            if (f->sad0[i] > (uint32_t)(DUP_HI * n)) moved = true;
+            if (f->sad0[i] > (uint32_t)(DUP_LO * n)) busy++;
+        }
+    }
+    return !moved && busy <= blocks * DUP_SHARE;
+}
+
+/* Predictive search on the analysis plane. Blocks the repeat check already
+   found still keep the zero vector without searching; the rest start from
+   their left, top and top-right neighbours of this field and their own
+   vector from the last one, then walk a small diamond. */
+static void estimate_motion(FrameRateConverter *f, const uint8_t *a, const uint8_t *b) {
+    double residual = 0;
+    int untrusted = 0, blocks = f->bw * f->bh;
+    for (int by = 0; by < f->bh; by++) {
+        for (int bx = 0; bx < f->bw; bx++) {
+            int i = by * f->bw + bx, n = block_pixels(f, bx, by);
+            int16_t *v = f->mv + 2 * i;
+            uint32_t best = f->sad0[i];
+            int bvx = 0, bvy = 0;
+            if (best > (uint32_t)(DUP_LO * n)) {
+                int cand[4][2], nc = 0;
+                cand[nc][0] = v[0]; cand[nc][1] = v[1]; nc++;
+                if (bx > 0) { cand[nc][0] = v[-2]; cand[nc][1] = v[-1]; nc++; }
+                if (by > 0) {
+                    const int16_t *up = v - 2 * f->bw;
+                    cand[nc][0] = up[0]; cand[nc][1] = up[1]; nc++;
+                    if (bx + 1 < f->bw) { cand[nc][0] = up[2]; cand[nc][1] = up[3]; nc++; }
+                }
+                for (int c = 0; c < nc; c++) {
+                    if (!cand[c][0] && !cand[c][1]) continue;
+                    uint32_t s = block_sad(f, a, b, bx, by, cand[c][0], cand[c][1]);
+                    if (s < best) { best = s; bvx = cand[c][0]; bvy = cand[c][1]; }
+                }
+                static const int diamond[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+                for (int step = 0; step < 2 * FRC_RANGE; step++) {
+                    int nx = bvx, ny = bvy;
+                    uint32_t around = best;
+                    for (int d = 0; d < 4; d++) {
+                        int tx = bvx + diamond[d][0], ty = bvy + diamond[d][1];
+                        if (abs(tx) > FRC_RANGE || abs(ty) > FRC_RANGE) continue;
+                        uint32_t s = block_sad(f, a, b, bx, by, tx, ty);
+                        if (s < around) { around = s; nx = tx; ny = ty; }
+                    }
+                    if (around == best) break;
+                    best = around; bvx = nx; bvy = ny;
+                }
+            }
+            v[0] = (int16_t)bvx;
+            v[1] = (int16_t)bvy;
+            float mean = (float)best / n;
+            float t = (TRUST_BAD - mean) / (TRUST_BAD - TRUST_GOOD);
+            f->trust[i] = t < 0 ? 0 : t > 1 ? 1 : t;
+            untrusted += f->trust[i] == 0;
+            residual += best;
+        }
+    }
+    f->cut = residual / ((double)f->lw * f->lh) > CUT_MEAN || untrusted > blocks * CUT_SHARE;
+    f->have_field = true;
+}
+
+typedef struct {
+    FrameRateConverter *f;
+    const uint8_t *a, *b;
+    int weight;                 // B's share, /256
+} RenderJob;
+
+static inline unsigned load_sample(const uint8_t *p, bool wide) {
+    return wide ? (unsigned)(p[0] | p[1] << 8) : p[0];
+}
+
+/* Each output pixel takes its vector and trust bilinearly from the four
+   nearest block centres, fetches A and B along that vector and mixes the
+   result with the co-located blend by trust */
+static void render_band(int band, void *ctx) {
+    RenderJob *j = ctx;
+    const FrameRateConverter *f = j->f;
+    bool wide = f->bpp == 6;
+    int wt = j->weight, step = wide ? 2 : 1;
+    float t = wt / 256.0f;
+    size_t stride = (size_t)f->width * f->bpp;
+    int y1 = (band + 1) * FRC_BAND_ROWS < f->height ? (band + 1) * FRC_BAND_ROWS : f->height;
+    for (int y = band * FRC_BAND_ROWS; y < y1; y++) {
+        float fy = (y + 0.5f) / FRC_PIXELS - 0.5f;
+        if (fy < 0) fy = 0;
+        if (fy > f->bh - 1) fy = (float)(f->bh - 1);
+        int r0 = (int)fy, r1 = r0 + 1 < f->bh ? r0 + 1 : r0;
+        float wy = fy - r0;
+        uint8_t *dst = f->out + y * stride;
+        for (int x = 0; x < f->width; x++) {
+            int i00 = r0 * f->bw + f->col_block[x], i01 = r0 * f->bw + f->col_next[x];
+            int i10 = r1 * f->bw + f->col_block[x], i11 = r1 * f->bw + f->col_next[x];
+            float wx = f->col_weight[x];
+            float w00 = (1 - wx) * (1 - wy), w01 = wx * (1 - wy), w10 = (1 - wx) * wy, w11 = wx * wy;
+            float vx = FRC_SCALE * (w00 * f->mv[2 * i00] + w01 * f->mv[2 * i01] + w10 * f->mv[2 * i10] + w11 * f->mv[2 * i11]);
+            float vy = FRC_SCALE * (w00 * f->mv[2 * i00 + 1] + w01 * f->mv[2 * i01 + 1] +
+                                    w10 * f->mv[2 * i10 + 1] + w11 * f->mv[2 * i11 + 1]);
+            float tr = f->cut ? 0 : w00 * f->trust[i00] + w01 * f->trust[i01] + w10 * f->trust[i10] + w11 * f->trust[i11];
+            int tr8 = (int)(tr * 256 + 0.5f);
+            const uint8_t *pa = j->a + y * stride + (size_t)x * f->bpp;
+            const uint8_t *pb = j->b + y * stride + (size_t)x * f->bpp;
+            const uint8_t *ma = pa, *mb = pb;
+            if (tr8) {
+                int ax = clampi(x + (int)lroundf(t * vx), 0, f->width - 1);
+                int ay = clampi(y + (int)lroundf(t * vy), 0, f->height - 1);
+                int bx = clampi(x - (int)lroundf((1 - t) * vx), 0, f->width - 1);
+                int by = clampi(y - (int)lroundf((1 - t) * vy), 0, f->height - 1);
+                ma = j->a + ay * stride + (size_t)ax * f->bpp;
+                mb = j->b + by * stride + (size_t)bx * f->bpp;
+            }
+            for (int c = 0; c < 3; c++) {
+                int o = c * step;
+                unsigned blend = (load_sample(pa + o, wide) * (256 - wt) + load_sample(pb + o, wide) * wt + 128) >> 8;
+                unsigned v = blend;
+                if (tr8) {
+                    unsigned mc = (load_sample(ma + o, wide) * (256 - wt) + load_sample(mb + o, wide) * wt + 128) >> 8;
+                    v = (mc * tr8 + blend * (256 - tr8) + 128) >> 8;
+                }
+                dst[x * f->bpp + o] = (uint8_t)v;
+                if (wide) dst[x * f->bpp + o + 1] = (uint8_t)(v >> 8);
+            }
+        }
+    }
+}
+
+static bool emit_frame(FrameRateConverter *f, const uint8_t *data, frc_emit_fn emit, void *ctx) {
+    up60p_frame out = { (unsigned char*)data, f->width, f->height, (ptrdiff_t)f->width * f->bpp, f->bpp };
+    f->out_index++;
+    f->stats.out++;
+    return emit(&out, ctx);
+}
+
+/* Output frames before source time end; b is NULL at the end of the
+   stream, where A just holds */
+static bool emit_until(FrameRateConverter *f, const uint8_t *b, long long b_index,
+                       frc_emit_fn emit, void *ctx) {
+    double ta = f->a_index / f->in_fps, end = b_index / f->in_fps;
+    const uint8_t *a = f->frame[f->a];
+    for (;;) {
+        double at = f->out_index / f->out_fps;
+        if (at >= end - 1e-7) return true;
+        double s = b ? (at - ta) / (end - ta) : 0;
+        int weight = (int)(s * 256 + 0.5);
+        bool ok;
+        if (weight <= 0 || weight >= 256) {
+            f->stats.copied++;
+            ok = emit_frame(f, weight >= 256 ? b : a, emit, ctx);
+        } else {
+            if (!f->have_field) estimate_motion(f, f->luma[f->a], f->luma[!f->a]);
+            if (f->cut) f->stats.blended++;
+            else f->stats.interpolated++;
+            RenderJob j = { f, a, b, weight };
+            pool_run(f->pool, (f->height + FRC_BAND_ROWS - 1) / FRC_BAND_ROWS, render_band, &j);
+            ok = emit_frame(f, f->out, emit, ctx);
+        }
+        if (!ok) return false;
+    }
+}
+
+static void store_frame(const FrameRateConverter *f, const up60p_frame *src, uint8_t *dst) {
+    size_t row = (size_t)f->width * f->bpp;
+    for (int y = 0; y < f->height; y++) memcpy(dst + y * row, src->data + (ptrdiff_t)y * src->stride, row);
+}
+
+bool frc_push(FrameRateConverter *f, const up60p_frame *frame, frc_emit_fn emit, void *ctx) {
+    if (frame->width != f->width || frame->height != f->height || frame->bytes_per_pixel != f->bpp) return false;
+    long long index = f->in_index++;
+    f->stats.in++;
+    int b = f->have_a ? !f->a : f->a;
+    AnalyseJob aj = { f, frame, f->luma[b] };
+    pool_run(f->pool, (f->lh * FRC_SCALE + FRC_BAND_ROWS - 1) / FRC_BAND_ROWS, analyse_band, &aj);
+    if (!f->have_a) {
+        store_frame(f, frame, f->frame[b]);
+        f->have_a = true;
+        f->a_index = index;
+        return true;
+    }
+    // Repeats are judged against the last kept frame, so a slow pan can't
+    // creep through as a run of near-duplicates. The check also leaves the
+    // zero-vector SADs the motion search starts from.
+    bool repeat = is_repeat(f, f->luma[f->a], f->luma[b]);
+    if (repeat && f->drops < FRC_MAX_DROPS) {
+        f->drops++;
+        f->stats.dropped++;
+        return true;
+    }
+    f->drops = 0;
+    store_frame(f, frame, f->frame[b]);
+    f->have_field = false;
+    bool ok = emit_until(f, f->frame[b], index, emit, ctx);
+    f->a = b;
+    f->a_index = index;
+    return ok;
+}
+
+bool frc_flush(FrameRateConverter *f, frc_emit_fn emit, void *ctx) {
+    if (!f->have_a) return true;
+    return emit_until(f, NULL, f->in_index, emit, ctx);
+}
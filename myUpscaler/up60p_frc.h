@@ -0,0 +1,42 @@
+#ifndef UP60P_FRC_H
+#define UP60P_FRC_H
+
+#include "up60p_common.h"
+
+#define FRC_SCALE 4          /* motion is measured on luma at 1/4 size */
+#define FRC_BLOCK 4          /* block side in analysis pixels, 16 source pixels */
+#define FRC_RANGE 8          /* longest vector component, analysis pixels */
+#define FRC_MAX_DROPS 3      /* longest run of duplicates dropped in a row */
+
+typedef struct FrameRateConverter FrameRateConverter;
+
+typedef struct {
+    long long in, dropped, out, copied, interpolated, blended;
+} FrcStats;
+
+/* frame points into converter memory and is only valid during the call;
+   return false to stop */
+typedef bool (*frc_emit_fn)(const up60p_frame *frame, void *ctx);
+
+/* native_frc is set and the job interpolates at all; logs once why not
+   when the chain would need minterpolate features it doesn't have. */
+bool frc_enabled(const Settings *s);
+
+/* Packed RGB frames (bytes_per_pixel 3 or 6) at in_fps in, out_fps out.
+   threads 0 = one per core. NULL for frames too small to analyse. */
+FrameRateConverter *frc_create(int width, int height, int bytes_per_pixel,
+                               double in_fps, double out_fps, int threads);
+
+/* Takes the next source frame and emits every output frame that falls
+   before it. Near-identical frames (telecine repeats, anime held cels)
+   are dropped first, so the motion between the frames that remain is
+   the real motion and the in-betweens are spread over it. */
+bool frc_push(FrameRateConverter *f, const up60p_frame *frame, frc_emit_fn emit, void *ctx);
+
+/* Emits the frames up to the end of the last source frame */
+bool frc_flush(FrameRateConverter *f, frc_emit_fn emit, void *ctx);
+
+void frc_get_stats(const FrameRateConverter *f, FrcStats *stats);
+void frc_destroy(FrameRateConverter *f);
+
+#endif
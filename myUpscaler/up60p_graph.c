@@ -0,0 +1,557 @@
+#include "up60p_graph.h"
+#include <math.h>
+
+static const FilterInfo FILTERS[] = {
+    { "format",          1.5, 16 },
+    { "setpts",          0.0, 16 },
+    { "setsar",          0.0, 16 },
+    { "split",           0.0, 16 },
+    { "mpdecimate",      1.0,  8 },
+    { "deblock",         6.0, 16 },
+    { "bm3d",          400.0, 16 },
+    { "nlmeans",       120.0,  8 },
+    { "hqdn3d",          4.0, 16 },
+    { "atadenoise",     10.0, 16 },
+    { "minterpolate",  150.0,  8 },
+    { "scale",           8.0, 16 },
+    { "zscale",         10.0, 16 },
+    { "scale_npp",       1.0, 16 },
+    { "sr",            500.0,  8 },
+    { "dnn_processing", 500.0, 8 },
+    { "cas",             3.0, 16 },
+    { "unsharp",         6.0, 16 },
+    { "deband",          5.0, 16 },
+    { "gradfun",         4.0,  8 },
+    { "noise",           3.0,  8 },
+    { "limiter",         1.0, 16 },
+    // Device filters cost the CPU next to nothing; the copies across the bus do
+    { "hwupload",        2.0, 16 },
+    { "hwdownload",      2.0, 16 },
+    { "scale_vaapi",     0.1, 16 },
+    { "scale_qsv",       0.1, 16 },
+    { "denoise_vaapi",   0.1, 16 },
+    { "sharpness_vaapi", 0.1, 16 },
+    { "deinterlace_vaapi", 0.1, 16 },
+    { "vpp_qsv",         0.1, 16 },
+};
+
+bool filter_is_scaler(const char *name) {
+    return !strcmp(name, "scale") || !strcmp(name, "zscale") || !strcmp(name, "scale_npp") ||
+           !strcmp(name, "scale_vaapi") || !strcmp(name, "scale_qsv") ||
+           !strcmp(name, "sr") || !strcmp(name, "dnn_processing");
+}
+
+const FilterInfo *filter_info(const char *name) {
+    for (int i = 0; i < ARR_LEN(FILTERS); i++) {
+        if (!strcmp(FILTERS[i].name, name)) return &FILTERS[i];
+    }
+    return NULL;
+}
+
+
+/* ---- IR ---- */
+
+void fg_init(FilterGraph *g, Arena *a) {
+    memset(g, 0, sizeof(*g));
+    g->arena = a;
+}
+
+FilterNode *fg_node(Arena *a, const char *name) {
+    FilterNode *n = arena_alloc(a, sizeof(*n));
+    if (!n) return NULL;
+    n->arena = a;
+    n->name = arena_strdup(a, name);
+    return n->name ? n : NULL;
+}
+
+void fg_push(FilterGraph *g, FilterNode *n) {
+    if (!n) return;
+    n->prev = g->tail;
+    n->next = NULL;
+    if (g->tail) g->tail->next = n;
+    else g->head = n;
+    g->tail = n;
+    g->count++;
+}
+
+FilterNode *fg_add(FilterGraph *g, const char *name) {
+    FilterNode *n = fg_node(g->arena, name);
+    fg_push(g, n);
+    return n;
+}
+
+void fg_remove(FilterGraph *g, FilterNode *n) {
+    if (n->prev) n->prev->next = n->next;
+    else g->head = n->next;
+    if (n->next) n->next->prev = n->prev;
+    else g->tail = n->prev;
+    n->prev = n->next = NULL;
+    g->count--;
+}
+
+void fg_splice(FilterGraph *g, FilterGraph *from) {
+    if (!from->head) return;
+    from->head->prev = g->tail;
+    if (g->tail) g->tail->next = from->head;
+    else g->head = from->head;
+    g->tail = from->tail;
+    g->count += from->count;
+    from->head = from->tail = NULL;
+    from->count = 0;
+}
+
+static FilterParam *add_param(FilterNode *n, const char *key) {
+    if (!n) return NULL;
+    if (n->nparams == n->cap) {
+        // Old arrays stay in the arena; nodes rarely pass four params
+        int cap = n->cap ? n->cap * 2 : 4;
+        FilterParam *p = arena_alloc(n->arena, (size_t)cap * sizeof(*p));
+        if (!p) return NULL;
+        if (n->nparams) memcpy(p, n->params, (size_t)n->nparams * sizeof(*p));
+        n->params = p;
+        n->cap = cap;
+    }
+    FilterParam *p = &n->params[n->nparams];
+    p->key = key ? arena_strdup(n->arena, key) : NULL;
+    if (key && !p->key) return NULL;
+    n->nparams++;
+    return p;
+}
+
+static void set_text(FilterParam *p, char *text) {
+    if (!p) return;
+    p->text = text ? text : "";
+    char *end;
+    p->num = strtod(p->text, &end);
+    p->type = *p->text && !*end ? PARAM_NUM : PARAM_TEXT;
+}
+
+void fg_text(FilterNode *n, const char *key, const char *value) {
+    FilterParam *p = add_param(n, key);
+    if (p) set_text(p, arena_strdup(n->arena, value));
+}
+
+void fg_textf(FilterNode *n, const char *key, const char *fmt, ...) {
+    FilterParam *p = add_param(n, key);
+    if (!p) return;
+    va_list ap;
+    va_start(ap, fmt);
+    set_text(p, arena_vprintf(n->arena, fmt, ap));
+    va_end(ap);
+}
+
+void fg_int(FilterNode *n, const char *key, long value) {
+    FilterParam *p = add_param(n, key);
+    if (!p) return;
+    p->text = arena_printf(n->arena, "%ld", value);
+    if (!p->text) p->text = "";
+    p->type = PARAM_INT;
+    p->num = (double)value;
+}
+
+void fg_num(FilterNode *n, const char *key, double value, int decimals) {
+    FilterParam *p = add_param(n, key);
+    if (!p) return;
+    p->text = arena_printf(n->arena, "%.*f", decimals, value);
+    if (!p->text) p->text = "";
+    p->type = PARAM_NUM;
+    p->num = value;
+}
+
+void fg_clear_params(FilterNode *n) {
+    n->nparams = 0;
+}
+
+bool fg_is(const FilterNode *n, const char *name) {
+    return n && !strcmp(n->name, name);
+}
+
+const FilterParam *fg_param(const FilterNode *n, const char *key) {
+    for (int i = 0; i < n->nparams; i++) {
+        if (n->params[i].key && !strcmp(n->params[i].key, key)) return &n->params[i];
+    }
+    return NULL;
+}
+
+const FilterParam *fg_positional(const FilterNode *n, int index) {
+    for (int i = 0; i < n->nparams; i++) {
+        if (!n->params[i].key && index-- == 0) return &n->params[i];
+    }
+    return NULL;
+}
+
+double fg_param_num(const FilterNode *n, const char *key, int index, double fallback) {
+    const FilterParam *p = key ? fg_param(n, key) : fg_positional(n, index);
+    return p && p->type != PARAM_TEXT ? p->num : fallback;
+}
+
+static bool nodes_equal(const FilterNode *a, const FilterNode *b) {
+    if (strcmp(a->name, b->name) || a->nparams != b->nparams) return false;
+    for (int i = 0; i < a->nparams; i++) {
+        const FilterParam *x = &a->params[i], *y = &b->params[i];
+        if (!x->key != !y->key || (x->key && strcmp(x->key, y->key)) || strcmp(x->text, y->text)) return false;
+    }
+    return true;
+}
+
+/* End of the ':'- or ','-separated piece starting at p. Quoted paths and
+   backslash escapes never split. */
+static const char *piece_end(const char *p, char sep) {
+    bool quoted = false;
+    for (; *p; p++) {
+        if (*p == '\\' && p[1]) { p++; continue; }
+        if (*p == '\'') quoted = !quoted;
+        else if (!quoted && *p == sep) break;
+    }
+    return p;
+}
+
+/* key=value when what precedes the first '=' is a plain option name */
+static size_t key_length(const char *p, const char *end) {
+    const char *k = p;
+    while (k < end && (isalnum((unsigned char)*k) || *k == '_')) k++;
+    return k > p && k < end && *k == '=' ? (size_t)(k - p) : 0;
+}
+
+static bool parse_params(FilterNode *n, const char *p, const char *end) {
+    for (;;) {
+        const char *stop = piece_end(p, ':');
+        if (stop > end) stop = end;
+        size_t k = key_length(p, stop);
+        char *key = k ? arena_strndup(n->arena, p, k) : NULL;
+        char *text = arena_strndup(n->arena, p + (k ? k + 1 : 0), (size_t)(stop - p) - (k ? k + 1 : 0));
+        FilterParam *param = (!k || key) && text ? add_param(n, NULL) : NULL;
+        if (!param) return false;
+        param->key = key;
+        set_text(param, text);
+        if (stop == end) return true;
+        p = stop + 1;
+    }
+}
+
+bool fg_parse_params(FilterNode *n, const char *args) {
+    return !n || !*args || parse_params(n, args, args + strlen(args));
+}
+
+static bool parse_node(FilterGraph *g, const char *start, const char *end) {
+    size_t name_len = strcspn(start, "=");
+    if (start + name_len > end) name_len = (size_t)(end - start);
+    char *name = arena_strndup(g->arena, start, name_len);
+    FilterNode *n = name ? fg_add(g, name) : NULL;
+    if (!n) return false;
+    const char *p = start + name_len;
+    return p == end || parse_params(n, p + 1, end);
+}
+
+bool fg_parse(FilterGraph *g, const char *vf) {
+    if (!vf) return true;
+    for (const char *p = vf; *p; ) {
+        const char *end = piece_end(p, ',');
+        if (end > p && !parse_node(g, p, end)) return false;
+        p = *end ? end + 1 : end;
+    }
+    return true;
+}
+
+void fg_render(const FilterGraph *g, SB *out) {
+    size_t len = 0;
+    for (const FilterNode *n = g->head; n; n = n->next) {
+        len += strlen(n->name) + 1;
+        for (int i = 0; i < n->nparams; i++) {
+            len += strlen(n->params[i].text) + 1;
+            if (n->params[i].key) len += strlen(n->params[i].key) + 1;
+        }
+    }
+    if (!g->head || !sb_reserve(out, len)) return;
+    char *d = out->buf + out->len;
+    for (const FilterNode *n = g->head; n; n = n->next) {
+        if (n != g->head) *d++ = ',';
+        d = stpcpy(d, n->name);
+        for (int i = 0; i < n->nparams; i++) {
+            *d++ = i ? ':' : '=';
+            if (n->params[i].key) {
+                d = stpcpy(d, n->params[i].key);
+                *d++ = '=';
+            }
+            d = stpcpy(d, n->params[i].text);
+        }
+    }
+    *d = 0;
+    out->len = (size_t)(d - out->buf);
+}
+
+/* ---- Passes ---- */
+
+static int fmt_depth(const char *pix) {
+    if (strstr(pix, "p16")) return 16;
+    if (strstr(pix, "p12")) return 12;
+    if (strstr(pix, "p10") || strstr(pix, "p010")) return 10;
+    return 8;
+}
+
+static int fmt_chroma(const char *pix) {
+    if (strstr(pix, "444")) return 444;
+    if (strstr(pix, "422")) return 422;
+    return 420;
+}
+
+static const char *format_of(const FilterNode *n) {
+    const FilterParam *p = fg_positional(n, 0);
+    if (!p) p = fg_param(n, "pix_fmts");
+    return p ? p->text : "";
+}
+
+/* Two hqdn3d passes in a row behave like one pass whose per-axis strengths
+   add in quadrature, at half the cost. */
+static bool merge_hqdn3d(FilterNode *a, const FilterNode *b) {
+    double x[4], y[4];
+    for (int i = 0; i < 4; i++) {
+        const FilterParam *pa = fg_positional(a, i), *pb = fg_positional(b, i);
+        if (!pa || !pb || pa->type == PARAM_TEXT || pb->type == PARAM_TEXT) return false;
+        x[i] = pa->num;
+        y[i] = pb->num;
+    }
+    if (a->nparams != 4 || b->nparams != 4) return false;
+    fg_clear_params(a);
+    for (int i = 0; i < 4; i++) fg_num(a, NULL, hypot(x[i], y[i]), 2);
+    return true;
+}
+
+void optimize_filter_chain(FilterGraph *g, bool img) {
+    for (FilterNode *n = g->head; n; ) {
+        FilterNode *next = n->next;
+        // Identity timestamp rewrite left behind after mpdecimate
+        if (fg_is(n, "setpts") && n->nparams == 1 && !strcmp(n->params[0].text, "PTS")) {
+            fg_remove(g, n);
+            n = next;
+            continue;
+        }
+        if (next && fg_is(n, "hqdn3d") && fg_is(next, "hqdn3d") && merge_hqdn3d(n, next)) {
+            fg_remove(g, next);
+            continue;
+        }
+        // A conversion immediately narrowed again by the next one is dead work
+        if (next && fg_is(n, "format") && fg_is(next, "format")) {
+            const char *a = format_of(n), *b = format_of(next);
+            if (fmt_depth(a) >= fmt_depth(b) && fmt_chroma(a) >= fmt_chroma(b)) {
+                fg_remove(g, n);
+                n = next;
+                continue;
+            }
+        }
+        if (next && (fg_is(n, "setsar") || fg_is(n, "format")) && nodes_equal(n, next)) {
+            fg_remove(g, next);
+            continue;
+        }
+        n = next;
+    }
+
+    // The working format only matters until the first 8-bit-only stage;
+    // output is always 4:2:0, so 4:4:4 up front buys nothing either.
+    FilterNode *first = g->head;
+    if (!img && g->count > 1 && fg_is(first, "format")) {
+        bool wide = false, known = true;
+        for (FilterNode *n = first->next; n && !fg_is(n, "format"); n = n->next) {
+            const FilterInfo *fi = filter_info(n->name);
+            if (!fi) { known = false; break; }
+            if (fi->max_depth < 16) break;
+            if (fi->cost > 0) wide = true;
+        }
+        const char *cur = format_of(first);
+        const char *pick = wide ? (fmt_depth(cur) > 8 ? "yuv420p16le" : "yuv420p") : "yuv420p";
+        if (known && (fmt_depth(pick) < fmt_depth(cur) || fmt_chroma(pick) < fmt_chroma(cur))) {
+            fg_clear_params(first);
+            fg_text(first, NULL, pick);
+        }
+    }
+}
+
+void make_frames_independent(FilterGraph *g) {
+    for (FilterNode *n = g->head; n; ) {
+        FilterNode *next = n->next;
+        if (fg_is(n, "atadenoise")) {
+            fg_remove(g, n);
+        } else if (fg_is(n, "hqdn3d")) {
+            double luma = fg_param(n, "luma_spatial") ? fg_param_num(n, "luma_spatial", 0, 4.0)
+                                                      : fg_param_num(n, NULL, 0, 4.0);
+            double chroma = fg_param(n, "chroma_spatial") ? fg_param_num(n, "chroma_spatial", 0, 0)
+                                                          : fg_param_num(n, NULL, 1, luma * 0.75);
+            fg_clear_params(n);
+            fg_num(n, NULL, luma, 2);
+            fg_num(n, NULL, chroma, 2);
+            fg_int(n, NULL, 0);
+            fg_int(n, NULL, 0);
+        }
+        n = next;
+    }
+}
+
+/* Output size of a scale/zscale node: positional or w=/h= expressions */
+static bool scale_size(const FilterNode *n, const char **w, const char **h) {
+    const FilterParam *pw = fg_param(n, "w"), *ph = fg_param(n, "h");
+    if (!pw) pw = fg_positional(n, 0);
+    if (!ph) ph = fg_positional(n, pw == fg_positional(n, 0) ? 1 : 0);
+    *w = pw ? pw->text : NULL;
+    *h = ph ? ph->text : NULL;
+    return *w && **w && *h && **h;
+}
+
+/* Stages that pass device frames through untouched */
+static bool hw_agnostic(const FilterNode *n) {
+    return fg_is(n, "setpts") || fg_is(n, "setsar") || fg_is(n, "trim") || fg_is(n, "fps") || fg_is(n, "null");
+}
+
+static FilterNode *hw_format_node(Arena *a, const HwPlan *p) {
+    FilterNode *n = fg_node(a, !strcmp(p->api, "vaapi") ? "scale_vaapi" : "vpp_qsv");
+    fg_text(n, "format", p->surface);
+    return n;
+}
+
+/* Device stand-in for one software node: *out NULL drops it, false means
+   there is none. Strengths come from the software filter's own arguments,
+   rescaled to the driver's 0..64 (vpp_qsv takes 0..100). */
+static bool hw_equivalent(Arena *a, const FilterNode *n, const HwPlan *p, FilterNode **out) {
+    bool va = !strcmp(p->api, "vaapi");
+    const char *w, *h;
+    *out = NULL;
+    if (fg_is(n, "format")) {
+        *out = hw_format_node(a, p);
+    } else if (fg_is(n, "limiter")) {
+        // The video processor writes limited-range surfaces already
+    } else if ((fg_is(n, "scale") || fg_is(n, "zscale")) && scale_size(n, &w, &h)) {
+        *out = fg_node(a, va ? "scale_vaapi" : "scale_qsv");
+        fg_text(*out, "w", w);
+        fg_text(*out, "h", h);
+        fg_text(*out, "format", p->surface);
+        fg_text(*out, "mode", "hq");
+    } else if (fg_is(n, "yadif") || fg_is(n, "bwdif")) {
+        *out = fg_node(a, va ? "deinterlace_vaapi" : "vpp_qsv");
+        if (!va) fg_int(*out, "deinterlace", 2);
+    } else if (fg_is(n, "hqdn3d") || fg_is(n, "nlmeans") || fg_is(n, "atadenoise") || fg_is(n, "bm3d")) {
+        double v = fg_is(n, "hqdn3d") ? fg_param_num(n, NULL, 0, 0) * 6 :
+                   fg_param(n, "sigma") ? fg_param_num(n, "sigma", 0, 0) * 8 :
+                   fg_param_num(n, "s", 0, 0) * 3;
+        int l = (int)lround(v <= 0 ? 24 : v > 64 ? 64 : v);
+        *out = fg_node(a, va ? "denoise_vaapi" : "vpp_qsv");
+        fg_int(*out, "denoise", va ? l : l * 100 / 64);
+    } else if (fg_is(n, "cas") || fg_is(n, "unsharp")) {
+        // cas=strength=s, unsharp=rx:ry:amount
+        double v = fg_is(n, "cas") ? fg_param_num(n, "strength", 0, 0) * 64 : fg_param_num(n, NULL, 2, 0) * 32;
+        int l = (int)lround(v <= 0 ? 16 : v > 64 ? 64 : v);
+        *out = fg_node(a, va ? "sharpness_vaapi" : "vpp_qsv");
+        fg_int(*out, va ? "sharpness" : "detail", va ? l : l * 100 / 64);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void push_upload(FilterGraph *g, const HwPlan *p) {
+    fg_text(fg_add(g, "format"), NULL, p->surface);
+    FilterNode *up = fg_add(g, "hwupload");
+    if (strcmp(p->api, "vaapi")) fg_int(up, "extra_hw_frames", 64);
+}
+
+static void push_download(FilterGraph *g, const HwPlan *p, bool known) {
+    if (!known) fg_push(g, hw_format_node(g->arena, p));
+    fg_add(g, "hwdownload");
+    fg_text(fg_add(g, "format"), NULL, p->surface);
+}
+
+static FilterNode *copy_node(Arena *a, const FilterNode *n) {
+    FilterNode *c = fg_node(a, n->name);
+    for (int i = 0; c && i < n->nparams; i++) fg_text(c, n->params[i].key, n->params[i].text);
+    return c;
+}
+
+void place_hw_filters(FilterGraph *g, const HwPlan *p) {
+    if (!p || !p->api) return;
+    int n = g->count;
+    FilterNode **nodes = n ? arena_alloc(g->arena, (size_t)n * sizeof(*nodes)) : NULL;
+    FilterNode **hw = n ? arena_alloc(g->arena, (size_t)n * sizeof(*hw)) : NULL;
+    bool *has_hw = n ? arena_alloc(g->arena, (size_t)n * sizeof(*has_hw)) : NULL;
+    if (n && (!nodes || !hw || !has_hw)) return;
+
+    int last_sw = -1, i = 0;
+    for (FilterNode *node = g->head; node; node = node->next, i++) {
+        nodes[i] = node;
+        has_hw[i] = p->native && hw_equivalent(g->arena, node, p, &hw[i]);
+        if (!has_hw[i] && !hw_agnostic(node)) last_sw = i;
+    }
+    // The working format is what software stages expect after a download
+    const FilterNode *work = n > 1 && fg_is(nodes[0], "format") ? nodes[0] : NULL;
+
+    FilterGraph out;
+    fg_init(&out, g->arena);
+    bool dev = p->decode;
+    bool known = false;           // surfaces are p->surface; decoded ones may be nv12 or p010
+    for (i = 0; i < n; i++) {
+        FilterNode *node = nodes[i];
+        if (i == 0 && work) {
+            if (!dev) fg_push(&out, node);
+            continue;
+        }
+        if (hw_agnostic(node)) {
+            fg_push(&out, node);
+            continue;
+        }
+        // Uploading only pays off when the encoder takes the surfaces, and
+        // a conversion or range clamp alone is no reason to go early
+        bool passive = fg_is(node, "format") || fg_is(node, "limiter");
+        if (has_hw[i] && (dev || (i > last_sw && p->encode && !passive))) {
+            if (!dev) {
+                push_upload(&out, p);
+                dev = known = true;
+            }
+            if (fg_is(node, "format") && known) continue;
+            if (hw[i]) {
+                fg_push(&out, hw[i]);
+                if (fg_param(hw[i], "format")) known = true;
+            }
+        } else {
+            if (dev) {
+                push_download(&out, p, known);
+                // The working format node may already sit in out
+                if (work && i && !fg_is(node, "format")) fg_push(&out, copy_node(g->arena, work));
+                dev = false;
+            }
+            fg_push(&out, node);
+        }
+    }
+    if (p->encode && !dev) push_upload(&out, p);
+    else if (!p->encode && dev) push_download(&out, p, known);
+    *g = out;
+}
+
+double filter_graph_cost(const FilterGraph *g, double scale, char *heaviest, size_t heaviest_size,
+                         double *heaviest_share) {
+    if (heaviest && heaviest_size) heaviest[0] = 0;
+    if (heaviest_share) *heaviest_share = 0;
+
+    double area = scale > 0 ? scale * scale : 1.0;
+    double total = 0, top = 0, mult = 1.0;
+    for (const FilterNode *n = g->head; n; n = n->next) {
+        const FilterInfo *fi = filter_info(n->name);
+        // The scaler itself writes output-sized frames
+        if (filter_is_scaler(n->name)) mult = area;
+        double c = fi ? fi->cost * mult : 0;
+        total += c;
+        if (c > top) {
+            top = c;
+            if (heaviest && heaviest_size) safe_copy(heaviest, n->name, heaviest_size);
+        }
+    }
+    if (heaviest_share && total > 0) *heaviest_share = top / total;
+    return total;
+}
+
+double filter_chain_cost(const char *vf, double scale, char *heaviest, size_t heaviest_size,
+                         double *heaviest_share) {
+    Arena arena = {0};
+    FilterGraph g;
+    fg_init(&g, &arena);
+    if (!fg_parse(&g, vf)) fg_init(&g, &arena);
+    double cost = filter_graph_cost(&g, scale, heaviest, heaviest_size, heaviest_share);
+    arena_free(&arena);
+    return cost;
+}
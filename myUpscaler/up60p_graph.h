@@ -0,0 +1,104 @@
+#ifndef UP60P_GRAPH_H
+#define UP60P_GRAPH_H
+
+#include "up60p_common.h"
+#include "up60p_utils.h"
+#include "up60p_hwaccel.h"
+#include "up60p_arena.h"
+
+/* A linear filter chain as typed nodes in a job arena. Builders add nodes
+   and passes rewrite them; the -vf string is rendered once at the end. */
+typedef enum { PARAM_TEXT, PARAM_INT, PARAM_NUM } FilterParamType;
+
+typedef struct {
+    const char *key;          /* NULL for a positional value */
+    const char *text;         /* value as rendered, quotes included */
+    FilterParamType type;
+    double num;               /* value of PARAM_INT / PARAM_NUM */
+} FilterParam;
+
+typedef struct FilterNode {
+    const char *name;
+    FilterParam *params;
+    int nparams, cap;
+    Arena *arena;
+    struct FilterNode *prev, *next;
+} FilterNode;
+
+typedef struct {
+    Arena *arena;
+    FilterNode *head, *tail;
+    int count;
+} FilterGraph;
+
+void fg_init(FilterGraph *g, Arena *a);
+/* New node at the end of g; NULL only when out of memory, which the
+   param setters and fg_push accept and ignore */
+FilterNode *fg_add(FilterGraph *g, const char *name);
+/* Node not yet in any graph, for fg_push */
+FilterNode *fg_node(Arena *a, const char *name);
+void fg_push(FilterGraph *g, FilterNode *n);
+void fg_remove(FilterGraph *g, FilterNode *n);
+/* Moves every node of from onto the end of g; both share an arena */
+void fg_splice(FilterGraph *g, FilterGraph *from);
+
+/* Params in render order. Text that reads as a number is typed PARAM_NUM
+   so passes can work with it; text is stored verbatim either way. */
+void fg_text(FilterNode *n, const char *key, const char *value);
+void fg_textf(FilterNode *n, const char *key, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+void fg_int(FilterNode *n, const char *key, long value);
+void fg_num(FilterNode *n, const char *key, double value, int decimals);
+void fg_clear_params(FilterNode *n);
+
+bool fg_is(const FilterNode *n, const char *name);
+const FilterParam *fg_param(const FilterNode *n, const char *key);
+const FilterParam *fg_positional(const FilterNode *n, int index);
+/* Numeric value of key (or of positional index when key is NULL), fallback otherwise */
+double fg_param_num(const FilterNode *n, const char *key, int index, double fallback);
+
+/* Appends the nodes of a rendered chain; quoted values and '\,' escapes
+   stay with their filter. False when out of memory. */
+bool fg_parse(FilterGraph *g, const char *vf);
+/* Adds the params of a written "k=v:w" argument list to n */
+bool fg_parse_params(FilterNode *n, const char *args);
+/* Appends "a=x:y,b=z" to out, sized in one pass */
+void fg_render(const FilterGraph *g, SB *out);
+
+/* Rough single-core numbers, good enough to rank stages and spot the one
+   that dominates a chain. */
+typedef struct {
+    const char *name;
+    double cost;          /* ms per megapixel per frame */
+    int max_depth;        /* widest bit depth the filter processes natively */
+} FilterInfo;
+
+const FilterInfo *filter_info(const char *name);
+/* Filters whose output is the upscaled size */
+bool filter_is_scaler(const char *name);
+
+/* Rewrites g in place: merges adjacent hqdn3d passes, drops identity and
+   superseded conversions, and narrows the leading working format to the
+   cheapest one that the first stages can actually use. */
+void optimize_filter_chain(FilterGraph *g, bool img);
+
+/* Rewrites g so no frame's output depends on the frames before it, for
+   unrelated stills sharing one graph: hqdn3d keeps its spatial strengths
+   only and atadenoise, which only averages across frames, is dropped. */
+void make_frames_independent(FilterGraph *g);
+
+/* Moves what it can of a finished chain onto the VAAPI/QSV device in p:
+   stages with a device equivalent run there while frames are already on
+   the device or never need to come back, so the chain crosses the bus at
+   most once each way, around the run of software-only stages. Appends the
+   hwupload the encoder needs or the hwdownload a software encoder needs. */
+void place_hw_filters(FilterGraph *g, const HwPlan *p);
+
+/* Estimated ms per frame for one megapixel of source; stages after the
+   scaler are charged at scale^2. Writes the most expensive stage's name. */
+double filter_graph_cost(const FilterGraph *g, double scale, char *heaviest, size_t heaviest_size,
+                         double *heaviest_share);
+/* Same for a rendered chain */
+double filter_chain_cost(const char *vf, double scale, char *heaviest, size_t heaviest_size,
+                         double *heaviest_share);
+
+#endif
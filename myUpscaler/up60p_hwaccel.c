@@ -0,0 +1,49 @@
+#include "up60p_hwaccel.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+
+static bool is_va_api(const char *name) {
+    return !strcmp(name, "vaapi") || !strcmp(name, "qsv");
+}
+
+bool hw_plan(const Settings *s, bool img, HwPlan *p) {
+    memset(p, 0, sizeof(*p));
+    const char *api = NULL;
+    if (!img && is_va_api(s->encoder)) api = s->encoder;
+    else if (s->hw_resident && is_va_api(s->hwaccel)) api = s->hwaccel;
+    if (!api) return false;
+    if (s->preview) {
+        log_once(NOTE_HW_PREVIEW, "Device-resident graph off: live preview needs host frames\n");
+        return false;
+    }
+
+    p->api = api;
+    p->native = s->hw_resident;
+    p->decode = s->hw_resident && !strcmp(s->hwaccel, api);
+    p->encode = !img && !strcmp(s->encoder, api);
+    p->surface = s->use10 && !s->pci_safe_mode ? "p010le" : "nv12";
+    if (!strcmp(api, "vaapi")) {
+        snprintf(p->device, sizeof(p->device), "vaapi=hw%s%s", *s->hw_device ? ":" : "", s->hw_device);
+    } else if (*s->hw_device) {
+        // QSV sits on a VAAPI device on Linux; pick its render node
+        snprintf(p->device, sizeof(p->device), "qsv=hw:hw_any,child_device=%s", s->hw_device);
+    } else {
+        snprintf(p->device, sizeof(p->device), "qsv=hw:hw_any");
+    }
+    return true;
+}
+
+int append_hw_input_args(char **args, int a, const HwPlan *p, const char *hwaccel) {
+    if (p && p->api) {
+        args[a++] = "-init_hw_device"; args[a++] = (char*)p->device;
+        args[a++] = "-filter_hw_device"; args[a++] = "hw";
+        if (hwaccel && p->decode) {
+            args[a++] = "-hwaccel"; args[a++] = (char*)p->api;
+            args[a++] = "-hwaccel_device"; args[a++] = "hw";
+            args[a++] = "-hwaccel_output_format"; args[a++] = (char*)p->api;
+            return a;
+        }
+    }
+    if (hwaccel && strcmp(hwaccel, "none")) { args[a++] = "-hwaccel"; args[a++] = (char*)hwaccel; }
+    return a;
+}
@@ -0,0 +1,29 @@
+#ifndef UP60P_HWACCEL_H
+#define UP60P_HWACCEL_H
+
+#include "up60p_common.h"
+
+/* Where a VAAPI/QSV job keeps its frames. With hw_resident the decoder
+   hands surfaces straight to the graph, stages with a device equivalent
+   run there, and frames only cross the bus around software-only filters. */
+typedef struct {
+    const char *api;        /* "vaapi" or "qsv" */
+    bool decode;            /* graph input is device surfaces */
+    bool encode;            /* graph output goes to the matching encoder as surfaces */
+    bool native;            /* swap in *_vaapi / vpp_qsv equivalents of software stages */
+    const char *surface;    /* nv12 or p010le, the layout frames cross the bus in */
+    char device[96];        /* -init_hw_device value, device named "hw" */
+} HwPlan;
+
+/* false when the job needs no device at all: no vaapi/qsv encoder and
+   hw_resident off or the hwaccel isn't vaapi/qsv. Live preview keeps the
+   software path (logged once). */
+bool hw_plan(const Settings *s, bool img, HwPlan *p);
+
+/* Device setup and, when the graph takes surfaces, the decoder options that
+   keep them there; otherwise a plain -hwaccel pair when hwaccel isn't
+   "none". NULL hwaccel for inputs no hw decoder reads (raw pipes). The
+   strings live in p. */
+int append_hw_input_args(char **args, int a, const HwPlan *p, const char *hwaccel);
+
+#endif
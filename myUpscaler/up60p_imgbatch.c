@@ -0,0 +1,282 @@
+#include "up60p_imgbatch.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_filters.h"
+#include "up60p_graph.h"
+#include "up60p_arena.h"
+#include "up60p_hwaccel.h"
+
+static unsigned be16(const unsigned char *p) { return (unsigned)p[0] << 8 | p[1]; }
+static unsigned be32(const unsigned char *p) { return (unsigned)p[0] << 24 | (unsigned)p[1] << 16 | (unsigned)p[2] << 8 | p[3]; }
+static int le32(const unsigned char *p) { return (int)((unsigned)p[0] | (unsigned)p[1] << 8 | (unsigned)p[2] << 16 | (unsigned)p[3] << 24); }
+
+/* Walks the marker segments up to the first start-of-frame; EXIF and ICC
+   blocks in front are skipped by their lengths, not read. */
+static bool read_jpeg_header(FILE *fp, ImageHeader *h) {
+    unsigned char b[8];
+    for (;;) {
+        int c = fgetc(fp);
+        if (c != 0xFF) return false;
+        int m;
+        while ((m = fgetc(fp)) == 0xFF) {}
+        if (m == EOF || m == 0xD9 || m == 0xDA) return false;
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD7)) continue;
+        if (fread(b, 1, 2, fp) != 2) return false;
+        unsigned len = be16(b);
+        if (len < 2) return false;
+        bool sof = m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC;
+        if (!sof) {
+            if (fseek(fp, (long)len - 2, SEEK_CUR) != 0) return false;
+            continue;
+        }
+        // precision, height, width, components, then the first component's sampling
+        if (len < 10 || fread(b, 1, 8, fp) != 8) return false;
+        safe_copy(h->codec, "mjpeg", sizeof(h->codec));
+        h->height = (int)be16(b + 1);
+        h->width = (int)be16(b + 3);
+        h->layout = b[0] << 16 | b[5] << 8 | b[7];
+        return h->width > 0 && h->height > 0;
+    }
+}
+
+bool read_image_header(const char *path, ImageHeader *h) {
+    memset(h, 0, sizeof(*h));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return false;
+    unsigned char b[32];
+    bool ok = false;
+    size_t n = fread(b, 1, 2, fp);
+    if (n == 2 && b[0] == 0xFF && b[1] == 0xD8) {
+        ok = read_jpeg_header(fp, h);
+    } else if (n == 2 && (n += fread(b + 2, 1, sizeof(b) - 2, fp)) >= 30) {
+        if (!memcmp(b, "\x89PNG\r\n\x1a\n", 8) && !memcmp(b + 12, "IHDR", 4)) {
+            safe_copy(h->codec, "png", sizeof(h->codec));
+            h->width = (int)be32(b + 16);
+            h->height = (int)be32(b + 20);
+            h->layout = b[24] << 8 | b[25];     // bit depth, colour type
+            ok = true;
+        } else if (b[0] == 'B' && b[1] == 'M') {
+            safe_copy(h->codec, "bmp", sizeof(h->codec));
+            h->width = le32(b + 18);
+            h->height = abs(le32(b + 22));      // negative is top-down
+            h->layout = b[28] | b[29] << 8;     // bits per pixel
+            ok = true;
+        }
+    }
+    fclose(fp);
+    return ok && h->width > 0 && h->height > 0;
+}
+
+typedef struct {
+    int index;
+    ImageHeader header;
+    const char *out;
+    size_t dirlen;
+} Candidate;
+
+static int compare_candidates(const void *pa, const void *pb) {
+    const Candidate *a = pa, *b = pb;
+    int c = strcmp(a->header.codec, b->header.codec);
+    if (c) return c;
+    if (a->header.width != b->header.width) return a->header.width < b->header.width ? -1 : 1;
+    if (a->header.height != b->header.height) return a->header.height < b->header.height ? -1 : 1;
+    if (a->header.layout != b->header.layout) return a->header.layout < b->header.layout ? -1 : 1;
+    if (a->dirlen != b->dirlen) return a->dirlen < b->dirlen ? -1 : 1;
+    c = strncmp(a->out, b->out, a->dirlen);
+    if (c) return c;
+    return a->index - b->index;
+}
+
+static bool same_group(const Candidate *a, const Candidate *b) {
+    return !strcmp(a->header.codec, b->header.codec) && a->header.width == b->header.width &&
+           a->header.height == b->header.height && a->header.layout == b->header.layout &&
+           a->dirlen == b->dirlen && !strncmp(a->out, b->out, a->dirlen);
+}
+
+static size_t dir_length(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? (size_t)(slash - path) : 0;
+}
+
+int plan_image_batches(const PathList *files, char *const outputs[], int workers, ImageBatch **batches) {
+    *batches = NULL;
+    Candidate *c = malloc((size_t)(files->count ? files->count : 1) * sizeof(*c));
+    if (!c) return 0;
+    int n = 0;
+    for (int i = 0; i < files->count; i++) {
+        if (up60p_is_cancelled()) break;
+        if (!is_image(files->items[i]) || !read_image_header(files->items[i], &c[n].header)) continue;
+        c[n].index = i;
+        c[n].out = outputs[i];
+        c[n].dirlen = dir_length(outputs[i]);
+        n++;
+    }
+    qsort(c, (size_t)n, sizeof(*c), compare_candidates);
+
+    // One chunk size for every group keeps the workers evenly loaded
+    if (workers < 1) workers = 1;
+    int target = (n + workers - 1) / workers;
+    if (target < IMAGE_BATCH_MIN) target = IMAGE_BATCH_MIN;
+    if (target > IMAGE_BATCH_MAX) target = IMAGE_BATCH_MAX;
+
+    int count = 0, cap = 0;
+    for (int start = 0, end; start < n; start = end) {
+        for (end = start + 1; end < n && same_group(&c[start], &c[end]); end++) {}
+        int size = end - start;
+        if (size < IMAGE_BATCH_MIN) continue;
+        int chunks = (size + target - 1) / target;
+        for (int k = 0; k < chunks; k++) {
+            int lo = start + (int)((long long)size * k / chunks);
+            int hi = start + (int)((long long)size * (k + 1) / chunks);
+            if (count == cap) {
+                int grown = cap ? cap * 2 : 16;
+                ImageBatch *b = realloc(*batches, (size_t)grown * sizeof(**batches));
+                if (!b) { free(c); return count; }
+                *batches = b;
+                cap = grown;
+            }
+            ImageBatch *b = &(*batches)[count];
+            b->items = malloc((size_t)(hi - lo) * sizeof(int));
+            if (!b->items) { free(c); return count; }
+            b->count = hi - lo;
+            b->header = c[lo].header;
+            for (int i = lo; i < hi; i++) b->items[i - lo] = c[i].index;
+            count++;
+        }
+    }
+    free(c);
+    return count;
+}
+
+void image_batches_free(ImageBatch *batches, int count) {
+    for (int i = 0; i < count; i++) free(batches[i].items);
+    free(batches);
+}
+
+typedef struct {
+    char *const *inputs;
+    char *const *outputs;
+    const char *ffmpeg;
+    const char *vf;
+    const HwPlan *hw;
+    bool dry_run;
+    bool *done;
+} BatchRun;
+
+/* ffconcat entry; paths are made absolute since the demuxer resolves
+   relative ones against the list's directory */
+static void write_entry(FILE *fp, const char *path) {
+    char cwd[PATH_MAX];
+    fputs("file '", fp);
+    if (path[0] != '/' && getcwd(cwd, sizeof(cwd))) fprintf(fp, "%s/", cwd);
+    for (const char *p = path; *p; p++) {
+        if (*p == '\'') fputs("'\\''", fp);
+        else fputc(*p, fp);
+    }
+    fputs("'\nduration 1\n", fp);
+}
+
+static void remove_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *e;
+        char path[PATH_MAX];
+        while ((e = readdir(d))) {
+            if (e->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/* One ffmpeg over [lo, hi): the concat demuxer feeds the stills as frames
+   of one stream, -vsync 0 keeps one output per input and -xerror stops at
+   the first bad file instead of silently dropping it and shifting the
+   numbering. Results are only moved into place if every one arrived. */
+static bool run_once(BatchRun *r, int lo, int hi) {
+    char dir[PATH_MAX], list[PATH_MAX], pattern[PATH_MAX + 16];
+    size_t dirlen = dir_length(r->outputs[lo]);
+    snprintf(dir, sizeof(dir), "%.*s/.up60p_batch_XXXXXX", (int)dirlen, r->outputs[lo]);
+    if (!r->dry_run && !mkdtemp(dir)) return false;
+    snprintf(list, sizeof(list), "%s/list.ffconcat", dir);
+    snprintf(pattern, sizeof(pattern), "%s/%%06d.png", dir);
+
+    char *args[64]; int a = 0;
+    args[a++] = (char*)r->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error";
+    args[a++] = "-stats"; args[a++] = "-y"; args[a++] = "-xerror";
+    a = append_hw_input_args(args, a, r->hw, S.hwaccel);
+    args[a++] = "-f"; args[a++] = "concat"; args[a++] = "-safe"; args[a++] = "0"; args[a++] = "-i"; args[a++] = list;
+    args[a++] = "-vf"; args[a++] = (char*)r->vf;
+    args[a++] = "-map"; args[a++] = "0:v:0"; args[a++] = "-vsync"; args[a++] = "0";
+    args[a++] = "-f"; args[a++] = "image2"; args[a++] = "-start_number"; args[a++] = "0";
+    args[a++] = pattern;
+    args[a] = NULL;
+
+    if (r->dry_run) {
+        SB cmd = {0};
+        sb_fmt(&cmd, "CMD (%d images): ", hi - lo);
+        for (int i = 0; args[i]; i++) {
+            sb_append(&cmd, args[i]);
+            sb_append(&cmd, " ");
+        }
+        sb_append(&cmd, "\n");
+        log_msg(cmd.buf);
+        free(cmd.buf);
+        for (int i = lo; i < hi; i++) r->done[i] = true;
+        return true;
+    }
+
+    FILE *fp = fopen(list, "w");
+    bool ok = fp != NULL;
+    if (fp) {
+        fputs("ffconcat version 1.0\n", fp);
+        for (int i = lo; i < hi; i++) write_entry(fp, r->inputs[i]);
+        ok = fclose(fp) == 0;
+    }
+    ok = ok && execute_ffmpeg_command(args) == 0;
+
+    char path[PATH_MAX];
+    for (int i = lo; ok && i < hi; i++) {
+        snprintf(path, sizeof(path), "%s/%06d.png", dir, i - lo);
+        ok = access(path, F_OK) == 0;
+    }
+    snprintf(path, sizeof(path), "%s/%06d.png", dir, hi - lo);
+    if (ok && access(path, F_OK) == 0) ok = false;      // more frames than files: numbering is off
+    for (int i = lo; ok && i < hi; i++) {
+        snprintf(path, sizeof(path), "%s/%06d.png", dir, i - lo);
+        r->done[i] = rename(path, r->outputs[i]) == 0;
+    }
+    remove_dir(dir);
+    return ok;
+}
+
+static void run_range(BatchRun *r, int lo, int hi) {
+    if (hi - lo < 2 || up60p_is_cancelled()) return;
+    if (run_once(r, lo, hi) || r->dry_run) return;
+    int mid = lo + (hi - lo) / 2;
+    run_range(r, lo, mid);
+    run_range(r, mid, hi);
+}
+
+void process_image_batch(char *const inputs[], char *const outputs[], int n,
+                         const char *ffmpeg, bool dry_run, bool done[]) {
+    for (int i = 0; i < n; i++) done[i] = false;
+
+    Arena arena = {0};
+    FilterGraph g;
+    fg_init(&g, &arena);
+    build_filter_graph(&S, &g, true);
+    make_frames_independent(&g);
+    SB vf = {0};
+    fg_render(&g, &vf);
+    arena_free(&arena);
+
+    HwPlan hw;
+    bool on_device = hw_plan(&S, true, &hw);
+    BatchRun r = { .inputs = inputs, .outputs = outputs, .ffmpeg = ffmpeg, .vf = vf.buf,
+                   .hw = on_device ? &hw : NULL, .dry_run = dry_run, .done = done };
+    run_range(&r, 0, n);
+    free(vf.buf);
+}
@@ -0,0 +1,42 @@
+#ifndef UP60P_IMGBATCH_H
+#define UP60P_IMGBATCH_H
+
+#include "up60p_common.h"
+#include "up60p_jobs.h"
+
+#define IMAGE_BATCH_MIN 4       /* smaller groups aren't worth a list file */
+#define IMAGE_BATCH_MAX 512     /* images per ffmpeg, bounds the rework after a bad file */
+
+/* What decides whether two stills can share one decoder and filter graph,
+   read from the file header without starting ffmpeg */
+typedef struct {
+    char codec[8];              /* "png", "mjpeg", "bmp" */
+    int width, height;
+    int layout;                 /* bit depth/colour type, components/sampling... per codec */
+} ImageHeader;
+
+/* false for formats it doesn't parse (tiff, webp) or unreadable files */
+bool read_image_header(const char *path, ImageHeader *h);
+
+/* A run of images from one directory listing processed by one ffmpeg.
+   items are indexes into the listing. */
+typedef struct {
+    int *items;
+    int count;
+    ImageHeader header;
+} ImageBatch;
+
+/* Groups the images in files with the same header and output directory
+   into batches, splitting big groups so workers all get some. outputs[i]
+   is where files->items[i] goes. Images left out are processed one by one. */
+int plan_image_batches(const PathList *files, char *const outputs[], int workers, ImageBatch **batches);
+void image_batches_free(ImageBatch *batches, int count);
+
+/* Runs inputs[0..n) through one ffmpeg with the image chain and moves the
+   results to outputs[i]. A failed run is retried in halves, so one broken
+   file costs a few extra runs rather than the batch; done[i] is set for
+   each image that got its output. dry_run logs the command instead. */
+void process_image_batch(char *const inputs[], char *const outputs[], int n,
+                         const char *ffmpeg, bool dry_run, bool done[]);
+
+#endif
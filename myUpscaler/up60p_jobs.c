@@ -0,0 +1,667 @@
+// wait4 and pipe2 sit outside the POSIX level up60p_common.h asks for
+#ifdef __APPLE__
+#define _DARWIN_C_SOURCE
+#else
+#define _GNU_SOURCE
+#endif
+#include "up60p_jobs.h"
+#include "up60p_utils.h"
+#include "up60p_topology.h"
+#include "up60p_memory.h"
+#include "up60p_context.h"
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+
+void path_list_push(PathList *l, const char *path) {
+    if (!l || !path) return;
+    if (l->count == l->cap) {
+        int new_cap = l->cap ? l->cap * 2 : 64;
+        char **tmp = realloc(l->items, (size_t)new_cap * sizeof(*tmp));
+        if (!tmp) return;
+        l->items = tmp;
+        l->cap = new_cap;
+    }
+    char *copy = strdup(path);
+    if (copy) l->items[l->count++] = copy;
+}
+
+void path_list_free(PathList *l) {
+    if (!l) return;
+    for (int i = 0; i < l->count; i++) free(l->items[i]);
+    free(l->items);
+    l->items = NULL;
+    l->count = l->cap = 0;
+}
+
+int up60p_cpu_count(void) {
+    return topology_cpu_count();
+}
+
+int up60p_plan_workers(int requested_jobs, int threads_budget, int njobs, int *threads_per_job) {
+    if (threads_budget <= 0) threads_budget = up60p_cpu_count();
+
+    int workers = requested_jobs;
+    if (workers <= 0) {
+        workers = threads_budget / UP60P_THREADS_PER_JOB_MAX;
+        if (workers < 1) workers = 1;
+    }
+    if (workers > threads_budget) workers = threads_budget;
+    if (workers > njobs) workers = njobs;
+    if (workers < 1) workers = 1;
+
+    if (threads_per_job) {
+        int per = threads_budget / workers;
+        *threads_per_job = per < 1 ? 1 : per;
+    }
+    return workers;
+}
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    int next, count;
+    up60p_task_fn fn;
+    void *ctx;
+    CpuAllot share;         /* the caller's, split across the workers */
+    int workers, slots;
+    bool started;           /* workers is final; set once every thread is up */
+} TaskQueue;
+
+static void *task_worker(void *arg) {
+    TaskQueue *q = arg;
+    pthread_mutex_lock(&q->lock);
+    while (!q->started) pthread_cond_wait(&q->start, &q->lock);
+    int slot = q->slots++, workers = q->workers;
+    pthread_mutex_unlock(&q->lock);
+    CpuAllot mine;
+    cpu_allot_split(&q->share, slot, workers, &mine);
+    set_current_allot(&mine);
+    for (;;) {
+        pthread_mutex_lock(&q->lock);
+        int idx = q->next < q->count ? q->next++ : -1;
+        pthread_mutex_unlock(&q->lock);
+        if (idx < 0) break;
+        q->fn(idx, q->ctx);
+    }
+    return NULL;
+}
+
+/* Tasks are handed out in submission order; the callee is expected to
+   check up60p_is_cancelled() itself so that every index still gets a
+   chance to report its result. Each worker gets its own part of the
+   caller's CPU share for the ffmpeg children its tasks start. */
+void up60p_run_parallel(int workers, int count, up60p_task_fn fn, void *ctx) {
+    if (count <= 0 || !fn) return;
+    if (workers > count) workers = count;
+    if (workers < 1) workers = 1;
+
+    TaskQueue q = { .next = 0, .count = count, .fn = fn, .ctx = ctx, .workers = workers };
+    pthread_mutex_init(&q.lock, NULL);
+    pthread_cond_init(&q.start, NULL);
+    current_allot(&q.share);
+
+    pthread_t *tids = NULL;
+    int started = 0;
+    if (workers > 1) tids = calloc((size_t)workers - 1, sizeof(*tids));
+    if (tids) {
+        for (; started < workers - 1; started++) {
+            if (context_thread_create(&tids[started], task_worker, &q) != 0) break;
+        }
+    }
+
+    // The workers wait for the count, so every one splits the share the
+    // same way; one that failed to start leaves no part idle
+    pthread_mutex_lock(&q.lock);
+    q.workers = started + 1;
+    q.started = true;
+    pthread_cond_broadcast(&q.start);
+    pthread_mutex_unlock(&q.lock);
+    task_worker(&q);
+    set_current_allot(&q.share);
+
+    for (int i = 0; i < started; i++) pthread_join(tids[i], NULL);
+    free(tids);
+    pthread_cond_destroy(&q.start);
+    pthread_mutex_destroy(&q.lock);
+}
+
+/* Long-lived variant of up60p_run_parallel for work issued many times a
+   second (per frame), where spawning threads each round would dominate. */
+struct WorkerPool {
+    pthread_mutex_t lock, run_lock;
+    pthread_cond_t work, done;
+    pthread_t *tids;
+    int nthreads;
+    up60p_task_fn fn;
+    void *ctx;
+    int next, count, finished;
+    bool stop;
+};
+
+/* Called with lock held; returns with it held */
+static void pool_drain(WorkerPool *p) {
+    while (p->next < p->count) {
+        int idx = p->next++;
+        up60p_task_fn fn = p->fn;
+        void *ctx = p->ctx;
+        pthread_mutex_unlock(&p->lock);
+        fn(idx, ctx);
+        pthread_mutex_lock(&p->lock);
+        if (++p->finished == p->count) pthread_cond_broadcast(&p->done);
+    }
+}
+
+static void *pool_worker(void *arg) {
+    WorkerPool *p = arg;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        while (!p->stop && p->next >= p->count) pthread_cond_wait(&p->work, &p->lock);
+        if (p->stop) break;
+        pool_drain(p);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+WorkerPool *pool_create(int threads) {
+    WorkerPool *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_mutex_init(&p->run_lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->done, NULL);
+    // The thread calling pool_run works too
+    if (threads > 1) p->tids = calloc((size_t)threads - 1, sizeof(*p->tids));
+    if (p->tids) {
+        for (; p->nthreads < threads - 1; p->nthreads++) {
+            if (context_thread_create(&p->tids[p->nthreads], pool_worker, p) != 0) break;
+        }
+    }
+    return p;
+}
+
+void pool_run(WorkerPool *p, int count, up60p_task_fn fn, void *ctx) {
+    if (count <= 0 || !fn) return;
+    pthread_mutex_lock(&p->run_lock);
+    pthread_mutex_lock(&p->lock);
+    p->fn = fn;
+    p->ctx = ctx;
+    p->next = p->finished = 0;
+    p->count = count;
+    pthread_cond_broadcast(&p->work);
+    pool_drain(p);
+    while (p->finished < p->count) pthread_cond_wait(&p->done, &p->lock);
+    p->count = p->next = 0;
+    pthread_mutex_unlock(&p->lock);
+    pthread_mutex_unlock(&p->run_lock);
+}
+
+int pool_size(const WorkerPool *p) {
+    return p->nthreads + 1;
+}
+
+void pool_destroy(WorkerPool *p) {
+    if (!p) return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = true;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nthreads; i++) pthread_join(p->tids[i], NULL);
+    free(p->tids);
+    pthread_mutex_destroy(&p->lock);
+    pthread_mutex_destroy(&p->run_lock);
+    pthread_cond_destroy(&p->work);
+    pthread_cond_destroy(&p->done);
+    free(p);
+}
+
+static __thread int thread_job_id;
+
+void set_current_job(int job_id) { thread_job_id = job_id; }
+int current_job_id(void) { return thread_job_id; }
+
+typedef struct {
+    char buf[4096];
+    size_t len;
+} LineBuf;
+
+/* Splits on \n or \r (ffmpeg ends stats lines with \r); a line longer than
+   the buffer is emitted in pieces rather than dropped. */
+static void feed_lines(LineBuf *lb, const char *data, ssize_t n, up60p_line_fn emit, void *ctx) {
+    for (ssize_t i = 0; i < n; i++) {
+        if (data[i] == '\n' || data[i] == '\r' || lb->len == sizeof(lb->buf) - 1) {
+            lb->buf[lb->len] = 0;
+            if (lb->len) emit(lb->buf, ctx);
+            lb->len = 0;
+            if (data[i] == '\n' || data[i] == '\r') continue;
+        }
+        lb->buf[lb->len++] = data[i];
+    }
+}
+
+static void flush_lines(LineBuf *lb, up60p_line_fn emit, void *ctx) {
+    if (!lb->len) return;
+    lb->buf[lb->len] = 0;
+    emit(lb->buf, ctx);
+    lb->len = 0;
+}
+
+typedef struct {
+    up60p_progress p;
+    long long last_ms;
+} ProgressState;
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* One key=value line of -progress output; "progress=" closes a block. */
+static void progress_line(const char *line, void *ctx) {
+    ProgressState *ps = ctx;
+    const char *eq = strchr(line, '=');
+    if (!eq) return;
+    size_t klen = (size_t)(eq - line);
+    const char *v = eq + 1;
+    bool na = !strncmp(v, "N/A", 3);
+#define KEY(k) (klen == sizeof(k) - 1 && !strncmp(line, k, klen))
+    if (KEY("frame")) ps->p.frame = atoll(v);
+    else if (KEY("fps")) ps->p.fps = atof(v);
+    else if (KEY("out_time_us") || KEY("out_time_ms")) ps->p.out_time_us = na ? -1 : atoll(v);  // _ms is microseconds too
+    else if (KEY("bitrate")) ps->p.bitrate_kbps = na ? -1 : atof(v);
+    else if (KEY("speed")) ps->p.speed = na ? -1 : atof(v);
+    else if (KEY("dup_frames")) ps->p.dup_frames = atoll(v);
+    else if (KEY("drop_frames")) ps->p.drop_frames = atoll(v);
+    else if (KEY("total_size")) ps->p.total_size = na ? -1 : atoll(v);
+    else if (KEY("progress")) {
+        ps->p.finished = !strcmp(v, "end");
+        long long now = monotonic_ms();
+        if (ps->p.finished || now - ps->last_ms >= UP60P_PROGRESS_INTERVAL_MS) {
+            ps->last_ms = now;
+            publish_progress(&ps->p);
+        }
+    }
+#undef KEY
+}
+
+#define PROGRESS_FD 3
+
+#ifdef __APPLE__
+// Without pipe2 a fork could land between pipe() and fcntl(); the two
+// are done under the lock our forks take
+static pthread_mutex_t fork_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int cloexec_pipe(int fds[2]) {
+#ifdef __APPLE__
+    pthread_mutex_lock(&fork_lock);
+    int rc = pipe(fds);
+    if (rc == 0) {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    }
+    pthread_mutex_unlock(&fork_lock);
+    return rc;
+#else
+    return pipe2(fds, O_CLOEXEC);
+#endif
+}
+
+static pid_t fork_child(void) {
+#ifdef __APPLE__
+    pthread_mutex_lock(&fork_lock);
+    pid_t pid = fork();
+    // The child only execs, and never looks at the lock
+    if (pid != 0) pthread_mutex_unlock(&fork_lock);
+    return pid;
+#else
+    return fork();
+#endif
+}
+
+/* Children lead their own process group, so a signal reaches whatever
+   they started (pipe_cmd's shell and its command) and the terminal's
+   Ctrl-C reaches only us, to cancel through the job. */
+static void own_process_group(void) {
+    setpgid(0, 0);
+}
+
+// Also set from the parent, in case it signals before the child ran setpgid
+static void child_started(pid_t pid) {
+    if (pid > 0) setpgid(pid, pid);
+}
+
+void signal_child(pid_t pid, int sig) {
+    if (pid <= 0) return;
+    if (kill(-pid, sig) < 0) kill(pid, sig);
+}
+
+/* Stops a child once its job is cancelled: SIGTERM so ffmpeg can finalize,
+   SIGKILL if it's still there UP60P_KILL_GRACE_MS later. Returns whether
+   the child has been told to stop. */
+typedef struct {
+    bool termed, killed;
+    long long term_ms;
+} ChildStop;
+
+static bool stop_if_cancelled(pid_t pid, ChildStop *cs) {
+    if (!cs->termed && up60p_is_cancelled()) {
+        signal_child(pid, SIGTERM);
+        cs->termed = true;
+        cs->term_ms = monotonic_ms();
+    } else if (cs->termed && !cs->killed && monotonic_ms() - cs->term_ms >= UP60P_KILL_GRACE_MS) {
+        signal_child(pid, SIGKILL);
+        cs->killed = true;
+    }
+    return cs->termed;
+}
+
+/* waitpid that keeps watching for a cancel, so a child that outlives its
+   pipes can't hold the job up; every child is reaped here. */
+static int reap_child(pid_t pid, int *status, struct rusage *ru, ChildStop *cs) {
+    long nap_ns = 1000000;
+    for (;;) {
+        pid_t r = wait4(pid, status, WNOHANG, ru);
+        if (r == pid) return 0;
+        if (r < 0 && errno != EINTR) return -1;
+        if (r == 0) {
+            stop_if_cancelled(pid, cs);
+            struct timespec nap = { 0, nap_ns };
+            nanosleep(&nap, NULL);
+            if (nap_ns < 50000000) nap_ns *= 2;
+        }
+    }
+}
+
+/* stdin_fd, if >= 0, becomes the child's stdin and is closed in the parent.
+   mem, if set, is the child's admitted reservation: its RSS is sampled
+   into it while it runs and its peak filled in at exit. */
+static int run_child(char *const argv[], up60p_line_fn on_line, void *ctx, bool want_progress, int stdin_fd,
+                     MemTicket *mem) {
+    int stdout_pipe[2];
+    int stderr_pipe[2];
+    int progress_pipe[2] = { -1, -1 };
+    pid_t pid;
+    int status;
+    
+    // Reroute stats to a private -progress pipe when someone is listening
+    char *pargv[256];
+    int argc = 0;
+    while (argv[argc]) argc++;
+    if (want_progress && progress_wanted() && argc + 3 < ARR_LEN(pargv) && cloexec_pipe(progress_pipe) == 0) {
+        int n = 0;
+        pargv[n++] = argv[0];
+        pargv[n++] = "-progress"; pargv[n++] = "pipe:3";
+        for (int i = 1; i < argc; i++) pargv[n++] = !strcmp(argv[i], "-stats") ? "-nostats" : argv[i];
+        pargv[n] = NULL;
+        argv = pargv;
+        argc = n;
+    }
+    bool progress = progress_pipe[0] >= 0;
+    
+    // ffmpeg sizes its decoder and filter threads by every CPU it can see,
+    // which is the whole host under a cgroup quota and for each of several
+    // jobs sharing it; a smaller share is passed on explicitly
+    CpuAllot allot;
+    current_allot(&allot);
+    char *targv[256], filter_threads[16], decode_threads[16];
+    bool explicit = false;
+    for (int i = 1; i < argc; i++) explicit |= !strcmp(argv[i], "-filter_threads");
+    if (!explicit && allot.ncpus < (int)sysconf(_SC_NPROCESSORS_ONLN) && argc + 7 < ARR_LEN(targv)) {
+        // Decoding is a small part of these chains; frame threads cost a frame each
+        snprintf(filter_threads, sizeof(filter_threads), "%d", allot.ncpus);
+        snprintf(decode_threads, sizeof(decode_threads), "%d", allot.ncpus > 1 ? allot.ncpus / 2 : 1);
+        int n = 0;
+        bool decoder = true;
+        targv[n++] = argv[0];
+        targv[n++] = "-filter_threads"; targv[n++] = filter_threads;
+        targv[n++] = "-filter_complex_threads"; targv[n++] = filter_threads;
+        for (int i = 1; i < argc; i++) {
+            if (decoder && !strcmp(argv[i], "-i")) {
+                targv[n++] = "-threads"; targv[n++] = decode_threads;
+                decoder = false;
+            }
+            targv[n++] = argv[i];
+        }
+        targv[n] = NULL;
+        argv = targv;
+    }
+    
+    if (cloexec_pipe(stdout_pipe) < 0) {
+        if (progress) { close(progress_pipe[0]); close(progress_pipe[1]); }
+        if (stdin_fd >= 0) close(stdin_fd);
+        return -1;
+    }
+    if (cloexec_pipe(stderr_pipe) < 0) {
+        close(stdout_pipe[0]);
+        close(stdout_pipe[1]);
+        if (progress) { close(progress_pipe[0]); close(progress_pipe[1]); }
+        if (stdin_fd >= 0) close(stdin_fd);
+        return -1;
+    }
+    
+    pid = fork_child();
+    if (pid == 0) {
+        own_process_group();
+        apply_allot(&allot);
+        // Out of the terminal's foreground group, a tty stdin would stop ffmpeg
+        if (stdin_fd < 0) stdin_fd = open("/dev/null", O_RDONLY);
+        if (stdin_fd >= 0) {
+            dup2(stdin_fd, STDIN_FILENO);
+            close(stdin_fd);
+        }
+        dup2(stdout_pipe[1], STDOUT_FILENO);
+        dup2(stderr_pipe[1], STDERR_FILENO);
+        close(stdout_pipe[0]);
+        close(stdout_pipe[1]);
+        close(stderr_pipe[0]);
+        close(stderr_pipe[1]);
+        if (progress) {
+            close(progress_pipe[0]);
+            if (progress_pipe[1] != PROGRESS_FD) {
+                dup2(progress_pipe[1], PROGRESS_FD);
+                close(progress_pipe[1]);
+            } else {
+                // dup2 would have cleared close-on-exec; nothing did
+                fcntl(PROGRESS_FD, F_SETFD, 0);
+            }
+        }
+        
+        execvp(argv[0], argv);
+        
+        // exec failed
+        fprintf(stderr, "execvp failed: %s (%d)\n", strerror(errno), errno);
+        _exit(127);
+    }
+    
+    child_started(pid);
+    close(stdout_pipe[1]);
+    close(stderr_pipe[1]);
+    if (progress) close(progress_pipe[1]);
+    if (stdin_fd >= 0) close(stdin_fd);
+    
+    if (pid < 0) {
+        fprintf(stderr, "fork failed: %s (%d)\n", strerror(errno), errno);
+        close(stdout_pipe[0]);
+        close(stderr_pipe[0]);
+        if (progress) close(progress_pipe[0]);
+        return -1;
+    }
+    
+    char buf[1024];
+    LineBuf err_lines = { .len = 0 }, prog_lines = { .len = 0 };
+    ProgressState ps = { .p = { .job_id = current_job_id() } };
+    int err_fd = stderr_pipe[0], prog_fd = progress ? progress_pipe[0] : -1;
+    ssize_t n;
+    ChildStop stop = { 0 };
+    long long sampled_ms = 0;
+    
+    // Poll so a cancel request reaches the child even while ffmpeg is silent
+    while (err_fd >= 0 || prog_fd >= 0) {
+        stop_if_cancelled(pid, &stop);
+        if (mem && monotonic_ms() - sampled_ms >= 250) {
+            mem_observe(mem, mem_process_rss_mb(pid));
+            sampled_ms = monotonic_ms();
+        }
+        
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        if (err_fd >= 0) FD_SET(err_fd, &rfds);
+        if (prog_fd >= 0) FD_SET(prog_fd, &rfds);
+        struct timeval tv = { 0, 250000 };
+        int ready = select((err_fd > prog_fd ? err_fd : prog_fd) + 1, &rfds, NULL, NULL, &tv);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (ready == 0) continue;
+        
+        if (prog_fd >= 0 && FD_ISSET(prog_fd, &rfds)) {
+            n = read(prog_fd, buf, sizeof(buf));
+            if (n <= 0) { close(prog_fd); prog_fd = -1; }
+            else feed_lines(&prog_lines, buf, n, progress_line, &ps);
+        }
+        if (err_fd >= 0 && FD_ISSET(err_fd, &rfds)) {
+            n = read(err_fd, buf, sizeof(buf) - 1);
+            if (n <= 0) { close(err_fd); err_fd = -1; continue; }
+            buf[n] = 0;
+            if (on_line) feed_lines(&err_lines, buf, n, on_line, ctx);
+            else log_msg(buf);
+        }
+    }
+    if (on_line) flush_lines(&err_lines, on_line, ctx);
+    flush_lines(&prog_lines, progress_line, &ps);
+    
+    close(stdout_pipe[0]);
+    if (err_fd >= 0) close(err_fd);
+    if (prog_fd >= 0) close(prog_fd);
+    
+    struct rusage ru;
+    if (reap_child(pid, &status, &ru, &stop) < 0) return -1;
+    // A run cut short says nothing about what the whole job needs
+    if (mem && WIFEXITED(status) && WEXITSTATUS(status) == 0 && !stop.termed) {
+#ifdef __APPLE__
+        mem->peak_mb = ru.ru_maxrss / (1024.0 * 1024.0);
+#else
+        mem->peak_mb = ru.ru_maxrss / 1024.0;
+#endif
+    }
+    
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    
+    return -1;
+}
+
+/* Encodes of a job with a memory estimate wait for room in the budget */
+static int run_admitted(char *const argv[], int stdin_fd) {
+    MemEstimate est;
+    if (!mem_job(current_job_id(), &est)) return run_child(argv, NULL, NULL, true, stdin_fd, NULL);
+    MemTicket ticket;
+    if (!mem_admit(&est, &ticket)) {
+        if (stdin_fd >= 0) close(stdin_fd);
+        return -1;
+    }
+    int result = run_child(argv, NULL, NULL, true, stdin_fd, &ticket);
+    mem_release(&ticket);
+    return result;
+}
+
+int execute_ffmpeg_command(char *const argv[]) {
+    return run_admitted(argv, -1);
+}
+
+int execute_ffmpeg_unmetered(char *const argv[]) {
+    return run_child(argv, NULL, NULL, true, -1, NULL);
+}
+
+/* Encoder end of a pipeline: like execute_ffmpeg_command with stdin_fd as
+   the child's stdin. Takes ownership of stdin_fd. */
+int execute_ffmpeg_feed(char *const argv[], int stdin_fd) {
+    return run_admitted(argv, stdin_fd);
+}
+
+/* Like execute_ffmpeg_command but hands stderr to on_line one line at a time
+   instead of forwarding it to the log, for probes whose output is parsed. */
+int execute_ffmpeg_capture(char *const argv[], up60p_line_fn on_line, void *ctx) {
+    return run_child(argv, on_line, ctx, false, -1, NULL);
+}
+
+/* Starts argv with stdout on a pipe for the caller to read raw frames from;
+   stderr is discarded, so callers pass -loglevel error or quieter. */
+pid_t spawn_ffmpeg_reader(char *const argv[], int *stdout_fd) {
+    int out_pipe[2];
+    if (cloexec_pipe(out_pipe) < 0) return -1;
+    
+    CpuAllot allot;
+    current_allot(&allot);
+    pid_t pid = fork_child();
+    if (pid == 0) {
+        own_process_group();
+        apply_allot(&allot);
+        int devnull = open("/dev/null", O_RDWR);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        if (devnull >= 0) { dup2(devnull, STDIN_FILENO); dup2(devnull, STDERR_FILENO); close(devnull); }
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    child_started(pid);
+    close(out_pipe[1]);
+    if (pid < 0) {
+        close(out_pipe[0]);
+        return -1;
+    }
+    *stdout_fd = out_pipe[0];
+    return pid;
+}
+
+/* Starts a filter stage with both ends piped: the caller writes to
+   *stdin_fd and reads *stdout_fd. stderr stays with ours so the tool's own
+   diagnostics are visible. */
+pid_t spawn_filter_process(char *const argv[], int *stdin_fd, int *stdout_fd) {
+    int in_pipe[2], out_pipe[2];
+    if (cloexec_pipe(in_pipe) < 0) return -1;
+    if (cloexec_pipe(out_pipe) < 0) {
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return -1;
+    }
+    
+    CpuAllot allot;
+    current_allot(&allot);
+    pid_t pid = fork_child();
+    if (pid == 0) {
+        own_process_group();
+        apply_allot(&allot);
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        close(in_pipe[0]);
+        close(out_pipe[1]);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    child_started(pid);
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    if (pid < 0) {
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        return -1;
+    }
+    *stdin_fd = in_pipe[1];
+    *stdout_fd = out_pipe[0];
+    return pid;
+}
+
+int wait_child(pid_t pid) {
+    int status;
+    ChildStop stop = { 0 };
+    if (reap_child(pid, &status, NULL, &stop) < 0) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
@@ -0,0 +1,62 @@
+#ifndef UP60P_JOBS_H
+#define UP60P_JOBS_H
+
+#include "up60p_common.h"
+
+/* bm3d / minterpolate stop scaling somewhere past 8-12 threads, so a
+   single ffmpeg child is never handed more than this by the planner. */
+#define UP60P_THREADS_PER_JOB_MAX 8
+
+typedef struct {
+    char **items;
+    int count, cap;
+} PathList;
+
+typedef void (*up60p_task_fn)(int index, void *ctx);
+typedef void (*up60p_line_fn)(const char *line, void *ctx);
+
+void path_list_push(PathList *l, const char *path);
+void path_list_free(PathList *l);
+
+int up60p_cpu_count(void);
+
+int up60p_plan_workers(int requested_jobs, int threads_budget, int njobs, int *threads_per_job);
+
+void up60p_run_parallel(int workers, int count, up60p_task_fn fn, void *ctx);
+
+/* Persistent threads for per-frame work. pool_run blocks until every index
+   has run; concurrent callers take turns. */
+typedef struct WorkerPool WorkerPool;
+WorkerPool *pool_create(int threads);
+void pool_run(WorkerPool *p, int count, up60p_task_fn fn, void *ctx);
+int pool_size(const WorkerPool *p);
+void pool_destroy(WorkerPool *p);
+
+/* Job id stamped on progress reports from ffmpeg children started by this
+   thread; workers that run on behalf of a job inherit it explicitly. */
+void set_current_job(int job_id);
+int current_job_id(void);
+
+int execute_ffmpeg_command(char *const argv[]);
+/* A job's side runs (remux, reference renders, probe encodes, first passes):
+   not admitted against the job's memory estimate, and not learned from */
+int execute_ffmpeg_unmetered(char *const argv[]);
+int execute_ffmpeg_capture(char *const argv[], up60p_line_fn on_line, void *ctx);
+int execute_ffmpeg_feed(char *const argv[], int stdin_fd);
+
+/* pipe() with both ends close-on-exec from the start (pipe2, or under the
+   lock the jobs module's forks take). Other threads fork while we set up
+   a child, and an end leaking into one of their children holds the pipe
+   open, so EOF never arrives; dup2 onto a child's stdio clears it. */
+int cloexec_pipe(int fds[2]);
+
+/* Children run in their own process group, and the calls that wait on
+   them stop them when the job is cancelled (SIGTERM, then SIGKILL after
+   UP60P_KILL_GRACE_MS); spawned ones are stopped and reaped by wait_child. */
+pid_t spawn_ffmpeg_reader(char *const argv[], int *stdout_fd);
+pid_t spawn_filter_process(char *const argv[], int *stdin_fd, int *stdout_fd);
+int wait_child(pid_t pid);
+/* sig to pid's process group */
+void signal_child(pid_t pid, int sig);
+
+#endif
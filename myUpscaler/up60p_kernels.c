@@ -0,0 +1,600 @@
+#include "up60p_kernels.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define KERNELS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define KERNELS_NEON 1
+#endif
+
+/* Rows a kernel reads around each output pixel; ref_radius -1 means it
+   takes no reference frame. linear kernels see linear-light rows. */
+typedef struct {
+    int radius, ref_radius;
+    bool linear;
+} KernelInfo;
+
+static const KernelInfo kernel_info[KERNEL_COUNT] = {
+    [UP60P_KERNEL_CAS_SHARPEN] = { 1, -1, false },
+    [UP60P_KERNEL_DEBAND_DITHER] = { 2, -1, false },
+    [UP60P_KERNEL_BLUE_NOISE_DEBAND] = { 1, -1, false },
+    [UP60P_KERNEL_BILATERAL_DENOISE] = { 2, -1, false },
+    [UP60P_KERNEL_DEHALO] = { 1, -1, false },
+    [UP60P_KERNEL_MOIRE_SUPPRESS] = { 1, -1, false },
+    [UP60P_KERNEL_DRIFT_GUARD] = { 1, 1, false },
+    [UP60P_KERNEL_TEMPORAL_SMOOTH] = { 0, 0, true },
+};
+
+/* Its deband reach comes on top, per call */
+static const KernelInfo fused_info = { 1, -1, false };
+
+/* ---- Scalar set: VW 1, also finishes every SIMD row ---- */
+
+static inline float kmin(float a, float b) { return a < b ? a : b; }
+static inline float kmax(float a, float b) { return a > b ? a : b; }
+static inline float kpow2i(float i) {
+    uint32_t bits = (uint32_t)((int)i + 127) << 23;
+    float v;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+#define V float
+#define VW 1
+#define KATTR
+#define KNAME(n) n##_scalar
+#define VLOAD(p) (*(p))
+#define VSTORE(p, v) (*(p) = (v))
+#define VSET(f) (f)
+#define VADD(a, b) ((a) + (b))
+#define VSUB(a, b) ((a) - (b))
+#define VMUL(a, b) ((a) * (b))
+#define VDIV(a, b) ((a) / (b))
+#define VMIN(a, b) kmin(a, b)
+#define VMAX(a, b) kmax(a, b)
+#define VABS(a) fabsf(a)
+#define VFLOOR(a) floorf(a)
+#define VPOW2I(i) kpow2i(i)
+#define VLOAD_U8(p) ((float)*(p))
+#define VLOAD_U16(p) ((float)*(p))
+#define VSTORE_U8(p, v) (*(p) = (uint8_t)(v))
+#define VSTORE_U16(p, v) (*(p) = (uint16_t)(v))
+#include "up60p_kernels_row.h"
+
+#ifdef KERNELS_X86
+/* ---- SSE4.1 (floor, packus_epi32, cvtepu8/16) ---- */
+
+__attribute__((target("sse4.1")))
+static inline __m128 u8x4_to_ps_sse4(const uint8_t *p) {
+    int32_t v;
+    memcpy(&v, p, 4);
+    return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(v)));
+}
+
+__attribute__((target("sse4.1")))
+static inline void ps_to_u8x4_sse4(uint8_t *p, __m128 v) {
+    __m128i w = _mm_packus_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128());
+    int32_t b = _mm_cvtsi128_si32(_mm_packus_epi16(w, w));
+    memcpy(p, &b, 4);
+}
+
+#define V __m128
+#define VW 4
+#define KATTR __attribute__((target("sse4.1")))
+#define KNAME(n) n##_sse4
+#define VLOAD(p) _mm_loadu_ps(p)
+#define VSTORE(p, v) _mm_storeu_ps(p, v)
+#define VSET(f) _mm_set1_ps(f)
+#define VADD(a, b) _mm_add_ps(a, b)
+#define VSUB(a, b) _mm_sub_ps(a, b)
+#define VMUL(a, b) _mm_mul_ps(a, b)
+#define VDIV(a, b) _mm_div_ps(a, b)
+#define VMIN(a, b) _mm_min_ps(a, b)
+#define VMAX(a, b) _mm_max_ps(a, b)
+#define VABS(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define VFLOOR(a) _mm_floor_ps(a)
+#define VPOW2I(i) _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(i), _mm_set1_epi32(127)), 23))
+#define VLOAD_U8(p) u8x4_to_ps_sse4(p)
+#define VLOAD_U16(p) _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)(p))))
+#define VSTORE_U8(p, v) ps_to_u8x4_sse4(p, v)
+#define VSTORE_U16(p, v) _mm_storel_epi64((__m128i*)(p), _mm_packus_epi32(_mm_cvttps_epi32(v), _mm_setzero_si128()))
+#include "up60p_kernels_row.h"
+
+/* ---- AVX2 ---- */
+
+__attribute__((target("avx2")))
+static inline __m128i pack_u16_avx2(__m256 v) {
+    __m256i i = _mm256_cvttps_epi32(v);
+    return _mm_packus_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+}
+
+#define V __m256
+#define VW 8
+#define KATTR __attribute__((target("avx2")))
+#define KNAME(n) n##_avx2
+#define VLOAD(p) _mm256_loadu_ps(p)
+#define VSTORE(p, v) _mm256_storeu_ps(p, v)
+#define VSET(f) _mm256_set1_ps(f)
+#define VADD(a, b) _mm256_add_ps(a, b)
+#define VSUB(a, b) _mm256_sub_ps(a, b)
+#define VMUL(a, b) _mm256_mul_ps(a, b)
+#define VDIV(a, b) _mm256_div_ps(a, b)
+#define VMIN(a, b) _mm256_min_ps(a, b)
+#define VMAX(a, b) _mm256_max_ps(a, b)
+#define VABS(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define VFLOOR(a) _mm256_floor_ps(a)
+#define VPOW2I(i) _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(i), _mm256_set1_epi32(127)), 23))
+#define VLOAD_U8(p) _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p))))
+#define VLOAD_U16(p) _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(p))))
+#define VSTORE_U8(p, v) _mm_storel_epi64((__m128i*)(p), _mm_packus_epi16(pack_u16_avx2(v), _mm_setzero_si128()))
+#define VSTORE_U16(p, v) _mm_storeu_si128((__m128i*)(p), pack_u16_avx2(v))
+#include "up60p_kernels_row.h"
+#endif
+
+#ifdef KERNELS_NEON
+/* ---- NEON (AArch64: vrndm, vdiv) ---- */
+
+static inline float32x4_t u8x4_to_f32_neon(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(v)))));
+}
+
+static inline void f32_to_u8x4_neon(uint8_t *p, float32x4_t v) {
+    uint16x4_t w = vmovn_u32(vcvtq_u32_f32(v));
+    uint32_t b = vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(w, w))), 0);
+    memcpy(p, &b, 4);
+}
+
+#define V float32x4_t
+#define VW 4
+#define KATTR
+#define KNAME(n) n##_neon
+#define VLOAD(p) vld1q_f32(p)
+#define VSTORE(p, v) vst1q_f32(p, v)
+#define VSET(f) vdupq_n_f32(f)
+#define VADD(a, b) vaddq_f32(a, b)
+#define VSUB(a, b) vsubq_f32(a, b)
+#define VMUL(a, b) vmulq_f32(a, b)
+#define VDIV(a, b) vdivq_f32(a, b)
+#define VMIN(a, b) vminq_f32(a, b)
+#define VMAX(a, b) vmaxq_f32(a, b)
+#define VABS(a) vabsq_f32(a)
+#define VFLOOR(a) vrndmq_f32(a)
+#define VPOW2I(i) vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(i), vdupq_n_s32(127)), 23))
+#define VLOAD_U8(p) u8x4_to_f32_neon(p)
+#define VLOAD_U16(p) vcvtq_f32_u32(vmovl_u16(vld1_u16(p)))
+#define VSTORE_U8(p, v) f32_to_u8x4_neon(p, v)
+#define VSTORE_U16(p, v) vst1_u16(p, vmovn_u32(vcvtq_u32_f32(v)))
+#include "up60p_kernels_row.h"
+#endif
+
+const RowKernels *scalar_row_kernels(void) { return &row_kernels_scalar; }
+
+const RowKernels *pick_row_kernels(void) {
+    static const RowKernels *kernels;
+    if (kernels) return kernels;
+#if defined(KERNELS_X86)
+    kernels = __builtin_cpu_supports("avx2") ? &row_kernels_avx2
+            : __builtin_cpu_supports("sse4.1") ? &row_kernels_sse4 : &row_kernels_scalar;
+#elif defined(KERNELS_NEON)
+    kernels = &row_kernels_neon;
+#else
+    kernels = &row_kernels_scalar;
+#endif
+    return kernels;
+}
+
+/* ---- Strip driver ---- */
+
+/* Either image layout as the strip loop sees it: planar has step 1 or 2
+   bytes per pixel, packed 3 or 6 with the planes offset by one sample. */
+typedef struct {
+    uint8_t *base[3];
+    ptrdiff_t stride[3];
+    int step;
+    int depth;
+} View;
+
+/* Padded float rows for one worker: the source ring (2 * span + 1 rows),
+   three reference rows and the output row, each as R, G, B planes. */
+typedef struct KernelScratch {
+    struct KernelScratch *next;
+    int width, nrows;
+    size_t pitch;             /* floats per padded plane row */
+    float *rows;
+} KernelScratch;
+
+struct up60p_kernels {
+    WorkerPool *pool;
+    pthread_mutex_t lock;     /* guards scratch and the decode tables */
+    KernelScratch *scratch;
+    float *to_linear[17];     /* sRGB sample -> linear, per depth, built on first use */
+    float to_srgb[SRGB_LUT_SIZE + 1];
+};
+
+typedef struct {
+    up60p_kernels *k;
+    up60p_kernel kind;
+    const KernelInfo *info;
+    const RowKernels *simd, *scalar;
+    kernel_row_fn simd_fn, scalar_fn;
+    const float *to_linear;
+    const FusedParams *fused;
+    View src, ref, dst;
+    int width, height;
+    int span, strip_rows;     /* source rows needed above and below each output row */
+    float p[2], c[4];
+    bool failed;
+} KernelJob;
+
+static float srgb_to_linear(double v) {
+    return (float)(v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4));
+}
+
+static float linear_to_srgb(double v) {
+    return (float)(v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055);
+}
+
+static const float *decode_table(up60p_kernels *k, int depth) {
+    pthread_mutex_lock(&k->lock);
+    if (!k->to_linear[depth]) {
+        int n = 1 << depth;
+        float *t = malloc((size_t)n * sizeof(float));
+        if (t) for (int i = 0; i < n; i++) t[i] = srgb_to_linear((double)i / (n - 1));
+        k->to_linear[depth] = t;
+    }
+    const float *t = k->to_linear[depth];
+    pthread_mutex_unlock(&k->lock);
+    return t;
+}
+
+static inline float encode_srgb(const float *lut, float v) {
+    float f = (v < 0 ? 0 : v > 1 ? 1 : v) * SRGB_LUT_SIZE;
+    int i = (int)f;
+    if (i >= SRGB_LUT_SIZE) return lut[SRGB_LUT_SIZE];
+    return lut[i] + (lut[i + 1] - lut[i]) * (f - (float)i);
+}
+
+static void free_scratch(KernelScratch *sc) {
+    if (!sc) return;
+    free(sc->rows);
+    free(sc);
+}
+
+static KernelScratch *take_scratch(up60p_kernels *k, int width, int nrows) {
+    pthread_mutex_lock(&k->lock);
+    KernelScratch **link = &k->scratch, *found = NULL;
+    while (*link) {
+        KernelScratch *sc = *link;
+        *link = sc->next;
+        if (sc->width == width && sc->nrows == nrows) { found = sc; break; }
+        free_scratch(sc);
+    }
+    pthread_mutex_unlock(&k->lock);
+    if (found) return found;
+
+    KernelScratch *sc = calloc(1, sizeof(*sc));
+    if (!sc) return NULL;
+    sc->width = width;
+    sc->nrows = nrows;
+    // Round up so SIMD rows start on a 32-byte boundary after the pad
+    sc->pitch = ((size_t)width + 2 * KERNEL_PAD + 7) & ~(size_t)7;
+    sc->rows = malloc(sc->pitch * 3 * (size_t)nrows * sizeof(float));
+    if (!sc->rows) { free(sc); return NULL; }
+    return sc;
+}
+
+static void give_scratch(up60p_kernels *k, KernelScratch *sc) {
+    pthread_mutex_lock(&k->lock);
+    sc->next = k->scratch;
+    k->scratch = sc;
+    pthread_mutex_unlock(&k->lock);
+}
+
+static inline float *scratch_row(KernelScratch *sc, int slot, int c) {
+    return sc->rows + (size_t)(slot * 3 + c) * sc->pitch + KERNEL_PAD;
+}
+
+static inline int ring_slot(int row, int size) { return ((row % size) + size) % size; }
+
+static void load_row(const KernelJob *j, const View *v, int y, float *const d[3]) {
+    int w = j->width;
+    y = y < 0 ? 0 : y >= j->height ? j->height - 1 : y;
+    bool deep = v->depth > 8;
+    int max = (1 << v->depth) - 1;
+    float k = 1.0f / (float)max;
+    for (int c = 0; c < 3; c++) {
+        const uint8_t *p = v->base[c] + (ptrdiff_t)y * v->stride[c];
+        float *o = d[c];
+        int x = 0;
+        if (j->to_linear) {
+            for (; x < w; x++) {
+                uint16_t u = p[(ptrdiff_t)x * v->step];
+                if (deep) memcpy(&u, p + (ptrdiff_t)x * v->step, 2);
+                o[x] = j->to_linear[u < max ? u : max];
+            }
+        } else if (v->step == 1) {
+            x = j->simd->load_u8(p, o, 0, w, k);
+            j->scalar->load_u8(p, o, x, w, k);
+        } else if (v->step == 2) {
+            x = j->simd->load_u16((const uint16_t*)(const void*)p, o, 0, w, k);
+            j->scalar->load_u16((const uint16_t*)(const void*)p, o, x, w, k);
+        } else {
+            for (; x < w; x++) {
+                const uint8_t *s = p + (ptrdiff_t)x * v->step;
+                uint16_t u = *s;
+                if (deep) memcpy(&u, s, 2);
+                o[x] = (float)u * k;
+            }
+        }
+        for (int i = 1; i <= KERNEL_PAD; i++) {
+            o[-i] = o[0];
+            o[w - 1 + i] = o[w - 1];
+        }
+    }
+}
+
+static void store_row(const KernelJob *j, int y, float *const s[3]) {
+    const View *v = &j->dst;
+    int w = j->width;
+    bool deep = v->depth > 8;
+    float top = (float)((1 << v->depth) - 1);
+    for (int c = 0; c < 3; c++) {
+        uint8_t *p = v->base[c] + (ptrdiff_t)y * v->stride[c];
+        float *o = s[c];
+        if (j->to_linear)
+            for (int x = 0; x < w; x++) o[x] = encode_srgb(j->k->to_srgb, o[x]);
+        if (v->step == 1) {
+            int x = j->simd->store_u8(o, p, 0, w, top);
+            j->scalar->store_u8(o, p, x, w, top);
+        } else if (v->step == 2) {
+            int x = j->simd->store_u16(o, (uint16_t*)(void*)p, 0, w, top);
+            j->scalar->store_u16(o, (uint16_t*)(void*)p, x, w, top);
+        } else {
+            for (int x = 0; x < w; x++) {
+                float f = o[x];
+                f = (f < 0 ? 0 : f > 1 ? 1 : f) * top + 0.5f;
+                uint8_t *d = p + (ptrdiff_t)x * v->step;
+                if (deep) { uint16_t u = (uint16_t)f; memcpy(d, &u, 2); }
+                else *d = (uint8_t)f;
+            }
+        }
+    }
+}
+
+/* Grain rows start at a per-frame, per-row offset into one shared table */
+static inline const float *noise_row(const FusedParams *fp, int y) {
+    uint32_t h = fp->seed * 0x9E3779B1u ^ (uint32_t)y * 0x85EBCA77u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 13;
+    return fp->noise + h % NOISE_SHIFT;
+}
+
+/* Each strip reloads its own halo rows, so strips share nothing and the
+   ring stays at a handful of rows however tall the frame is. */
+static void run_strip(int strip, void *ctx) {
+    KernelJob *j = ctx;
+    int span = j->span, ring = 2 * span + 1;
+    int y0 = strip * j->strip_rows;
+    int y1 = y0 + j->strip_rows < j->height ? y0 + j->strip_rows : j->height;
+    KernelScratch *sc = take_scratch(j->k, j->width, ring + 4);
+    if (!sc) { __atomic_store_n(&j->failed, true, __ATOMIC_RELAXED); return; }
+
+    int r = j->info->radius, rr = j->info->ref_radius;
+    float *d[3];
+    for (int y = y0 - span; y < y0 + span; y++) {
+        for (int c = 0; c < 3; c++) d[c] = scratch_row(sc, ring_slot(y, ring), c);
+        load_row(j, &j->src, y, d);
+    }
+    for (int y = y0 - rr; rr >= 0 && y < y0 + rr; y++) {
+        for (int c = 0; c < 3; c++) d[c] = scratch_row(sc, ring + ring_slot(y, 3), c);
+        load_row(j, &j->ref, y, d);
+    }
+
+    KernelRow row = { .p = { j->p[0], j->p[1] }, .k = { j->c[0], j->c[1], j->c[2], j->c[3] } };
+    for (int c = 0; c < 3; c++) row.dst[c] = scratch_row(sc, ring + 3, c);
+    for (int y = y0; y < y1; y++) {
+        for (int c = 0; c < 3; c++) d[c] = scratch_row(sc, ring_slot(y + span, ring), c);
+        load_row(j, &j->src, y + span, d);
+        if (rr >= 0) {
+            for (int c = 0; c < 3; c++) d[c] = scratch_row(sc, ring + ring_slot(y + rr, 3), c);
+            load_row(j, &j->ref, y + rr, d);
+        }
+        // Rows outside the radius alias the nearest loaded one
+        for (int i = -2; i <= 2; i++) {
+            int dy = i < -r ? -r : i > r ? r : i;
+            for (int c = 0; c < 3; c++) row.src[i + 2][c] = scratch_row(sc, ring_slot(y + dy, ring), c);
+        }
+        for (int i = -1; rr >= 0 && i <= 1; i++) {
+            int dy = i < -rr ? -rr : i > rr ? rr : i;
+            for (int c = 0; c < 3; c++) row.ref[i + 1][c] = scratch_row(sc, ring + ring_slot(y + dy, 3), c);
+        }
+        if (j->fused) {
+            row.reach = j->fused->deband_reach;
+            for (int c = 0; c < 3; c++) {
+                row.far[0][c] = scratch_row(sc, ring_slot(y - row.reach, ring), c);
+                row.far[1][c] = scratch_row(sc, ring_slot(y + row.reach, ring), c);
+            }
+            row.noise = noise_row(j->fused, y);
+        }
+        int x = j->simd_fn(&row, 0, j->width);
+        j->scalar_fn(&row, x, j->width);
+        store_row(j, y, row.dst);
+    }
+    give_scratch(j->k, sc);
+}
+
+/* Clamps params to the ranges the Metal kernels assume and derives the
+   per-kernel constants; degenerate settings become an exact pass-through. */
+static void prepare_params(KernelJob *j, const float *in) {
+    float a = in[0], b = in[1];
+    float *p = j->p, *c = j->c;
+    p[0] = a;
+    p[1] = b;
+    switch (j->kind) {
+    case UP60P_KERNEL_CAS_SHARPEN:
+    case UP60P_KERNEL_TEMPORAL_SMOOTH:
+        p[0] = a < 0 ? 0 : a > 1 ? 1 : a;
+        break;
+    case UP60P_KERNEL_DEBAND_DITHER:
+    case UP60P_KERNEL_BLUE_NOISE_DEBAND:
+    case UP60P_KERNEL_DRIFT_GUARD:
+        if (!(a > 0)) { p[0] = 1; p[1] = 0; }
+        c[0] = 1.0f / p[0];
+        c[1] = 1.0f / (4.0f * p[0]);
+        break;
+    case UP60P_KERNEL_BILATERAL_DENOISE:
+        if (a > 0 && b > 0) {
+            c[0] = -1.0f / fmaxf(2.0f * a * a, 1e-4f);
+            c[1] = -1.0f / fmaxf(2.0f * b * b, 1e-4f);
+            c[2] = fminf(fmaxf(1.0f - b * 4.0f, 0.0f), 0.5f);
+        } else {
+            c[0] = c[1] = -1.0f;
+            c[2] = 1.0f;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static View view_of_image(const up60p_image *im) {
+    View v = { .step = im->depth > 8 ? 2 : 1, .depth = im->depth };
+    for (int c = 0; c < 3; c++) {
+        v.base[c] = im->plane[c];
+        v.stride[c] = im->stride[c];
+    }
+    return v;
+}
+
+static View view_of_frame(const up60p_frame *f) {
+    int sample = f->bytes_per_pixel / 3;
+    View v = { .step = f->bytes_per_pixel, .depth = sample == 2 ? 16 : 8 };
+    for (int c = 0; c < 3; c++) {
+        v.base[c] = f->data + c * sample;
+        v.stride[c] = f->stride;
+    }
+    return v;
+}
+
+static bool views_overlap(const View *a, const View *b, int height) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            const uint8_t *a0 = a->base[i], *b0 = b->base[j];
+            const uint8_t *a1 = a0 + (ptrdiff_t)height * a->stride[i];
+            const uint8_t *b1 = b0 + (ptrdiff_t)height * b->stride[j];
+            if (a0 < b1 && b0 < a1) return true;
+        }
+    }
+    return false;
+}
+
+/* Strips grow with the reach so halo reloads stay a small share of the work */
+static up60p_error run_strips(KernelJob *j) {
+    j->simd_fn = j->fused ? j->simd->fused : j->simd->op[j->kind];
+    j->scalar_fn = j->fused ? j->scalar->fused : j->scalar->op[j->kind];
+    j->span = j->info->radius;
+    if (j->fused && j->fused->deband_reach > j->span) j->span = j->fused->deband_reach;
+    j->strip_rows = 4 * j->span > KERNEL_STRIP_ROWS ? 4 * j->span : KERNEL_STRIP_ROWS;
+    pool_run(j->k->pool, (j->height + j->strip_rows - 1) / j->strip_rows, run_strip, j);
+    return j->failed ? UP60P_ERR_INTERNAL : UP60P_OK;
+}
+
+static up60p_error run_job(up60p_kernels *k, const up60p_kernel_op *op, View src, const View *ref,
+                           View dst, int width, int height) {
+    if ((unsigned)op->kind >= KERNEL_COUNT || width < 1 || height < 1) return UP60P_ERR_INVALID_OPTIONS;
+    if (src.depth < 8 || src.depth > 16 || dst.depth != src.depth) return UP60P_ERR_INVALID_OPTIONS;
+    if (views_overlap(&src, &dst, height)) return UP60P_ERR_INVALID_OPTIONS;
+
+    KernelJob j = {
+        .k = k, .kind = op->kind, .info = &kernel_info[op->kind],
+        .simd = pick_row_kernels(), .scalar = scalar_row_kernels(),
+        .src = src, .dst = dst, .width = width, .height = height
+    };
+    if (j.info->ref_radius >= 0) {
+        if (!ref || ref->depth != src.depth || views_overlap(ref, &dst, height)) return UP60P_ERR_INVALID_OPTIONS;
+        j.ref = *ref;
+    }
+    if (j.info->linear && !(j.to_linear = decode_table(k, src.depth))) return UP60P_ERR_INTERNAL;
+    prepare_params(&j, op->params);
+    return run_strips(&j);
+}
+
+static bool image_ok(const up60p_image *im, const up60p_image *like) {
+    return im && im->plane[0] && im->plane[1] && im->plane[2] &&
+           im->width == like->width && im->height == like->height;
+}
+
+up60p_error up60p_kernels_apply(up60p_kernels *k, const up60p_kernel_op *op,
+                                const up60p_image *src, const up60p_image *ref, up60p_image *dst) {
+    if (!k || !op || !src || !image_ok(src, src) || !image_ok(dst, src)) return UP60P_ERR_INVALID_OPTIONS;
+    View rv, *rp = NULL;
+    if (ref && image_ok(ref, src)) { rv = view_of_image(ref); rp = &rv; }
+    return run_job(k, op, view_of_image(src), rp, view_of_image(dst), src->width, src->height);
+}
+
+static bool frame_ok(const up60p_frame *f, const up60p_frame *like) {
+    return f && f->data && (f->bytes_per_pixel == 3 || f->bytes_per_pixel == 6) &&
+           f->width == like->width && f->height == like->height;
+}
+
+up60p_error up60p_kernels_apply_frame(up60p_kernels *k, const up60p_kernel_op *op,
+                                      const up60p_frame *src, const up60p_frame *ref, up60p_frame *dst) {
+    if (!k || !op || !src || !frame_ok(src, src) || !frame_ok(dst, src)) return UP60P_ERR_INVALID_OPTIONS;
+    View rv, *rp = NULL;
+    if (ref && frame_ok(ref, src)) { rv = view_of_frame(ref); rp = &rv; }
+    return run_job(k, op, view_of_frame(src), rp, view_of_frame(dst), src->width, src->height);
+}
+
+up60p_error kernels_apply_fused(up60p_kernels *k, const FusedParams *fp,
+                                const up60p_frame *src, up60p_frame *dst) {
+    if (!k || !fp || !fp->noise || !frame_ok(src, src) || !frame_ok(dst, src) ||
+        dst->bytes_per_pixel != src->bytes_per_pixel) return UP60P_ERR_INVALID_OPTIONS;
+    if (fp->deband_reach < 1 || fp->deband_reach > KERNEL_MAX_REACH) return UP60P_ERR_INVALID_OPTIONS;
+    View sv = view_of_frame(src), dv = view_of_frame(dst);
+    if (views_overlap(&sv, &dv, src->height)) return UP60P_ERR_INVALID_OPTIONS;
+
+    KernelJob j = {
+        .k = k, .info = &fused_info, .fused = fp,
+        .simd = pick_row_kernels(), .scalar = scalar_row_kernels(),
+        .src = sv, .dst = dv, .width = src->width, .height = src->height
+    };
+    float th = fp->deband_threshold > 0 ? fp->deband_threshold : 1.0f;
+    j.p[0] = th;
+    j.p[1] = fp->grain > 0 ? fp->grain : 0;
+    j.c[0] = 4.0f * (fp->sharpen < 0 ? 0 : fp->sharpen > 1 ? 1 : fp->sharpen);
+    j.c[1] = 1.0f / th;
+    j.c[2] = 1.0f / (4.0f * th);
+    j.c[3] = fp->deband_threshold > 0 ? 1.0f : 0.0f;
+    return run_strips(&j);
+}
+
+up60p_kernels *up60p_kernels_create(int threads) {
+    up60p_kernels *k = calloc(1, sizeof(*k));
+    if (!k) return NULL;
+    k->pool = pool_create(threads > 0 ? threads : up60p_cpu_count());
+    if (!k->pool) { free(k); return NULL; }
+    pthread_mutex_init(&k->lock, NULL);
+    for (int i = 0; i <= SRGB_LUT_SIZE; i++) k->to_srgb[i] = linear_to_srgb((double)i / SRGB_LUT_SIZE);
+    return k;
+}
+
+void up60p_kernels_destroy(up60p_kernels *k) {
+    if (!k) return;
+    pool_destroy(k->pool);
+    while (k->scratch) {
+        KernelScratch *next = k->scratch->next;
+        free_scratch(k->scratch);
+        k->scratch = next;
+    }
+    for (int i = 0; i < ARR_LEN(k->to_linear); i++) free(k->to_linear[i]);
+    pthread_mutex_destroy(&k->lock);
+    free(k);
+}
@@ -0,0 +1,59 @@
+#ifndef UP60P_KERNELS_H
+#define UP60P_KERNELS_H
+
+#include "up60p_common.h"
+
+#define KERNEL_COUNT (UP60P_KERNEL_TEMPORAL_SMOOTH + 1)
+#define KERNEL_STRIP_ROWS 32   /* output rows per task; keeps the row ring in L2 */
+#define KERNEL_MAX_REACH 16    /* farthest sample of the fused deband, in pixels */
+#define KERNEL_PAD KERNEL_MAX_REACH   /* replicated columns on each side of a loaded row */
+#define NOISE_SHIFT 1024       /* grain table slack for per-row random offsets */
+#define SRGB_LUT_SIZE 4096     /* linear -> sRGB segments, interpolated */
+
+/* One output row's view of the float rows around it. src[2] is the row
+   being produced; rows and columns outside a kernel's radius may not be
+   loaded. Values are 0..1 in planar R, G, B order. */
+typedef struct {
+    const float *src[5][3];   /* rows y-2 .. y+2 */
+    const float *ref[3][3];   /* rows y-1 .. y+1 of the reference frame */
+    const float *far[2][3];   /* rows y-reach and y+reach (fused deband) */
+    int reach;
+    const float *noise;       /* grain for this row, -0.5..0.5 (fused) */
+    float *dst[3];
+    float p[2];               /* up60p_kernel_op.params, validated */
+    float k[4];               /* constants derived from p, per kernel */
+} KernelRow;
+
+typedef int (*kernel_row_fn)(const KernelRow *row, int x, int n);
+
+/* One instruction set's row kernels and sample converters; each covers
+   whole vectors from x and returns where the scalar set should resume. */
+typedef struct {
+    kernel_row_fn op[KERNEL_COUNT];
+    kernel_row_fn fused;
+    int (*load_u8)(const uint8_t *p, float *d, int x, int n, float k);
+    int (*load_u16)(const uint16_t *p, float *d, int x, int n, float k);
+    int (*store_u8)(const float *s, uint8_t *p, int x, int n, float top);
+    int (*store_u16)(const float *s, uint16_t *p, int x, int n, float top);
+} RowKernels;
+
+/* The post-scale stages that fuse into one pass, already in 0..1 units */
+typedef struct {
+    float sharpen;            /* CAS sharpness 0..1, 0 = off */
+    float deband_threshold;   /* luma difference still treated as banding, 0 = off */
+    int deband_reach;         /* distance of the four diagonal samples, <= KERNEL_MAX_REACH */
+    float grain;              /* peak-to-peak grain amplitude, 0 = off */
+    const float *noise;       /* width + NOISE_SHIFT values in -0.5..0.5 */
+    uint32_t seed;            /* picks this frame's grain row offsets */
+} FusedParams;
+
+/* Sharpen -> deband -> grain -> clamp over packed frames, one read and one
+   write of each pixel; src and dst must not overlap. */
+up60p_error kernels_apply_fused(up60p_kernels *k, const FusedParams *fp,
+                                const up60p_frame *src, up60p_frame *dst);
+
+/* Widest set the CPU supports, and the scalar set that finishes rows */
+const RowKernels *pick_row_kernels(void);
+const RowKernels *scalar_row_kernels(void);
+
+#endif
@@ -0,0 +1,308 @@
+/* Row kernels, written once against a small vector vocabulary and compiled
+   per instruction set by up60p_kernels.c. Not a standalone header: the
+   includer defines V (vector type), VW (lanes), KATTR (target attribute),
+   KNAME(name) (suffixes the ISA) and the V* operations used below; all
+   of them are undefined again at the end.
+
+   Each kernel covers whole vectors in [x, n) and returns where it stopped;
+   the scalar build (VW 1) finishes the row. Math follows Shaders.ci.metal
+   so the Linux path matches the CoreImage one. */
+
+#define VSMOOTH(x, e0, inv) KNAME(smoothstep)(x, VSET(e0), VSET(inv))
+#define VMIX(a, b, t) VADD(a, VMUL(VSUB(b, a), t))
+#define VCLAMP(v, lo, hi) VMIN(VMAX(v, lo), hi)
+#define VLUMA(r, g, b) VADD(VADD(VMUL(r, VSET(0.299f)), VMUL(g, VSET(0.587f))), VMUL(b, VSET(0.114f)))
+#define SRC(dy, c, dx) VLOAD(a->src[2 + (dy)][c] + x + (dx))
+#define REF(dy, c, dx) VLOAD(a->ref[1 + (dy)][c] + x + (dx))
+
+KATTR static inline V KNAME(smoothstep)(V x, V e0, V inv) {
+    V t = VCLAMP(VMUL(VSUB(x, e0), inv), VSET(0.0f), VSET(1.0f));
+    return VMUL(VMUL(t, t), VSUB(VSET(3.0f), VADD(t, t)));
+}
+
+/* e^x for x <= 0: 2^(x log2 e) split into 2^int (exponent bits) and a
+   degree-5 polynomial for 2^frac, ~1e-7 relative error */
+KATTR static inline V KNAME(exp_neg)(V x) {
+    V t = VMUL(VMAX(x, VSET(-87.0f)), VSET(1.44269504f));
+    V i = VFLOOR(t);
+    V f = VSUB(t, i);
+    V p = VSET(1.33336e-3f);
+    p = VADD(VMUL(p, f), VSET(9.61813e-3f));
+    p = VADD(VMUL(p, f), VSET(5.55041e-2f));
+    p = VADD(VMUL(p, f), VSET(2.40227e-1f));
+    p = VADD(VMUL(p, f), VSET(6.93147e-1f));
+    p = VADD(VMUL(p, f), VSET(1.0f));
+    return VMUL(p, VPOW2I(i));
+}
+
+/* p[0] sharpness 0..1 */
+KATTR static int KNAME(cas_sharpen)(const KernelRow *a, int x, int n) {
+    const V s4 = VSET(a->p[0] * 4.0f);
+    for (; x + VW <= n; x += VW) {
+        V e[3], hp[3], lo[3], hi[3];
+        for (int c = 0; c < 3; c++) {
+            V b = SRC(-1, c, 0), d = SRC(0, c, -1), f = SRC(0, c, 1), h = SRC(1, c, 0);
+            e[c] = SRC(0, c, 0);
+            V mn = VMIN(VMIN(VMIN(d, e[c]), VMIN(f, b)), h);
+            V mx = VMAX(VMAX(VMAX(d, e[c]), VMAX(f, b)), h);
+            V ca = SRC(-1, c, -1), cc = SRC(-1, c, 1), cg = SRC(1, c, -1), ci = SRC(1, c, 1);
+            V mn2 = VMIN(VMIN(VMIN(ca, cc), VMIN(cg, ci)), mn);
+            V mx2 = VMAX(VMAX(VMAX(ca, cc), VMAX(cg, ci)), mx);
+            lo[c] = VMUL(VADD(mn, mn2), VSET(0.5f));
+            hi[c] = VMUL(VADD(mx, mx2), VSET(0.5f));
+            hp[c] = VSUB(e[c], VMUL(VADD(VADD(b, d), VADD(f, h)), VSET(0.25f)));
+        }
+        V contrast = VSUB(VLUMA(hi[0], hi[1], hi[2]), VLUMA(lo[0], lo[1], lo[2]));
+        V gain = VMUL(s4, VSUB(VSET(1.0f), VSMOOTH(contrast, 0.15f, 1.0f / 0.45f)));
+        for (int c = 0; c < 3; c++)
+            VSTORE(a->dst[c] + x, VCLAMP(VADD(e[c], VMUL(hp[c], gain)), VSET(0.0f), VSET(1.0f)));
+    }
+    return x;
+}
+
+/* p[0] threshold, p[1] amount; k[0] = 1 / threshold, k[1] = 1 / (4 threshold) */
+KATTR static int KNAME(deband_dither)(const KernelRow *a, int x, int n) {
+    const float th = a->p[0];
+    for (; x + VW <= n; x += VW) {
+        V ctr[3], avg[3], d12[3], d34[3];
+        for (int c = 0; c < 3; c++) {
+            V s1 = SRC(-2, c, -2), s2 = SRC(-2, c, 2), s3 = SRC(2, c, -2), s4 = SRC(2, c, 2);
+            ctr[c] = SRC(0, c, 0);
+            avg[c] = VMUL(VADD(VADD(s1, s2), VADD(s3, s4)), VSET(0.25f));
+            d12[c] = VSUB(s1, s2);
+            d34[c] = VSUB(s3, s4);
+        }
+        V diff = VABS(VSUB(VLUMA(ctr[0], ctr[1], ctr[2]), VLUMA(avg[0], avg[1], avg[2])));
+        V var = VADD(VABS(VLUMA(d12[0], d12[1], d12[2])), VABS(VLUMA(d34[0], d34[1], d34[2])));
+        V flat = VSUB(VSET(1.0f), VSMOOTH(var, th * 2.0f, a->k[1]));
+        V band = VSUB(VSET(1.0f), VSMOOTH(diff, 0.0f, a->k[0]));
+        V t = VCLAMP(VMUL(VSET(a->p[1]), VMUL(band, flat)), VSET(0.0f), VSET(1.0f));
+        for (int c = 0; c < 3; c++) VSTORE(a->dst[c] + x, VMIX(ctr[c], avg[c], t));
+    }
+    return x;
+}
+
+/* p[0] threshold, p[1] amount; k[0] = 1 / threshold */
+KATTR static int KNAME(blue_noise_deband)(const KernelRow *a, int x, int n) {
+    for (; x + VW <= n; x += VW) {
+        V ctr[3], avg[3], dmax = VSET(0.0f);
+        for (int c = 0; c < 3; c++) {
+            ctr[c] = SRC(0, c, 0);
+            avg[c] = VMUL(VADD(VADD(SRC(-1, c, -1), SRC(1, c, 1)), ctr[c]), VSET(1.0f / 3.0f));
+            dmax = VMAX(dmax, VABS(VSUB(ctr[c], avg[c])));
+        }
+        V f = VSUB(VSET(1.0f), VSMOOTH(dmax, 0.0f, a->k[0]));
+        V t = VCLAMP(VMUL(VSET(a->p[1]), f), VSET(0.0f), VSET(1.0f));
+        for (int c = 0; c < 3; c++) VSTORE(a->dst[c] + x, VMIX(ctr[c], avg[c], t));
+    }
+    return x;
+}
+
+/* p[0] sigma_spatial, p[1] sigma_range; k[0] = -1 / (2 sigma_spatial^2),
+   k[1] = -1 / (2 sigma_range^2), k[2] = share of the original mixed back */
+KATTR static int KNAME(bilateral_denoise)(const KernelRow *a, int x, int n) {
+    for (; x + VW <= n; x += VW) {
+        V ctr[3], sum[3] = { VSET(0.0f), VSET(0.0f), VSET(0.0f) }, wsum = VSET(0.0f);
+        for (int c = 0; c < 3; c++) ctr[c] = SRC(0, c, 0);
+        for (int dy = -2; dy <= 2; dy++) {
+            for (int dx = -2; dx <= 2; dx++) {
+                V s[3], d2 = VSET(0.0f);
+                for (int c = 0; c < 3; c++) {
+                    s[c] = SRC(dy, c, dx);
+                    V d = VSUB(ctr[c], s[c]);
+                    d2 = VADD(d2, VMUL(d, d));
+                }
+                V w = KNAME(exp_neg)(VADD(VSET((float)(dx * dx + dy * dy) * a->k[0]), VMUL(d2, VSET(a->k[1]))));
+                for (int c = 0; c < 3; c++) sum[c] = VADD(sum[c], VMUL(s[c], w));
+                wsum = VADD(wsum, w);
+            }
+        }
+        // The centre tap has weight 1, so wsum >= 1
+        V inv = VDIV(VSET(1.0f), wsum);
+        for (int c = 0; c < 3; c++) VSTORE(a->dst[c] + x, VMIX(VMUL(sum[c], inv), ctr[c], VSET(a->k[2])));
+    }
+    return x;
+}
+
+/* p[0] strength */
+KATTR static int KNAME(dehalo)(const KernelRow *a, int x, int n) {
+    const V s = VSET(a->p[0]);
+    for (; x + VW <= n; x += VW) {
+        for (int c = 0; c < 3; c++) {
+            V ctr = SRC(0, c, 0), tl = SRC(-1, c, -1), br = SRC(1, c, 1);
+            V ring = VMUL(VADD(VADD(SRC(0, c, -1), SRC(0, c, 1)), VADD(SRC(-1, c, 0), SRC(1, c, 0))), VSET(0.25f));
+            V lo = VMIN(VMIN(ring, ctr), VMIN(tl, br));
+            V hi = VMAX(VMAX(ring, ctr), VMAX(tl, br));
+            V halo = VCLAMP(VSUB(ctr, ring), VSET(0.0f), VSET(1.0f));
+            VSTORE(a->dst[c] + x, VMIX(ctr, VCLAMP(VSUB(ctr, halo), lo, hi), s));
+        }
+    }
+    return x;
+}
+
+/* p[0] strength */
+KATTR static int KNAME(moire_suppress)(const KernelRow *a, int x, int n) {
+    const V s = VSET(a->p[0]);
+    for (; x + VW <= n; x += VW) {
+        for (int c = 0; c < 3; c++) {
+            V ctr = SRC(0, c, 0);
+            V diag = VADD(VADD(SRC(1, c, 1), SRC(-1, c, -1)), VADD(SRC(1, c, -1), SRC(-1, c, 1)));
+            V cross = VADD(VADD(SRC(0, c, 1), SRC(0, c, -1)), VADD(SRC(1, c, 0), SRC(-1, c, 0)));
+            V smooth = VMUL(VADD(cross, diag), VSET(0.125f));
+            VSTORE(a->dst[c] + x, VMIX(ctr, smooth, s));
+        }
+    }
+    return x;
+}
+
+/* Sum of |luma step| to the four direct neighbours */
+#define DETAIL(AT, ctr) \
+    VADD(VADD(VABS(VSUB(VLUMA(AT(0, 0, -1), AT(0, 1, -1), AT(0, 2, -1)), ctr)), \
+              VABS(VSUB(VLUMA(AT(0, 0, 1), AT(0, 1, 1), AT(0, 2, 1)), ctr))), \
+         VADD(VABS(VSUB(VLUMA(AT(-1, 0, 0), AT(-1, 1, 0), AT(-1, 2, 0)), ctr)), \
+              VABS(VSUB(VLUMA(AT(1, 0, 0), AT(1, 1, 0), AT(1, 2, 0)), ctr))))
+
+/* src is the AI output, ref the baseline; p[0] threshold, p[1] amount,
+   k[0] = 1 / threshold */
+KATTR static int KNAME(drift_guard)(const KernelRow *a, int x, int n) {
+    const V eps = VSET(1e-3f);
+    for (; x + VW <= n; x += VW) {
+        V s[3], b[3], dmax = VSET(0.0f);
+        for (int c = 0; c < 3; c++) {
+            s[c] = SRC(0, c, 0);
+            b[c] = REF(0, c, 0);
+            dmax = VMAX(dmax, VABS(VSUB(s[c], b[c])));
+        }
+        V sl = VLUMA(s[0], s[1], s[2]), bl = VLUMA(b[0], b[1], b[2]);
+        V sd = DETAIL(SRC, sl), bd = DETAIL(REF, bl);
+        V ratio = VDIV(VADD(bd, eps), VADD(sd, eps));
+        V detail = VCLAMP(VSUB(ratio, VSET(1.0f)), VSET(0.0f), VSET(1.0f));
+        V guard = VSMOOTH(dmax, a->p[0], a->k[0]);
+        V t = VMUL(VMUL(guard, detail), VSET(a->p[1]));
+        for (int c = 0; c < 3; c++) VSTORE(a->dst[c] + x, VMIX(s[c], b[c], t));
+    }
+    return x;
+}
+
+/* Rows arrive in linear light (see KernelInfo.linear); ref is the previous
+   frame, p[0] strength 0..1 */
+KATTR static int KNAME(temporal_smooth)(const KernelRow *a, int x, int n) {
+    const V s = VSET(a->p[0]);
+    for (; x + VW <= n; x += VW)
+        for (int c = 0; c < 3; c++) VSTORE(a->dst[c] + x, VMIX(SRC(0, c, 0), REF(0, c, 0), s));
+    return x;
+}
+
+#define FAR(i, c, dx) VLOAD(a->far[i][c] + x + (dx))
+
+/* Post-scale chain in one pass (FusedParams): cas_sharpen, then
+   deband_dither widened to samples at +-reach, then grain and the final
+   clamp. The deband tests and averages the unsharpened input; where it
+   acts the area is flat and CAS leaves it nearly untouched anyway.
+   k[0] 4 * sharpness, k[1] 1 / threshold, k[2] 1 / (4 threshold),
+   k[3] deband amount (0 or 1), p[0] threshold, p[1] grain amplitude */
+KATTR static int KNAME(fused_post)(const KernelRow *a, int x, int n) {
+    const int d = a->reach;
+    const V s4 = VSET(a->k[0]), grain = VSET(a->p[1]);
+    for (; x + VW <= n; x += VW) {
+        V e[3], hp[3], lo[3], hi[3], avg[3], d12[3], d34[3];
+        for (int c = 0; c < 3; c++) {
+            V b = SRC(-1, c, 0), dl = SRC(0, c, -1), f = SRC(0, c, 1), h = SRC(1, c, 0);
+            e[c] = SRC(0, c, 0);
+            V mn = VMIN(VMIN(VMIN(dl, e[c]), VMIN(f, b)), h);
+            V mx = VMAX(VMAX(VMAX(dl, e[c]), VMAX(f, b)), h);
+            V ca = SRC(-1, c, -1), cc = SRC(-1, c, 1), cg = SRC(1, c, -1), ci = SRC(1, c, 1);
+            lo[c] = VMUL(VADD(mn, VMIN(VMIN(VMIN(ca, cc), VMIN(cg, ci)), mn)), VSET(0.5f));
+            hi[c] = VMUL(VADD(mx, VMAX(VMAX(VMAX(ca, cc), VMAX(cg, ci)), mx)), VSET(0.5f));
+            hp[c] = VSUB(e[c], VMUL(VADD(VADD(b, dl), VADD(f, h)), VSET(0.25f)));
+
+            V s1 = FAR(0, c, -d), s2 = FAR(0, c, d), s3 = FAR(1, c, -d), s4c = FAR(1, c, d);
+            avg[c] = VMUL(VADD(VADD(s1, s2), VADD(s3, s4c)), VSET(0.25f));
+            d12[c] = VSUB(s1, s2);
+            d34[c] = VSUB(s3, s4c);
+        }
+        V contrast = VSUB(VLUMA(hi[0], hi[1], hi[2]), VLUMA(lo[0], lo[1], lo[2]));
+        V gain = VMUL(s4, VSUB(VSET(1.0f), VSMOOTH(contrast, 0.15f, 1.0f / 0.45f)));
+
+        V diff = VABS(VSUB(VLUMA(e[0], e[1], e[2]), VLUMA(avg[0], avg[1], avg[2])));
+        V var = VADD(VABS(VLUMA(d12[0], d12[1], d12[2])), VABS(VLUMA(d34[0], d34[1], d34[2])));
+        V flat = VSUB(VSET(1.0f), VSMOOTH(var, a->p[0] * 2.0f, a->k[2]));
+        V band = VSUB(VSET(1.0f), VSMOOTH(diff, 0.0f, a->k[1]));
+        V t = VMUL(VSET(a->k[3]), VMUL(band, flat));
+
+        V g = VMUL(VLOAD(a->noise + x), grain);
+        for (int c = 0; c < 3; c++) {
+            V v = VMIX(VADD(e[c], VMUL(hp[c], gain)), avg[c], t);
+            VSTORE(a->dst[c] + x, VCLAMP(VADD(v, g), VSET(0.0f), VSET(1.0f)));
+        }
+    }
+    return x;
+}
+
+/* Sample conversion: v / top on load; clamp, scale and round on store */
+KATTR static int KNAME(load_u8)(const uint8_t *p, float *d, int x, int n, float k) {
+    for (; x + VW <= n; x += VW) VSTORE(d + x, VMUL(VLOAD_U8(p + x), VSET(k)));
+    return x;
+}
+
+KATTR static int KNAME(load_u16)(const uint16_t *p, float *d, int x, int n, float k) {
+    for (; x + VW <= n; x += VW) VSTORE(d + x, VMUL(VLOAD_U16(p + x), VSET(k)));
+    return x;
+}
+
+KATTR static int KNAME(store_u8)(const float *s, uint8_t *p, int x, int n, float top) {
+    for (; x + VW <= n; x += VW)
+        VSTORE_U8(p + x, VADD(VMUL(VCLAMP(VLOAD(s + x), VSET(0.0f), VSET(1.0f)), VSET(top)), VSET(0.5f)));
+    return x;
+}
+
+KATTR static int KNAME(store_u16)(const float *s, uint16_t *p, int x, int n, float top) {
+    for (; x + VW <= n; x += VW)
+        VSTORE_U16(p + x, VADD(VMUL(VCLAMP(VLOAD(s + x), VSET(0.0f), VSET(1.0f)), VSET(top)), VSET(0.5f)));
+    return x;
+}
+
+static const RowKernels KNAME(row_kernels) = {
+    .op = {
+        [UP60P_KERNEL_CAS_SHARPEN] = KNAME(cas_sharpen),
+        [UP60P_KERNEL_DEBAND_DITHER] = KNAME(deband_dither),
+        [UP60P_KERNEL_BLUE_NOISE_DEBAND] = KNAME(blue_noise_deband),
+        [UP60P_KERNEL_BILATERAL_DENOISE] = KNAME(bilateral_denoise),
+        [UP60P_KERNEL_DEHALO] = KNAME(dehalo),
+        [UP60P_KERNEL_MOIRE_SUPPRESS] = KNAME(moire_suppress),
+        [UP60P_KERNEL_DRIFT_GUARD] = KNAME(drift_guard),
+        [UP60P_KERNEL_TEMPORAL_SMOOTH] = KNAME(temporal_smooth),
+    },
+    .fused = KNAME(fused_post),
+    .load_u8 = KNAME(load_u8), .load_u16 = KNAME(load_u16),
+    .store_u8 = KNAME(store_u8), .store_u16 = KNAME(store_u16),
+};
+
+#undef VSMOOTH
+#undef VMIX
+#undef VCLAMP
+#undef VLUMA
+#undef SRC
+#undef REF
+#undef DETAIL
+#undef FAR
+#undef V
+#undef VW
+#undef KATTR
+#undef KNAME
+#undef VLOAD
+#undef VSTORE
+#undef VSET
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VMIN
+#undef VMAX
+#undef VABS
+#undef VFLOOR
+#undef VPOW2I
+#undef VLOAD_U8
+#undef VLOAD_U16
+#undef VSTORE_U8
+#undef VSTORE_U16
@@ -0,0 +1,674 @@
+#include "up60p_libav.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+
+#ifdef UP60P_HAVE_LIBAV
+
+#include <math.h>
+#include <pthread.h>
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/display.h>
+#include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+
+typedef struct LibavSession {
+    struct LibavSession *next;
+    AVCodecContext *dec;
+    AVCodecParameters *dec_par;
+    AVCodecContext *enc;
+} LibavSession;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static LibavSession *pool;
+
+/* One source audio track, decoded and re-encoded to AAC as the CLI does */
+typedef struct {
+    int ostream;                /* -1 = not carried over */
+    AVCodecContext *dec, *enc;
+    AVFilterGraph *graph;       /* built from the first decoded frame */
+    AVFilterContext *src, *sink;
+} LibavAudio;
+
+typedef struct {
+    LibavSession *s;
+    const LibavEncodeParams *p;
+    const char *filters;
+    const char *out;
+
+    AVFormatContext *ifmt, *ofmt;
+    AVCodecContext *dec, *enc;
+    AVFilterGraph *graph;
+    AVFilterContext *src, *sink;
+    AVFrame *frame, *filt;
+    AVFrame *aframe;            /* audio's own: pending audio is drained mid-video-frame */
+    AVPacket *pkt, *enc_pkt;
+
+    int vstream, ovstream;
+    LibavAudio *audio;          /* per input stream */
+    AVPacket **pending;
+    int npending, cap_pending;
+    bool header_written;
+
+    int64_t frames, t0, last_report;
+} LibavFile;
+
+bool libav_available(void) { return true; }
+
+static LibavSession *session_acquire(void) {
+    pthread_mutex_lock(&pool_lock);
+    LibavSession *s = pool;
+    if (s) pool = s->next;
+    pthread_mutex_unlock(&pool_lock);
+    if (!s) {
+        s = calloc(1, sizeof(*s));
+        if (s) s->dec_par = avcodec_parameters_alloc();
+    }
+    return s;
+}
+
+static void session_release(LibavSession *s) {
+    if (!s) return;
+    pthread_mutex_lock(&pool_lock);
+    s->next = pool;
+    pool = s;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void session_free(LibavSession *s) {
+    avcodec_free_context(&s->dec);
+    avcodec_free_context(&s->enc);
+    avcodec_parameters_free(&s->dec_par);
+    free(s);
+}
+
+void libav_shutdown(void) {
+    pthread_mutex_lock(&pool_lock);
+    while (pool) {
+        LibavSession *s = pool;
+        pool = s->next;
+        session_free(s);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static void log_averror(const char *what, const char *path, int err) {
+    char e[AV_ERROR_MAX_STRING_SIZE], msg[PATH_MAX + 128];
+    av_strerror(err, e, sizeof(e));
+    snprintf(msg, sizeof(msg), "libav: %s failed for %s: %s\n", what, path, e);
+    log_msg(msg);
+}
+
+static bool same_stream_params(const AVCodecParameters *a, const AVCodecParameters *b) {
+    return a->codec_id == b->codec_id && a->width == b->width && a->height == b->height &&
+           a->format == b->format && a->extradata_size == b->extradata_size &&
+           (a->extradata_size == 0 || !memcmp(a->extradata, b->extradata, (size_t)a->extradata_size));
+}
+
+static int open_decoder(LibavFile *f, AVStream *st) {
+    LibavSession *s = f->s;
+    int threads = f->p->threads ? atoi(f->p->threads) : 0;
+
+    if (s->dec && same_stream_params(s->dec_par, st->codecpar)) {
+        avcodec_flush_buffers(s->dec);
+        s->dec->pkt_timebase = st->time_base;
+        f->dec = s->dec;
+        return 0;
+    }
+    avcodec_free_context(&s->dec);
+
+    const AVCodec *codec = avcodec_find_decoder(st->codecpar->codec_id);
+    if (!codec) return AVERROR_DECODER_NOT_FOUND;
+
+    AVCodecContext *dec = avcodec_alloc_context3(codec);
+    if (!dec) return AVERROR(ENOMEM);
+    int ret = avcodec_parameters_to_context(dec, st->codecpar);
+    if (ret < 0) { avcodec_free_context(&dec); return ret; }
+
+    dec->pkt_timebase = st->time_base;
+    dec->framerate = av_guess_frame_rate(f->ifmt, st, NULL);
+    dec->thread_count = threads;
+    // Frame threading delays output by N frames, pointless for single stills
+    if (f->p->image) dec->thread_type = FF_THREAD_SLICE;
+
+    if ((ret = avcodec_open2(dec, codec, NULL)) < 0) { avcodec_free_context(&dec); return ret; }
+    avcodec_parameters_copy(s->dec_par, st->codecpar);
+    s->dec = f->dec = dec;
+    return 0;
+}
+
+static const AVCodec *find_encoder(const LibavFile *f) {
+    return f->p->encoder ? avcodec_find_encoder_by_name(f->p->encoder)
+                         : avcodec_find_encoder(f->ofmt->oformat->video_codec);
+}
+
+static const int32_t *display_matrix(const AVStream *st) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(60, 29, 100)
+    const AVPacketSideData *sd = av_packet_side_data_get(st->codecpar->coded_side_data,
+                                                         st->codecpar->nb_coded_side_data,
+                                                         AV_PKT_DATA_DISPLAYMATRIX);
+    return sd && sd->size >= 9 * (int)sizeof(int32_t) ? (const int32_t*)sd->data : NULL;
+#else
+    return (const int32_t*)av_stream_get_side_data(st, AV_PKT_DATA_DISPLAYMATRIX, NULL);
+#endif
+}
+
+/* What ffmpeg's autorotate puts in front of -vf for the stream's display
+   matrix, so both backends hand the filters upright frames; NULL if none */
+static const char *autorotate_filter(const AVStream *st, char *buf, size_t sz) {
+    const int32_t *m = display_matrix(st);
+    if (!m) return NULL;
+    double theta = -round(av_display_rotation_get(m));
+    theta -= 360 * floor(theta / 360 + 0.9 / 360);
+    if (fabs(theta - 90) < 1.0) return "transpose=clock";
+    if (fabs(theta - 180) < 1.0) return "hflip,vflip";
+    if (fabs(theta - 270) < 1.0) return "transpose=cclock";
+    if (fabs(theta) > 1.0) {
+        snprintf(buf, sz, "rotate=%f*PI/180", theta);
+        return buf;
+    }
+    return NULL;
+}
+
+static int build_graph(LibavFile *f, const AVFrame *first) {
+    AVStream *st = f->ifmt->streams[f->vstream];
+    AVRational sar = first->sample_aspect_ratio;
+    AVRational fr = av_guess_frame_rate(f->ifmt, st, NULL);
+    if (sar.num <= 0 || sar.den <= 0) sar = (AVRational){ 0, 1 };
+
+    f->graph = avfilter_graph_alloc();
+    if (!f->graph) return AVERROR(ENOMEM);
+    if (f->p->threads) f->graph->nb_threads = atoi(f->p->threads);
+
+    char args[512];
+    int n = snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d",
+                     first->width, first->height, first->format,
+                     st->time_base.num, st->time_base.den, sar.num, sar.den);
+    if (fr.num > 0 && fr.den > 0)
+        snprintf(args + n, sizeof(args) - n, ":frame_rate=%d/%d", fr.num, fr.den);
+
+    int ret = avfilter_graph_create_filter(&f->src, avfilter_get_by_name("buffer"), "in", args, NULL, f->graph);
+    if (ret < 0) return ret;
+
+    f->sink = avfilter_graph_alloc_filter(f->graph, avfilter_get_by_name("buffersink"), "out");
+    if (!f->sink) return AVERROR(ENOMEM);
+    if (f->p->pix_fmt) {
+        enum AVPixelFormat fmts[] = { av_get_pix_fmt(f->p->pix_fmt), AV_PIX_FMT_NONE };
+        av_opt_set_int_list(f->sink, "pix_fmts", fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+    } else {
+        // Let the graph negotiate down to something the encoder accepts (rgb24 for png, ...)
+        const AVCodec *codec = find_encoder(f);
+        if (codec && codec->pix_fmts)
+            av_opt_set_int_list(f->sink, "pix_fmts", codec->pix_fmts, AV_PIX_FMT_NONE, AV_OPT_SEARCH_CHILDREN);
+    }
+    if ((ret = avfilter_init_str(f->sink, NULL)) < 0) return ret;
+
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    if (!outputs || !inputs) {
+        avfilter_inout_free(&outputs);
+        avfilter_inout_free(&inputs);
+        return AVERROR(ENOMEM);
+    }
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = f->src;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = f->sink;
+
+    // Same string the CLI backend passes to -vf
+    const char *filters = (f->filters && *f->filters) ? f->filters : "null";
+    char turn_buf[64];
+    const char *turn = autorotate_filter(st, turn_buf, sizeof(turn_buf));
+    char *chain = turn ? av_asprintf("%s,%s", turn, filters) : NULL;
+    if (turn && !chain) ret = AVERROR(ENOMEM);
+    else ret = avfilter_graph_parse_ptr(f->graph, chain ? chain : filters, &inputs, &outputs, NULL);
+    av_free(chain);
+    if (ret >= 0) ret = avfilter_graph_config(f->graph, NULL);
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    return ret;
+}
+
+static int open_encoder(LibavFile *f) {
+    LibavSession *s = f->s;
+    const LibavEncodeParams *p = f->p;
+    const AVCodec *codec = find_encoder(f);
+    if (!codec) return AVERROR_ENCODER_NOT_FOUND;
+
+    int w = av_buffersink_get_w(f->sink);
+    int h = av_buffersink_get_h(f->sink);
+    int fmt = av_buffersink_get_format(f->sink);
+
+    if (s->enc && s->enc->codec == codec && s->enc->width == w && s->enc->height == h && s->enc->pix_fmt == fmt) {
+        f->enc = s->enc;
+        return 0;
+    }
+    avcodec_free_context(&s->enc);
+
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    if (!enc) return AVERROR(ENOMEM);
+    enc->width = w;
+    enc->height = h;
+    enc->pix_fmt = fmt;
+    enc->sample_aspect_ratio = av_buffersink_get_sample_aspect_ratio(f->sink);
+    enc->time_base = av_buffersink_get_time_base(f->sink);
+    AVRational fr = av_buffersink_get_frame_rate(f->sink);
+    if (fr.num > 0 && fr.den > 0) enc->framerate = fr;
+    if (f->ofmt->oformat->flags & AVFMT_GLOBALHEADER) enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    AVDictionary *opts = NULL;
+    if (p->crf && *p->crf) av_dict_set(&opts, "crf", p->crf, 0);
+    if (p->preset && *p->preset) av_dict_set(&opts, "preset", p->preset, 0);
+    if (p->threads && *p->threads) av_dict_set(&opts, "threads", p->threads, 0);
+    if (p->x265_params && *p->x265_params) av_dict_set(&opts, "x265-params", p->x265_params, 0);
+
+    int ret = avcodec_open2(enc, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) { avcodec_free_context(&enc); return ret; }
+
+    f->enc = enc;
+    // Only delay-free (intra) encoders can be reused without a drain
+    if (p->image && !(codec->capabilities & AV_CODEC_CAP_DELAY)) s->enc = enc;
+    return 0;
+}
+
+static int aac_sample_rate(const AVCodec *codec, int want) {
+    int best = 0;
+    for (const int *r = codec->supported_samplerates; r && *r; r++)
+        if (!best || abs(*r - want) < abs(best - want)) best = *r;
+    return best ? best : want;
+}
+
+static int open_audio(LibavFile *f, const AVStream *ist, LibavAudio *a) {
+    const AVCodec *dcodec = avcodec_find_decoder(ist->codecpar->codec_id);
+    if (!dcodec) return AVERROR_DECODER_NOT_FOUND;
+    const AVCodec *ecodec = avcodec_find_encoder(AV_CODEC_ID_AAC);
+    if (!ecodec) return AVERROR_ENCODER_NOT_FOUND;
+
+    if (!(a->dec = avcodec_alloc_context3(dcodec))) return AVERROR(ENOMEM);
+    int ret = avcodec_parameters_to_context(a->dec, ist->codecpar);
+    if (ret < 0) return ret;
+    a->dec->pkt_timebase = ist->time_base;
+    if ((ret = avcodec_open2(a->dec, dcodec, NULL)) < 0) return ret;
+
+    if (!(a->enc = avcodec_alloc_context3(ecodec))) return AVERROR(ENOMEM);
+    const AVChannelLayout *in_layout = &ist->codecpar->ch_layout;
+    if (in_layout->order == AV_CHANNEL_ORDER_UNSPEC || in_layout->nb_channels <= 0)
+        av_channel_layout_default(&a->enc->ch_layout, in_layout->nb_channels > 0 ? in_layout->nb_channels : 2);
+    else if ((ret = av_channel_layout_copy(&a->enc->ch_layout, in_layout)) < 0)
+        return ret;
+    a->enc->sample_rate = aac_sample_rate(ecodec, ist->codecpar->sample_rate);
+    a->enc->sample_fmt = ecodec->sample_fmts ? ecodec->sample_fmts[0] : AV_SAMPLE_FMT_FLTP;
+    a->enc->time_base = (AVRational){ 1, a->enc->sample_rate };
+    if (f->ofmt->oformat->flags & AVFMT_GLOBALHEADER) a->enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    AVDictionary *opts = NULL;
+    if (f->p->audio_bitrate && *f->p->audio_bitrate) av_dict_set(&opts, "b", f->p->audio_bitrate, 0);
+    ret = avcodec_open2(a->enc, ecodec, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+/* abuffer -> aformat -> abuffersink, cut to the encoder's frame size.
+   Built on the first decoded frame, which is what the source really is. */
+static int build_audio_graph(LibavAudio *a, const AVFrame *first) {
+    char layout[128], args[512];
+    int ret;
+    if (!(a->graph = avfilter_graph_alloc())) return AVERROR(ENOMEM);
+
+    av_channel_layout_describe(&first->ch_layout, layout, sizeof(layout));
+    snprintf(args, sizeof(args), "time_base=1/%d:sample_rate=%d:sample_fmt=%s:channel_layout=%s",
+             first->sample_rate, first->sample_rate, av_get_sample_fmt_name(first->format), layout);
+    ret = avfilter_graph_create_filter(&a->src, avfilter_get_by_name("abuffer"), "ain", args, NULL, a->graph);
+    if (ret < 0) return ret;
+
+    AVFilterContext *fmt;
+    av_channel_layout_describe(&a->enc->ch_layout, layout, sizeof(layout));
+    snprintf(args, sizeof(args), "sample_fmts=%s:sample_rates=%d:channel_layouts=%s",
+             av_get_sample_fmt_name(a->enc->sample_fmt), a->enc->sample_rate, layout);
+    ret = avfilter_graph_create_filter(&fmt, avfilter_get_by_name("aformat"), "afmt", args, NULL, a->graph);
+    if (ret < 0) return ret;
+    ret = avfilter_graph_create_filter(&a->sink, avfilter_get_by_name("abuffersink"), "aout", NULL, NULL, a->graph);
+    if (ret < 0) return ret;
+
+    if ((ret = avfilter_link(a->src, 0, fmt, 0)) < 0) return ret;
+    if ((ret = avfilter_link(fmt, 0, a->sink, 0)) < 0) return ret;
+    if ((ret = avfilter_graph_config(a->graph, NULL)) < 0) return ret;
+    if (!(a->enc->codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE))
+        av_buffersink_set_frame_size(a->sink, (unsigned)a->enc->frame_size);
+    return 0;
+}
+
+static int write_packet(LibavFile *f, AVPacket *pkt, AVRational src_tb, int ostream) {
+    AVStream *ost = f->ofmt->streams[ostream];
+    pkt->stream_index = ostream;
+    av_packet_rescale_ts(pkt, src_tb, ost->time_base);
+    pkt->pos = -1;
+    return av_interleaved_write_frame(f->ofmt, pkt);
+}
+
+static int encode_audio(LibavFile *f, LibavAudio *a, const AVFrame *frame) {
+    int ret = avcodec_send_frame(a->enc, frame);
+    if (ret < 0 && ret != AVERROR_EOF) return ret;
+    for (;;) {
+        ret = avcodec_receive_packet(a->enc, f->enc_pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+        if ((ret = write_packet(f, f->enc_pkt, a->enc->time_base, a->ostream)) < 0) return ret;
+    }
+}
+
+static int pull_audio(LibavFile *f, LibavAudio *a) {
+    AVRational tb = av_buffersink_get_time_base(a->sink);
+    for (;;) {
+        int ret = av_buffersink_get_frame(a->sink, f->aframe);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+
+        if (f->aframe->pts != AV_NOPTS_VALUE) f->aframe->pts = av_rescale_q(f->aframe->pts, tb, a->enc->time_base);
+        ret = encode_audio(f, a, f->aframe);
+        av_frame_unref(f->aframe);
+        if (ret < 0) return ret;
+    }
+}
+
+static int decode_audio(LibavFile *f, LibavAudio *a, const AVPacket *pkt) {
+    int ret = avcodec_send_packet(a->dec, pkt);
+    if (ret < 0 && ret != AVERROR_EOF) return ret;
+    for (;;) {
+        AVFrame *fr = f->aframe;
+        ret = avcodec_receive_frame(a->dec, fr);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+
+        // Unlabelled channels get the default layout for their count, as in ffmpeg
+        if (fr->ch_layout.order == AV_CHANNEL_ORDER_UNSPEC) {
+            int channels = fr->ch_layout.nb_channels;
+            av_channel_layout_uninit(&fr->ch_layout);
+            av_channel_layout_default(&fr->ch_layout, channels);
+        }
+        // abuffer counts in samples
+        int64_t pts = fr->best_effort_timestamp;
+        fr->pts = pts == AV_NOPTS_VALUE ? pts : av_rescale_q(pts, a->dec->pkt_timebase, (AVRational){ 1, fr->sample_rate });
+        if (!a->graph && (ret = build_audio_graph(a, fr)) < 0) {
+            av_frame_unref(fr);
+            return ret;
+        }
+        ret = av_buffersrc_add_frame_flags(a->src, fr, 0);
+        av_frame_unref(fr);
+        if (ret < 0) return ret;
+        if ((ret = pull_audio(f, a)) < 0) return ret;
+    }
+}
+
+static int setup_output(LibavFile *f, const AVFrame *first) {
+    int ret;
+    if ((ret = build_graph(f, first)) < 0) { log_averror("filter graph", f->out, ret); return ret; }
+    if ((ret = open_encoder(f)) < 0) { log_averror("encoder open", f->out, ret); return ret; }
+
+    AVStream *ost = avformat_new_stream(f->ofmt, NULL);
+    if (!ost) return AVERROR(ENOMEM);
+    f->ovstream = ost->index;
+    if ((ret = avcodec_parameters_from_context(ost->codecpar, f->enc)) < 0) return ret;
+    ost->time_base = f->enc->time_base;
+    if (f->enc->codec_id == AV_CODEC_ID_HEVC) ost->codecpar->codec_tag = MKTAG('h', 'v', 'c', '1');
+
+    // Every audio track, as AAC at the configured bitrate like -map 0:a? -c:a aac
+    for (unsigned i = 0; i < f->ifmt->nb_streams; i++) {
+        AVStream *ist = f->ifmt->streams[i];
+        LibavAudio *a = &f->audio[i];
+        if (f->p->image || ist->codecpar->codec_type != AVMEDIA_TYPE_AUDIO) continue;
+        if ((ret = open_audio(f, ist, a)) < 0) { log_averror("audio encoder open", f->out, ret); return ret; }
+        AVStream *ast = avformat_new_stream(f->ofmt, NULL);
+        if (!ast) return AVERROR(ENOMEM);
+        if ((ret = avcodec_parameters_from_context(ast->codecpar, a->enc)) < 0) return ret;
+        ast->time_base = a->enc->time_base;
+        a->ostream = ast->index;
+    }
+
+    if (!(f->ofmt->oformat->flags & AVFMT_NOFILE)) {
+        if ((ret = avio_open(&f->ofmt->pb, f->out, AVIO_FLAG_WRITE)) < 0) { log_averror("open", f->out, ret); return ret; }
+    }
+    AVDictionary *mux_opts = NULL;
+    if (f->p->movflags && *f->p->movflags) av_dict_set(&mux_opts, "movflags", f->p->movflags, 0);
+    ret = avformat_write_header(f->ofmt, &mux_opts);
+    av_dict_free(&mux_opts);
+    if (ret < 0) { log_averror("write header", f->out, ret); return ret; }
+    f->header_written = true;
+
+    for (int i = 0; i < f->npending && ret >= 0; i++) {
+        AVPacket *pkt = f->pending[i];
+        ret = decode_audio(f, &f->audio[pkt->stream_index], pkt);
+    }
+    return ret;
+}
+
+static void report_progress(LibavFile *f, int64_t pts, bool final) {
+    int64_t now = av_gettime_relative();
+    if (!final && now - f->last_report < 500000) return;
+    f->last_report = now;
+
+    double t = pts != AV_NOPTS_VALUE ? pts * av_q2d(f->enc->time_base) : 0.0;
+    double elapsed = (now - f->t0) / 1e6;
+    double fps = elapsed > 0 ? f->frames / elapsed : 0.0;
+    int hh = (int)(t / 3600), mm = (int)(t / 60) % 60;
+    double ss = t - hh * 3600 - mm * 60;
+
+    if (progress_wanted()) {
+        up60p_progress p = {
+            .job_id = current_job_id(), .frame = f->frames, .fps = fps,
+            .out_time_us = (long long)(t * 1e6), .bitrate_kbps = -1,
+            .speed = elapsed > 0 ? t / elapsed : 0.0, .total_size = -1, .finished = final
+        };
+        publish_progress(&p);
+        return;
+    }
+
+    // Same shape as ffmpeg -stats so FFmpegParser keeps working unchanged
+    char msg[160];
+    snprintf(msg, sizeof(msg), "frame=%5lld fps=%.1f time=%02d:%02d:%05.2f speed=%.3gx%s",
+             (long long)f->frames, fps, hh, mm, ss, elapsed > 0 ? t / elapsed : 0.0, final ? "\n" : "\r");
+    log_msg(msg);
+}
+
+static int encode_frame(LibavFile *f, const AVFrame *frame) {
+    int ret = avcodec_send_frame(f->enc, frame);
+    if (ret < 0 && ret != AVERROR_EOF) return ret;
+    for (;;) {
+        ret = avcodec_receive_packet(f->enc, f->enc_pkt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+        if ((ret = write_packet(f, f->enc_pkt, f->enc->time_base, f->ovstream)) < 0) return ret;
+    }
+}
+
+static int pull_filtered(LibavFile *f) {
+    for (;;) {
+        int ret = av_buffersink_get_frame(f->sink, f->filt);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+
+        f->filt->pict_type = AV_PICTURE_TYPE_NONE;
+        int64_t pts = f->filt->pts;
+        ret = encode_frame(f, f->filt);
+        av_frame_unref(f->filt);
+        if (ret < 0) return ret;
+
+        f->frames++;
+        report_progress(f, pts, false);
+    }
+}
+
+static int decode_packet(LibavFile *f, const AVPacket *pkt) {
+    int ret = avcodec_send_packet(f->dec, pkt);
+    if (ret < 0 && ret != AVERROR_EOF) return ret;
+    for (;;) {
+        ret = avcodec_receive_frame(f->dec, f->frame);
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) return 0;
+        if (ret < 0) return ret;
+
+        f->frame->pts = f->frame->best_effort_timestamp;
+        if (!f->graph && (ret = setup_output(f, f->frame)) < 0) {
+            av_frame_unref(f->frame);
+            return ret;
+        }
+        ret = av_buffersrc_add_frame_flags(f->src, f->frame, 0);
+        av_frame_unref(f->frame);
+        if (ret < 0) return ret;
+        if ((ret = pull_filtered(f)) < 0) return ret;
+    }
+}
+
+static int handle_audio(LibavFile *f, AVPacket *pkt) {
+    LibavAudio *a = &f->audio[pkt->stream_index];
+    if (a->ostream < 0) return 0;
+    if (f->header_written) return decode_audio(f, a, pkt);
+
+    // Header waits for the first filtered frame; hold audio until then
+    if (f->npending == f->cap_pending) {
+        int cap = f->cap_pending ? f->cap_pending * 2 : 64;
+        AVPacket **tmp = av_realloc_array(f->pending, (size_t)cap, sizeof(*tmp));
+        if (!tmp) return AVERROR(ENOMEM);
+        f->pending = tmp;
+        f->cap_pending = cap;
+    }
+    AVPacket *copy = av_packet_clone(pkt);
+    if (!copy) return AVERROR(ENOMEM);
+    f->pending[f->npending++] = copy;
+    return 0;
+}
+
+static int flush_audio(LibavFile *f, LibavAudio *a) {
+    int ret = decode_audio(f, a, NULL);
+    if (ret < 0 || !a->graph) return ret;
+    if ((ret = av_buffersrc_add_frame_flags(a->src, NULL, 0)) < 0) return ret;
+    if ((ret = pull_audio(f, a)) < 0) return ret;
+    return encode_audio(f, a, NULL);
+}
+
+static int flush_all(LibavFile *f) {
+    int ret = decode_packet(f, NULL);
+    if (ret < 0 || !f->graph) return ret;
+    for (unsigned i = 0; i < f->ifmt->nb_streams && f->header_written; i++) {
+        if (f->audio[i].ostream >= 0 && (ret = flush_audio(f, &f->audio[i])) < 0) return ret;
+    }
+    if ((ret = av_buffersrc_add_frame_flags(f->src, NULL, 0)) < 0) return ret;
+    if ((ret = pull_filtered(f)) < 0) return ret;
+
+    if (f->enc == f->s->enc) return 0;
+    return encode_frame(f, NULL);
+}
+
+static void close_file(LibavFile *f) {
+    if (f->enc && f->enc != f->s->enc) avcodec_free_context(&f->enc);
+    avfilter_graph_free(&f->graph);
+    av_frame_free(&f->frame);
+    av_frame_free(&f->filt);
+    av_frame_free(&f->aframe);
+    av_packet_free(&f->pkt);
+    av_packet_free(&f->enc_pkt);
+    for (int i = 0; i < f->npending; i++) av_packet_free(&f->pending[i]);
+    av_freep(&f->pending);
+    for (unsigned i = 0; f->audio && i < f->ifmt->nb_streams; i++) {
+        avcodec_free_context(&f->audio[i].dec);
+        avcodec_free_context(&f->audio[i].enc);
+        avfilter_graph_free(&f->audio[i].graph);
+    }
+    av_freep(&f->audio);
+    if (f->ofmt) {
+        if (!(f->ofmt->oformat->flags & AVFMT_NOFILE)) avio_closep(&f->ofmt->pb);
+        avformat_free_context(f->ofmt);
+    }
+    avformat_close_input(&f->ifmt);
+}
+
+static int run_file(LibavFile *f, const char *in) {
+    int ret;
+    if ((ret = avformat_open_input(&f->ifmt, in, NULL, NULL)) < 0) { log_averror("open", in, ret); return ret; }
+    if ((ret = avformat_find_stream_info(f->ifmt, NULL)) < 0) { log_averror("probe", in, ret); return ret; }
+
+    f->vstream = av_find_best_stream(f->ifmt, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (f->vstream < 0) { log_averror("video stream lookup", in, f->vstream); return f->vstream; }
+    if ((ret = open_decoder(f, f->ifmt->streams[f->vstream])) < 0) { log_averror("decoder open", in, ret); return ret; }
+
+    if ((ret = avformat_alloc_output_context2(&f->ofmt, NULL, NULL, f->out)) < 0) { log_averror("output", f->out, ret); return ret; }
+
+    f->audio = av_calloc(f->ifmt->nb_streams, sizeof(*f->audio));
+    f->frame = av_frame_alloc();
+    f->filt = av_frame_alloc();
+    f->aframe = av_frame_alloc();
+    f->pkt = av_packet_alloc();
+    f->enc_pkt = av_packet_alloc();
+    if (!f->audio || !f->frame || !f->filt || !f->aframe || !f->pkt || !f->enc_pkt) return AVERROR(ENOMEM);
+    for (unsigned i = 0; i < f->ifmt->nb_streams; i++) f->audio[i].ostream = -1;
+
+    if (f->ifmt->duration > 0) {
+        double d = f->ifmt->duration / (double)AV_TIME_BASE;
+        int hh = (int)(d / 3600), mm = (int)(d / 60) % 60;
+        char msg[96];
+        snprintf(msg, sizeof(msg), "  Duration: %02d:%02d:%05.2f\n", hh, mm, d - hh * 3600 - mm * 60);
+        log_msg(msg);
+    }
+    f->t0 = f->last_report = av_gettime_relative();
+
+    while ((ret = av_read_frame(f->ifmt, f->pkt)) >= 0) {
+        if (up60p_is_cancelled()) {
+            av_packet_unref(f->pkt);
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (f->pkt->stream_index == f->vstream) ret = decode_packet(f, f->pkt);
+        else ret = handle_audio(f, f->pkt);
+        av_packet_unref(f->pkt);
+        if (ret < 0) break;
+    }
+    if (ret == AVERROR_EOF) ret = flush_all(f);
+
+    if (f->header_written) {
+        int tr = av_write_trailer(f->ofmt);
+        if (ret >= 0) ret = tr;
+    } else if (ret >= 0) {
+        ret = AVERROR_INVALIDDATA;    // no frame ever reached the encoder
+    }
+    if (ret >= 0 && f->enc) report_progress(f, AV_NOPTS_VALUE, true);
+    if (ret < 0 && ret != AVERROR_EXIT) log_averror("processing", in, ret);
+    return ret;
+}
+
+int libav_process_file(const char *in, const char *out, const char *filters, const LibavEncodeParams *p) {
+    LibavFile f = { .p = p, .filters = filters, .out = out, .vstream = -1, .ovstream = -1 };
+    f.s = session_acquire();
+    if (!f.s || !f.s->dec_par) {
+        if (f.s) session_free(f.s);
+        return AVERROR(ENOMEM);
+    }
+
+    int ret = run_file(&f, in);
+    close_file(&f);
+
+    // A failed decoder/encoder is not trusted for the next file
+    if (ret < 0) {
+        avcodec_free_context(&f.s->dec);
+        avcodec_free_context(&f.s->enc);
+    }
+    session_release(f.s);
+    return ret;
+}
+
+#else
+
+bool libav_available(void) { return false; }
+
+int libav_process_file(const char *in, const char *out, const char *filters, const LibavEncodeParams *p) {
+    (void)in; (void)out; (void)filters; (void)p;
+    return -1;
+}
+
+void libav_shutdown(void) {}
+
+#endif
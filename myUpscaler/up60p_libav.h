@@ -0,0 +1,31 @@
+#ifndef UP60P_LIBAV_H
+#define UP60P_LIBAV_H
+
+#include "up60p_common.h"
+
+/* In-process decode -> filter -> encode, used instead of fork/exec of the
+   ffmpeg CLI when the library is built with UP60P_HAVE_LIBAV and the
+   "libav" backend is selected. The output matches the CLI path's: rotated
+   sources are turned upright and audio is re-encoded to AAC. Decoders
+   (and delay-free image encoders) are kept open between files of a batch
+   and reused when the stream parameters match. */
+
+typedef struct {
+    const char *encoder;     /* libx264, libx265, ...; NULL picks the muxer default (images) */
+    const char *pix_fmt;     /* NULL lets the encoder choose */
+    const char *crf;
+    const char *preset;
+    const char *threads;
+    const char *x265_params;
+    const char *movflags;
+    const char *audio_bitrate;
+    bool image;
+} LibavEncodeParams;
+
+bool libav_available(void);
+
+int libav_process_file(const char *in, const char *out, const char *filters, const LibavEncodeParams *p);
+
+void libav_shutdown(void);
+
+#endif
@@ -0,0 +1,366 @@
+#include "up60p_memory.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_cache.h"
+#include "up60p_context.h"
+#include <pthread.h>
+
+#define MB (1024.0 * 1024.0)
+#define MODEL_GLOBAL_SIG 1      /* every shape together, for shapes not seen yet */
+
+/* ---- Model ---- */
+
+static bool pix_wide(const char *name) {
+    return strstr(name, "10") || strstr(name, "12") || strstr(name, "14") || strstr(name, "16") ||
+           strstr(name, "48") || strstr(name, "64");
+}
+
+/* Bytes per pixel of a pix_fmt name; the first of a '|' list */
+static double pix_bytes(const char *fmt) {
+    if (!fmt || !*fmt) return 1.5;
+    char name[32];
+    safe_copy(name, fmt, sizeof(name));
+    name[strcspn(name, "|:")] = 0;
+    double samples = 3;
+    if (strstr(name, "420") || strstr(name, "nv12") || strstr(name, "nv21") || strstr(name, "p010") ||
+        strstr(name, "p016")) samples = 1.5;
+    else if (strstr(name, "422") || strstr(name, "yuyv") || strstr(name, "uyvy")) samples = 2;
+    else if (strstr(name, "gray")) samples = 1;
+    if (strstr(name, "yuva") || strstr(name, "gbrap") || strstr(name, "rgba") || strstr(name, "bgra") ||
+        strstr(name, "argb")) samples += samples / 3;
+    if (strstr(name, "f32")) return samples * 4;
+    return samples * (pix_wide(name) ? 2 : 1);
+}
+
+static int popcount(unsigned v) {
+    int n = 0;
+    for (; v; v &= v - 1) n++;
+    return n;
+}
+
+/* Bytes n holds beyond passing a frame on, at px pixels of bpp bytes */
+static double node_bytes(const FilterNode *n, double w, double h, double bpp) {
+    double px = w * h, frame = px * bpp;
+    if (fg_is(n, "split") || fg_is(n, "setsar") || fg_is(n, "setpts")) return 0;
+    if (fg_is(n, "bm3d")) {
+        // Float numerator and denominator per processed plane, plus the block groups
+        int planes = popcount((unsigned)fg_param_num(n, "planes", -1, 7));
+        return px * 8 * (planes ? planes : 3) + 2 * frame;
+    }
+    if (fg_is(n, "nlmeans")) {
+        // 32-bit integral image padded by the patch and research radii, and a
+        // float weight and sum per pixel
+        double p = fg_param_num(n, "p", -1, 7), r = fg_param_num(n, "r", -1, 15);
+        double e = (p + r) / 2 + 1;
+        return (w + 2 * e) * (h + 2 * e) * 4 + px * 8 + frame;
+    }
+    if (fg_is(n, "atadenoise")) return fg_param_num(n, "s", -1, 9) * frame;
+    if (fg_is(n, "hqdn3d")) return 2 * frame;                 // 16-bit previous frame
+    if (fg_is(n, "minterpolate")) {
+        // Four frames in flight plus motion vectors; mci keeps the most
+        const FilterParam *mode = fg_param(n, "mi_mode");
+        bool mci = !mode || !strcmp(mode->text, "mci");
+        return (mci ? 6 : 3) * frame;
+    }
+    if (fg_is(n, "mpdecimate")) return 2 * frame;
+    if (fg_is(n, "sr") || fg_is(n, "dnn_processing")) return 256 * MB + px * 3 * 4 * 2;
+    if (fg_is(n, "zscale")) return frame + px * 4;
+    return frame;
+}
+
+static double encoder_bytes(const char *encoder, double out_px, double out_bpp) {
+    if (!encoder) return 2 * out_px * out_bpp;
+    // Lookahead, reference and frame-thread queues, plus per-frame analysis
+    if (!strcmp(encoder, "libx265")) return 50 * out_px * out_bpp * 1.5;
+    if (!strcmp(encoder, "libx264")) return 45 * out_px * out_bpp * 1.2;
+    // Device encoders keep their queues in device memory
+    return 6 * out_px * out_bpp;
+}
+
+static int size_class(int height) {
+    return height <= 576 ? 0 : height <= 1080 ? 1 : height <= 2160 ? 2 : 3;
+}
+
+typedef struct { uint64_t sig; int samples; double ratio; } ModelEntry;
+
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mem_freed = PTHREAD_COND_INITIALIZER;
+static ModelEntry *model;
+static int nmodel, model_cap;
+static bool model_loaded;
+static double in_use_mb;
+static int running;
+
+static ModelEntry *model_entry(uint64_t sig, bool create) {
+    for (int i = 0; i < nmodel; i++) if (model[i].sig == sig) return &model[i];
+    if (!create) return NULL;
+    if (nmodel == model_cap) {
+        int cap = model_cap ? model_cap * 2 : 32;
+        ModelEntry *m = realloc(model, (size_t)cap * sizeof(*m));
+        if (!m) return NULL;
+        model = m;
+        model_cap = cap;
+    }
+    model[nmodel] = (ModelEntry){ sig, 0, 1.0 };
+    return &model[nmodel++];
+}
+
+static void model_path(char *path, size_t size) {
+    snprintf(path, size, "%s/%s", CONFIG_DIR, MEM_MODEL_NAME);
+}
+
+/* Caller holds mem_lock */
+static void load_model(void) {
+    if (model_loaded) return;
+    model_loaded = true;
+    char path[PATH_MAX + 32], line[128];
+    model_path(path, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return;
+    int version = 0;
+    if (fgets(line, sizeof(line), fp) && sscanf(line, "up60p-memory %d", &version) == 1 && version == 1) {
+        while (fgets(line, sizeof(line), fp)) {
+            unsigned long long sig;
+            int samples;
+            double ratio;
+            if (sscanf(line, "%llx %d %lf", &sig, &samples, &ratio) != 3 || ratio <= 0) continue;
+            ModelEntry *e = model_entry(sig, true);
+            if (e) { e->samples = samples; e->ratio = ratio; }
+        }
+    }
+    fclose(fp);
+}
+
+/* Caller holds mem_lock */
+static void save_model(void) {
+    if (!*CONFIG_DIR) return;
+    char path[PATH_MAX + 32], tmp[PATH_MAX + 48];
+    model_path(path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp%d", path, (int)getpid());
+    mkdir_p(CONFIG_DIR);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+    fprintf(fp, "up60p-memory 1\n");
+    for (int i = 0; i < nmodel; i++) {
+        fprintf(fp, "%016llx %d %.4f\n", (unsigned long long)model[i].sig, model[i].samples, model[i].ratio);
+    }
+    if (fclose(fp) != 0 || rename(tmp, path) != 0) unlink(tmp);
+}
+
+void mem_predict(const FilterGraph *g, int width, int height, double scale,
+                 const char *encoder, const char *pix_fmt, MemEstimate *out) {
+    double w = width, h = height, bpp = 1.5;
+    bool wide = false;
+    double bytes = 64 * MB + 8 * w * h * bpp;           // process, decoder queue
+    uint64_t sig = xxh64(encoder ? encoder : "image", strlen(encoder ? encoder : "image"), 0);
+    for (const FilterNode *n = g->head; n; n = n->next) {
+        if (filter_is_scaler(n->name) && scale > 0) { w *= scale; h *= scale; }
+        if (fg_is(n, "format")) {
+            const FilterParam *f = fg_param(n, "pix_fmts");
+            if (!f) f = fg_positional(n, 0);
+            if (f) {
+                bpp = pix_bytes(f->text);
+                wide = pix_wide(f->text);
+            }
+        }
+        // minterpolate only takes 8-bit input, so ffmpeg converts ahead of it
+        if (fg_is(n, "minterpolate") && wide) {
+            bpp /= 2;
+            wide = false;
+        }
+        bytes += node_bytes(n, w, h, bpp);
+        sig = xxh64(n->name, strlen(n->name) + 1, sig);
+    }
+    bytes += encoder_bytes(encoder, w * h, pix_bytes(pix_fmt));
+    int cls = size_class(height) * 1000 + (int)(scale * 100);
+    sig = xxh64(&cls, sizeof(cls), xxh64(pix_fmt ? pix_fmt : "", pix_fmt ? strlen(pix_fmt) : 0, sig));
+    if (sig <= MODEL_GLOBAL_SIG) sig += 2;
+
+    out->sig = sig;
+    out->raw_mb = bytes / MB;
+    pthread_mutex_lock(&mem_lock);
+    load_model();
+    const ModelEntry *e = model_entry(sig, false);
+    if (!e) e = model_entry(MODEL_GLOBAL_SIG, false);
+    out->mb = out->raw_mb * (e ? e->ratio : 1.0);
+    pthread_mutex_unlock(&mem_lock);
+}
+
+/* ---- Per-job estimates ---- */
+
+/* Job ids restart at 0 in every context, so entries are keyed by both */
+typedef struct { const up60p_context *ctx; int job_id; MemEstimate est; } JobEstimate;
+
+static JobEstimate *jobs;
+static int njobs, jobs_cap;
+
+static int find_job(const up60p_context *ctx, int job_id) {
+    for (int i = 0; i < njobs; i++) {
+        if (jobs[i].ctx == ctx && jobs[i].job_id == job_id) return i;
+    }
+    return -1;
+}
+
+void mem_set_job(int job_id, const MemEstimate *e) {
+    if (job_id < 0) return;
+    const up60p_context *ctx = current_context();
+    pthread_mutex_lock(&mem_lock);
+    int i = find_job(ctx, job_id);
+    if (i < 0 && e) {
+        if (njobs == jobs_cap) {
+            int n = jobs_cap ? jobs_cap * 2 : 64;
+            JobEstimate *j = realloc(jobs, (size_t)n * sizeof(*j));
+            if (j) {
+                jobs = j;
+                jobs_cap = n;
+            }
+        }
+        if (njobs < jobs_cap) {
+            i = njobs++;
+            jobs[i].ctx = ctx;
+            jobs[i].job_id = job_id;
+        }
+    }
+    if (i >= 0) {
+        if (e) jobs[i].est = *e;
+        else jobs[i] = jobs[--njobs];
+    }
+    pthread_mutex_unlock(&mem_lock);
+}
+
+bool mem_job(int job_id, MemEstimate *out) {
+    const up60p_context *ctx = current_context();
+    pthread_mutex_lock(&mem_lock);
+    int i = find_job(ctx, job_id);
+    if (i >= 0) *out = jobs[i].est;
+    pthread_mutex_unlock(&mem_lock);
+    return i >= 0;
+}
+
+/* ---- Admission ---- */
+
+static double limit_mb(void) {
+    double phys = (double)sysconf(_SC_PHYS_PAGES) * (double)sysconf(_SC_PAGESIZE) / MB;
+#ifdef __linux__
+    static const char *const limits[] = { "/sys/fs/cgroup/memory.max", "/sys/fs/cgroup/memory/memory.limit_in_bytes" };
+    for (int i = 0; i < ARR_LEN(limits); i++) {
+        FILE *fp = fopen(limits[i], "r");
+        if (!fp) continue;
+        unsigned long long bytes;
+        // "max" doesn't parse, and v1 says unlimited with a huge number
+        if (fscanf(fp, "%llu", &bytes) == 1 && bytes / MB < phys) phys = bytes / MB;
+        fclose(fp);
+    }
+#endif
+    return phys;
+}
+
+/* 0 = no limit */
+static double budget_mb(void) {
+    if (S.mem_budget_mb < 0) return 0;
+    if (S.mem_budget_mb > 0) return S.mem_budget_mb;
+    static double automatic = -1;
+    pthread_mutex_lock(&mem_lock);
+    if (automatic < 0) automatic = limit_mb() * MEM_BUDGET_SHARE;
+    double b = automatic;
+    pthread_mutex_unlock(&mem_lock);
+    return b;
+}
+
+bool mem_admit(const MemEstimate *e, MemTicket *t) {
+    memset(t, 0, sizeof(*t));
+    t->est = *e;
+    t->held_mb = e->mb;
+    double budget = budget_mb();
+    char msg[192];
+    bool waited = false;
+
+    pthread_mutex_lock(&mem_lock);
+    while (budget > 0 && running > 0 && in_use_mb + t->held_mb > budget) {
+        if (up60p_is_cancelled()) {
+            pthread_mutex_unlock(&mem_lock);
+            t->held_mb = 0;
+            return false;
+        }
+        if (!waited) {
+            snprintf(msg, sizeof(msg), "Memory: job needs ~%.0f MB, %.0f of %.0f MB taken; waiting for room\n",
+                     t->held_mb, in_use_mb, budget);
+            log_msg(msg);
+            waited = true;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 500000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_sec++; ts.tv_nsec -= 1000000000L; }
+        pthread_cond_timedwait(&mem_freed, &mem_lock, &ts);
+    }
+    in_use_mb += t->held_mb;
+    running++;
+    pthread_mutex_unlock(&mem_lock);
+
+    if (budget > 0 && t->held_mb > budget) {
+        snprintf(msg, sizeof(msg), "Memory: job needs ~%.0f MB, over the %.0f MB budget; running it alone\n",
+                 t->held_mb, budget);
+        log_msg(msg);
+    }
+    return true;
+}
+
+void mem_observe(MemTicket *t, double rss_mb) {
+    if (rss_mb <= t->held_mb) return;
+    pthread_mutex_lock(&mem_lock);
+    in_use_mb += rss_mb - t->held_mb;
+    t->held_mb = rss_mb;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+void mem_release(MemTicket *t) {
+    pthread_mutex_lock(&mem_lock);
+    in_use_mb -= t->held_mb;
+    if (--running <= 0 || in_use_mb < 0) {
+        in_use_mb = 0;
+        if (running < 0) running = 0;
+    }
+    pthread_cond_broadcast(&mem_freed);
+    load_model();
+    if (t->peak_mb > 0 && t->est.raw_mb > 0) {
+        // Recent runs count most, but a first sample replaces the default outright
+        double sample = t->peak_mb / t->est.raw_mb;
+        uint64_t sigs[2] = { t->est.sig, MODEL_GLOBAL_SIG };
+        for (int i = 0; i < 2; i++) {
+            ModelEntry *e = model_entry(sigs[i], true);
+            if (!e) continue;
+            double alpha = e->samples < 4 ? 1.0 / (e->samples + 1) : 0.25;
+            e->ratio += alpha * (sample - e->ratio);
+            e->samples++;
+        }
+        save_model();
+    }
+    pthread_mutex_unlock(&mem_lock);
+
+    if (t->peak_mb > 0) {
+        char msg[128];
+        snprintf(msg, sizeof(msg), "Memory: peak %.0f MB, predicted %.0f MB\n", t->peak_mb, t->est.mb);
+        log_msg(msg);
+    }
+    t->held_mb = 0;
+}
+
+double mem_process_rss_mb(pid_t pid) {
+#ifdef __linux__
+    char path[64], line[128];
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+    double mb = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        long kb;
+        if (sscanf(line, "VmRSS: %ld kB", &kb) == 1) { mb = kb / 1024.0; break; }
+    }
+    fclose(fp);
+    return mb;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
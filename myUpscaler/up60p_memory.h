@@ -0,0 +1,52 @@
+#ifndef UP60P_MEMORY_H
+#define UP60P_MEMORY_H
+
+#include "up60p_common.h"
+#include "up60p_graph.h"
+
+#define MEM_BUDGET_SHARE 0.8        /* of RAM (or the cgroup limit) when mem_budget_mb is 0 */
+#define MEM_MODEL_NAME "memory_model"
+
+/* Peak resident size expected of one ffmpeg child of a job. sig names the
+   chain's shape (filters, encoder, resolution class) so measured peaks
+   can correct later predictions for the same shape. */
+typedef struct {
+    uint64_t sig;
+    double raw_mb;          /* straight from the model */
+    double mb;              /* corrected by what earlier runs measured */
+} MemEstimate;
+
+/* Model of one ffmpeg running g on width x height frames, scaled by scale,
+   into encoder (NULL for a still). Charges each filter the frames it holds
+   and the working buffers its parameters imply (nlmeans' integral image
+   grows with p + r, atadenoise keeps s frames, formats change the bytes
+   per pixel), plus decoder and encoder queues at their own sizes. */
+void mem_predict(const FilterGraph *g, int width, int height, double scale,
+                 const char *encoder, const char *pix_fmt, MemEstimate *out);
+
+/* Estimate for every encode the job starts, looked up by current_job_id()
+   in the current context when ffmpeg children are started; NULL clears it. */
+void mem_set_job(int job_id, const MemEstimate *e);
+bool mem_job(int job_id, MemEstimate *out);
+
+typedef struct {
+    MemEstimate est;
+    double held_mb;         /* reserved against the budget: the estimate, or more once seen */
+    double peak_mb;         /* the child's peak RSS once it has exited, 0 = unknown */
+} MemTicket;
+
+/* Blocks until e fits in the budget next to what's running in every
+   context; a job larger than the budget runs alone. false if cancelled
+   while waiting. */
+bool mem_admit(const MemEstimate *e, MemTicket *t);
+/* Current RSS of the child, sampled while it runs; raises the reservation
+   when it outgrows the estimate. */
+void mem_observe(MemTicket *t, double rss_mb);
+/* Returns the reservation and records t->peak_mb against the estimate,
+   persisting the correction in CONFIG_DIR. */
+void mem_release(MemTicket *t);
+
+/* RSS of a live process in MB from /proc/<pid>/status, -1 where unavailable */
+double mem_process_rss_mb(pid_t pid);
+
+#endif
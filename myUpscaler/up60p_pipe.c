@@ -0,0 +1,549 @@
+#include "up60p_pipe.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_filters.h"
+#include "up60p_graph.h"
+#include "up60p_probe.h"
+#include "up60p_post.h"
+#include "up60p_hwaccel.h"
+#include "up60p_frc.h"
+#include "up60p_context.h"
+#include <math.h>
+#include <pthread.h>
+
+typedef struct {
+    uint8_t *items[PIPE_DEPTH];
+    int head, count;
+    bool closed;
+} FrameQueue;
+
+/* Every buffer lives in exactly one queue or in one stage's hands. free_*
+   start out holding all PIPE_DEPTH buffers of their size, so no queue can
+   overflow and nothing is allocated per frame. */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool failed;
+    const char *error;
+    FrameQueue free_in, ready_in, free_out, ready_out;
+    uint8_t *buffers[2 * PIPE_DEPTH];
+    up60p_frame src, dst;           /* geometry; data is filled per frame */
+    size_t in_size, out_size;
+    up60p_upscale_fn fn;
+    void *user;
+    FusedPost *post;                /* runs on each upscaled frame when set */
+    uint8_t *staging;               /* upscaler output ahead of the fused pass */
+    FrameRateConverter *frc;        /* between the decoder and the upscaler when set */
+    uint8_t *decoded;               /* decoder frame ahead of the converter */
+    int dec_fd, filt_in, filt_out, enc_fd;
+    long long frames_in, frames_out, frames_post;
+} Pipeline;
+
+static void pipeline_fail(Pipeline *p, const char *why) {
+    pthread_mutex_lock(&p->lock);
+    if (!p->failed) {
+        p->failed = true;
+        p->error = why;
+    }
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static bool queue_push(Pipeline *p, FrameQueue *q, uint8_t *buf) {
+    pthread_mutex_lock(&p->lock);
+    while (q->count == PIPE_DEPTH && !p->failed) pthread_cond_wait(&p->changed, &p->lock);
+    bool ok = !p->failed;
+    if (ok) {
+        q->items[(q->head + q->count) % PIPE_DEPTH] = buf;
+        q->count++;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return ok;
+}
+
+/* NULL once the queue is closed and drained, or the pipeline failed */
+static uint8_t *queue_pop(Pipeline *p, FrameQueue *q) {
+    pthread_mutex_lock(&p->lock);
+    while (q->count == 0 && !q->closed && !p->failed) pthread_cond_wait(&p->changed, &p->lock);
+    uint8_t *buf = NULL;
+    if (!p->failed && q->count > 0) {
+        buf = q->items[q->head];
+        q->head = (q->head + 1) % PIPE_DEPTH;
+        q->count--;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return buf;
+}
+
+static void queue_close(Pipeline *p, FrameQueue *q) {
+    pthread_mutex_lock(&p->lock);
+    q->closed = true;
+    pthread_cond_broadcast(&p->changed);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Returns bytes read; less than n only at EOF, -1 on error */
+static ssize_t read_full(int fd, uint8_t *buf, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+        ssize_t r = read(fd, buf + got, n - got);
+        if (r < 0) { if (errno == EINTR) continue; return -1; }
+        if (r == 0) break;
+        got += (size_t)r;
+    }
+    return (ssize_t)got;
+}
+
+static bool write_full(int fd, const uint8_t *buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if (w < 0) { if (errno == EINTR) continue; return false; }
+        buf += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+/* A stage that dies must surface as EPIPE on our side, not kill the host */
+static void block_sigpipe(void) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+/* The converter hands over each output frame here; it goes on like a
+   decoded one would */
+static bool queue_converted(const up60p_frame *frame, void *ctx) {
+    Pipeline *p = ctx;
+    uint8_t *buf = queue_pop(p, &p->free_in);
+    if (!buf) return false;
+    memcpy(buf, frame->data, p->in_size);
+    p->frames_in++;
+    return queue_push(p, &p->ready_in, buf);
+}
+
+/* The decoder runs at the source rate and the converter decides which
+   frames the rest of the pipe sees */
+static void convert_frames(Pipeline *p) {
+    up60p_frame f = p->src;
+    f.data = p->decoded;
+    for (;;) {
+        if (up60p_is_cancelled()) { pipeline_fail(p, NULL); return; }
+        ssize_t n = read_full(p->dec_fd, p->decoded, p->in_size);
+        if (n == 0) break;
+        if (n != (ssize_t)p->in_size) { pipeline_fail(p, "short frame from decoder"); return; }
+        if (!frc_push(p->frc, &f, queue_converted, p)) return;
+    }
+    frc_flush(p->frc, queue_converted, p);
+}
+
+static void *read_frames(void *arg) {
+    Pipeline *p = arg;
+    if (p->frc) {
+        convert_frames(p);
+        queue_close(p, &p->ready_in);
+        return NULL;
+    }
+    uint8_t *buf;
+    while ((buf = queue_pop(p, &p->free_in))) {
+        if (up60p_is_cancelled()) { pipeline_fail(p, NULL); break; }
+        ssize_t n = read_full(p->dec_fd, buf, p->in_size);
+        if (n == 0) break;
+        if (n != (ssize_t)p->in_size) { pipeline_fail(p, "short frame from decoder"); break; }
+        p->frames_in++;
+        if (!queue_push(p, &p->ready_in, buf)) break;
+    }
+    queue_close(p, &p->ready_in);
+    return NULL;
+}
+
+/* Fused pass from the staging frame into dst; the caller is the only
+   thread producing output, so frames_post is the frame index */
+static bool post_frame(Pipeline *p, const up60p_frame *staged, uint8_t *dst) {
+    up60p_frame b = p->dst;
+    b.data = dst;
+    if (fused_post_apply(p->post, staged, &b, p->frames_post++) == UP60P_OK) return true;
+    pipeline_fail(p, "fused post pass failed");
+    return false;
+}
+
+/* Without an upscaler (fn NULL) the decoder already scaled and only the
+   fused pass runs here, or nothing when the pipe is only there for the
+   frame-rate converter */
+static void *upscale_frames(void *arg) {
+    Pipeline *p = arg;
+    uint8_t *src;
+    while ((src = queue_pop(p, &p->ready_in))) {
+        uint8_t *dst = queue_pop(p, &p->free_out);
+        if (!dst) break;
+        up60p_frame a = p->src, b = p->dst;
+        a.data = src;
+        b.data = p->post ? p->staging : dst;
+        if (p->fn && p->fn(&a, &b, p->user) != 0) { pipeline_fail(p, "upscaler callback failed"); break; }
+        if (p->post && !post_frame(p, p->fn ? &b : &a, dst)) break;
+        if (!p->fn && !p->post) memcpy(dst, src, p->out_size);
+        if (!queue_push(p, &p->free_in, src) || !queue_push(p, &p->ready_out, dst)) break;
+    }
+    queue_close(p, &p->ready_out);
+    return NULL;
+}
+
+/* pipe_cmd runs as its own process; one thread feeds it while another
+   drains it, so a tool that buffers a few frames can't deadlock us. */
+static void *feed_filter(void *arg) {
+    Pipeline *p = arg;
+    block_sigpipe();
+    uint8_t *src;
+    while ((src = queue_pop(p, &p->ready_in))) {
+        if (!write_full(p->filt_in, src, p->in_size)) { pipeline_fail(p, "upscaler stopped reading"); break; }
+        if (!queue_push(p, &p->free_in, src)) break;
+    }
+    close(p->filt_in);
+    p->filt_in = -1;
+    return NULL;
+}
+
+static void *drain_filter(void *arg) {
+    Pipeline *p = arg;
+    uint8_t *dst;
+    while ((dst = queue_pop(p, &p->free_out))) {
+        up60p_frame staged = p->dst;
+        staged.data = p->post ? p->staging : dst;
+        ssize_t n = read_full(p->filt_out, staged.data, p->out_size);
+        if (n == 0) break;
+        if (n != (ssize_t)p->out_size) { pipeline_fail(p, "short frame from upscaler"); break; }
+        if (p->post && !post_frame(p, &staged, dst)) break;
+        if (!queue_push(p, &p->ready_out, dst)) break;
+    }
+    queue_close(p, &p->ready_out);
+    return NULL;
+}
+
+static void *write_frames(void *arg) {
+    Pipeline *p = arg;
+    block_sigpipe();
+    uint8_t *buf;
+    while ((buf = queue_pop(p, &p->ready_out))) {
+        if (!write_full(p->enc_fd, buf, p->out_size)) { pipeline_fail(p, "encoder stopped reading"); break; }
+        p->frames_out++;
+        if (!queue_push(p, &p->free_out, buf)) break;
+    }
+    // EOF lets the encoder finish; on failure the frame count check catches it
+    close(p->enc_fd);
+    p->enc_fd = -1;
+    return NULL;
+}
+
+bool pipe_upscale_enabled(const Settings *s) {
+    if (strcmp(s->scaler, "ai") || strcmp(s->ai_backend, "pipe")) return false;
+    if (current_context()->upscale_fn || *s->pipe_cmd) return true;
+    log_once(NOTE_PIPE_NO_UPSCALER, "Pipe mode: no upscaler set (pipe_cmd or up60p_set_upscaler), using lanczos\n");
+    return false;
+}
+
+/* Exact rational for the NTSC family, since the banner only shows 2 decimals */
+static void frame_rate_string(double fps, char *buf, size_t size) {
+    static const int ntsc[] = { 24, 30, 48, 60, 120 };
+    for (int i = 0; i < ARR_LEN(ntsc); i++) {
+        if (fabs(fps - ntsc[i] * 1000.0 / 1001.0) < 0.01) {
+            snprintf(buf, size, "%d000/1001", ntsc[i]);
+            return;
+        }
+    }
+    if (fabs(fps - round(fps)) < 0.01) snprintf(buf, size, "%d", (int)round(fps));
+    else snprintf(buf, size, "%.3f", fps);
+}
+
+/* "24000/1001", "59.94" -> frames per second */
+static double rate_value(const char *rate) {
+    double num = 0, den = 1;
+    if (sscanf(rate, "%lf/%lf", &num, &den) == 2 && den > 0) return num / den;
+    return num;
+}
+
+static void log_command(char *const argv[]) {
+    SB cmd = {0};
+    sb_append(&cmd, "CMD: ");
+    for (int i = 0; argv[i]; i++) {
+        sb_append(&cmd, argv[i]);
+        sb_append(&cmd, " ");
+    }
+    sb_append(&cmd, "\n");
+    log_msg(cmd.buf);
+    free(cmd.buf);
+}
+
+int process_piped(const char *in, const char *out, const char *ffmpeg, const char *threads,
+                  bool img, bool dry_run) {
+    MediaProbe info;
+    probe_media(ffmpeg, in, false, &info);
+    probe_free(&info);
+    if (info.width <= 0 || info.height <= 0 || (!img && info.fps <= 0)) {
+        log_msg("Pipe mode: could not read the input's frame size and rate\n");
+        return -1;
+    }
+    // The raw frames carry no display matrix, so the decoder hands them over
+    // upright and everything after it works at the rotated size
+    if (info.rotation == 90 || info.rotation == 270) {
+        int w = info.width;
+        info.width = info.height;
+        info.height = w;
+    }
+
+    // Without an upscaler the decoder runs the configured scaler and the
+    // pipe only carries frames through the fused pass and converter
+    bool upscaler = pipe_upscale_enabled(&S);
+    bool fused = fused_post_enabled(&S);
+    bool frc = !img && frc_enabled(&S);
+    Settings chain = S;
+    chain.post_fused = fused;
+    if (frc) chain.no_decimate = chain.no_interpolate = 1;
+    // Nothing native needs the frames at output size, so convert them at
+    // the source size and let the encoder side scale
+    bool scale_late = frc && !upscaler && !fused;
+
+    // The upscaler works in whole multiples; a fractional factor is finished with lanczos
+    double factor = atof(S.scale_factor);
+    int k = (int)ceil(factor - 1e-3);
+    if (k < 1) k = 1;
+    int in_w = info.width, in_h = info.height;
+    if (!upscaler) k = 1;
+    if (!upscaler && !scale_late) {
+        in_w = (int)(info.width * factor / 2) * 2;
+        in_h = (int)(info.height * factor / 2) * 2;
+        if (in_w < 2 || in_h < 2) {
+            log_msg("Pipe mode: scale factor gives an empty frame\n");
+            return -1;
+        }
+    }
+    bool deep = S.use10 && !S.pci_safe_mode;
+    const char *raw_fmt = deep ? "rgb48le" : "rgb24";
+    int bpp = deep ? 6 : 3;
+
+    Arena arena = {0};
+    FilterGraph pre_g, scale_g, post_g, tail_g;
+    fg_init(&pre_g, &arena);
+    fg_init(&scale_g, &arena);
+    fg_init(&post_g, &arena);
+    fg_init(&tail_g, &arena);
+    build_filter_stages(&chain, &pre_g, &scale_g, &post_g, img);
+    if (!upscaler && !scale_late) fg_splice(&pre_g, &scale_g);
+    if (!S.no_optimize) optimize_filter_chain(&pre_g, img);
+
+    if (!img) fg_text(fg_add(&tail_g, "format"), NULL, S.pci_safe_mode ? "yuv420p" : "yuv444p16le");
+    if (upscaler && factor > 0 && fabs(factor - k) > 1e-3) {
+        FilterNode *n = fg_add(&tail_g, "scale");
+        fg_int(n, NULL, (int)(info.width * factor / 2) * 2);
+        fg_int(n, NULL, (int)(info.height * factor / 2) * 2);
+        fg_text(n, "flags", "lanczos+accurate_rnd");
+    }
+    if (scale_late) fg_splice(&tail_g, &scale_g);
+    fg_splice(&tail_g, &post_g);
+    if (!S.no_optimize) optimize_filter_chain(&tail_g, img);
+    // Frames come back on the host; the encoder side can still finish on the device
+    HwPlan hw;
+    bool on_device = hw_plan(&chain, img, &hw);
+    if (on_device) {
+        hw.decode = false;
+        place_hw_filters(&tail_g, &hw);
+    }
+    SB pre = {0}, tail = {0};
+    fg_render(&pre_g, &pre);
+    fg_render(&tail_g, &tail);
+    arena_free(&arena);
+
+    char rate[32] = "25", src_rate[32] = "25", in_size[32], out_size[32], arg_w[16], arg_h[16], arg_k[16];
+    if (!img) {
+        if (!S.no_interpolate && atof(S.fps) > 0) safe_copy(rate, S.fps, sizeof(rate));
+        else frame_rate_string(info.fps, rate, sizeof(rate));
+        frame_rate_string(info.fps, src_rate, sizeof(src_rate));
+    }
+    snprintf(in_size, sizeof(in_size), "%dx%d", in_w, in_h);
+    snprintf(out_size, sizeof(out_size), "%dx%d", in_w * k, in_h * k);
+    snprintf(arg_w, sizeof(arg_w), "%d", in_w);
+    snprintf(arg_h, sizeof(arg_h), "%d", in_h);
+    snprintf(arg_k, sizeof(arg_k), "%d", k);
+
+    // Decode + pre-scale chain -> raw RGB on stdout, at a constant rate so
+    // frame n of the pipe is frame n of the output
+    char *dec[40]; int d = 0;
+    dec[d++] = (char*)ffmpeg; dec[d++] = "-hide_banner"; dec[d++] = "-loglevel"; dec[d++] = "error"; dec[d++] = "-nostats";
+    if (strcmp(S.hwaccel, "none")) { dec[d++] = "-hwaccel"; dec[d++] = S.hwaccel; }
+    dec[d++] = "-i"; dec[d++] = (char*)in;
+    dec[d++] = "-map"; dec[d++] = "0:v:0";
+    if (pre.len) { dec[d++] = "-vf"; dec[d++] = pre.buf; }
+    if (img) { dec[d++] = "-frames:v"; dec[d++] = "1"; }
+    else { dec[d++] = "-vsync"; dec[d++] = "cfr"; dec[d++] = "-r"; dec[d++] = frc ? src_rate : rate; }
+    dec[d++] = "-f"; dec[d++] = "rawvideo"; dec[d++] = "-pix_fmt"; dec[d++] = (char*)raw_fmt;
+    dec[d++] = "pipe:1";
+    dec[d] = NULL;
+
+    // Upscaled frames on stdin + audio from the source -> post-scale chain and encode
+    char *enc[96]; int e = 0;
+    enc[e++] = (char*)ffmpeg; enc[e++] = "-hide_banner"; enc[e++] = "-loglevel"; enc[e++] = "error"; enc[e++] = "-stats"; enc[e++] = "-y";
+    e = append_hw_input_args(enc, e, on_device ? &hw : NULL, NULL);
+    enc[e++] = "-f"; enc[e++] = "rawvideo"; enc[e++] = "-pix_fmt"; enc[e++] = (char*)raw_fmt;
+    enc[e++] = "-video_size"; enc[e++] = out_size; enc[e++] = "-framerate"; enc[e++] = rate;
+    enc[e++] = "-i"; enc[e++] = "pipe:0";
+    if (!img) { enc[e++] = "-i"; enc[e++] = (char*)in; }
+    enc[e++] = "-map"; enc[e++] = "0:v:0";
+    if (tail.len) { enc[e++] = "-vf"; enc[e++] = tail.buf; }
+    char x265_fixed[256] = "";
+    if (!img) {
+        enc[e++] = "-map"; enc[e++] = "1:a?";
+        e = append_video_encoder_args(enc, e, pick_video_encoder(), on_device && hw.encode ? NULL : output_pix_fmt(), threads,
+                                      x265_fixed, sizeof(x265_fixed));
+        enc[e++] = "-c:a"; enc[e++] = "aac"; enc[e++] = "-b:a"; enc[e++] = S.audio_bitrate;
+        if (*S.movflags) { enc[e++] = "-movflags"; enc[e++] = S.movflags; }
+    } else {
+        enc[e++] = "-frames:v"; enc[e++] = "1";
+    }
+    enc[e++] = (char*)out;
+    enc[e] = NULL;
+
+    char *filt[] = { "/bin/sh", "-c", S.pipe_cmd, "up60p-pipe", arg_w, arg_h, arg_k, (char*)raw_fmt, NULL };
+    up60p_upscale_fn fn = upscaler ? current_context()->upscale_fn : NULL;
+
+    char msg[PATH_MAX + 96];
+    snprintf(msg, sizeof(msg), "Pipe mode: %s -> %s through %s%s%s\n", in_size, out_size,
+             frc ? "frame-rate converter" : !upscaler ? "fused post pass" : fn ? "upscaler callback" : S.pipe_cmd,
+             frc && upscaler ? (fn ? ", upscaler callback" : ", pipe_cmd") : "",
+             (upscaler || frc) && fused ? " and fused post pass" : "");
+    log_msg(msg);
+
+    if (dry_run) {
+        log_command(dec);
+        log_command(enc);
+        free(pre.buf);
+        free(tail.buf);
+        return 0;
+    }
+
+    Pipeline p = {
+        .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER,
+        .src = { NULL, in_w, in_h, (ptrdiff_t)in_w * bpp, bpp },
+        .dst = { NULL, in_w * k, in_h * k, (ptrdiff_t)in_w * k * bpp, bpp },
+        .fn = fn, .user = current_context()->upscale_user,
+        .dec_fd = -1, .filt_in = -1, .filt_out = -1, .enc_fd = -1
+    };
+    p.in_size = (size_t)p.src.stride * (size_t)p.src.height;
+    p.out_size = (size_t)p.dst.stride * (size_t)p.dst.height;
+
+    int result = -1;
+    pid_t dec_pid = -1, filt_pid = -1;
+    int enc_pipe[2] = { -1, -1 };
+    bool ok = true;
+    for (int i = 0; i < 2 * PIPE_DEPTH && ok; i++) {
+        p.buffers[i] = malloc(i < PIPE_DEPTH ? p.in_size : p.out_size);
+        ok = p.buffers[i] != NULL;
+    }
+    if (ok && fused) {
+        p.post = fused_post_create(&S, p.dst.width, threads ? atoi(threads) : 0);
+        p.staging = malloc(p.out_size);
+        ok = p.post && p.staging;
+    }
+    if (ok && frc) {
+        p.frc = frc_create(in_w, in_h, bpp, info.fps, rate_value(rate), threads ? atoi(threads) : 0);
+        p.decoded = malloc(p.in_size);
+        ok = p.frc && p.decoded;
+    }
+    if (!ok) {
+        log_msg("Pipe mode: out of memory for frame buffers\n");
+        goto done;
+    }
+    for (int i = 0; i < PIPE_DEPTH; i++) {
+        p.free_in.items[i] = p.buffers[i];
+        p.free_out.items[i] = p.buffers[PIPE_DEPTH + i];
+    }
+    p.free_in.count = p.free_out.count = PIPE_DEPTH;
+
+    dec_pid = spawn_ffmpeg_reader(dec, &p.dec_fd);
+    if (dec_pid < 0) goto done;
+    if (upscaler && !fn) {
+        filt_pid = spawn_filter_process(filt, &p.filt_in, &p.filt_out);
+        if (filt_pid < 0) goto done;
+    }
+    if (cloexec_pipe(enc_pipe) < 0) goto done;
+    p.enc_fd = enc_pipe[1];
+
+    pthread_t workers[4];
+    int nthreads = 0;
+    context_thread_create(&workers[nthreads++], read_frames, &p);
+    if (fn || !upscaler) {
+        context_thread_create(&workers[nthreads++], upscale_frames, &p);
+    } else {
+        context_thread_create(&workers[nthreads++], feed_filter, &p);
+        context_thread_create(&workers[nthreads++], drain_filter, &p);
+    }
+    context_thread_create(&workers[nthreads++], write_frames, &p);
+
+    result = execute_ffmpeg_feed(enc, enc_pipe[0]);
+    enc_pipe[0] = -1;
+
+    // Encoder is gone; anything still running upstream has nowhere to go
+    pthread_mutex_lock(&p.lock);
+    bool failed = p.failed;
+    pthread_mutex_unlock(&p.lock);
+    if (result != 0 || failed || up60p_is_cancelled()) {
+        pipeline_fail(&p, NULL);
+        signal_child(dec_pid, SIGTERM);
+        if (filt_pid > 0) signal_child(filt_pid, SIGTERM);
+    }
+    for (int i = 0; i < nthreads; i++) pthread_join(workers[i], NULL);
+    // A stage can fail after the encoder already saw EOF; the decoder may
+    // then be stuck on a full pipe nobody drains
+    if (p.failed && !failed) {
+        signal_child(dec_pid, SIGTERM);
+        if (filt_pid > 0) signal_child(filt_pid, SIGTERM);
+    }
+
+    if (p.filt_in >= 0) { close(p.filt_in); p.filt_in = -1; }
+    int dec_status = wait_child(dec_pid);
+    dec_pid = -1;
+    int filt_status = filt_pid > 0 ? wait_child(filt_pid) : 0;
+    filt_pid = -1;
+
+    if (result == 0) {
+        if (p.failed || dec_status != 0 || filt_status != 0 || p.frames_out != p.frames_in) {
+            snprintf(msg, sizeof(msg), "Pipe mode failed: %s (decoder %d, upscaler %d, %lld of %lld frames)\n",
+                     p.error ? p.error : "stage exited early", dec_status, filt_status,
+                     p.frames_out, p.frames_in);
+            log_msg(msg);
+            result = -1;
+        } else {
+            snprintf(msg, sizeof(msg), "Pipe mode: %lld frames upscaled\n", p.frames_out);
+            log_msg(msg);
+        }
+        if (p.frc) {
+            FrcStats st;
+            frc_get_stats(p.frc, &st);
+            snprintf(msg, sizeof(msg), "Frame-rate conversion: %lld in, %lld repeats dropped, %lld out "
+                     "(%lld interpolated, %lld blended at cuts, %lld kept)\n",
+                     st.in, st.dropped, st.out, st.interpolated, st.blended, st.copied);
+            log_msg(msg);
+        }
+    }
+
+done:
+    if (dec_pid > 0) { signal_child(dec_pid, SIGTERM); wait_child(dec_pid); }
+    if (filt_pid > 0) { signal_child(filt_pid, SIGTERM); wait_child(filt_pid); }
+    if (p.dec_fd >= 0) close(p.dec_fd);
+    if (p.filt_in >= 0) close(p.filt_in);
+    if (p.filt_out >= 0) close(p.filt_out);
+    if (enc_pipe[0] >= 0) close(enc_pipe[0]);
+    if (p.enc_fd >= 0) close(p.enc_fd);
+    for (int i = 0; i < 2 * PIPE_DEPTH; i++) free(p.buffers[i]);
+    free(p.staging);
+    free(p.decoded);
+    fused_post_destroy(p.post);
+    frc_destroy(p.frc);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.changed);
+    free(pre.buf);
+    free(tail.buf);
+    return result;
+}
@@ -0,0 +1,20 @@
+#ifndef UP60P_PIPE_H
+#define UP60P_PIPE_H
+
+#include "up60p_common.h"
+
+/* Frames in flight on each side of the upscaler: one being filled while
+   the other is worked on, so decode, inference and encode overlap. */
+#define PIPE_DEPTH 2
+
+/* ai_backend "pipe" with an upscaler callback or pipe_cmd to run it */
+bool pipe_upscale_enabled(const Settings *s);
+
+/* Runs the pre-scale chain in one ffmpeg that writes raw RGB frames, hands
+   each frame to the upscaler and feeds the results to a second ffmpeg for
+   the post-scale chain and encode. Returns the encoder's exit code, or -1
+   if any stage failed or dropped frames. dry_run only logs the commands. */
+int process_piped(const char *in, const char *out, const char *ffmpeg, const char *threads,
+                  bool img, bool dry_run);
+
+#endif
@@ -0,0 +1,105 @@
+#include "up60p_post.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_kernels.h"
+
+struct FusedPost {
+    up60p_kernels *kernels;
+    FusedParams params;
+    float *noise;
+    int width;
+};
+
+static bool post_stage_unsupported(const Settings *s, const char **why) {
+    if (!strcmp(s->scaler, "hw")) *why = "hw scaler keeps frames on the device";
+    else if (!strcmp(s->scaler, "ai") && strcmp(s->ai_backend, "pipe")) *why = "ai scaler runs inside ffmpeg";
+    else if (!s->no_sharpen && strcmp(s->sharpen_method, "cas")) *why = "only cas sharpening is fused";
+    else if (!s->no_deband && !strcmp(s->deband_method, "gradfun")) *why = "gradfun is not fused";
+    // Second-set stages sit between the first deband and grain, so
+    // pulling grain out of the chain would reorder them
+    else if ((s->use_dering_2 && s->dering_active_2) || (s->use_denoise_2 && !s->no_denoise) ||
+             (s->use_sharpen_2 && !s->no_sharpen) || (s->use_deband_2 && !s->no_deband))
+        *why = "second-pass stages are enabled";
+    else return false;
+    return true;
+}
+
+bool fused_post_enabled(const Settings *s) {
+    if (!s->fused_post || s->preview) return false;
+    if (s->no_sharpen && s->no_deband && s->no_grain) return false;
+    const char *why = NULL;
+    if (!post_stage_unsupported(s, &why)) return true;
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Fused post pass off: %s, using ffmpeg filters\n", why);
+    log_once(NOTE_FUSED_POST_OFF, msg);
+    return false;
+}
+
+/* Same thresholds build_filter_stages hands to ffmpeg's deband */
+static void deband_params(const Settings *s, FusedParams *fp) {
+    fp->deband_reach = 1;     // keeps the row ring small when off
+    if (s->no_deband) return;
+    fp->deband_reach = KERNEL_MAX_REACH;
+    double thr;
+    if (!strcmp(s->deband_method, "f3kdb")) {
+        double y = atof(s->f3kdb_y);
+        thr = y > 0 ? y / 2000.0 : 0.03;
+        if (thr > 0.5) thr = 0.5;
+        if (thr < 0.001) thr = 0.001;
+        int r = atoi(s->f3kdb_range);
+        if (r >= 1 && r < KERNEL_MAX_REACH) fp->deband_reach = r;
+    } else {
+        thr = atof(s->deband_strength);
+        if (thr <= 0) thr = 0.02;
+        if (thr > 0.5) thr = 0.5;
+    }
+    fp->deband_threshold = (float)thr;
+}
+
+FusedPost *fused_post_create(const Settings *s, int width, int threads) {
+    if (width < 1) return NULL;
+    FusedPost *fp = calloc(1, sizeof(*fp));
+    if (!fp) return NULL;
+    fp->width = width;
+    fp->noise = malloc(((size_t)width + NOISE_SHIFT) * sizeof(float));
+    fp->kernels = up60p_kernels_create(threads);
+    if (!fp->noise || !fp->kernels) {
+        fused_post_destroy(fp);
+        return NULL;
+    }
+    // Fixed LCG so a given job always gets the same grain
+    uint32_t state = 0x2545F491u;
+    for (int i = 0; i < width + NOISE_SHIFT; i++) {
+        state = state * 1664525u + 1013904223u;
+        fp->noise[i] = (float)(state >> 8) / 16777216.0f - 0.5f;
+    }
+
+    FusedParams *p = &fp->params;
+    if (!s->no_sharpen) {
+        double v = atof(s->sharpen_strength);
+        p->sharpen = (float)(v < 0 ? 0 : v > 1 ? 1 : v);
+    }
+    deband_params(s, p);
+    if (!s->no_grain) {
+        // noise=alls=n adds uniform noise of +-n code values at 8 bits
+        double v = atof(s->use_grain_2 ? s->grain_strength_2 : s->grain_strength);
+        if (v > 0) p->grain = (float)(2.0 * (v > 100 ? 100 : v) / 255.0);
+    }
+    p->noise = fp->noise;
+    return fp;
+}
+
+up60p_error fused_post_apply(FusedPost *fp, const up60p_frame *src, up60p_frame *dst,
+                             long long index) {
+    if (!fp || !src || src->width > fp->width) return UP60P_ERR_INVALID_OPTIONS;
+    FusedParams p = fp->params;
+    p.seed = (uint32_t)index;
+    return kernels_apply_fused(fp->kernels, &p, src, dst);
+}
+
+void fused_post_destroy(FusedPost *fp) {
+    if (!fp) return;
+    up60p_kernels_destroy(fp->kernels);
+    free(fp->noise);
+    free(fp);
+}
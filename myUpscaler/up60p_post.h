@@ -0,0 +1,24 @@
+#ifndef UP60P_POST_H
+#define UP60P_POST_H
+
+#include "up60p_common.h"
+
+typedef struct FusedPost FusedPost;
+
+/* fused_post is set and every post-scale stage it would replace has a
+   native equivalent; logs once why not otherwise. Callers run the chain
+   from a copy with post_fused set so ffmpeg skips those stages. */
+bool fused_post_enabled(const Settings *s);
+
+/* Sharpen, deband and grain from s, for frames up to width pixels wide.
+   threads 0 = one per core. */
+FusedPost *fused_post_create(const Settings *s, int width, int threads);
+
+/* One pass from src into dst (same size, not overlapping); index seeds the
+   grain so it changes every frame like noise's allf=t. */
+up60p_error fused_post_apply(FusedPost *fp, const up60p_frame *src, up60p_frame *dst,
+                             long long index);
+
+void fused_post_destroy(FusedPost *fp);
+
+#endif
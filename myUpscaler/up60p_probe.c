@@ -0,0 +1,73 @@
+#include "up60p_probe.h"
+#include "up60p_jobs.h"
+
+static void parse_video_line(MediaProbe *p, const char *video) {
+    if (p->fps <= 0) {
+        const char *s = strstr(video, " fps");
+        if (s) {
+            const char *num = s;
+            while (num > video && num[-1] != ' ') num--;
+            p->fps = strtod(num, NULL);
+        }
+    }
+    if (p->width > 0) return;
+    // "..., yuv420p(tv, bt709), 1920x1080 [SAR 1:1 DAR 16:9], ..." - skip 0x31637661 style tags
+    for (const char *s = video; *s; s++) {
+        if (s[-1] != ' ' || !isdigit((unsigned char)*s)) continue;
+        int w = 0, h = 0;
+        if (sscanf(s, "%dx%d", &w, &h) == 2 && w >= 16 && h >= 16) {
+            p->width = w;
+            p->height = h;
+            return;
+        }
+    }
+}
+
+static void probe_line(const char *line, void *ctx) {
+    MediaProbe *p = ctx;
+    const char *s;
+    if ((s = strstr(line, "pts_time:"))) {
+        if (p->nkeys == p->cap) {
+            int cap = p->cap ? p->cap * 2 : 256;
+            double *tmp = realloc(p->keys, (size_t)cap * sizeof(*tmp));
+            if (!tmp) return;
+            p->keys = tmp;
+            p->cap = cap;
+        }
+        p->keys[p->nkeys++] = strtod(s + 9, NULL);
+    } else if ((s = strstr(line, "Duration: "))) {
+        int hh, mm; double ss;
+        if (sscanf(s + 10, "%d:%d:%lf", &hh, &mm, &ss) == 3) p->duration = hh * 3600.0 + mm * 60.0 + ss;
+    } else if (strstr(line, "Stream #")) {
+        // The side data lines that follow belong to this stream
+        s = strstr(line, "Video:");
+        p->in_video = s && p->width <= 0;
+        if (s && strstr(line, "Stream #0")) parse_video_line(p, s);
+    } else if (p->in_video && (s = strstr(line, "rotation of "))) {
+        // "displaymatrix: rotation of -90.00 degrees"
+        double deg = strtod(s + 12, NULL);
+        p->rotation = ((int)(deg < 0 ? deg - 0.5 : deg + 0.5) % 360 + 360) % 360;
+    }
+}
+
+/* keyframes=true decodes only keyframes (-skip_frame nokey) and records
+   their timestamps; otherwise a single frame is decoded for the banner. */
+int probe_media(const char *ffmpeg, const char *in, bool keyframes, MediaProbe *out) {
+    memset(out, 0, sizeof(*out));
+    char *key_args[] = {
+        (char*)ffmpeg, "-hide_banner", "-nostats", "-skip_frame", "nokey", "-i", (char*)in,
+        "-map", "0:v:0", "-vf", "showinfo", "-an", "-f", "null", "-", NULL
+    };
+    char *info_args[] = {
+        (char*)ffmpeg, "-hide_banner", "-nostats", "-i", (char*)in,
+        "-map", "0:v:0", "-frames:v", "1", "-an", "-f", "null", "-", NULL
+    };
+    return execute_ffmpeg_capture(keyframes ? key_args : info_args, probe_line, out);
+}
+
+void probe_free(MediaProbe *p) {
+    if (!p) return;
+    free(p->keys);
+    p->keys = NULL;
+    p->nkeys = p->cap = 0;
+}
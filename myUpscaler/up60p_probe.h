@@ -0,0 +1,20 @@
+#ifndef UP60P_PROBE_H
+#define UP60P_PROBE_H
+
+#include "up60p_common.h"
+
+/* Stream facts scraped from ffmpeg's own input banner, so the core does not
+   need ffprobe or libavformat to plan work. */
+typedef struct {
+    double duration, fps;
+    int width, height;     /* coded size, before any display rotation */
+    int rotation;          /* display matrix rotation: 0, 90, 180 or 270 */
+    bool in_video;         /* parsing the first video stream's lines */
+    double *keys;          /* keyframe pts in seconds, only with keyframes=true */
+    int nkeys, cap;
+} MediaProbe;
+
+int probe_media(const char *ffmpeg, const char *in, bool keyframes, MediaProbe *out);
+void probe_free(MediaProbe *p);
+
+#endif
@@ -0,0 +1,332 @@
+#include "up60p_ratecontrol.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_filters.h"
+#include "up60p_probe.h"
+#include "up60p_segment.h"
+#include "up60p_hwaccel.h"
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// Where the search starts; a refinement probe is added near the crossing
+static const double RATE_PROBES[] = { 18, 23, 28, 33 };
+
+typedef struct {
+    const char *ffmpeg, *in, *threads, *metric;
+    char *cod;
+    char dir[PATH_MAX];
+    double start[RATE_WINDOWS], len[RATE_WINDOWS];
+    int windows;
+} RateJob;
+
+typedef struct {
+    const char *metric;
+    double score;
+    bool seen;
+} MetricScan;
+
+double parse_bitrate(const char *s) {
+    if (!s || !*s) return 0;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v <= 0) return 0;
+    switch (*end) {
+        case 'k': case 'K': v *= 1e3; break;
+        case 'm': case 'M': v *= 1e6; break;
+        case 'g': case 'G': v *= 1e9; break;
+        default: break;
+    }
+    return v;
+}
+
+double interpolate_crf(const RateProbe *probes, int n, double target, double *kbps) {
+    if (n <= 0) return -1;
+    const RateProbe *lo = &probes[0], *hi = &probes[n - 1];
+    double t = 0;
+    if (target >= lo->score) {
+        hi = lo;                  // even the best probe misses: take it
+    } else if (target <= hi->score) {
+        lo = hi;                  // even the smallest probe is good enough
+    } else {
+        for (int i = 0; i + 1 < n; i++) {
+            if (probes[i].score >= target && probes[i + 1].score <= target) {
+                lo = &probes[i];
+                hi = &probes[i + 1];
+                break;
+            }
+        }
+        double span = lo->score - hi->score;
+        t = span > 0 ? (lo->score - target) / span : 0;
+    }
+    if (kbps) {
+        *kbps = lo->kbps > 0 && hi->kbps > 0 ? exp(log(lo->kbps) + t * (log(hi->kbps) - log(lo->kbps)))
+                                             : lo->kbps + t * (hi->kbps - lo->kbps);
+    }
+    return lo->crf + t * (hi->crf - lo->crf);
+}
+
+static double default_target(const char *metric) {
+    if (!strcmp(metric, "ssim")) return 0.98;
+    if (!strcmp(metric, "psnr")) return 40.0;
+    return 93.0;
+}
+
+/* Summary lines ffmpeg prints at info level when the comparison ends */
+static void scan_metric(const char *line, void *ctx) {
+    MetricScan *m = ctx;
+    const char *p = NULL;
+    if (!strcmp(m->metric, "vmaf")) {
+        if ((p = strstr(line, "VMAF score:"))) p += 11;
+    } else if (!strcmp(m->metric, "ssim")) {
+        if (strstr(line, "SSIM ") && (p = strstr(line, "All:"))) p += 4;
+    } else if (strstr(line, "PSNR ") && (p = strstr(line, "average:"))) {
+        p += 8;
+    }
+    if (!p) return;
+    while (*p == ' ') p++;
+    // Identical frames report inf
+    m->score = !strncmp(p, "inf", 3) ? 100.0 : atof(p);
+    m->seen = true;
+}
+
+static void window_path(const RateJob *j, int k, const char *what, char *path, size_t size) {
+    snprintf(path, size, "%s/%s_%d.%s", j->dir, what, k, !strcmp(what, "ref") ? "mkv" : "mp4");
+}
+
+/* Restored chain over one window, lossless, as the reference every probe
+   is scored against */
+static int render_reference(const RateJob *j, int k, const char *vf) {
+    char ss[32], tt[32], ref[PATH_MAX];
+    snprintf(ss, sizeof(ss), "%.3f", j->start[k]);
+    snprintf(tt, sizeof(tt), "%.3f", j->len[k]);
+    window_path(j, k, "ref", ref, sizeof(ref));
+
+    HwPlan hw;
+    bool on_device = hw_plan(&S, false, &hw);
+    char *args[48]; int a = 0;
+    args[a++] = (char*)j->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-nostats"; args[a++] = "-y";
+    a = append_hw_input_args(args, a, on_device ? &hw : NULL, S.hwaccel);
+    args[a++] = "-ss"; args[a++] = ss; args[a++] = "-t"; args[a++] = tt;
+    args[a++] = "-i"; args[a++] = (char*)j->in;
+    args[a++] = "-vf"; args[a++] = (char*)vf;
+    args[a++] = "-map"; args[a++] = "0:v:0"; args[a++] = "-an";
+    args[a++] = "-c:v"; args[a++] = "ffv1"; args[a++] = "-level"; args[a++] = "3";
+    args[a++] = ref;
+    args[a] = NULL;
+    return execute_ffmpeg_unmetered(args);
+}
+
+static int score_window(const RateJob *j, int k, const char *crf, double *score, double *kbits) {
+    char ref[PATH_MAX], enc[PATH_MAX], x265_fixed[512] = "";
+    window_path(j, k, "ref", ref, sizeof(ref));
+    window_path(j, k, "probe", enc, sizeof(enc));
+
+    RateControl rc = { .crf = crf };
+    char *args[64]; int a = 0;
+    args[a++] = (char*)j->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-nostats"; args[a++] = "-y";
+    args[a++] = "-i"; args[a++] = ref;
+    args[a++] = "-map"; args[a++] = "0:v:0"; args[a++] = "-an";
+    a = append_video_encoder_args_rc(args, a, j->cod, output_pix_fmt(), j->threads, &rc, x265_fixed, sizeof(x265_fixed));
+    args[a++] = enc;
+    args[a] = NULL;
+    int rcode = execute_ffmpeg_unmetered(args);
+    if (rcode != 0) return rcode;
+
+    struct stat st;
+    *kbits = stat(enc, &st) == 0 ? st.st_size * 8.0 / 1000.0 : 0;
+
+    // libvmaf wants the distorted input first
+    char graph[64];
+    if (!strcmp(j->metric, "vmaf")) {
+        snprintf(graph, sizeof(graph), "[0:v][1:v]libvmaf%s%s", *j->threads ? "=n_threads=" : "", j->threads);
+    } else {
+        snprintf(graph, sizeof(graph), "[0:v][1:v]%s", j->metric);
+    }
+    a = 0;
+    args[a++] = (char*)j->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "info"; args[a++] = "-nostats";
+    args[a++] = "-i"; args[a++] = enc; args[a++] = "-i"; args[a++] = ref;
+    args[a++] = "-lavfi"; args[a++] = graph; args[a++] = "-f"; args[a++] = "null"; args[a++] = "-";
+    args[a] = NULL;
+    MetricScan m = { .metric = j->metric };
+    rcode = execute_ffmpeg_capture(args, scan_metric, &m);
+    if (rcode == 0 && !m.seen) {
+        char msg[96];
+        snprintf(msg, sizeof(msg), "Target quality: ffmpeg printed no %s score\n", j->metric);
+        log_msg(msg);
+        return -1;
+    }
+    *score = m.score;
+    return rcode;
+}
+
+static int probe_crf(const RateJob *j, double crf, RateProbe *out) {
+    char crf_s[16];
+    snprintf(crf_s, sizeof(crf_s), "%.1f", crf);
+    double score = 0, kbits = 0, secs = 0;
+    for (int k = 0; k < j->windows; k++) {
+        if (up60p_is_cancelled()) return -1;
+        double s = 0, b = 0;
+        int rc = score_window(j, k, crf_s, &s, &b);
+        if (rc != 0) return rc;
+        score += s;
+        kbits += b;
+        secs += j->len[k];
+    }
+    out->crf = crf;
+    out->score = score / j->windows;
+    out->kbps = secs > 0 ? kbits / secs : 0;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Target quality: crf %s -> %s %.4g, %.0f kb/s\n", crf_s, j->metric, out->score, out->kbps);
+    log_msg(msg);
+    return 0;
+}
+
+static void insert_probe(RateProbe *probes, int *n, RateProbe p) {
+    int i = *n;
+    while (i > 0 && probes[i - 1].crf > p.crf) {
+        probes[i] = probes[i - 1];
+        i--;
+    }
+    probes[i] = p;
+    (*n)++;
+}
+
+static void remove_work_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *e;
+        char path[PATH_MAX];
+        while ((e = readdir(d))) {
+            if (e->d_name[0] == '.') continue;
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+static int encode_final(const RateJob *j, const char *out, const char *vf, const RateControl *rc, bool first_pass) {
+    HwPlan hw;
+    bool on_device = hw_plan(&S, false, &hw);
+    char x265_fixed[PATH_MAX + 256] = "";
+    char *args[96]; int a = 0;
+    args[a++] = (char*)j->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-stats"; args[a++] = "-y";
+    a = append_hw_input_args(args, a, on_device ? &hw : NULL, S.hwaccel);
+    args[a++] = "-i"; args[a++] = (char*)j->in;
+    args[a++] = "-vf"; args[a++] = (char*)vf;
+    args[a++] = "-map"; args[a++] = "0:v:0";
+    if (!first_pass) { args[a++] = "-map"; args[a++] = "0:a?"; }
+    a = append_video_encoder_args_rc(args, a, j->cod, output_pix_fmt(), j->threads, rc, x265_fixed, sizeof(x265_fixed));
+    if (first_pass) {
+        args[a++] = "-an"; args[a++] = "-f"; args[a++] = "null"; args[a++] = "-";
+    } else {
+        args[a++] = "-c:a"; args[a++] = "aac"; args[a++] = "-b:a"; args[a++] = S.audio_bitrate;
+        if (*S.movflags) { args[a++] = "-movflags"; args[a++] = S.movflags; }
+        args[a++] = (char*)out;
+    }
+    args[a] = NULL;
+    return first_pass ? execute_ffmpeg_unmetered(args) : execute_ffmpeg_command(args);
+}
+
+int process_target_quality(const char *in, const char *out, const char *ffmpeg,
+                           const char *vf, const char *threads) {
+    if (!*S.target_metric) return SEGMENT_FALLBACK;
+    const char *metric = S.target_metric;
+    if (strcmp(metric, "vmaf") && strcmp(metric, "ssim") && strcmp(metric, "psnr")) {
+        log_msg("Target quality: metric must be vmaf, ssim or psnr, using crf\n");
+        return SEGMENT_FALLBACK;
+    }
+    RateJob j = { .ffmpeg = ffmpeg, .in = in, .threads = threads ? threads : "", .metric = metric,
+                  .cod = pick_video_encoder() };
+    if (strcmp(j.cod, "libx264") && strcmp(j.cod, "libx265")) {
+        log_msg("Target quality: needs libx264 or libx265, using crf\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    MediaProbe info;
+    probe_media(ffmpeg, in, false, &info);
+    probe_free(&info);
+    if (up60p_is_cancelled()) return -1;
+    if (info.duration <= 0) {
+        log_msg("Target quality: input has no duration, using crf\n");
+        return SEGMENT_FALLBACK;
+    }
+    // Windows centred in equal slices; a short input is one window from the start
+    j.windows = info.duration >= 2 * RATE_WINDOWS * RATE_WINDOW_SECONDS ? RATE_WINDOWS : 1;
+    for (int k = 0; k < j.windows; k++) {
+        j.len[k] = j.windows == 1 ? fmin(info.duration, 2 * RATE_WINDOW_SECONDS) : RATE_WINDOW_SECONDS;
+        j.start[k] = j.windows == 1 ? 0 : info.duration * (k + 0.5) / j.windows - j.len[k] / 2;
+    }
+
+    double target = *S.target_score ? atof(S.target_score) : default_target(metric);
+    char msg[256];
+    snprintf(msg, sizeof(msg), "Target quality: %s %.4g over %d sample window%s\n", metric, target,
+             j.windows, j.windows == 1 ? "" : "s");
+    log_msg(msg);
+
+    snprintf(j.dir, sizeof(j.dir), "%s.rate", out);
+    mkdir_p(j.dir);
+    int result = 0;
+    for (int k = 0; k < j.windows && result == 0; k++) result = render_reference(&j, k, vf);
+
+    RateProbe probes[RATE_MAX_PROBES];
+    int n = 0;
+    for (int i = 0; i < ARR_LEN(RATE_PROBES) && result == 0; i++) {
+        RateProbe p;
+        result = probe_crf(&j, RATE_PROBES[i], &p);
+        if (result == 0) insert_probe(probes, &n, p);
+    }
+
+    double kbps = 0, crf = 0;
+    if (result == 0) {
+        crf = interpolate_crf(probes, n, target, &kbps);
+        // One more probe at the crossing unless a probe already sits on it
+        double near = round(crf * 2) / 2;
+        bool probed = false;
+        for (int i = 0; i < n; i++) probed |= fabs(probes[i].crf - near) < 0.5;
+        if (!probed && n < RATE_MAX_PROBES) {
+            RateProbe p;
+            result = probe_crf(&j, near, &p);
+            if (result == 0) {
+                insert_probe(probes, &n, p);
+                crf = interpolate_crf(probes, n, target, &kbps);
+            }
+        }
+    }
+
+    if (result == 0 && !up60p_is_cancelled()) {
+        char crf_s[16], rate_s[32] = "", max_s[32] = "", buf_s[32] = "", passlog[PATH_MAX];
+        snprintf(crf_s, sizeof(crf_s), "%.1f", crf);
+        snprintf(passlog, sizeof(passlog), "%s/pass", j.dir);
+        double cap = parse_bitrate(S.max_bitrate) / 1000.0;
+        if (cap > 0) {
+            snprintf(max_s, sizeof(max_s), "%.0fk", cap);
+            snprintf(buf_s, sizeof(buf_s), "%.0fk", 2 * cap);
+        }
+        RateControl rc = { .crf = crf_s, .maxrate = cap > 0 ? max_s : NULL, .bufsize = cap > 0 ? buf_s : NULL };
+        if (S.two_pass) {
+            double abr = cap > 0 && kbps > cap ? cap : kbps;
+            snprintf(rate_s, sizeof(rate_s), "%.0fk", abr);
+            rc.bitrate = rate_s;
+            rc.passlog = passlog;
+        }
+
+        snprintf(msg, sizeof(msg), "Target quality: crf %s, ~%.0f kb/s predicted%s%s%s\n", crf_s, kbps,
+                 S.two_pass ? ", two-pass at " : "", S.two_pass ? rate_s : "",
+                 cap > 0 && kbps > cap ? " (capped)" : "");
+        log_msg(msg);
+
+        if (S.two_pass) {
+            rc.pass = "1";
+            result = encode_final(&j, out, vf, &rc, true);
+            rc.pass = "2";
+        }
+        if (result == 0 && !up60p_is_cancelled()) result = encode_final(&j, out, vf, &rc, false);
+    }
+    remove_work_dir(j.dir);
+    return up60p_is_cancelled() ? -1 : result;
+}
@@ -0,0 +1,32 @@
+#ifndef UP60P_RATECONTROL_H
+#define UP60P_RATECONTROL_H
+
+#include "up60p_common.h"
+
+#define RATE_WINDOWS 4            /* sample windows spread over the input */
+#define RATE_WINDOW_SECONDS 3.0
+#define RATE_MAX_PROBES 8
+
+/* Mean score and bitrate of the sample windows at one CRF */
+typedef struct {
+    double crf, score, kbps;
+} RateProbe;
+
+/* CRF where the score curve crosses target, linear between the probes that
+   bracket it (probes sorted by crf, score falling as crf rises); clamps to
+   the probed range. kbps gets the bitrate at that CRF, interpolated in the
+   log domain since size falls roughly exponentially with CRF. */
+double interpolate_crf(const RateProbe *probes, int n, double target, double *kbps);
+
+/* "8M", "4500k", "1200000" -> bits per second, 0 if unparseable */
+double parse_bitrate(const char *s);
+
+/* target_metric mode: renders the restored chain over a few sample windows
+   losslessly, encodes them at several CRFs, scores each against the
+   rendering and runs the full encode at the CRF that meets target_score,
+   capped by max_bitrate and optionally as two-pass ABR. Returns
+   SEGMENT_FALLBACK when the mode is off or the encoder has no CRF. */
+int process_target_quality(const char *in, const char *out, const char *ffmpeg,
+                           const char *vf, const char *threads);
+
+#endif
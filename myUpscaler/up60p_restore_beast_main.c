@@ -1,5 +1,25 @@
 #include "up60p_settings.h"
 #include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_libav.h"
+#include "up60p_filters.h"
+#include "up60p_segment.h"
+#include "up60p_adaptive.h"
+#include "up60p_graph.h"
+#include "up60p_cache.h"
+#include "up60p_pipe.h"
+#include "up60p_post.h"
+#include "up60p_hwaccel.h"
+#include "up60p_ratecontrol.h"
+#include "up60p_resume.h"
+#include "up60p_frc.h"
+#include "up60p_imgbatch.h"
+#include "up60p_stages.h"
+#include "up60p_watch.h"
+#include "up60p_topology.h"
+#include "up60p_memory.h"
+#include "up60p_probe.h"
+#include "up60p_context.h"
 #include "up60p.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,101 +29,80 @@
 #include <termios.h>
 
 Settings DEF;
-Settings S;
 
-int execute_ffmpeg_command(char *const argv[]) {
-    int stdout_pipe[2];
-    int stderr_pipe[2];
-    pid_t pid;
-    int status;
-    
-    if (pipe(stdout_pipe) < 0 || pipe(stderr_pipe) < 0) {
-        return -1;
-    }
-    
-    pid = fork();
-    if (pid == 0) {
-        dup2(stdout_pipe[1], STDOUT_FILENO);
-        dup2(stderr_pipe[1], STDERR_FILENO);
-        close(stdout_pipe[0]);
-        close(stdout_pipe[1]);
-        close(stderr_pipe[0]);
-        close(stderr_pipe[1]);
-        
-        execvp(argv[0], argv);
-        
-        // exec failed
-        fprintf(stderr, "execvp failed: %s (%d)\n", strerror(errno), errno);
-        _exit(127);
-    }
-    
-    if (pid < 0) {
-        fprintf(stderr, "fork failed: %s (%d)\n", strerror(errno), errno);
-        return -1;
-    }
-    
-    close(stdout_pipe[1]);
-    close(stderr_pipe[1]);
-    
-    char buf[1024];
-    ssize_t n;
-    
-    while ((n = read(stderr_pipe[0], buf, sizeof(buf) - 1)) > 0) {
-        buf[n] = 0;
-        if (global_log_cb) global_log_cb(buf);
-    }
-    
-    close(stdout_pipe[0]);
-    close(stderr_pipe[0]);
-    
-    if (waitpid(pid, &status, 0) < 0) {
-        return -1;
-    }
-    
-    if (WIFEXITED(status)) {
-        return WEXITSTATUS(status);
-    }
-    
-    return -1;
-}
-
-static volatile sig_atomic_t cancel_requested = 0;
 //
 //static const char *SCRIPT_NAME = "up60p_restore_beast";
 //static char NULL_BUF[PATH_MAX];
-static char FFMPEG_PATH[PATH_MAX] = {0};
-int DRY_RUN = 0;
 
-static const char* get_bundled_ffmpeg_path(void) {
-    if (FFMPEG_PATH[0] != '\0') {
-        return FFMPEG_PATH;
-    }
-    
+static bool executable_dir(char *dir, size_t size) {
     char exe_path[PATH_MAX];
-    uint32_t size = sizeof(exe_path);
-    
-    if (_NSGetExecutablePath(exe_path, &size) != 0) {
-        return NULL;
+#ifdef __APPLE__
+    uint32_t len = sizeof(exe_path);
+    if (_NSGetExecutablePath(exe_path, &len) != 0) return false;
+#else
+    ssize_t len = readlink("/proc/self/exe", exe_path, sizeof(exe_path) - 1);
+    if (len <= 0) return false;
+    exe_path[len] = '\0';
+#endif
+    safe_copy(dir, dirname(exe_path), size);
+    return true;
+}
+
+/* First executable "ffmpeg" on PATH, for hosts without a bundled copy */
+static bool ffmpeg_on_path(char *out, size_t size) {
+    const char *path = getenv("PATH");
+    if (!path) return false;
+    while (*path) {
+        const char *end = strchr(path, ':');
+        size_t n = end ? (size_t)(end - path) : strlen(path);
+        if (n > 0 && n < PATH_MAX - 8) {
+            snprintf(out, size, "%.*s/ffmpeg", (int)n, path);
+            if (access(out, X_OK) == 0) return true;
+        }
+        path += n + (end ? 1 : 0);
+    }
+    return false;
+}
+
+/* up60p_set_ffmpeg_path, then $UP60P_FFMPEG, then the copy bundled next
+   to the executable, then PATH; resolved once per context */
+const char* get_bundled_ffmpeg_path(void) {
+    char *path = current_context()->ffmpeg_path;
+    size_t size = sizeof(current_context()->ffmpeg_path);
+    if (path[0] != '\0') {
+        return path;
     }
     
-    char exe_dir_buf[PATH_MAX];
-    strncpy(exe_dir_buf, exe_path, sizeof(exe_dir_buf) - 1);
-    exe_dir_buf[sizeof(exe_dir_buf) - 1] = '\0';
-    
-    char *exe_dir = dirname(exe_dir_buf);
-    
-    snprintf(FFMPEG_PATH, sizeof(FFMPEG_PATH), "%s/ThirdParty/FFmpeg/ffmpeg", exe_dir);
+    const char *env = getenv("UP60P_FFMPEG");
+    if (env && *env && access(env, X_OK) == 0) {
+        safe_copy(path, env, size);
+        return path;
+    }
     
-    if (access(FFMPEG_PATH, X_OK) != 0) {
-        FFMPEG_PATH[0] = '\0';
-        return NULL;
+    char exe_dir[PATH_MAX];
+    if (executable_dir(exe_dir, sizeof(exe_dir))) {
+        snprintf(path, size, "%s/ThirdParty/FFmpeg/ffmpeg", exe_dir);
+        if (access(path, X_OK) == 0) return path;
     }
     
-    return FFMPEG_PATH;
+    if (ffmpeg_on_path(path, size)) return path;
+    path[0] = '\0';
+    return NULL;
 }
 
-static void process_file(const char *in, const char *ffmpeg, bool batch);
-static void process_directory(const char *dir, const char *ffmpeg);
+up60p_error up60p_set_ffmpeg_path(const char *path) {
+    up60p_context *ctx = current_context();
+    if (!path || !*path) {
+        ctx->ffmpeg_path[0] = '\0';
+        return UP60P_OK;
+    }
+    if (access(path, X_OK) != 0) return UP60P_ERR_FFMPEG_NOT_FOUND;
+    safe_copy(ctx->ffmpeg_path, path, sizeof(ctx->ffmpeg_path));
+    return UP60P_OK;
+}
+
+static int process_file(const char *in, const char *ffmpeg, int job_id, const char *threads);
+static void process_directory(const char *dir, PathList *files);
 //static int ar_menu_choose(const char *prompt, const char **items, int n, int start_index);
 
 typedef struct { struct termios orig; int fd; bool ok; } TermCtx;
@@ -118,308 +117,110 @@ static void prompt_edit(const char *name, char *buf, size_t sz) {
     }
 }
 
-static void build_hqdn3d_filter(SB *vf, const char *strength_str) {
-    double strength = parse_strength(strength_str);
-    if (strength <= 0) strength = 4.0;
-    
-    
-    double luma_spatial = strength;
-    if (luma_spatial < 1.0) luma_spatial = 1.0;
-    if (luma_spatial > 10.0) luma_spatial = 10.0;
-    
-    
-    double chroma_spatial = luma_spatial * 0.75;
-    double luma_tmp = luma_spatial * 1.5;
-    double chroma_tmp = luma_tmp * 0.75;
-    
-    sb_fmt(vf, "hqdn3d=%.2f:%.2f:%.2f:%.2f,", luma_spatial, chroma_spatial, luma_tmp, chroma_tmp);
+/* The in-process engine covers the software path only; anything needing the
+   CLI's extra outputs or hw device setup keeps forking ffmpeg. */
+static bool use_libav_backend(const char *cod) {
+    if (strcmp(S.backend, "libav")) return false;
+    
+    const char *why = NULL;
+    if (!libav_available()) why = "not compiled in (UP60P_HAVE_LIBAV)";
+    else if (S.preview) why = "live preview needs the CLI";
+    else if (strcmp(S.hwaccel, "none")) why = "hwaccel needs the CLI";
+    else if (cod && strcmp(cod, "libx264") && strcmp(cod, "libx265")) why = "hardware encoders need the CLI";
+    
+    if (why) {
+        char msg[160];
+        snprintf(msg, sizeof(msg), "libav backend: %s, using ffmpeg CLI\n", why);
+        log_once(NOTE_LIBAV_OFF, msg);
+    }
+    return why == NULL;
 }
 
-
-static void build_nlmeans_filter(SB *vf, const char *strength_str) {
-    double strength = parse_strength(strength_str);
-    if (strength <= 0) strength = 1.0;
-    
-    
-    if (strength < 1.0) strength = 1.0;
-    if (strength > 30.0) strength = 30.0;
-    
-    
-    int patch_size = 7;
-    if (strength > 5.0) patch_size = 9;
-    if (strength > 10.0) patch_size = 11;
-    if (strength > 15.0) patch_size = 13;
-    if (strength > 20.0) patch_size = 15;
-    
-    
-    int research_size = 15;
-    if (strength > 5.0) research_size = 17;
-    if (strength > 10.0) research_size = 19;
-    if (strength > 15.0) research_size = 21;
-    if (strength > 20.0) research_size = 23;
-    if (strength > 25.0) research_size = 25;
-    
-    sb_fmt(vf, "nlmeans=s=%.2f:p=%d:r=%d,", strength, patch_size, research_size);
+static void report_file(int job_id, const char *in, const char *out, int exit_code, up60p_error status) {
+    up60p_job_result r = { job_id, in, out, exit_code, status };
+    report_job(&r);
 }
 
-
-static void build_atadenoise_filter(SB *vf, const char *strength_str) {
-    double strength = parse_strength(strength_str);
-    if (strength <= 0) strength = 9.0;
-    
-    
-    double threshold = strength;
-    if (threshold < 1.0) threshold = 1.0;
-    if (threshold > 20.0) threshold = 20.0;
-    
-    
-    
-    double param_a = 0.01 + (threshold / 20.0) * 0.03;
-    double param_b = 0.02 + (threshold / 20.0) * 0.06;
-    
-    sb_fmt(vf, "atadenoise=s=%.2f:0a=%.3f:0b=%.3f,", threshold, param_a, param_b);
+/* <outdir or the input's dir>/<name>_[restored].png|mp4 */
+static void output_path(const char *in, bool img, char *out, size_t size) {
+    char t[PATH_MAX], base[PATH_MAX], outdir[PATH_MAX];
+    safe_copy(t, in, sizeof(t));
+    safe_copy(base, basename(t), sizeof(base));
+    char *dot = strrchr(base, '.');
+    if (dot) *dot = 0;
+    
+    if (*S.outdir) {
+        safe_copy(outdir, S.outdir, sizeof(outdir));
+    } else {
+        safe_copy(t, in, sizeof(t));
+        safe_copy(outdir, dirname(t), sizeof(outdir));
+    }
+    snprintf(out, size, "%s/%s_[restored].%s", outdir, base, img ? "png" : "mp4");
 }
 
-
-static void build_dering_filter(SB *vf, const char *strength_str) {
-    double dstr = parse_strength(strength_str);
-    if (dstr <= 0) dstr = 0.5;
-    double luma = dstr * 8.0;
-    double chroma = luma * 0.75;
-    double luma_tmp = luma * 1.5;
-    double chroma_tmp = luma_tmp * 0.75;
-    if (luma > 15.0) luma = 15.0;
-    sb_fmt(vf, "hqdn3d=%.2f:%.2f:%.2f:%.2f,", luma, chroma, luma_tmp, chroma_tmp);
+/* Admission only matters when several encodes can be up at once: a
+   directory batch, one file split into parallel segments, or jobs of
+   several contexts. */
+static bool memory_gated(void) {
+    up60p_context *ctx = current_context();
+    return S.mem_budget_mb >= 0 && !ctx->dry_run &&
+           (ctx->batch_workers > 1 || S.segments > 1 || S.resume_seconds > 0 || context_count() > 0);
 }
 
-static void build_deblock_filter(SB *vf, const char *mode, const char *thresh) {
-    if (*thresh) {
-        sb_fmt(vf, "deblock=filter=%s:block=8:%s,", mode, thresh);
+/* Registers the job's predicted peak so its encodes wait for room; a file
+   whose size can't be read runs unmetered. */
+static void estimate_memory(const char *in, bool img, const char *ffmpeg, int job_id) {
+    int width = 0, height = 0;
+    if (img) {
+        ImageHeader h;
+        if (read_image_header(in, &h)) { width = h.width; height = h.height; }
     } else {
-        sb_fmt(vf, "deblock=filter=%s:block=8,", mode);
-    }
+        MediaProbe mp = {0};
+        if (probe_media(ffmpeg, in, false, &mp) == 0) { width = mp.width; height = mp.height; }
+        probe_free(&mp);
+    }
+    if (width <= 0 || height <= 0) return;
+    
+    Arena arena = {0};
+    FilterGraph g;
+    fg_init(&g, &arena);
+    build_filter_graph(&S, &g, img);
+    MemEstimate e;
+    mem_predict(&g, width, height, atof(S.scale_factor), img ? NULL : pick_video_encoder(),
+                img ? "rgb24" : output_pix_fmt(), &e);
+    arena_free(&arena);
+    mem_set_job(job_id, &e);
 }
 
-
-static void process_file(const char *in, const char *ffmpeg, bool batch) {
-    (void)batch; char outdir[PATH_MAX], base[PATH_MAX], out[PATH_MAX];
+/* threads: per-job -threads value handed out by the scheduler, "" keeps ffmpeg's default. */
+static int process_file(const char *in, const char *ffmpeg, int job_id, const char *threads) {
+    char out[PATH_MAX];
     bool img = is_image(in);
+    set_current_job(job_id);
     
-    if (up60p_is_cancelled()) return;
-    
-    {
-        char t[PATH_MAX];
-        safe_copy(t, in, sizeof(t));
-        char *b = basename(t);
-        safe_copy(base, b, sizeof(base));
-        
-        char *dot = strrchr(base, '.');
-        if (dot) *dot = 0;
-        
-        if (*S.outdir) {
-            safe_copy(outdir, S.outdir, sizeof(outdir));
-        } else {
-            safe_copy(t, in, sizeof(t));
-            char *d = dirname(t);
-            safe_copy(outdir, d, sizeof(outdir));
-        }
+    if (up60p_is_cancelled()) {
+        report_file(job_id, in, NULL, -1, UP60P_ERR_CANCELLED);
+        return -1;
     }
-    
-    if (img) snprintf(out, sizeof(out), "%s/%s_[restored].png", outdir, base);
-    else snprintf(out, sizeof(out), "%s/%s_[restored].mp4", outdir, base);
+    output_path(in, img, out, sizeof(out));
     
     SB vf = {0};
-    
-    
-    if (!img) {
-        if (S.pci_safe_mode) sb_append(&vf, "format=yuv420p,");
-        else sb_append(&vf, "format=yuv444p16le,");
-        
-        if (!S.no_decimate) sb_append(&vf, "mpdecimate=hi=64*12,setpts=PTS,");
-    }
-    
-    if (!S.no_deblock) {
-        build_deblock_filter(&vf, S.deblock_mode, S.deblock_thresh);
-    }
-    
-    if (!S.no_denoise) {
-        if (!strcmp(S.denoiser, "bm3d")) {
-            if (!strcmp(S.denoise_strength, "auto")) sb_append(&vf, "bm3d=estim=final:planes=1,");
-            else {
-                double sigma = parse_strength(S.denoise_strength);
-                if (sigma <= 0) sigma = 2.5;
-                if (sigma > 20.0) sigma = 20.0;
-                sb_fmt(&vf, "bm3d=sigma=%.2f:estim=basic:planes=1,", sigma);
-            }
-        }
-        else if (!strcmp(S.denoiser, "hqdn3d")) {
-            build_hqdn3d_filter(&vf, S.denoise_strength);
-        }
-        else if (!strcmp(S.denoiser, "nlmeans")) {
-            build_nlmeans_filter(&vf, S.denoise_strength);
-        }
-        else if (!strcmp(S.denoiser, "atadenoise")) {
-            build_atadenoise_filter(&vf, S.denoise_strength);
-        }
-    }
-    
-    
-    if (!img && !S.no_interpolate) {
-        if (!strcmp(S.fps, "source") || !strcmp(S.fps, "lock")) {
-            sb_fmt(&vf, "minterpolate=mi_mode=%s:mc_mode=aobmc:me_mode=bidir:vsbmc=1,", S.mi_mode);
-        } else {
-            sb_fmt(&vf, "minterpolate=fps=%s:mi_mode=%s:mc_mode=aobmc:me_mode=bidir:vsbmc=1,", S.fps, S.mi_mode);
-        }
-    }
-    
-    if (!strcmp(S.scaler, "zscale")) {
-        sb_fmt(&vf, "zscale=w=trunc(iw*%s/2)*2:h=trunc(ih*%s/2)*2:filter=lanczos:dither=error_diffusion,", S.scale_factor, S.scale_factor);
-    } else if (!strcmp(S.scaler, "ai")) {
-        if (!strcmp(S.ai_backend, "sr")) {
-            sb_fmt(&vf, "sr=dnn_backend=%s:model='%s'", S.dnn_backend, S.ai_model);
-            if (!strcmp(S.ai_model_type, "srcnn")) sb_fmt(&vf, ":scale_factor=%s", S.scale_factor);
-            sb_append(&vf, ",");
-        } else {
-            sb_fmt(&vf, "dnn_processing=dnn_backend=%s:model='%s':input=x:output=y,", S.dnn_backend, S.ai_model);
-        }
-    } else if (!strcmp(S.scaler, "hw")) {
-        if (!strcmp(S.hwaccel,"cuda")) {
-            sb_fmt(&vf, "scale_npp=trunc(iw*%s/2)*2:trunc(ih*%s/2)*2,", S.scale_factor, S.scale_factor);
-        } else {
-            sb_fmt(&vf, "scale=trunc(iw*%s/2)*2:trunc(ih*%s/2)*2:flags=lanczos,", S.scale_factor, S.scale_factor);
-        }
-    } else {
-        sb_fmt(&vf, "scale=trunc(iw*%s/2)*2:trunc(ih*%s/2)*2:flags=lanczos+accurate_rnd,", S.scale_factor, S.scale_factor);
-    }
-    
-    if (!S.no_sharpen) {
-        if (!strcmp(S.sharpen_method, "unsharp")) {
-            sb_fmt(&vf, "unsharp=%s:%s:%s,", S.usm_radius, S.usm_radius, S.usm_amount);
-        }
-        else sb_fmt(&vf, "cas=strength=%s,", S.sharpen_strength);
-    }
-    
-    if (!S.no_deband) {
-        if (!strcmp(S.deband_method, "gradfun")) sb_fmt(&vf, "gradfun=%s,", S.deband_strength);
-        else if (!strcmp(S.deband_method, "f3kdb")) {
-            
-            double y = atof(S.f3kdb_y);
-            double cb = atof(S.f3kdb_cbcr);
-            double range = atof(S.f3kdb_range);
-            
-            double thr_y = y > 0 ? y / 2000.0 : 0.03;
-            double thr_c = cb > 0 ? cb / 2000.0 : 0.015;
-            
-            if (thr_y > 0.5) thr_y = 0.5;
-            if (thr_c > 0.5) thr_c = 0.5;
-            if (thr_y < 0.001) thr_y = 0.001;
-            
-            int r = (int)range;
-            if (r < 1) r = 16;
-            
-            sb_fmt(&vf, "deband=1thr=%.5f:2thr=%.5f:3thr=%.5f:range=%d:blur=0,", thr_y, thr_c, thr_c, r);
-        }
-        else sb_fmt(&vf, "deband=1thr=%s:b=1,", S.deband_strength);
-    }
-        if (S.use_dering_2 && S.dering_active_2) {
-            build_dering_filter(&vf, S.dering_strength_2);
-        }
-        
-    if (S.use_denoise_2 && !S.no_denoise) {
-        if (!strcmp(S.denoiser_2, "bm3d")) {
-            if (!strcmp(S.denoise_strength_2, "auto")) sb_append(&vf, "bm3d=estim=final:planes=1,");
-            else {
-                double sigma = parse_strength(S.denoise_strength_2);
-                if (sigma <= 0) sigma = 2.5;
-                if (sigma > 20.0) sigma = 20.0;
-                sb_fmt(&vf, "bm3d=sigma=%.2f:estim=basic:planes=1,", sigma);
-            }
-        }
-        else if (!strcmp(S.denoiser_2, "hqdn3d")) {
-            build_hqdn3d_filter(&vf, S.denoise_strength_2);
-        }
-        else if (!strcmp(S.denoiser_2, "nlmeans")) {
-            build_nlmeans_filter(&vf, S.denoise_strength_2);
-        }
-        else if (!strcmp(S.denoiser_2, "atadenoise")) {
-            build_atadenoise_filter(&vf, S.denoise_strength_2);
-        }
-    }
-    
-    if (S.use_sharpen_2 && !S.no_sharpen) {
-        if (!strcmp(S.sharpen_method_2, "unsharp")) {
-            sb_fmt(&vf, "unsharp=%s:%s:%s,", S.usm_radius_2, S.usm_radius_2, S.usm_amount_2);
-        }
-        else sb_fmt(&vf, "cas=strength=%s,", S.sharpen_strength_2);
-    }
-    
-    if (S.use_deband_2 && !S.no_deband) {
-        if (!strcmp(S.deband_method_2, "gradfun")) sb_fmt(&vf, "gradfun=%s,", S.deband_strength_2);
-        else if (!strcmp(S.deband_method_2, "f3kdb")) {
-            
-            double y = atof(S.f3kdb_y_2);
-            double cb = atof(S.f3kdb_cbcr_2);
-            double range = atof(S.f3kdb_range_2);
-            
-            double thr_y = y > 0 ? y / 2000.0 : 0.03;
-            double thr_c = cb > 0 ? cb / 2000.0 : 0.015;
-            
-            if (thr_y > 0.5) thr_y = 0.5;
-            if (thr_c > 0.5) thr_c = 0.5;
-            if (thr_y < 0.001) thr_y = 0.001;
-            
-            int r = (int)range;
-            if (r < 1) r = 16;
-            
-            sb_fmt(&vf, "deband=1thr=%.5f:2thr=%.5f:3thr=%.5f:range=%d:blur=0,", thr_y, thr_c, thr_c, r);
-        }
-        else sb_fmt(&vf, "deband=1thr=%s:b=1,", S.deband_strength_2);
-    }
-    if (!S.no_grain) {
-        if (S.use_grain_2) sb_fmt(&vf, "noise=alls=%s:allf=t,", S.grain_strength_2);
-        else sb_fmt(&vf, "noise=alls=%s:allf=t,", S.grain_strength);
-    }
-    
-    
-    const char *pix = S.use10 ? "yuv420p10le" : "yuv420p";
-    if (S.use10 && (!strcmp(S.encoder,"nvenc") || !strcmp(S.encoder,"hevc_nvenc"))) pix="p010le";
-    if (S.pci_safe_mode) pix = "yuv420p";
-    
-    if (!img) {
-        
-        sb_fmt(&vf, "format=%s,", pix);
-        if (S.use10 && !S.pci_safe_mode) {
-            
-            sb_append(&vf, "limiter=min=64:max=940:planes=15,");
-        } else {
-            
-            sb_append(&vf, "limiter=min=16:max=235:planes=15,");
-        }
-        sb_append(&vf, "setsar=1,");
-    } else {
-        
-        
-    }
-    
-    
-    if (vf.buf && vf.len > 0 && vf.buf[vf.len-1] == ',') {
-        vf.buf[vf.len-1] = '\0';
-        vf.len--;
-    }
+    build_filter_chain(&vf, img);
+    if (memory_gated()) estimate_memory(in, img, ffmpeg, job_id);
+    const char *pix = output_pix_fmt();
+    HwPlan hw;
+    bool on_device = hw_plan(&S, img, &hw);
+    if (on_device && hw.encode) pix = NULL;
     
     char *args[128]; int a=0;
     args[a++] = (char*)ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-stats"; args[a++] = "-y";
-    if (strcmp(S.hwaccel,"none")) {
-        args[a++] = "-hwaccel"; args[a++] = S.hwaccel;
-        if (!strcmp(S.hwaccel, "videotoolbox")) {
-        }
-    }
+    a = append_hw_input_args(args, a, on_device ? &hw : NULL, S.hwaccel);
     args[a++] = "-i"; args[a++] = (char*)in;
     
-    char complex_filter[8192];
+    SB complex_filter = {0};
     if (S.preview) {
-        snprintf(complex_filter, sizeof(complex_filter), "[0:v]%s,split=2[main][prev]", vf.buf);
-        args[a++] = "-filter_complex"; args[a++] = complex_filter;
+        sb_fmt(&complex_filter, "[0:v]%s,split=2[main][prev]", vf.buf);
+        args[a++] = "-filter_complex"; args[a++] = complex_filter.buf;
         args[a++] = "-map"; args[a++] = "[main]";
         args[a++] = "-map"; args[a++] = "0:a?";
     } else {
@@ -427,44 +228,11 @@ static void process_file(const char *in, const char *ffmpeg, bool batch) {
         args[a++] = "-map"; args[a++] = "0:v:0";
         args[a++] = "-map"; args[a++] = "0:a?";
     }
+    char *cod = NULL;
+    char x265_fixed[256] = "";
     if (!img) {
-        char *cod = "libx264";
-        if (!strcmp(S.codec, "hevc")) {
-            if (!strcmp(S.encoder, "nvenc")) cod = "hevc_nvenc"; else if (!strcmp(S.encoder, "qsv")) cod = "hevc_qsv"; else if (!strcmp(S.encoder, "vaapi")) cod = "hevc_vaapi"; else cod = "libx265";
-        } else { if (!strcmp(S.encoder, "nvenc")) cod = "h264_nvenc"; else if (!strcmp(S.encoder, "qsv")) cod = "h264_qsv"; else if (!strcmp(S.encoder, "vaapi")) cod = "h264_vaapi"; }
-        
-        args[a++] = "-c:v"; args[a++] = cod;
-        if (strstr(cod, "hevc") || strstr(cod, "265")) { args[a++] = "-tag:v"; args[a++] = "hvc1"; }
-        args[a++] = "-pix_fmt"; args[a++] = (char*)pix;
-        if (*S.threads) { args[a++] = "-threads"; args[a++] = S.threads; }
-        
-        char x265_fixed[256];
-        if (!strstr(cod, "vaapi")) { args[a++] = "-preset"; args[a++] = S.preset; args[a++] = "-crf"; args[a++] = S.crf; }
-        if (!strcmp(cod, "libx265") && *S.x265_params) {
-            safe_copy(x265_fixed, S.x265_params, sizeof(x265_fixed));
-            
-            for (char *p = x265_fixed; *p; p++) {
-                if (*p == ',') {
-                    char *next = p + 1;
-                    while (*next == ' ' || *next == '\t') next++;
-                    int is_param_separator = 0;
-                    char *check = next;
-                    while (*check && *check != ',' && *check != ':') {
-                        if (*check == '=') {
-                            is_param_separator = 1;
-                            break;
-                        }
-                        check++;
-                    }
-                    if (is_param_separator) {
-                        *p = ':';
-                    }
-                    
-                }
-            }
-            args[a++] = "-x265-params";
-            args[a++] = x265_fixed;
-        }
+        cod = pick_video_encoder();
+        a = append_video_encoder_args(args, a, cod, pix, threads, x265_fixed, sizeof(x265_fixed));
         
         args[a++] = "-c:a"; args[a++] = "aac"; args[a++] = "-b:a"; args[a++] = S.audio_bitrate;
         if (*S.movflags) { args[a++] = "-movflags"; args[a++] = S.movflags; }
@@ -481,38 +249,122 @@ static void process_file(const char *in, const char *ffmpeg, bool batch) {
     }
     args[a] = NULL;
     
+    // An external upscaler replaces the scale stage between two ffmpegs
+    bool pipe_upscale = !S.preview && pipe_upscale_enabled(&S);
+    bool fused = fused_post_enabled(&S);
+    bool native_frc = !img && frc_enabled(&S);
+    bool piped = pipe_upscale || fused || native_frc;
+    bool in_process = !piped && use_libav_backend(cod);
+    bool staged = !img && *S.stage_cache_dir && !S.preview && !piped && !in_process;
+    LibavEncodeParams lp = {
+        .encoder = cod, .pix_fmt = img ? NULL : pix,
+        .crf = img ? NULL : S.crf, .preset = img ? NULL : S.preset,
+        .threads = threads, .x265_params = *x265_fixed ? x265_fixed : NULL,
+        .movflags = img ? NULL : S.movflags, .audio_bitrate = img ? NULL : S.audio_bitrate,
+        .image = img
+    };
+    
     char msg_buf[1024];
     snprintf(msg_buf, sizeof(msg_buf), "Processing: %s\n", in);
     
-    if (global_log_cb) {
+    int result = 0;
+    up60p_error status = UP60P_OK;
+    if (context_log_cb(current_context())) {
         // === MODE: LIBRARY (Swift App) ===
-        global_log_cb(msg_buf);
+        log_msg(msg_buf);
         
-        if (DRY_RUN) {
-            char cmd_buf[8192];
-            int pos = snprintf(cmd_buf, sizeof(cmd_buf), "CMD: ");
+        char heavy[32];
+        double share = 0;
+        double cost = filter_chain_cost(vf.buf, atof(S.scale_factor), heavy, sizeof(heavy), &share);
+        if (cost > 0) {
+            char cost_buf[160];
+            snprintf(cost_buf, sizeof(cost_buf), "Filter graph: ~%.0f ms/frame per source megapixel on one core, %s %.0f%%\n",
+                     cost, heavy, share * 100.0);
+            log_msg(cost_buf);
+        }
+        
+        if (current_context()->dry_run && piped) {
+            process_piped(in, out, ffmpeg, threads, img, true);
+        } else if (current_context()->dry_run) {
+            SB cmd = {0};
+            sb_append(&cmd, "CMD: ");
             for(int i=0; args[i]; i++) {
-                pos += snprintf(cmd_buf + pos, sizeof(cmd_buf) - pos, "%s ", args[i]);
+                sb_append(&cmd, args[i]);
+                sb_append(&cmd, " ");
             }
-            snprintf(cmd_buf + pos, sizeof(cmd_buf) - pos, "\n");
-            global_log_cb(cmd_buf);
+            sb_append(&cmd, "\n");
+            log_msg(cmd.buf);
+            free(cmd.buf);
         } else {
-            int result = execute_ffmpeg_command(args);
+            // Same bytes in, same recipe: reuse the earlier result
+            char key[40] = "";
+            const char *ext = img ? "png" : "mp4";
+            bool cached = false;
+            // A callback upscaler has no identity to key on
+            bool keyed = !S.preview && !(pipe_upscale && current_context()->upscale_fn);
+            if (keyed && (*S.cache_dir || S.resume_seconds > 0)) {
+                char extra[PATH_MAX + 192];
+                snprintf(extra, sizeof(extra), "segments=%d resume=%d adaptive=%d backend=%s pipe=%s fused=%d frc=%d stages=%d target=%s:%s:%s:%d",
+                         S.segments > 1 ? S.segments : 0, S.resume_seconds, S.adaptive, in_process ? "libav" : "cli",
+                         pipe_upscale ? S.pipe_cmd : "", fused, native_frc, staged,
+                         S.target_metric, S.target_score, S.max_bitrate, S.two_pass);
+                if (!cache_key(in, out, args, extra, key, sizeof(key))) key[0] = 0;
+            }
+            if (*S.cache_dir && *key) {
+                cached = cache_fetch(S.cache_dir, key, ext, out);
+            }
             
-            if (result != 0) {
-                char err[128];
-                snprintf(err, sizeof(err), "FFmpeg failed with exit code %d\n", result);
-                global_log_cb(err);
+            result = cached ? 0 : SEGMENT_FALLBACK;
+            if (cached) {
+                log_msg("Cache hit, reused earlier result\n");
+            }
+            if (result == SEGMENT_FALLBACK && piped) {
+                result = process_piped(in, out, ffmpeg, threads, img, false);
+            }
+            // The CRF search does its own full encode; segments/adaptive don't combine with it
+            if (result == SEGMENT_FALLBACK && !img && *S.target_metric && !S.preview && !in_process) {
+                result = process_target_quality(in, out, ffmpeg, vf.buf, threads);
+            }
+            if (result == SEGMENT_FALLBACK && !img && S.resume_seconds > 0 && !S.preview && !in_process) {
+                result = process_resumable(in, out, ffmpeg, vf.buf, threads, key);
+            }
+            if (result == SEGMENT_FALLBACK && !img && S.adaptive && !S.preview && !in_process) {
+                result = process_adaptive(in, out, ffmpeg, vf.buf, threads);
+            }
+            if (result == SEGMENT_FALLBACK && !img && S.segments > 1 && !S.preview && !in_process) {
+                result = process_segmented(in, out, ffmpeg, vf.buf, threads);
+            }
+            if (result == SEGMENT_FALLBACK && staged) {
+                result = process_stage_cached(in, out, ffmpeg, threads);
+            }
+            if (result == SEGMENT_FALLBACK) {
+                result = in_process ? libav_process_file(in, out, vf.buf, &lp) : execute_ffmpeg_command(args);
+            }
+            if (result == 0 && !cached && *S.cache_dir && *key && !up60p_is_cancelled()) {
+                cache_store(S.cache_dir, key, ext, out, S.cache_max_mb);
+            }
+            
+            if (up60p_is_cancelled()) {
+                status = UP60P_ERR_CANCELLED;
+            } else if (result != 0) {
+                char err[PATH_MAX + 64];
+                snprintf(err, sizeof(err), "FFmpeg failed with exit code %d: %s\n", result, in);
+                log_msg(err);
+                status = UP60P_ERR_INTERNAL;
             } else {
-                global_log_cb("Done.\n");
+                log_msg("Done.\n");
             }
         }
     }
+    report_file(job_id, in, out, result, status);
+    mem_set_job(job_id, NULL);
     free(vf.buf);
+    free(complex_filter.buf);
+    return result;
 }
 
 
-void process_directory(const char *dir, const char *ffmpeg) {
+static void process_directory(const char *dir, PathList *files) {
     DIR *d = opendir(dir); if (!d) return;
     struct dirent *e;
     while ((e = readdir(d))) {
@@ -521,15 +373,164 @@ void process_directory(const char *dir, const char *ffmpeg) {
         char path[PATH_MAX]; snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
         struct stat st;
         if (stat(path, &st) == 0) {
-            if (S_ISDIR(st.st_mode)) process_directory(path, ffmpeg);
-            else if (strstr(path, ".mp4") || strstr(path, ".mkv") || strstr(path, ".mov") || is_image(path)) process_file(path, ffmpeg, true);
+            if (S_ISDIR(st.st_mode)) process_directory(path, files);
+            else if (is_restorable(path)) path_list_push(files, path);
         }
     } closedir(d);
 }
 
+typedef struct {
+    const PathList *files;
+    char **outputs;
+    const ImageBatch *batches;
+    int nbatches;
+    const int *singles;
+    const char *ffmpeg;
+    char threads[16];
+    bool split;                 /* several workers, each with its own CPU share */
+    up60p_error *status;        /* per file, NULL when nobody asks */
+} BatchCtx;
+
+/* Shares can differ in size (a part per node, nodes of unequal size), so
+   unless threads caps the budget each job is sized to the share its
+   worker was given */
+static const char *job_threads(const BatchCtx *b, char *buf, size_t size) {
+    if (!b->split || *S.threads) return b->threads;
+    CpuAllot share;
+    current_allot(&share);
+    snprintf(buf, size, "%d", share.ncpus);
+    return buf;
+}
+
+static void set_status(const BatchCtx *b, int file, int result) {
+    if (!b->status) return;
+    if (up60p_is_cancelled() && result != 0) b->status[file] = UP60P_ERR_CANCELLED;
+    else b->status[file] = result == 0 ? UP60P_OK : UP60P_ERR_INTERNAL;
+}
+
+/* Stills can share one ffmpeg on the plain CLI path; anything keyed,
+   piped or in-process per file keeps one job per image. */
+static bool image_batching(void) {
+    return context_log_cb(current_context()) && !S.no_image_batch && !S.preview && !*S.cache_dir &&
+           !pipe_upscale_enabled(&S) && !fused_post_enabled(&S) && !use_libav_backend(NULL);
+}
+
+/* Images the batch didn't produce (cancelled, or broken files the retries
+   isolated) go through the per-file path, which reports its own error. */
+static void run_image_batch(const BatchCtx *b, const ImageBatch *batch) {
+    int n = batch->count;
+    char **in = malloc((size_t)n * sizeof(*in));
+    char **out = malloc((size_t)n * sizeof(*out));
+    bool *done = calloc((size_t)n, sizeof(*done));
+    if (in && out && done) {
+        for (int i = 0; i < n; i++) {
+            in[i] = b->files->items[batch->items[i]];
+            out[i] = b->outputs[batch->items[i]];
+        }
+        set_current_job(batch->items[0]);
+        char msg[160];
+        snprintf(msg, sizeof(msg), "Image batch: %d %s images at %dx%d in one ffmpeg\n",
+                 n, batch->header.codec, batch->header.width, batch->header.height);
+        log_msg(msg);
+        process_image_batch(in, out, n, b->ffmpeg, current_context()->dry_run, done);
+    }
+    for (int i = 0; i < n; i++) {
+        int job = batch->items[i];
+        if (done && done[i]) {
+            report_file(job, b->files->items[job], b->outputs[job], 0, UP60P_OK);
+            set_status(b, job, 0);
+        } else {
+            char threads[16];
+            set_status(b, job, process_file(b->files->items[job], b->ffmpeg, job,
+                                            job_threads(b, threads, sizeof(threads))));
+        }
+    }
+    free(in);
+    free(out);
+    free(done);
+}
+
+static void run_batch_file(int index, void *ctx) {
+    BatchCtx *b = ctx;
+    if (index < b->nbatches) {
+        run_image_batch(b, &b->batches[index]);
+        return;
+    }
+    int file = b->singles[index - b->nbatches];
+    char threads[16];
+    set_status(b, file, process_file(b->files->items[file], b->ffmpeg, file, job_threads(b, threads, sizeof(threads))));
+}
+
+/* Spread one directory over a bounded pool of ffmpeg children. S.threads is
+   treated as the total budget and split evenly across the running jobs.
+   Same-format stills are grouped so each group costs one ffmpeg start.
+   status, if set, gets each file's outcome. */
+static void run_batch(const PathList *files, const char *ffmpeg, up60p_error *status) {
+    if (files->count == 0) return;
+    
+    int per_job = 0;
+    int workers = up60p_plan_workers(S.max_jobs, atoi(S.threads), files->count, &per_job);
+    
+    char **outputs = calloc((size_t)files->count, sizeof(*outputs));
+    int *singles = malloc((size_t)files->count * sizeof(*singles));
+    bool *batched = calloc((size_t)files->count, sizeof(*batched));
+    ImageBatch *batches = NULL;
+    int nbatches = 0, nsingles = 0, nbatched = 0;
+    bool grouping = outputs && singles && batched && image_batching();
+    for (int i = 0; grouping && i < files->count; i++) {
+        outputs[i] = malloc(PATH_MAX);
+        if (outputs[i]) output_path(files->items[i], is_image(files->items[i]), outputs[i], PATH_MAX);
+        else grouping = false;
+    }
+    if (grouping) nbatches = plan_image_batches(files, outputs, workers, &batches);
+    for (int k = 0; k < nbatches; k++) {
+        for (int i = 0; i < batches[k].count; i++) batched[batches[k].items[i]] = true;
+        nbatched += batches[k].count;
+    }
+    for (int i = 0; singles && i < files->count; i++) {
+        if (!batched || !batched[i]) singles[nsingles++] = i;
+    }
+    int tasks = nbatches + nsingles;
+    if (nbatches) workers = up60p_plan_workers(S.max_jobs, atoi(S.threads), tasks, &per_job);
+    
+    BatchCtx b = { .files = files, .outputs = outputs, .batches = batches, .nbatches = nbatches,
+                   .singles = singles, .ffmpeg = ffmpeg, .status = status };
+    if (workers > 1) snprintf(b.threads, sizeof(b.threads), "%d", per_job);
+    else snprintf(b.threads, sizeof(b.threads), "%s", S.threads);
+    b.split = workers > 1;
+    
+    char msg[192];
+    if (nbatches) {
+        snprintf(msg, sizeof(msg), "Batch: %d files, %d images in %d image batches, %d concurrent jobs, %s threads each\n",
+                 files->count, nbatched, nbatches, workers, *b.threads ? b.threads : "auto");
+    } else {
+        snprintf(msg, sizeof(msg), "Batch: %d files, %d concurrent jobs, %s threads each\n",
+                 files->count, workers, *b.threads ? b.threads : "auto");
+    }
+    log_msg(msg);
+    if (workers > 1) {
+        char topo[96];
+        topology_describe(topo, sizeof(topo));
+        snprintf(msg, sizeof(msg), "CPU plan: %s, %s\n", topo,
+                 topology_pins(workers) ? "each job bound to its own cores" : "jobs share them");
+        log_msg(msg);
+    }
+    
+    up60p_context *ctx = current_context();
+    ctx->batch_workers = workers;
+    if (singles) up60p_run_parallel(workers, tasks, run_batch_file, &b);
+    ctx->batch_workers = 0;
+    
+    image_batches_free(batches, nbatches);
+    for (int i = 0; outputs && i < files->count; i++) free(outputs[i]);
+    free(outputs);
+    free(singles);
+    free(batched);
+}
+
 
 void up60p_set_dry_run(int enable) {
-    DRY_RUN = enable;
+    current_context()->dry_run = enable;
 }
 
 up60p_error up60p_init(const char *app_support_dir, up60p_log_callback log_cb) {
@@ -557,21 +558,43 @@ up60p_error up60p_process_path(const char *input_path,
 {
     if (!input_path || !opts) return UP60P_ERR_INVALID_OPTIONS;
     
-    cancel_requested = 0;
+    up60p_reset_cancel();
     
     settings_from_up60p_options(&S, opts);
     
     struct stat st;
     if (stat(input_path, &st) == 0) {
         if (S_ISDIR(st.st_mode)) {
-            process_directory(input_path, get_bundled_ffmpeg_path());
+            PathList files = {0};
+            process_directory(input_path, &files);
+            run_batch(&files, get_bundled_ffmpeg_path(), NULL);
+            path_list_free(&files);
         } else {
-            process_file(input_path, get_bundled_ffmpeg_path(), false);
+            process_file(input_path, get_bundled_ffmpeg_path(), 0, S.threads);
         }
-        return UP60P_OK;
+        return up60p_is_cancelled() ? UP60P_ERR_CANCELLED : UP60P_OK;
     }
     
     return UP60P_ERR_INVALID_OPTIONS;
 }
 
-void up60p_shutdown(void) {}
+static void run_watch_batch(const PathList *files, up60p_error *status, void *ctx) {
+    run_batch(files, ctx, status);
+}
+
+up60p_error up60p_watch_path(const char *dir, const up60p_options *opts) {
+    if (!dir || !opts) return UP60P_ERR_INVALID_OPTIONS;
+    
+    up60p_reset_cancel();
+    
+    settings_from_up60p_options(&S, opts);
+    
+    struct stat st;
+    if (stat(dir, &st) != 0 || !S_ISDIR(st.st_mode)) return UP60P_ERR_INVALID_OPTIONS;
+    return watch_directory(dir, S.watch_index, S.watch_settle, run_watch_batch,
+                           (void*)get_bundled_ffmpeg_path());
+}
+
+void up60p_shutdown(void) {
+    libav_shutdown();
+}
@@ -0,0 +1,201 @@
+#include "up60p_resume.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_probe.h"
+#include <math.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* Journal layout, one record per line, appended as segments land:
+     up60p-journal 1
+     key <cache key of input + recipe>
+     segments <n>
+     span <i> <start> <end> <pre> <post>
+     done <i> <bytes>                     */
+
+typedef struct {
+    FILE *fp;
+    pthread_mutex_t lock;
+} JournalWriter;
+
+void journal_free(ResumeJournal *j) {
+    if (!j) return;
+    free(j->spans);
+    free(j->bytes);
+    free(j->done);
+    memset(j, 0, sizeof(*j));
+}
+
+bool journal_load(const char *path, ResumeJournal *j) {
+    memset(j, 0, sizeof(*j));
+    FILE *fp = fopen(path, "r");
+    if (!fp) return false;
+    char line[256];
+    int version = 0, spans = 0;
+    bool ok = fgets(line, sizeof(line), fp) && sscanf(line, "up60p-journal %d", &version) == 1 &&
+              version == RESUME_JOURNAL_VERSION;
+    while (ok && fgets(line, sizeof(line), fp)) {
+        int i, n;
+        long long bytes;
+        SegmentSpan sp = {0};
+        if (!strncmp(line, "key ", 4)) {
+            if (sscanf(line + 4, "%39s", j->key) != 1) ok = false;
+        } else if (sscanf(line, "segments %d", &n) == 1) {
+            if (j->count || n < 1 || n > 100000) { ok = false; break; }
+            j->spans = calloc((size_t)n, sizeof(*j->spans));
+            j->bytes = calloc((size_t)n, sizeof(*j->bytes));
+            j->done = calloc((size_t)n, sizeof(*j->done));
+            if (!j->spans || !j->bytes || !j->done) ok = false;
+            j->count = n;
+        } else if (sscanf(line, "span %d %lf %lf %lf %lf", &i, &sp.start, &sp.end, &sp.pre, &sp.post) == 5) {
+            if (i < 0 || i >= j->count) ok = false;
+            else { j->spans[i] = sp; spans++; }
+        } else if (sscanf(line, "done %d %lld", &i, &bytes) == 2) {
+            // A torn last line from a crash just doesn't count
+            if (i >= 0 && i < j->count) { j->done[i] = true; j->bytes[i] = bytes; }
+        }
+    }
+    fclose(fp);
+    if (!ok || !*j->key || !j->count || spans != j->count) {
+        journal_free(j);
+        return false;
+    }
+    return true;
+}
+
+static bool journal_create(const char *path, const char *key, const SegmentSpan *spans, int n) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) return false;
+    fprintf(fp, "up60p-journal %d\nkey %s\nsegments %d\n", RESUME_JOURNAL_VERSION, key, n);
+    for (int i = 0; i < n; i++) {
+        fprintf(fp, "span %d %.6f %.6f %.6f %.6f\n", i, spans[i].start, spans[i].end, spans[i].pre, spans[i].post);
+    }
+    bool ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    return fclose(fp) == 0 && ok;
+}
+
+/* The segment is only journaled once it's durable, so a power cut can't
+   leave a "done" pointing at unwritten data */
+static void journal_segment_done(int index, const char *path, void *ctx) {
+    JournalWriter *w = ctx;
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    bool durable = fsync(fd) == 0 && fstat(fd, &st) == 0;
+    close(fd);
+    if (!durable) return;
+    pthread_mutex_lock(&w->lock);
+    fprintf(w->fp, "done %d %lld\n", index, (long long)st.st_size);
+    fflush(w->fp);
+    fsync(fileno(w->fp));
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Size as journaled and a container ffmpeg can open with about the span's
+   duration; an interrupted mp4 has no index and fails to open. */
+static bool segment_valid(const char *ffmpeg, const char *path, const SegmentSpan *sp, long long bytes) {
+    struct stat st;
+    if (stat(path, &st) != 0 || (long long)st.st_size != bytes) return false;
+    MediaProbe info;
+    int rc = probe_media(ffmpeg, path, false, &info);
+    probe_free(&info);
+    if (rc != 0 || info.duration <= 0) return false;
+    if (sp->end < 0) return true;
+    double want = sp->end - sp->start;
+    return fabs(info.duration - want) <= fmax(1.0, want * 0.05);
+}
+
+static void clear_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *e;
+    char path[PATH_MAX];
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+/* Fresh plan: keyframe cuts about resume_seconds apart */
+static int plan_resume(const char *ffmpeg, const char *in, const char *vf, SegmentSpan **spans) {
+    MediaProbe info;
+    int rc = probe_media(ffmpeg, in, true, &info);
+    if (rc != 0 || info.duration <= 0 || info.nkeys < 1) {
+        probe_free(&info);
+        return 0;
+    }
+    double seconds = S.resume_seconds < SEGMENT_MIN_SECONDS ? SEGMENT_MIN_SECONDS : S.resume_seconds;
+    int want = (int)ceil(info.duration / seconds);
+    if (want < 1) want = 1;
+    *spans = calloc((size_t)want, sizeof(**spans));
+    if (!*spans) { probe_free(&info); return 0; }
+    double fps = info.fps > 0 ? info.fps : 25.0;
+    int n = plan_segments(info.keys, info.nkeys, info.duration, want,
+                          temporal_overlap_frames(vf) / fps, *spans);
+    probe_free(&info);
+    return n;
+}
+
+int process_resumable(const char *in, const char *out, const char *ffmpeg,
+                      const char *vf, const char *threads, const char *key) {
+    if (S.resume_seconds <= 0) return SEGMENT_FALLBACK;
+    if (!key || !*key) {
+        log_msg("Resumable mode: can't fingerprint the input, running single pass\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    char dir[PATH_MAX], path[PATH_MAX], seg[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s.resume", out);
+    snprintf(path, sizeof(path), "%s/journal", dir);
+
+    ResumeJournal j;
+    char msg[192];
+    bool resumed = journal_load(path, &j) && !strcmp(j.key, key);
+    if (resumed) {
+        int kept = 0;
+        for (int i = 0; i < j.count; i++) {
+            if (!j.done[i]) continue;
+            snprintf(seg, sizeof(seg), "%s/seg_%03d.mp4", dir, i);
+            j.done[i] = segment_valid(ffmpeg, seg, &j.spans[i], j.bytes[i]);
+            kept += j.done[i];
+        }
+        snprintf(msg, sizeof(msg), "Resumable mode: resuming, %d of %d segments already done\n", kept, j.count);
+        log_msg(msg);
+    } else {
+        if (j.count) log_msg("Resumable mode: journal is for another input or recipe, starting over\n");
+        journal_free(&j);
+        clear_dir(dir);
+        mkdir_p(dir);
+        SegmentSpan *spans = NULL;
+        int n = plan_resume(ffmpeg, in, vf, &spans);
+        if (up60p_is_cancelled()) { free(spans); return -1; }
+        if (n < 1 || !journal_create(path, key, spans, n)) {
+            free(spans);
+            rmdir(dir);
+            log_msg("Resumable mode: input can't be cut or journal not writable, running single pass\n");
+            return SEGMENT_FALLBACK;
+        }
+        j = (ResumeJournal){ .spans = spans, .count = n,
+                             .bytes = calloc((size_t)n, sizeof(long long)),
+                             .done = calloc((size_t)n, sizeof(bool)) };
+        safe_copy(j.key, key, sizeof(j.key));
+        if (!j.bytes || !j.done) { journal_free(&j); return -1; }
+        snprintf(msg, sizeof(msg), "Resumable mode: %d segments journaled in %s\n", n, dir);
+        log_msg(msg);
+    }
+
+    JournalWriter w = { .fp = fopen(path, "a") };
+    if (!w.fp) { journal_free(&j); return -1; }
+    pthread_mutex_init(&w.lock, NULL);
+    SegmentResume r = { .dir = dir, .journal = path, .done = j.done,
+                        .on_done = journal_segment_done, .ctx = &w };
+    int result = run_segments_resumable(in, out, ffmpeg, vf, j.spans, j.count, threads, &r);
+    fclose(w.fp);
+    pthread_mutex_destroy(&w.lock);
+    journal_free(&j);
+    if (result != 0) log_msg("Resumable mode: stopped, finished segments are kept for the next run\n");
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef UP60P_RESUME_H
+#define UP60P_RESUME_H
+
+#include "up60p_common.h"
+#include "up60p_segment.h"
+
+#define RESUME_JOURNAL_VERSION 1
+
+/* What a journal promises about its directory. done[i] is set for
+   segments recorded as finished, with their byte size in bytes[i]. */
+typedef struct {
+    char key[40];
+    SegmentSpan *spans;
+    long long *bytes;
+    bool *done;
+    int count;
+} ResumeJournal;
+
+/* false if the file is missing, from another version or malformed */
+bool journal_load(const char *path, ResumeJournal *j);
+void journal_free(ResumeJournal *j);
+
+/* resume_seconds mode: encodes the video as keyframe-aligned segments of
+   about that length under <out>.resume/, journaling each one as it lands.
+   A rerun with the same input and recipe (key) checks the segments the
+   journal lists, encodes the rest and remuxes; anything else starts over.
+   Returns SEGMENT_FALLBACK when off or the input can't be cut. */
+int process_resumable(const char *in, const char *out, const char *ffmpeg,
+                      const char *vf, const char *threads, const char *key);
+
+#endif
@@ -0,0 +1,222 @@
+#include "up60p_segment.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_filters.h"
+#include "up60p_probe.h"
+#include "up60p_hwaccel.h"
+#include <math.h>
+
+typedef struct {
+    const char *in, *ffmpeg, *vf;
+    char threads[16];
+    char dir[PATH_MAX];
+    const SegmentSpan *spans;
+    int count, job_id;
+    int *codes;
+    const SegmentResume *resume;
+} SegmentCtx;
+
+/* How many source frames of history the stateful filters in vf need before
+   their output matches an uncut run. Spatial-only chains still get a couple
+   of frames so mpdecimate has something to compare against. */
+int temporal_overlap_frames(const char *vf) {
+    int frames = 2;
+    if (!vf) return frames;
+    if (strstr(vf, "hqdn3d=") && frames < 16) frames = 16;      // recursive temporal IIR
+    if (strstr(vf, "minterpolate=") && frames < 4) frames = 4;  // bidir ME looks 2 each way
+    const char *ata = strstr(vf, "atadenoise=s=");
+    if (ata) {
+        int window = (int)ceil(atof(ata + 13));
+        if (window / 2 + 1 > frames) frames = window / 2 + 1;
+    }
+    return frames;
+}
+
+int plan_segments(const double *keyframes, int nkeys, double duration, int want,
+                  double overlap, SegmentSpan *spans) {
+    int n = 0;
+    double prev = 0.0;
+    for (int k = 1; k < want; k++) {
+        double target = duration * k / want;
+        double best = -1.0;
+        for (int i = 0; i < nkeys; i++) {
+            double t = keyframes[i];
+            if (t < prev + SEGMENT_MIN_SECONDS || t > duration - SEGMENT_MIN_SECONDS) continue;
+            if (best < 0 || fabs(t - target) < fabs(best - target)) best = t;
+        }
+        if (best < 0) continue;
+        spans[n++] = (SegmentSpan){ prev, best, 0, 0, NULL };
+        prev = best;
+    }
+    spans[n++] = (SegmentSpan){ prev, -1.0, 0, 0, NULL };
+
+    for (int i = 0; i < n; i++) {
+        spans[i].pre = spans[i].start < overlap ? spans[i].start : overlap;
+        spans[i].post = spans[i].end < 0 ? 0.0 : overlap;
+    }
+    return n;
+}
+
+static void run_segment(int index, void *ctx) {
+    SegmentCtx *c = ctx;
+    const SegmentSpan *sp = &c->spans[index];
+    if (up60p_is_cancelled()) { c->codes[index] = -1; return; }
+    if (c->resume && c->resume->done && c->resume->done[index]) { c->codes[index] = 0; return; }
+    set_current_job(c->job_id);
+
+    char ss[32], tt[32], seg[PATH_MAX], x265_fixed[256] = "";
+    snprintf(ss, sizeof(ss), "%.6f", sp->start - sp->pre);
+    if (sp->end >= 0) snprintf(tt, sizeof(tt), "%.6f", sp->pre + (sp->end - sp->start) + sp->post);
+    snprintf(seg, sizeof(seg), "%s/seg_%03d.mp4", c->dir, index);
+
+    // Warm-up and run-out frames go through the whole chain, then get trimmed
+    SB chain = {0};
+    sb_append(&chain, sp->vf ? sp->vf : c->vf);
+    sb_fmt(&chain, ",trim=start=%.6f", sp->pre);
+    if (sp->end >= 0) sb_fmt(&chain, ":duration=%.6f", sp->end - sp->start);
+    sb_append(&chain, ",setpts=PTS-STARTPTS");
+
+    HwPlan hw;
+    bool on_device = hw_plan(&S, false, &hw);
+
+    char *args[96]; int a = 0;
+    args[a++] = (char*)c->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-nostats"; args[a++] = "-y";
+    a = append_hw_input_args(args, a, on_device ? &hw : NULL, S.hwaccel);
+    args[a++] = "-ss"; args[a++] = ss;
+    if (sp->end >= 0) { args[a++] = "-t"; args[a++] = tt; }
+    args[a++] = "-i"; args[a++] = (char*)c->in;
+    args[a++] = "-vf"; args[a++] = chain.buf;
+    args[a++] = "-map"; args[a++] = "0:v:0"; args[a++] = "-an";
+    a = append_video_encoder_args(args, a, pick_video_encoder(), on_device && hw.encode ? NULL : output_pix_fmt(),
+                                  c->threads, x265_fixed, sizeof(x265_fixed));
+    args[a++] = seg;
+    args[a] = NULL;
+
+    c->codes[index] = execute_ffmpeg_command(args);
+    free(chain.buf);
+
+    if (c->codes[index] == 0 && c->resume && c->resume->on_done) c->resume->on_done(index, seg, c->resume->ctx);
+
+    char msg[96];
+    if (c->codes[index] == 0) snprintf(msg, sizeof(msg), "Segment %d/%d done\n", index + 1, c->count);
+    else snprintf(msg, sizeof(msg), "Segment %d/%d failed with exit code %d\n", index + 1, c->count, c->codes[index]);
+    log_msg(msg);
+}
+
+static int concat_segments(const SegmentCtx *c, const char *out) {
+    char list[PATH_MAX];
+    snprintf(list, sizeof(list), "%s/list.txt", c->dir);
+    FILE *fp = fopen(list, "w");
+    if (!fp) return -1;
+    for (int i = 0; i < c->count; i++) fprintf(fp, "file 'seg_%03d.mp4'\n", i);
+    fclose(fp);
+
+    // Remuxed next to the segments and renamed, so out is never left truncated
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s/remux.mp4", c->dir);
+
+    char *cod = pick_video_encoder();
+    char *args[64]; int a = 0;
+    args[a++] = (char*)c->ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-y";
+    args[a++] = "-f"; args[a++] = "concat"; args[a++] = "-safe"; args[a++] = "0"; args[a++] = "-i"; args[a++] = list;
+    args[a++] = "-i"; args[a++] = (char*)c->in;
+    args[a++] = "-map"; args[a++] = "0:v:0"; args[a++] = "-map"; args[a++] = "1:a?";
+    args[a++] = "-c:v"; args[a++] = "copy";
+    if (strstr(cod, "hevc") || strstr(cod, "265")) { args[a++] = "-tag:v"; args[a++] = "hvc1"; }
+    args[a++] = "-c:a"; args[a++] = "aac"; args[a++] = "-b:a"; args[a++] = S.audio_bitrate;
+    if (*S.movflags) { args[a++] = "-movflags"; args[a++] = S.movflags; }
+    args[a++] = tmp;
+    args[a] = NULL;
+    int result = execute_ffmpeg_unmetered(args);
+    if (result == 0 && rename(tmp, out) != 0) result = -1;
+    unlink(tmp);
+    return result;
+}
+
+static void remove_segments(const SegmentCtx *c) {
+    char path[PATH_MAX];
+    for (int i = 0; i < c->count; i++) {
+        snprintf(path, sizeof(path), "%s/seg_%03d.mp4", c->dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/list.txt", c->dir);
+    unlink(path);
+    if (c->resume && c->resume->journal) unlink(c->resume->journal);
+    rmdir(c->dir);
+}
+
+/* Encodes each span concurrently into <out>.segments/ and concatenates the
+   results into out. */
+int run_segments(const char *in, const char *out, const char *ffmpeg, const char *vf,
+                 const SegmentSpan *spans, int n, const char *threads) {
+    return run_segments_resumable(in, out, ffmpeg, vf, spans, n, threads, NULL);
+}
+
+int run_segments_resumable(const char *in, const char *out, const char *ffmpeg, const char *vf,
+                           const SegmentSpan *spans, int n, const char *threads,
+                           const SegmentResume *resume) {
+    int *codes = calloc((size_t)n, sizeof(*codes));
+    if (!codes) return -1;
+
+    SegmentCtx c = { .in = in, .ffmpeg = ffmpeg, .vf = vf, .spans = spans, .count = n,
+                     .job_id = current_job_id(), .codes = codes, .resume = resume };
+    if (resume) safe_copy(c.dir, resume->dir, sizeof(c.dir));
+    else snprintf(c.dir, sizeof(c.dir), "%s.segments", out);
+    mkdir_p(c.dir);
+
+    int per_job = 0;
+    int workers = up60p_plan_workers(S.max_jobs, atoi(threads ? threads : ""), n, &per_job);
+    snprintf(c.threads, sizeof(c.threads), "%d", per_job);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Segmented mode: %d segments, %d concurrent, %.2fs overlap at each cut\n",
+             n, workers, spans[0].end >= 0 ? spans[0].post : 0.0);
+    log_msg(msg);
+
+    up60p_run_parallel(workers, n, run_segment, &c);
+
+    int result = 0;
+    for (int i = 0; i < n && result == 0; i++) result = codes[i];
+    if (result == 0 && !up60p_is_cancelled()) result = concat_segments(&c, out);
+
+    // A journaled run keeps finished segments for the next attempt
+    if (!resume || result == 0) remove_segments(&c);
+    free(codes);
+    return result;
+}
+
+/* Splits one video on keyframes near K even cut points, restores the pieces
+   concurrently with the same filter chain, and stitches them back with the
+   concat demuxer (video is stream-copied, audio comes from the source). */
+int process_segmented(const char *in, const char *out, const char *ffmpeg,
+                      const char *vf, const char *threads) {
+    // Decoding keyframes only is cheap even for feature-length inputs
+    MediaProbe info;
+    int rc = probe_media(ffmpeg, in, true, &info);
+    if (up60p_is_cancelled()) { probe_free(&info); return -1; }
+
+    int want = S.segments;
+    if (rc != 0 || info.duration < 2 * SEGMENT_MIN_SECONDS || info.nkeys < 2) {
+        probe_free(&info);
+        log_msg("Segmented mode: input too short or not seekable, running single pass\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    double fps = info.fps > 0 ? info.fps : 25.0;
+    double overlap = temporal_overlap_frames(vf) / fps;
+    SegmentSpan *spans = calloc((size_t)want, sizeof(*spans));
+    if (!spans) { probe_free(&info); return -1; }
+
+    int n = plan_segments(info.keys, info.nkeys, info.duration, want, overlap, spans);
+    probe_free(&info);
+    if (n < 2) {
+        free(spans);
+        log_msg("Segmented mode: no usable keyframes for cutting, running single pass\n");
+        return SEGMENT_FALLBACK;
+    }
+
+    int result = run_segments(in, out, ffmpeg, vf, spans, n, threads);
+    free(spans);
+    return result;
+}
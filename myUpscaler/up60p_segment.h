@@ -0,0 +1,44 @@
+#ifndef UP60P_SEGMENT_H
+#define UP60P_SEGMENT_H
+
+#include "up60p_common.h"
+
+/* Returned by process_segmented when the input can't be split (no duration,
+   too few keyframes, too short); the caller runs the normal single pass. */
+#define SEGMENT_FALLBACK (-2)
+
+#define SEGMENT_MIN_SECONDS 10.0
+
+typedef struct {
+    double start, end;     /* cut points on keyframes, end < 0 means EOF */
+    double pre, post;      /* warm-up / run-out decoded around the cut and trimmed away */
+    const char *vf;        /* chain for this span only, NULL uses the shared one */
+} SegmentSpan;
+
+int temporal_overlap_frames(const char *vf);
+
+int plan_segments(const double *keyframes, int nkeys, double duration, int want,
+                  double overlap, SegmentSpan *spans);
+
+int run_segments(const char *in, const char *out, const char *ffmpeg, const char *vf,
+                 const SegmentSpan *spans, int n, const char *threads);
+
+/* Segments kept across runs: encoded into dir, done ones skipped, on_done
+   called from the worker as each new one finishes. The segments and the
+   journal file are only removed once the remux succeeded. */
+typedef struct {
+    const char *dir;
+    const char *journal;
+    const bool *done;
+    void (*on_done)(int index, const char *path, void *ctx);
+    void *ctx;
+} SegmentResume;
+
+int run_segments_resumable(const char *in, const char *out, const char *ffmpeg, const char *vf,
+                           const SegmentSpan *spans, int n, const char *threads,
+                           const SegmentResume *resume);
+
+int process_segmented(const char *in, const char *out, const char *ffmpeg,
+                      const char *vf, const char *threads);
+
+#endif
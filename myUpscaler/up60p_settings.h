@@ -12,6 +12,7 @@ struct Settings {
     
     char scaler[16]; char ai_backend[16]; char ai_model[PATH_MAX];
     char ai_model_type[16]; char dnn_backend[32];
+    char pipe_cmd[PATH_MAX];
     
     
     char denoiser[16]; char denoise_strength[16];
@@ -55,12 +56,28 @@ struct Settings {
 //    char lut3d_file[PATH_MAX]; // LUT DEACTIVATED
     
     char x265_params[256];
+    char target_metric[16]; char target_score[16]; char max_bitrate[32];
+    int  two_pass;
     
     
     char outdir[PATH_MAX]; char audio_bitrate[32]; char threads[16];
     char movflags[32];
+    char cache_dir[PATH_MAX]; int cache_max_mb;
+    char stage_cache_dir[PATH_MAX]; int stage_cache_mb;
+    char watch_index[PATH_MAX]; int watch_settle;
     int  use10;
     int  preview;
+    int  max_jobs;
+    int  mem_budget_mb;
+    int  segments;
+    int  resume_seconds;
+    int  adaptive;
+    int  no_optimize;
+    int  fused_post;
+    int  native_frc;
+    int  no_image_batch;
+    int  no_cpu_pin;
+    int  post_fused;    /* internal: the chain leaves sharpen/deband/grain/limiter to the fused pass */
     
     
     int no_deblock, no_denoise, no_decimate, no_interpolate;
@@ -69,9 +86,14 @@ struct Settings {
     
     
     char hwaccel[16]; char encoder[16];
+    int  hw_resident; char hw_device[64];
+    
+    char backend[16];
 };
 
 void init_paths(void);
+/* Factory settings into *d; set_defaults() also makes them DEF and S */
+void default_settings(Settings *d);
 void set_defaults(void);
 void reset_to_factory(void);
 
@@ -80,7 +102,11 @@ void up60p_options_from_settings(up60p_options *dst, const Settings *src);
 
 void settings_from_up60p_options(Settings *dst, const up60p_options *src);
 
-extern Settings S;
+/* Like errno: the settings of the calling thread's context (up60p_context.h) */
+Settings *current_settings(void);
+#define S (*current_settings())
+
 extern Settings DEF;
+extern char CONFIG_DIR[PATH_MAX];   /* $XDG_CONFIG_HOME/up60p, set by init_paths */
 
 #endif
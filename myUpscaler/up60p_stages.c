@@ -0,0 +1,139 @@
+#include "up60p_stages.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include "up60p_filters.h"
+#include "up60p_graph.h"
+#include "up60p_arena.h"
+#include "up60p_cache.h"
+#include "up60p_hwaccel.h"
+#include "up60p_segment.h"
+
+enum { STAGE_PRE, STAGE_SCALE, STAGE_POST, STAGE_COUNT };
+
+static const char *const STAGE_NAMES[STAGE_COUNT] = { "restore", "scale", "post-scale" };
+
+typedef struct {
+    SB vf;                  /* rendered, NULL buf for an empty stage */
+    char key[40];           /* input content + chain through this stage */
+    bool keep;              /* expensive enough to store */
+    char tmp[PATH_MAX];     /* being written by this run, "" if not */
+} Stage;
+
+/* Renders the stages and chains their keys. Each stage is optimized on its
+   own; the working-format narrowing is only for the head of the chain, so
+   the later stages go through the optimizer's image rules, which skip it. */
+static void plan_stages(uint64_t content, Stage st[STAGE_COUNT]) {
+    Arena arena = {0};
+    FilterGraph g[STAGE_COUNT];
+    for (int i = 0; i < STAGE_COUNT; i++) fg_init(&g[i], &arena);
+    build_filter_stages(&S, &g[STAGE_PRE], &g[STAGE_SCALE], &g[STAGE_POST], false);
+
+    double factor = atof(S.scale_factor);
+    double area = factor > 0 ? factor * factor : 1.0;
+    // The container and codec are part of what an entry is
+    uint64_t chain = xxh64("ffv1/nut", 8, content);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (!S.no_optimize) optimize_filter_chain(&g[i], i != STAGE_PRE);
+        fg_render(&g[i], &st[i].vf);
+        const char *text = st[i].vf.buf ? st[i].vf.buf : "";
+        chain = xxh64(text, strlen(text) + 1, chain);
+        snprintf(st[i].key, sizeof(st[i].key), "%016llx%016llx",
+                 (unsigned long long)content, (unsigned long long)chain);
+        // Charged per megapixel of what the stage writes
+        double cost = filter_graph_cost(&g[i], factor, NULL, 0, NULL);
+        st[i].keep = i != STAGE_POST && cost >= STAGE_CACHE_MIN_COST * (i == STAGE_SCALE ? area : 1.0);
+    }
+    arena_free(&arena);
+}
+
+/* [0:v] through the stages from start on, each kept stage teed off to
+   [c<i>] with split, ending in [out] */
+static void build_graph(Stage st[STAGE_COUNT], int start, SB *fc) {
+    sb_append(fc, "[0:v]");
+    bool open = false;
+    for (int i = start; i < STAGE_COUNT; i++) {
+        if (st[i].vf.buf && *st[i].vf.buf) {
+            if (open) sb_append(fc, ",");
+            sb_append(fc, st[i].vf.buf);
+            open = true;
+        }
+        if (*st[i].tmp) {
+            sb_fmt(fc, "%ssplit=2[v%d][c%d];[v%d]", open ? "," : "", i, i, i);
+            open = false;
+        }
+    }
+    sb_append(fc, open ? "[out]" : "null[out]");
+}
+
+int process_stage_cached(const char *in, const char *out, const char *ffmpeg, const char *threads) {
+    if (!*S.stage_cache_dir) return SEGMENT_FALLBACK;
+    HwPlan hw;
+    if (hw_plan(&S, false, &hw)) {
+        log_once(NOTE_STAGE_ON_DEVICE, "Stage cache: chains placed on the device run as one graph, not cached\n");
+        return SEGMENT_FALLBACK;
+    }
+    uint64_t content;
+    if (!hash_file_sampled(in, &content)) return SEGMENT_FALLBACK;
+
+    const char *dir = S.stage_cache_dir;
+    int max_mb = S.stage_cache_mb > 0 ? S.stage_cache_mb : STAGE_CACHE_DEFAULT_MB;
+    Stage st[STAGE_COUNT] = {0};
+    plan_stages(content, st);
+
+    // Deepest stored stage wins; the post stage is the job's own output
+    char src[PATH_MAX];
+    int start = 0;
+    for (int i = STAGE_POST - 1; i >= 0 && !start; i--) {
+        if (cache_lookup(dir, st[i].key, "nut", src, sizeof(src))) start = i + 1;
+    }
+    if (!start) safe_copy(src, in, sizeof(src));
+
+    char msg[160];
+    for (int i = start; i < STAGE_POST; i++) {
+        if (st[i].keep) cache_temp_path(dir, st[i].key, "nut", st[i].tmp, sizeof(st[i].tmp));
+    }
+    if (start) snprintf(msg, sizeof(msg), "Stage cache: starting after the cached %s stage\n", STAGE_NAMES[start - 1]);
+    else snprintf(msg, sizeof(msg), "Stage cache: nothing cached for this input and chain\n");
+    log_msg(msg);
+
+    SB fc = {0};
+    build_graph(st, start, &fc);
+
+    char x265_fixed[256] = "";
+    char *args[96]; int a = 0;
+    args[a++] = (char*)ffmpeg; args[a++] = "-hide_banner"; args[a++] = "-loglevel"; args[a++] = "error"; args[a++] = "-stats"; args[a++] = "-y";
+    args[a++] = "-i"; args[a++] = src;
+    if (start) { args[a++] = "-i"; args[a++] = (char*)in; }
+    args[a++] = "-filter_complex"; args[a++] = fc.buf;
+    args[a++] = "-map"; args[a++] = "[out]";
+    args[a++] = "-map"; args[a++] = start ? "1:a?" : "0:a?";
+    a = append_video_encoder_args(args, a, pick_video_encoder(), output_pix_fmt(), threads, x265_fixed, sizeof(x265_fixed));
+    args[a++] = "-c:a"; args[a++] = "aac"; args[a++] = "-b:a"; args[a++] = S.audio_bitrate;
+    if (*S.movflags) { args[a++] = "-movflags"; args[a++] = S.movflags; }
+    args[a++] = (char*)out;
+    char labels[STAGE_COUNT][8];
+    for (int i = start; i < STAGE_POST; i++) {
+        if (!*st[i].tmp) continue;
+        snprintf(labels[i], sizeof(labels[i]), "[c%d]", i);
+        args[a++] = "-map"; args[a++] = labels[i];
+        args[a++] = "-c:v"; args[a++] = "ffv1"; args[a++] = "-level"; args[a++] = "3";
+        args[a++] = "-f"; args[a++] = "nut"; args[a++] = st[i].tmp;
+    }
+    args[a] = NULL;
+
+    int result = execute_ffmpeg_command(args);
+    int kept = 0;
+    for (int i = start; i < STAGE_POST; i++) {
+        if (!*st[i].tmp) continue;
+        if (result == 0 && !up60p_is_cancelled()) kept += cache_publish(dir, st[i].key, "nut", st[i].tmp, max_mb);
+        else unlink(st[i].tmp);
+    }
+    if (result == 0 && kept) {
+        snprintf(msg, sizeof(msg), "Stage cache: kept %d stage output%s for later runs\n", kept, kept == 1 ? "" : "s");
+        log_msg(msg);
+    }
+    free(fc.buf);
+    for (int i = 0; i < STAGE_COUNT; i++) free(st[i].vf.buf);
+    return result;
+}
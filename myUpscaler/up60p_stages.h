@@ -0,0 +1,20 @@
+#ifndef UP60P_STAGES_H
+#define UP60P_STAGES_H
+
+#include "up60p_common.h"
+
+/* A stage cheaper than this (ms per source megapixel, see filter_graph_cost)
+   re-runs faster than its lossless output decodes, so it isn't kept */
+#define STAGE_CACHE_MIN_COST 50.0
+#define STAGE_CACHE_DEFAULT_MB 102400
+
+/* stage_cache_dir mode: the chain runs as restore (pre-scale), scale and
+   post-scale stages in one ffmpeg, with the output of each expensive stage
+   split off to FFV1 in the stage cache, keyed by the input content and
+   the chain up to and including that stage. A rerun starts from the
+   deepest stage found there, so changing only sharpen/deband/grain
+   re-runs just the post stage. Returns SEGMENT_FALLBACK when off or when
+   the chain runs on a device. */
+int process_stage_cached(const char *in, const char *out, const char *ffmpeg, const char *threads);
+
+#endif
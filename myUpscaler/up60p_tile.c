@@ -0,0 +1,413 @@
+#include "up60p_tile.h"
+#include "up60p_utils.h"
+#include "up60p_jobs.h"
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define TILE_X86 1
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define TILE_NEON 1
+#endif
+
+/* Weighted sums for one output frame: R, G, B and total weight planes.
+   Kept at full precision until the end so overlaps never round twice. */
+typedef struct Canvas {
+    struct Canvas *next;
+    int w, h;
+    float *plane[4];
+} Canvas;
+
+/* Per-tile working memory: model input/output and the two weight vectors */
+typedef struct Scratch {
+    struct Scratch *next;
+    float *in, *out, *wx, *wy;
+} Scratch;
+
+struct up60p_tiler {
+    up60p_tile_config cfg;
+    int feather;
+    float *ramp;
+    WorkerPool *pool;
+    pthread_mutex_t lock;       /* guards the two free lists */
+    Canvas *canvases;
+    Scratch *scratch;
+};
+
+typedef struct {
+    up60p_tiler *t;
+    const up60p_frame *in;
+    up60p_frame *out;
+    Canvas *cv;
+    int tiles_x, tiles_y, step_x, step_y;
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    int next_blend;
+    bool failed;
+} TileFrame;
+
+void feather_ramp(float *ramp, int n, bool cosine) {
+    for (int i = 0; i < n; i++) {
+        double t = (i + 0.5) / n;
+        ramp[i] = (float)(cosine ? 0.5 * (1.0 - cos(t * 3.14159265358979323846)) : t);
+    }
+}
+
+/* Accumulation kernels. SIMD variants cover whole vectors and return where
+   the scalar tail picks up; all do the same multiplies in the same order. */
+typedef int (*accum_kernel_fn)(float *const acc[3], float *wsum, const float *const src[3],
+                               const float *wx, float wy, int n);
+
+#ifdef TILE_X86
+static int accum_sse(float *const acc[3], float *wsum, const float *const src[3],
+                     const float *wx, float wy, int n) {
+    const __m128 vy = _mm_set1_ps(wy);
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128 w = _mm_mul_ps(_mm_loadu_ps(wx + x), vy);
+        _mm_storeu_ps(wsum + x, _mm_add_ps(_mm_loadu_ps(wsum + x), w));
+        for (int c = 0; c < 3; c++) {
+            __m128 v = _mm_mul_ps(_mm_loadu_ps(src[c] + x), w);
+            _mm_storeu_ps(acc[c] + x, _mm_add_ps(_mm_loadu_ps(acc[c] + x), v));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx")))
+static int accum_avx(float *const acc[3], float *wsum, const float *const src[3],
+                     const float *wx, float wy, int n) {
+    const __m256 vy = _mm256_set1_ps(wy);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256 w = _mm256_mul_ps(_mm256_loadu_ps(wx + x), vy);
+        _mm256_storeu_ps(wsum + x, _mm256_add_ps(_mm256_loadu_ps(wsum + x), w));
+        for (int c = 0; c < 3; c++) {
+            __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src[c] + x), w);
+            _mm256_storeu_ps(acc[c] + x, _mm256_add_ps(_mm256_loadu_ps(acc[c] + x), v));
+        }
+    }
+    return x;
+}
+#endif
+
+#ifdef TILE_NEON
+static int accum_neon(float *const acc[3], float *wsum, const float *const src[3],
+                      const float *wx, float wy, int n) {
+    const float32x4_t vy = vdupq_n_f32(wy);
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        float32x4_t w = vmulq_f32(vld1q_f32(wx + x), vy);
+        vst1q_f32(wsum + x, vaddq_f32(vld1q_f32(wsum + x), w));
+        for (int c = 0; c < 3; c++) {
+            float32x4_t v = vmulq_f32(vld1q_f32(src[c] + x), w);
+            vst1q_f32(acc[c] + x, vaddq_f32(vld1q_f32(acc[c] + x), v));
+        }
+    }
+    return x;
+}
+#endif
+
+static accum_kernel_fn pick_accum_kernel(void) {
+    static accum_kernel_fn kernel;
+    if (kernel) return kernel;
+#if defined(TILE_X86)
+    kernel = __builtin_cpu_supports("avx") ? accum_avx : accum_sse;
+#elif defined(TILE_NEON)
+    kernel = accum_neon;
+#else
+    kernel = NULL;
+#endif
+    return kernel;
+}
+
+void tile_accumulate_row(float *const acc[3], float *wsum, const float *const src[3],
+                         const float *wx, float wy, int n) {
+    accum_kernel_fn kernel = pick_accum_kernel();
+    int x = kernel ? kernel(acc, wsum, src, wx, wy, n) : 0;
+    for (; x < n; x++) {
+        float w = wx[x] * wy;
+        wsum[x] += w;
+        for (int c = 0; c < 3; c++) acc[c][x] += src[c][x] * w;
+    }
+}
+
+static void free_canvas(Canvas *cv) {
+    if (!cv) return;
+    free(cv->plane[0]);
+    free(cv);
+}
+
+/* Frames of one video share a size, so after the first frame this is a
+   list pop. Idle canvases of another size are dropped, not hoarded. */
+static Canvas *take_canvas(up60p_tiler *t, int w, int h) {
+    pthread_mutex_lock(&t->lock);
+    Canvas **link = &t->canvases, *found = NULL;
+    while (*link) {
+        Canvas *cv = *link;
+        if (!found && cv->w == w && cv->h == h) {
+            found = cv;
+            *link = cv->next;
+        } else if (cv->w != w || cv->h != h) {
+            *link = cv->next;
+            free_canvas(cv);
+        } else {
+            link = &cv->next;
+        }
+    }
+    pthread_mutex_unlock(&t->lock);
+    if (found) return found;
+
+    size_t n = (size_t)w * (size_t)h;
+    Canvas *cv = calloc(1, sizeof(*cv));
+    float *data = cv ? malloc(n * 4 * sizeof(float)) : NULL;
+    if (!data) { free(cv); return NULL; }
+    cv->w = w;
+    cv->h = h;
+    for (int i = 0; i < 4; i++) cv->plane[i] = data + n * (size_t)i;
+    return cv;
+}
+
+static void give_canvas(up60p_tiler *t, Canvas *cv) {
+    pthread_mutex_lock(&t->lock);
+    cv->next = t->canvases;
+    t->canvases = cv;
+    pthread_mutex_unlock(&t->lock);
+}
+
+static void free_scratch(Scratch *sc) {
+    if (!sc) return;
+    free(sc->in);
+    free(sc->out);
+    free(sc->wx);
+    free(sc->wy);
+    free(sc);
+}
+
+static Scratch *take_scratch(up60p_tiler *t) {
+    pthread_mutex_lock(&t->lock);
+    Scratch *sc = t->scratch;
+    if (sc) t->scratch = sc->next;
+    pthread_mutex_unlock(&t->lock);
+    if (sc) return sc;
+
+    size_t tw = (size_t)t->cfg.tile_w, th = (size_t)t->cfg.tile_h, s = (size_t)t->cfg.scale;
+    sc = calloc(1, sizeof(*sc));
+    if (!sc) return NULL;
+    sc->in = malloc(3 * tw * th * sizeof(float));
+    sc->out = malloc(3 * tw * th * s * s * sizeof(float));
+    sc->wx = malloc(tw * s * sizeof(float));
+    sc->wy = malloc(th * s * sizeof(float));
+    if (!sc->in || !sc->out || !sc->wx || !sc->wy) {
+        free_scratch(sc);
+        return NULL;
+    }
+    return sc;
+}
+
+static void give_scratch(up60p_tiler *t, Scratch *sc) {
+    pthread_mutex_lock(&t->lock);
+    sc->next = t->scratch;
+    t->scratch = sc;
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* Packed RGB -> planar floats; the part of the tile past the frame edge
+   repeats the last row/column so the model sees no artificial border. */
+static void load_tile(const up60p_frame *f, int x, int y, int w, int h, int tw, int th, float *dst) {
+    size_t plane = (size_t)tw * (size_t)th;
+    bool deep = f->bytes_per_pixel == 6;
+    const float k = deep ? 1.0f / 65535.0f : 1.0f / 255.0f;
+    for (int r = 0; r < th; r++) {
+        const uint8_t *row = f->data + (ptrdiff_t)(y + (r < h ? r : h - 1)) * f->stride;
+        float *d = dst + (size_t)r * (size_t)tw;
+        for (int c = 0; c < tw; c++) {
+            const uint8_t *px = row + (ptrdiff_t)(x + (c < w ? c : w - 1)) * f->bytes_per_pixel;
+            for (int ch = 0; ch < 3; ch++) {
+                float v;
+                if (deep) { uint16_t u; memcpy(&u, px + ch * 2, 2); v = u; }
+                else v = px[ch];
+                d[plane * (size_t)ch + (size_t)c] = v * k;
+            }
+        }
+    }
+}
+
+/* Weight along one axis: ramps up from the leading edge and down to the
+   trailing one, except on sides that touch the frame border. */
+static void edge_weights(float *wv, int n, const float *ramp, int feather, bool lead, bool trail) {
+    for (int i = 0; i < n; i++) {
+        float v = 1.0f;
+        if (lead && i < feather) v = ramp[i];
+        if (trail && n - 1 - i < feather && ramp[n - 1 - i] < v) v = ramp[n - 1 - i];
+        wv[i] = v;
+    }
+}
+
+static void blend_tile(TileFrame *f, Scratch *sc, int tx, int ty, int ox, int oy, int ow, int oh) {
+    up60p_tiler *t = f->t;
+    Canvas *cv = f->cv;
+    int tsw = t->cfg.tile_w * t->cfg.scale;
+    size_t plane = (size_t)tsw * (size_t)(t->cfg.tile_h * t->cfg.scale);
+    edge_weights(sc->wx, ow, t->ramp, t->feather, tx > 0, tx < f->tiles_x - 1);
+    edge_weights(sc->wy, oh, t->ramp, t->feather, ty > 0, ty < f->tiles_y - 1);
+    for (int r = 0; r < oh; r++) {
+        size_t at = (size_t)(oy + r) * (size_t)cv->w + (size_t)ox;
+        size_t from = (size_t)r * (size_t)tsw;
+        float *acc[3] = { cv->plane[0] + at, cv->plane[1] + at, cv->plane[2] + at };
+        const float *src[3] = { sc->out + from, sc->out + plane + from, sc->out + 2 * plane + from };
+        tile_accumulate_row(acc, cv->plane[3] + at, src, sc->wx, sc->wy[r], ow);
+    }
+}
+
+static int tile_origin(int i, int step, int tile, int size) {
+    int x = i * step, last = size - tile;
+    if (last < 0) last = 0;
+    return x < last ? x : last;
+}
+
+static void run_tile(int idx, void *ctx) {
+    TileFrame *f = ctx;
+    up60p_tiler *t = f->t;
+    int tw = t->cfg.tile_w, th = t->cfg.tile_h, s = t->cfg.scale;
+    int tx = idx % f->tiles_x, ty = idx / f->tiles_x;
+    int x = tile_origin(tx, f->step_x, tw, f->in->width);
+    int y = tile_origin(ty, f->step_y, th, f->in->height);
+    int w = f->in->width - x < tw ? f->in->width - x : tw;
+    int h = f->in->height - y < th ? f->in->height - y : th;
+
+    pthread_mutex_lock(&f->lock);
+    bool ok = !f->failed;
+    pthread_mutex_unlock(&f->lock);
+    Scratch *sc = ok && !up60p_is_cancelled() ? take_scratch(t) : NULL;
+    ok = sc != NULL;
+    if (ok) {
+        load_tile(f->in, x, y, w, h, tw, th, sc->in);
+        ok = t->cfg.infer(sc->in, sc->out, tw, th, s, t->cfg.user) == 0;
+    }
+
+    // Inference runs in parallel; blends go in tile order so the sums in
+    // overlaps, and so the output, are the same on every run
+    pthread_mutex_lock(&f->lock);
+    while (f->next_blend != idx) pthread_cond_wait(&f->turn, &f->lock);
+    if (!ok) f->failed = true;
+    ok = !f->failed;
+    pthread_mutex_unlock(&f->lock);
+
+    if (ok) blend_tile(f, sc, tx, ty, x * s, y * s, w * s, h * s);
+
+    pthread_mutex_lock(&f->lock);
+    f->next_blend++;
+    pthread_cond_broadcast(&f->turn);
+    pthread_mutex_unlock(&f->lock);
+    if (sc) give_scratch(t, sc);
+}
+
+static void clear_band(int band, void *ctx) {
+    TileFrame *f = ctx;
+    Canvas *cv = f->cv;
+    int y0 = band * TILE_BAND_ROWS;
+    int y1 = y0 + TILE_BAND_ROWS < cv->h ? y0 + TILE_BAND_ROWS : cv->h;
+    size_t at = (size_t)y0 * (size_t)cv->w, n = (size_t)(y1 - y0) * (size_t)cv->w;
+    for (int i = 0; i < 4; i++) memset(cv->plane[i] + at, 0, n * sizeof(float));
+}
+
+static void resolve_band(int band, void *ctx) {
+    TileFrame *f = ctx;
+    Canvas *cv = f->cv;
+    up60p_frame *out = f->out;
+    bool deep = out->bytes_per_pixel == 6;
+    const float top = deep ? 65535.0f : 255.0f;
+    int y0 = band * TILE_BAND_ROWS;
+    int y1 = y0 + TILE_BAND_ROWS < cv->h ? y0 + TILE_BAND_ROWS : cv->h;
+    for (int y = y0; y < y1; y++) {
+        size_t at = (size_t)y * (size_t)cv->w;
+        uint8_t *row = out->data + (ptrdiff_t)y * out->stride;
+        for (int x = 0; x < cv->w; x++) {
+            float wsum = cv->plane[3][at + (size_t)x];
+            float inv = wsum > 0 ? top / wsum : 0;
+            uint8_t *px = row + (ptrdiff_t)x * out->bytes_per_pixel;
+            for (int c = 0; c < 3; c++) {
+                float v = cv->plane[c][at + (size_t)x] * inv + 0.5f;
+                v = v < 0 ? 0 : v > top ? top : v;
+                if (deep) { uint16_t u = (uint16_t)v; memcpy(px + c * 2, &u, 2); }
+                else px[c] = (uint8_t)v;
+            }
+        }
+    }
+}
+
+up60p_tiler *up60p_tiler_create(const up60p_tile_config *config) {
+    if (!config || !config->infer || config->tile_w < 1 || config->tile_h < 1 || config->scale < 1) return NULL;
+    up60p_tile_config cfg = *config;
+    if (cfg.overlap <= 0) cfg.overlap = TILE_DEFAULT_OVERLAP;
+    if (cfg.overlap >= cfg.tile_w || cfg.overlap >= cfg.tile_h) return NULL;
+
+    up60p_tiler *t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->cfg = cfg;
+    t->feather = cfg.feather > 0 ? cfg.feather : cfg.overlap * cfg.scale;
+    t->ramp = malloc((size_t)t->feather * sizeof(float));
+    t->pool = pool_create(cfg.threads > 0 ? cfg.threads : up60p_cpu_count());
+    if (!t->ramp || !t->pool) {
+        free(t->ramp);
+        pool_destroy(t->pool);
+        free(t);
+        return NULL;
+    }
+    feather_ramp(t->ramp, t->feather, cfg.cosine);
+    pthread_mutex_init(&t->lock, NULL);
+    return t;
+}
+
+int up60p_tiler_upscale(const up60p_frame *in, up60p_frame *out, void *tiler) {
+    up60p_tiler *t = tiler;
+    if (!t || !in || !out || !in->data || !out->data) return -1;
+    int s = t->cfg.scale, bpp = in->bytes_per_pixel;
+    if ((bpp != 3 && bpp != 6) || out->bytes_per_pixel != bpp ||
+        out->width != in->width * s || out->height != in->height * s) return -1;
+
+    Canvas *cv = take_canvas(t, out->width, out->height);
+    if (!cv) return -1;
+
+    TileFrame f = {
+        .t = t, .in = in, .out = out, .cv = cv,
+        .step_x = t->cfg.tile_w - t->cfg.overlap, .step_y = t->cfg.tile_h - t->cfg.overlap
+    };
+    f.tiles_x = (in->width - t->cfg.overlap + f.step_x - 1) / f.step_x;
+    f.tiles_y = (in->height - t->cfg.overlap + f.step_y - 1) / f.step_y;
+    if (f.tiles_x < 1) f.tiles_x = 1;
+    if (f.tiles_y < 1) f.tiles_y = 1;
+    pthread_mutex_init(&f.lock, NULL);
+    pthread_cond_init(&f.turn, NULL);
+
+    int bands = (cv->h + TILE_BAND_ROWS - 1) / TILE_BAND_ROWS;
+    pool_run(t->pool, bands, clear_band, &f);
+    pool_run(t->pool, f.tiles_x * f.tiles_y, run_tile, &f);
+    if (!f.failed) pool_run(t->pool, bands, resolve_band, &f);
+
+    pthread_mutex_destroy(&f.lock);
+    pthread_cond_destroy(&f.turn);
+    give_canvas(t, cv);
+    return f.failed ? -1 : 0;
+}
+
+void up60p_tiler_destroy(up60p_tiler *t) {
+    if (!t) return;
+    pool_destroy(t->pool);
+    while (t->canvases) {
+        Canvas *next = t->canvases->next;
+        free_canvas(t->canvases);
+        t->canvases = next;
+    }
+    while (t->scratch) {
+        Scratch *next = t->scratch->next;
+        free_scratch(t->scratch);
+        t->scratch = next;
+    }
+    pthread_mutex_destroy(&t->lock);
+    free(t->ramp);
+    free(t);
+}
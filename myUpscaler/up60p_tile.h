@@ -0,0 +1,17 @@
+#ifndef UP60P_TILE_H
+#define UP60P_TILE_H
+
+#include "up60p_common.h"
+
+#define TILE_DEFAULT_OVERLAP 16
+#define TILE_BAND_ROWS 64      /* canvas rows per task when clearing and resolving */
+
+/* Rising edge of the blend window, sampled at pixel centres so no pixel
+   gets zero weight: Hann (0.5 - 0.5 cos) or linear. */
+void feather_ramp(float *ramp, int n, bool cosine);
+
+/* One canvas row: acc[c][x] += src[c][x] * wx[x] * wy, wsum[x] += wx[x] * wy */
+void tile_accumulate_row(float *const acc[3], float *wsum, const float *const src[3],
+                         const float *wx, float wy, int n);
+
+#endif
@@ -0,0 +1,295 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+#include "up60p_topology.h"
+#include "up60p_settings.h"
+#include <pthread.h>
+
+#define MPOL_PREFERRED_MODE 1   /* MPOL_PREFERRED, without needing numaif.h */
+
+typedef struct { int cpu, node, package, core; } CpuInfo;
+
+static struct {
+    CpuInfo cpus[UP60P_CPU_MAX];    /* allowed CPUs, node, package, core order */
+    int n;
+    int nnodes;
+    int quota;                      /* cgroup CPU limit, 0 = none */
+    CpuAllot root;
+} topo;
+
+static pthread_once_t topo_once = PTHREAD_ONCE_INIT;
+
+static __thread CpuAllot thread_allot;
+static __thread bool thread_allot_set;
+
+static void mask_set(CpuAllot *a, int cpu) { a->mask[cpu / 64] |= 1ULL << (cpu % 64); }
+static bool mask_has(const CpuAllot *a, int cpu) { return a->mask[cpu / 64] >> (cpu % 64) & 1; }
+
+#ifdef __linux__
+static long read_long(const char *path, long fallback) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return fallback;
+    long v;
+    if (fscanf(fp, "%ld", &v) != 1) v = fallback;
+    fclose(fp);
+    return v;
+}
+
+/* "0-3,8-11" */
+static void parse_cpulist(const char *s, int node, int *node_of) {
+    while (*s) {
+        char *end;
+        long lo = strtol(s, &end, 10), hi = lo;
+        if (end == s) break;
+        if (*end == '-') hi = strtol(end + 1, &end, 10);
+        for (long c = lo; c <= hi && c < UP60P_CPU_MAX; c++) if (c >= 0) node_of[c] = node;
+        s = *end == ',' ? end + 1 : end;
+        if (*s == '\n') break;
+    }
+}
+
+/* cpu.max (v2) or cfs_quota_us / cfs_period_us (v1), rounded up; the
+   tightest along the v2 hierarchy wins */
+static int cgroup_quota(void) {
+    int best = 0;
+    char line[PATH_MAX], path[PATH_MAX + 64];
+    FILE *fp = fopen("/proc/self/cgroup", "r");
+    while (fp && fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, "0::", 3)) continue;
+        line[strcspn(line, "\n")] = 0;
+        for (char *dir = line + 3; *dir; ) {
+            snprintf(path, sizeof(path), "/sys/fs/cgroup%s/cpu.max", dir);
+            FILE *m = fopen(path, "r");
+            long quota, period;
+            if (m && fscanf(m, "%ld %ld", &quota, &period) == 2 && quota > 0 && period > 0) {
+                int cpus = (int)((quota + period - 1) / period);
+                if (!best || cpus < best) best = cpus;
+            }
+            if (m) fclose(m);
+            char *slash = strrchr(dir, '/');
+            if (!slash) break;
+            if (slash == dir) {
+                if (!dir[1]) break;
+                dir[1] = 0;
+            } else {
+                *slash = 0;
+            }
+        }
+    }
+    if (fp) fclose(fp);
+    if (best) return best;
+
+    static const char *const v1[] = { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" };
+    for (int i = 0; i < ARR_LEN(v1); i++) {
+        snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", v1[i]);
+        long quota = read_long(path, -1);
+        snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", v1[i]);
+        long period = read_long(path, 0);
+        if (quota > 0 && period > 0) return (int)((quota + period - 1) / period);
+    }
+    return 0;
+}
+#endif
+
+static int cpu_order(const void *a, const void *b) {
+    const CpuInfo *x = a, *y = b;
+    if (x->node != y->node) return x->node - y->node;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static void load_topology(void) {
+#ifdef __linux__
+    static int node_of[UP60P_CPU_MAX];
+    for (int c = 0; c < UP60P_CPU_MAX; c++) node_of[c] = 0;
+    char path[128], list[4096];
+    for (int node = 0; node < UP60P_NODE_MAX; node++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (!fp) continue;
+        if (fgets(list, sizeof(list), fp)) parse_cpulist(list, node, node_of);
+        fclose(fp);
+    }
+    cpu_set_t allowed;
+    bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    long online = sysconf(_SC_NPROCESSORS_CONF);
+    bool seen[UP60P_NODE_MAX] = {0};
+    for (int c = 0; c < UP60P_CPU_MAX && c < CPU_SETSIZE && (have_mask || c < online); c++) {
+        if (have_mask ? !CPU_ISSET(c, &allowed) : false) continue;
+        CpuInfo *ci = &topo.cpus[topo.n++];
+        ci->cpu = c;
+        ci->node = node_of[c];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+        ci->package = (int)read_long(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+        ci->core = (int)read_long(path, c);
+        if (!seen[ci->node]) { seen[ci->node] = true; topo.nnodes++; }
+    }
+    qsort(topo.cpus, (size_t)topo.n, sizeof(topo.cpus[0]), cpu_order);
+    topo.quota = cgroup_quota();
+#endif
+    if (topo.n == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        topo.n = n > 0 ? (n < UP60P_CPU_MAX ? (int)n : UP60P_CPU_MAX) : 1;
+        for (int i = 0; i < topo.n; i++) topo.cpus[i] = (CpuInfo){ i, 0, 0, i };
+        topo.nnodes = 1;
+    }
+    for (int i = 0; i < topo.n; i++) mask_set(&topo.root, topo.cpus[i].cpu);
+    topo.root.ncpus = topo.quota > 0 && topo.quota < topo.n ? topo.quota : topo.n;
+    topo.root.node = topo.nnodes == 1 ? topo.cpus[0].node : -1;
+}
+
+static void ensure_topology(void) {
+    pthread_once(&topo_once, load_topology);
+}
+
+int topology_cpu_count(void) {
+    ensure_topology();
+    return topo.root.ncpus;
+}
+
+int topology_node_count(void) {
+    ensure_topology();
+    return topo.nnodes;
+}
+
+static bool can_pin(const CpuAllot *parent) {
+#ifdef __linux__
+    if (S.no_cpu_pin) return false;
+    int set = 0;
+    for (int i = 0; i < topo.n; i++) set += mask_has(parent, topo.cpus[i].cpu);
+    // Under a quota any subset is as good as another, so there's nothing to place
+    return parent->ncpus == set;
+#else
+    (void)parent;
+    return false;
+#endif
+}
+
+void cpu_allot_split(const CpuAllot *parent, int index, int n, CpuAllot *out) {
+    ensure_topology();
+    *out = *parent;
+    if (n <= 1) return;
+    if (!can_pin(parent) || parent->ncpus < n) {
+        out->ncpus = parent->ncpus / n + (index < parent->ncpus % n);
+        if (out->ncpus < 1) out->ncpus = 1;
+        return;
+    }
+
+    // parent's CPUs in topology order, as runs of one node each
+    CpuInfo list[UP60P_CPU_MAX];
+    int m = 0, run_start[UP60P_NODE_MAX + 1], runs = 0;
+    for (int i = 0; i < topo.n; i++) {
+        if (!mask_has(parent, topo.cpus[i].cpu)) continue;
+        if (!m || list[m - 1].node != topo.cpus[i].node) {
+            if (runs == UP60P_NODE_MAX) break;
+            run_start[runs++] = m;
+        }
+        list[m++] = topo.cpus[i];
+    }
+    run_start[runs] = m;
+
+    int lo, hi;
+    if (n >= runs) {
+        // Parts per node in proportion to its CPUs, at least one each
+        int k[UP60P_NODE_MAX], given = 0;
+        for (int r = 0; r < runs; r++) {
+            int len = run_start[r + 1] - run_start[r];
+            k[r] = (int)((long)n * len / m);
+            if (k[r] < 1) k[r] = 1;
+            given += k[r];
+        }
+        while (given != n) {
+            int pick = -1;
+            double best = 0;
+            for (int r = 0; r < runs; r++) {
+                double per = (double)(run_start[r + 1] - run_start[r]) / k[r];
+                if (given < n ? per > best : (k[r] > 1 && (pick < 0 || per < best))) { pick = r; best = per; }
+            }
+            if (pick < 0) break;
+            k[pick] += given < n ? 1 : -1;
+            given += given < n ? 1 : -1;
+        }
+        int r = 0, first = 0;
+        while (r < runs - 1 && index >= first + k[r]) first += k[r++];
+        int s = index - first, len = run_start[r + 1] - run_start[r];
+        if (s >= k[r]) s = k[r] - 1;
+        lo = run_start[r] + s * len / k[r];
+        hi = run_start[r] + (s + 1) * len / k[r];
+    } else {
+        // Whole nodes, cut where the CPU count comes closest to even
+        int cut = 0;
+        lo = hi = 0;
+        for (int i = 1; i <= index + 1; i++) {
+            int best = cut + 1;
+            for (int r = best; r <= runs - (n - i); r++) {
+                if (abs(run_start[r] - i * m / n) < abs(run_start[best] - i * m / n)) best = r;
+            }
+            lo = run_start[cut];
+            cut = i == n ? runs : best;
+            hi = run_start[cut];
+        }
+    }
+
+    memset(out->mask, 0, sizeof(out->mask));
+    for (int i = lo; i < hi; i++) mask_set(out, list[i].cpu);
+    out->ncpus = hi - lo;
+    out->node = hi > lo && list[lo].node == list[hi - 1].node ? list[lo].node : -1;
+    out->pinned = true;
+}
+
+void set_current_allot(const CpuAllot *a) {
+    if (a) thread_allot = *a;
+    thread_allot_set = a != NULL;
+}
+
+void current_allot(CpuAllot *out) {
+    ensure_topology();
+    *out = thread_allot_set ? thread_allot : topo.root;
+}
+
+void apply_allot(const CpuAllot *a) {
+#ifdef __linux__
+    if (!a->pinned) return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < UP60P_CPU_MAX && c < CPU_SETSIZE; c++) {
+        if (mask_has(a, c)) CPU_SET(c, &set);
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+    // First touch is local to the bound CPUs already; this covers what
+    // the kernel would otherwise spill to the other node
+    if (a->node >= 0 && a->node < 64) {
+        unsigned long nodes = 1UL << a->node;
+        syscall(SYS_set_mempolicy, MPOL_PREFERRED_MODE, &nodes, sizeof(nodes) * 8);
+    }
+#else
+    (void)a;
+#endif
+}
+
+void topology_pin_process(int index, int n) {
+    ensure_topology();
+    CpuAllot part;
+    cpu_allot_split(&topo.root, index, n, &part);
+    apply_allot(&part);
+    // Children inherit the binding, so they needn't apply it again
+    part.pinned = false;
+    topo.root = part;
+}
+
+bool topology_pins(int n) {
+    ensure_topology();
+    return n > 1 && n <= topo.root.ncpus && can_pin(&topo.root);
+}
+
+void topology_describe(char *buf, size_t size) {
+    ensure_topology();
+    int n = snprintf(buf, size, "%d CPUs on %d NUMA node%s", topo.n, topo.nnodes, topo.nnodes == 1 ? "" : "s");
+    if (topo.quota > 0 && topo.quota < topo.n && n > 0 && (size_t)n < size) {
+        snprintf(buf + n, size - (size_t)n, ", cgroup limit %d", topo.quota);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef UP60P_TOPOLOGY_H
+#define UP60P_TOPOLOGY_H
+
+#include "up60p_common.h"
+
+#define UP60P_CPU_MAX 1024
+#define UP60P_NODE_MAX 64
+
+/* A share of the machine for one job: the CPUs it may run on and how many
+   threads it should size itself for. */
+typedef struct {
+    uint64_t mask[UP60P_CPU_MAX / 64];
+    int ncpus;          /* threads this share is good for */
+    int node;           /* NUMA node every CPU in mask is on, -1 = several or unknown */
+    bool pinned;        /* children started under this share are bound to mask */
+} CpuAllot;
+
+/* CPUs this process may use: its affinity mask, capped by a cgroup CPU
+   quota. Read from sysfs once; macOS has neither and gets the core count. */
+int topology_cpu_count(void);
+int topology_node_count(void);
+
+/* Part index of n parts of parent. With n of at least the NUMA nodes in
+   parent, each part lies on one node and takes whole cores; with fewer,
+   each part takes whole nodes. Parts are only pinned on Linux, without
+   no_cpu_pin, and when no cgroup quota is smaller than the CPU set;
+   otherwise parent's CPUs are shared and only ncpus is split. */
+void cpu_allot_split(const CpuAllot *parent, int index, int n, CpuAllot *out);
+
+/* The calling thread's share, inherited by ffmpeg children it starts.
+   Unset, it's everything topology_cpu_count covers. */
+void set_current_allot(const CpuAllot *a);
+void current_allot(CpuAllot *out);
+
+/* Called in a child between fork and exec: binds it to a's CPUs and
+   prefers a's node for its memory. */
+void apply_allot(const CpuAllot *a);
+
+/* Narrows this whole process to part index of n, for a front end that
+   forks one process per job. */
+void topology_pin_process(int index, int n);
+
+/* Whether splitting the whole process n ways pins the parts (see cpu_allot_split) */
+bool topology_pins(int n);
+
+/* "64 CPUs on 2 NUMA nodes, cgroup limit 16" */
+void topology_describe(char *buf, size_t size);
+
+#endif
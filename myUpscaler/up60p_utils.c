@@ -1,10 +1,10 @@
 #include "up60p_utils.h"
 #include "up60p_common.h"
+#include "up60p_context.h"
+#include <pthread.h>
 
 up60p_log_callback global_log_cb = NULL;
 
-volatile sig_atomic_t cancel_requested = 0;
-
  void mkdir_p(const char *path) {
     char tmp[PATH_MAX]; snprintf(tmp, sizeof(tmp), "%s", path);
     for (char *p = tmp + 1; *p; p++) { if (*p == '/') { *p = 0; mkdir(tmp, 0775); *p = '/'; } }
@@ -33,39 +33,58 @@ void sanitize_path(char *p) {
 
 
 
+bool sb_reserve(SB *s, size_t extra) {
+    if (!s) return false;
+    if (s->buf && s->len + extra < s->cap) return true;
+    size_t new_cap = s->cap ? s->cap : 1024;
+    while (s->len + extra >= new_cap) new_cap *= 2;
+    char *tmp = realloc(s->buf, new_cap);
+    if (!tmp) return false;
+    if (!s->buf) tmp[0] = '\0';
+    s->buf = tmp;
+    s->cap = new_cap;
+    return true;
+}
+
 void sb_append(SB *s, const char *str) {
     if (!s || !str) return;
-    
-    if (!s->buf) {
-        s->cap = 1024;
-        s->buf = malloc(s->cap);
-        s->len = 0;
-        if (!s->buf) {
-            s->cap = 0;
-            return;
-        }
-        s->buf[0] = '\0';
-    }
-    
     size_t l = strlen(str);
-    
-    if (s->len + l + 1 >= s->cap) {
-        size_t new_cap = (s->cap + l) * 2;
-        char *tmp = realloc(s->buf, new_cap);
-        if (!tmp) return;
-        s->buf = tmp;
-        s->cap = new_cap;
-    }
-    
+    if (!sb_reserve(s, l)) return;
     memcpy(s->buf + s->len, str, l + 1);
     s->len += l;
 }
 
 
+/* Formats in place; only output that doesn't fit the spare capacity is
+   formatted a second time, after one grow */
 void sb_fmt(SB *s, const char *fmt, ...) {
-    va_list ap; va_start(ap, fmt);
-    char tmp[2048]; vsnprintf(tmp, sizeof(tmp), fmt, ap);
-    va_end(ap); sb_append(s, tmp);
+    if (!s || !sb_reserve(s, 0)) return;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(s->buf + s->len, s->cap - s->len, fmt, ap);
+    va_end(ap);
+    if (n < 0) { s->buf[s->len] = 0; return; }
+    if ((size_t)n >= s->cap - s->len) {
+        if (!sb_reserve(s, (size_t)n)) { s->buf[s->len] = 0; return; }
+        va_start(ap, fmt);
+        vsnprintf(s->buf + s->len, s->cap - s->len, fmt, ap);
+        va_end(ap);
+    }
+    s->len += (size_t)n;
+}
+
+/* s as a quoted JSON string */
+void sb_json_string(SB *sb, const char *s) {
+    sb_append(sb, "\"");
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') sb_fmt(sb, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) sb_fmt(sb, "\\u%04x", *s);
+        else {
+            char c[2] = { *s, 0 };
+            sb_append(sb, c);
+        }
+    }
+    sb_append(sb, "\"");
 }
 
 double parse_strength(const char *strength) {
@@ -87,12 +106,67 @@ bool is_image(const char *path) {
     return false;
 }
 
+bool is_restorable(const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    if (name[0] == '.' || strstr(name, "_[restored]")) return false;
+    const char *ext = strrchr(name, '.');
+    if (!ext) return false;
+    return is_image(name) || !strcasecmp(ext, ".mp4") || !strcasecmp(ext, ".mkv") || !strcasecmp(ext, ".mov");
+}
+
 
-bool up60p_is_cancelled(void) { return cancel_requested != 0; }
+/* A job's workers share its callbacks; serialize so chunks never interleave.
+   Jobs in different contexts don't wait on each other. */
+void log_msg(const char *msg) {
+    up60p_context *ctx = current_context();
+    up60p_log_callback cb = context_log_cb(ctx);
+    if (!cb || !msg) return;
+    pthread_mutex_lock(&ctx->cb_lock);
+    cb(msg);
+    pthread_mutex_unlock(&ctx->cb_lock);
+}
+
+void log_once(LogNote note, const char *msg) {
+    unsigned seen = __atomic_fetch_or(&current_context()->notes_logged, (unsigned)note, __ATOMIC_RELAXED);
+    if (!(seen & note)) log_msg(msg);
+}
+
+void report_job(const up60p_job_result *result) {
+    up60p_context *ctx = current_context();
+    if (!ctx->job_cb || !result) return;
+    pthread_mutex_lock(&ctx->cb_lock);
+    ctx->job_cb(result);
+    pthread_mutex_unlock(&ctx->cb_lock);
+}
+
+void publish_progress(const up60p_progress *progress) {
+    up60p_context *ctx = current_context();
+    if (!ctx->progress_cb || !progress) return;
+    pthread_mutex_lock(&ctx->cb_lock);
+    ctx->progress_cb(progress);
+    pthread_mutex_unlock(&ctx->cb_lock);
+}
 
+bool progress_wanted(void) { return current_context()->progress_cb != NULL; }
+
+
+bool up60p_is_cancelled(void) { return current_context()->cancelled != 0; }
+
+void up60p_reset_cancel(void) { current_context()->cancelled = 0; }
+
+void up60p_set_job_callback(up60p_job_callback cb) {
+    current_context()->job_cb = cb;
+}
+
+void up60p_set_progress_callback(up60p_progress_callback cb) {
+    current_context()->progress_cb = cb;
+}
 
-void up60p_request_cancel(void) {
-    cancel_requested = 1;
+void up60p_set_upscaler(up60p_upscale_fn fn, void *user) {
+    up60p_context *ctx = current_context();
+    ctx->upscale_user = user;
+    ctx->upscale_fn = fn;
 }
 
 
@@ -16,19 +16,49 @@ void safe_copy(char *dst, const char *src, size_t size);
 void mkdir_p(const char *path);
 void sanitize_path(char *p);
 
+/* Room for extra more bytes plus the terminator; false if out of memory */
+bool sb_reserve(SB *s, size_t extra);
 void sb_append(SB *s, const char *str);
 void sb_fmt(SB *s, const char *fmt, ...);
+void sb_json_string(SB *sb, const char *s);
 
 double parse_strength(const char *strength);
 
 bool is_image(const char *path);
+/* A video or image by its final extension, so "x.mp4.part" isn't one;
+   dotfiles (rsync temporaries) and our own _[restored] outputs aren't either */
+bool is_restorable(const char *path);
 
+const char *get_bundled_ffmpeg_path(void);
 
 
+
+void log_msg(const char *msg);
+
+/* Fallback notes worth saying once, not once per file */
+typedef enum {
+    NOTE_PIPE_NO_UPSCALER = 1 << 0,
+    NOTE_FUSED_POST_OFF   = 1 << 1,
+    NOTE_FRC_OFF          = 1 << 2,
+    NOTE_HW_PREVIEW       = 1 << 3,
+    NOTE_LIBAV_OFF        = 1 << 4,
+    NOTE_STAGE_ON_DEVICE  = 1 << 5,
+    NOTE_INOTIFY_FULL     = 1 << 6,
+} LogNote;
+
+/* log_msg the first time note comes up in the current context */
+void log_once(LogNote note, const char *msg);
+void report_job(const up60p_job_result *result);
+void publish_progress(const up60p_progress *progress);
+/* Whether the current context has a progress callback to publish to */
+bool progress_wanted(void);
+
 bool up60p_is_cancelled(void);
+void up60p_reset_cancel(void);
 void up60p_request_cancel(void);
 
 
+/* Log callback of the process-wide context (up60p_init) */
 extern up60p_log_callback global_log_cb;
 
 #endif
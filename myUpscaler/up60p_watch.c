@@ -0,0 +1,623 @@
+#include "up60p_watch.h"
+#include "up60p_settings.h"
+#include "up60p_utils.h"
+#include "up60p_cache.h"
+#include "up60p_context.h"
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+/* Journal layout, later lines win:
+     up60p-index 1
+     f <state> <path hash> <size> <mtime ns> [path]    state d done, f failed, p found
+     d <mtime ns> <path>                               a directory as last listed
+   Paths are kept for directories and unfinished files only, so two million
+   finished files cost their hashes. */
+
+/* Open addressing, linear probing, backward-shift deletion. Key 0 is free. */
+typedef struct { uint64_t key; int value; } MapSlot;
+typedef struct { MapSlot *slots; size_t cap, count; } Map;
+
+static int *map_get(Map *m, uint64_t key) {
+    if (!m->cap) return NULL;
+    for (size_t i = key & (m->cap - 1); m->slots[i].key; i = (i + 1) & (m->cap - 1)) {
+        if (m->slots[i].key == key) return &m->slots[i].value;
+    }
+    return NULL;
+}
+
+static bool map_put(Map *m, uint64_t key, int value) {
+    if ((m->count + 1) * 2 > m->cap) {
+        size_t cap = m->cap ? m->cap * 2 : 1024;
+        MapSlot *slots = calloc(cap, sizeof(*slots));
+        if (!slots) return false;
+        for (size_t i = 0; i < m->cap; i++) {
+            if (!m->slots[i].key) continue;
+            size_t j = m->slots[i].key & (cap - 1);
+            while (slots[j].key) j = (j + 1) & (cap - 1);
+            slots[j] = m->slots[i];
+        }
+        free(m->slots);
+        m->slots = slots;
+        m->cap = cap;
+    }
+    size_t i = key & (m->cap - 1);
+    while (m->slots[i].key && m->slots[i].key != key) i = (i + 1) & (m->cap - 1);
+    if (!m->slots[i].key) m->count++;
+    m->slots[i] = (MapSlot){ key, value };
+    return true;
+}
+
+static void map_del(Map *m, uint64_t key) {
+    if (!m->cap) return;
+    size_t mask = m->cap - 1, i = key & mask;
+    while (m->slots[i].key && m->slots[i].key != key) i = (i + 1) & mask;
+    if (!m->slots[i].key) return;
+    m->count--;
+    // Pull later entries of the run back so lookups never stop early
+    for (size_t j = (i + 1) & mask; m->slots[j].key; j = (j + 1) & mask) {
+        size_t home = m->slots[j].key & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            m->slots[i] = m->slots[j];
+            i = j;
+        }
+    }
+    m->slots[i].key = 0;
+}
+
+static void map_free(Map *m) {
+    free(m->slots);
+    memset(m, 0, sizeof(*m));
+}
+
+static uint64_t path_hash(const char *path) {
+    uint64_t h = xxh64(path, strlen(path), 0);
+    return h ? h : 1;
+}
+
+typedef struct {
+    long long size, mtime;
+    char state;
+    char *path;             /* state 'p' only */
+} FileRecord;
+
+typedef struct {
+    char *path;
+    long long mtime;        /* -1 once gone */
+} DirRecord;
+
+typedef struct {
+    char *path;
+    long long size, mtime;
+} Pending;
+
+typedef struct {
+    PathList files;
+    uint64_t *hashes;
+    long long *size, *mtime;
+    up60p_error *status;
+    watch_batch_fn run;
+    void *ctx;
+    int done;
+    pthread_t thread;
+} WatchBatch;
+
+typedef struct {
+    char root[PATH_MAX];
+    char index[PATH_MAX];
+    FILE *journal;
+    long journal_lines;
+    long long settle_ns;
+    Map files;              /* path hash -> records */
+    FileRecord *records;
+    int nrecords, records_cap;
+    Map dirs;               /* path hash -> dirlist */
+    DirRecord *dirlist;
+    int ndirs, dirs_cap;
+    Pending *pending;       /* written recently, waiting to settle */
+    int npending, pending_cap;
+    Map pending_map;
+    PathList ready;         /* settled, ready[ready_head..] not yet handed out */
+    int ready_head;
+    Map queued;             /* ready or in the running batch */
+    bool rescan;
+    int ifd;
+#ifdef __linux__
+    Map wds;                /* watch descriptor + 1 -> dirlist */
+#endif
+} Watch;
+
+static long long mtime_ns(const struct stat *st) {
+#ifdef __APPLE__
+    return (long long)st->st_mtimespec.tv_sec * 1000000000LL + st->st_mtimespec.tv_nsec;
+#else
+    return (long long)st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+#endif
+}
+
+static long long wall_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static double mono_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* ---- Index ---- */
+
+static FileRecord *file_record(Watch *w, uint64_t hash, bool create) {
+    int *slot = map_get(&w->files, hash);
+    if (slot) return &w->records[*slot];
+    if (!create) return NULL;
+    if (w->nrecords == w->records_cap) {
+        int cap = w->records_cap ? w->records_cap * 2 : 1024;
+        FileRecord *r = realloc(w->records, (size_t)cap * sizeof(*r));
+        if (!r) return NULL;
+        w->records = r;
+        w->records_cap = cap;
+    }
+    if (!map_put(&w->files, hash, w->nrecords)) return NULL;
+    FileRecord *r = &w->records[w->nrecords++];
+    memset(r, 0, sizeof(*r));
+    return r;
+}
+
+static void set_file(Watch *w, uint64_t hash, const char *path, long long size, long long mtime, char state) {
+    FileRecord *r = file_record(w, hash, true);
+    if (!r) return;
+    r->size = size;
+    r->mtime = mtime;
+    r->state = state;
+    free(r->path);
+    r->path = state == 'p' && path ? strdup(path) : NULL;
+}
+
+static DirRecord *dir_record(Watch *w, const char *path, bool create) {
+    uint64_t hash = path_hash(path);
+    int *slot = map_get(&w->dirs, hash);
+    if (slot) return &w->dirlist[*slot];
+    if (!create) return NULL;
+    if (w->ndirs == w->dirs_cap) {
+        int cap = w->dirs_cap ? w->dirs_cap * 2 : 256;
+        DirRecord *d = realloc(w->dirlist, (size_t)cap * sizeof(*d));
+        if (!d) return NULL;
+        w->dirlist = d;
+        w->dirs_cap = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy || !map_put(&w->dirs, hash, w->ndirs)) { free(copy); return NULL; }
+    DirRecord *d = &w->dirlist[w->ndirs++];
+    d->path = copy;
+    d->mtime = 0;
+    return d;
+}
+
+static void journal_file(Watch *w, uint64_t hash, const FileRecord *r) {
+    if (!w->journal) return;
+    fprintf(w->journal, "f %c %016llx %lld %lld", r->state, (unsigned long long)hash, r->size, r->mtime);
+    if (r->path) fprintf(w->journal, " %s", r->path);
+    fputc('\n', w->journal);
+    fflush(w->journal);
+    w->journal_lines++;
+}
+
+static void journal_dir(Watch *w, const DirRecord *d) {
+    if (!w->journal) return;
+    fprintf(w->journal, "d %lld %s\n", d->mtime, d->path);
+    fflush(w->journal);
+    w->journal_lines++;
+}
+
+static void load_index(Watch *w) {
+    FILE *fp = fopen(w->index, "r");
+    if (!fp) return;
+    char *line = malloc(PATH_MAX + 128);
+    int version = 0;
+    if (!line || !fgets(line, PATH_MAX + 128, fp) || sscanf(line, "up60p-index %d", &version) != 1 ||
+        version != WATCH_INDEX_VERSION) {
+        free(line);
+        fclose(fp);
+        return;
+    }
+    while (fgets(line, PATH_MAX + 128, fp)) {
+        w->journal_lines++;
+        size_t n = strlen(line);
+        if (!n || line[n - 1] != '\n') break;       // torn last line
+        line[n - 1] = 0;
+        char state;
+        unsigned long long hash;
+        long long size, mtime;
+        int used = 0;
+        if (sscanf(line, "f %c %llx %lld %lld%n", &state, &hash, &size, &mtime, &used) == 4 && hash) {
+            const char *path = line[used] == ' ' ? line + used + 1 : NULL;
+            set_file(w, hash, path, size, mtime, state);
+        } else if (sscanf(line, "d %lld %n", &mtime, &used) == 1 && line[used]) {
+            DirRecord *d = dir_record(w, line + used, true);
+            if (d) d->mtime = mtime;
+        }
+    }
+    free(line);
+    fclose(fp);
+}
+
+/* Rewrites the journal as one line per live record */
+static void compact_index(Watch *w) {
+    char tmp[PATH_MAX + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->index);
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return;
+    FILE *live = w->journal;
+    w->journal = fp;
+    w->journal_lines = 0;
+    fprintf(fp, "up60p-index %d\n", WATCH_INDEX_VERSION);
+    for (int i = 0; i < w->ndirs; i++) {
+        if (w->dirlist[i].mtime >= 0) journal_dir(w, &w->dirlist[i]);
+    }
+    for (size_t i = 0; i < w->files.cap; i++) {
+        const MapSlot *s = &w->files.slots[i];
+        if (s->key) journal_file(w, s->key, &w->records[s->value]);
+    }
+    bool ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fclose(fp) == 0 && ok && rename(tmp, w->index) == 0) {
+        if (live) fclose(live);
+        w->journal = fopen(w->index, "a");
+    } else {
+        unlink(tmp);
+        w->journal = live;
+    }
+}
+
+/* ---- Discovery ---- */
+
+static bool same_dir(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+    while (la > 1 && a[la - 1] == '/') la--;
+    while (lb > 1 && b[lb - 1] == '/') lb--;
+    return la == lb && !strncmp(a, b, la);
+}
+
+/* Hidden and output directories, and caches that sit inside the tree */
+static bool skip_dir(const char *path) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    if (name[0] == '.' || strstr(name, "_[restored]")) return true;
+    return (*S.cache_dir && same_dir(path, S.cache_dir)) ||
+           (*S.stage_cache_dir && same_dir(path, S.stage_cache_dir));
+}
+
+static void make_ready(Watch *w, const char *path, uint64_t hash) {
+    if (map_get(&w->queued, hash) || !map_put(&w->queued, hash, 1)) return;
+    path_list_push(&w->ready, path);
+}
+
+static void add_pending(Watch *w, const char *path, const struct stat *st) {
+    uint64_t hash = path_hash(path);
+    int *slot = map_get(&w->pending_map, hash);
+    if (slot) {
+        w->pending[*slot].size = st->st_size;
+        w->pending[*slot].mtime = mtime_ns(st);
+        return;
+    }
+    if (w->npending == w->pending_cap) {
+        int cap = w->pending_cap ? w->pending_cap * 2 : 64;
+        Pending *p = realloc(w->pending, (size_t)cap * sizeof(*p));
+        if (!p) return;
+        w->pending = p;
+        w->pending_cap = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy || !map_put(&w->pending_map, hash, w->npending)) { free(copy); return; }
+    w->pending[w->npending++] = (Pending){ copy, st->st_size, mtime_ns(st) };
+}
+
+/* A file was seen with this size and mtime: nothing to do if that's what
+   was processed, queued if nothing has written to it for the settle time,
+   otherwise watched until it holds still. */
+static void consider(Watch *w, const char *path, const struct stat *st) {
+    if (!S_ISREG(st->st_mode) || !is_restorable(path)) return;
+    uint64_t hash = path_hash(path);
+    long long mtime = mtime_ns(st);
+    FileRecord *r = file_record(w, hash, false);
+    bool same = r && r->size == st->st_size && r->mtime == mtime;
+    if (same && r->state != 'p') return;
+    if (!same) {
+        set_file(w, hash, path, st->st_size, mtime, 'p');
+        r = file_record(w, hash, false);
+        if (r) journal_file(w, hash, r);
+    }
+    if (wall_ns() - mtime >= w->settle_ns && !map_get(&w->queued, hash)) make_ready(w, path, hash);
+    else add_pending(w, path, st);
+}
+
+static void add_watch(Watch *w, int dir) {
+#ifdef __linux__
+    if (w->ifd < 0) return;
+    int wd = inotify_add_watch(w->ifd, w->dirlist[dir].path,
+                               IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+    if (wd >= 0) {
+        map_put(&w->wds, (uint64_t)wd + 1, dir);
+    } else if (errno == ENOSPC) {
+        log_once(NOTE_INOTIFY_FULL, "Watch: out of inotify watches (fs.inotify.max_user_watches), the rest is swept periodically\n");
+    }
+#else
+    (void)w; (void)dir;
+#endif
+}
+
+/* Lists a directory whose mtime moved since it was last listed. New
+   subdirectories are appended to dirlist, so a sweep reaches them too. */
+static void scan_dir(Watch *w, int index, bool watch) {
+    DirRecord *d = &w->dirlist[index];
+    struct stat st;
+    if (d->mtime < 0) return;
+    if (stat(d->path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        d->mtime = -1;
+        return;
+    }
+    if (watch) add_watch(w, index);
+    long long mtime = mtime_ns(&st);
+    if (mtime == d->mtime) return;
+
+    DIR *dir = opendir(d->path);
+    if (!dir) return;
+    char path[PATH_MAX];
+    struct dirent *e;
+    while ((e = readdir(dir))) {
+        if (e->d_name[0] == '.') continue;
+        int n = snprintf(path, sizeof(path), "%s/%s", w->dirlist[index].path, e->d_name);
+        if (n < 0 || n >= (int)sizeof(path) || stat(path, &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            if (!skip_dir(path)) dir_record(w, path, true);
+        } else {
+            consider(w, path, &st);
+        }
+    }
+    closedir(dir);
+    // dir_record may have moved dirlist
+    w->dirlist[index].mtime = mtime;
+    journal_dir(w, &w->dirlist[index]);
+}
+
+static void sweep(Watch *w, bool watch) {
+    for (int i = 0; i < w->ndirs && !up60p_is_cancelled(); i++) scan_dir(w, i, watch);
+}
+
+#ifdef __linux__
+static void read_events(Watch *w) {
+    char buf[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t n = read(w->ifd, buf, sizeof(buf));
+        if (n <= 0) return;
+        for (char *p = buf; p < buf + n; ) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            p += sizeof(*ev) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) { w->rescan = true; continue; }
+            int *dir = map_get(&w->wds, (uint64_t)ev->wd + 1);
+            if (ev->mask & IN_IGNORED) { map_del(&w->wds, (uint64_t)ev->wd + 1); continue; }
+            if (!dir || !ev->len || ev->name[0] == '.') continue;
+            char path[PATH_MAX];
+            int len = snprintf(path, sizeof(path), "%s/%s", w->dirlist[*dir].path, ev->name);
+            struct stat st;
+            if (len < 0 || len >= (int)sizeof(path) || stat(path, &st) != 0) continue;
+            if (S_ISDIR(st.st_mode)) {
+                if (skip_dir(path)) continue;
+                // Files can land before the watch does; listing it covers them
+                DirRecord *d = dir_record(w, path, true);
+                if (d) scan_dir(w, (int)(d - w->dirlist), true);
+            } else {
+                consider(w, path, &st);
+            }
+        }
+    }
+}
+#endif
+
+/* Pending files that held still long enough move to ready */
+static void settle_pending(Watch *w) {
+    long long now = wall_ns();
+    int kept = 0;
+    map_free(&w->pending_map);
+    for (int i = 0; i < w->npending; i++) {
+        Pending p = w->pending[i];
+        struct stat st;
+        if (stat(p.path, &st) != 0) { free(p.path); continue; }
+        uint64_t hash = path_hash(p.path);
+        bool still = st.st_size == p.size && mtime_ns(&st) == p.mtime;
+        if (still && now - p.mtime >= w->settle_ns && !map_get(&w->queued, hash)) {
+            consider(w, p.path, &st);
+            free(p.path);
+            continue;
+        }
+        p.size = st.st_size;
+        p.mtime = mtime_ns(&st);
+        w->pending[kept] = p;
+        map_put(&w->pending_map, hash, kept);
+        kept++;
+    }
+    w->npending = kept;
+}
+
+/* ---- Batches ---- */
+
+static void *batch_thread(void *arg) {
+    WatchBatch *b = arg;
+    b->run(&b->files, b->status, b->ctx);
+    __atomic_store_n(&b->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static bool start_batch(Watch *w, WatchBatch *b, watch_batch_fn run, void *ctx) {
+    int left = w->ready.count - w->ready_head;
+    int n = left < WATCH_BATCH_MAX ? left : WATCH_BATCH_MAX;
+    memset(b, 0, sizeof(*b));
+    b->hashes = calloc((size_t)n, sizeof(*b->hashes));
+    b->size = calloc((size_t)n, sizeof(*b->size));
+    b->mtime = calloc((size_t)n, sizeof(*b->mtime));
+    b->status = calloc((size_t)n, sizeof(*b->status));
+    if (!b->hashes || !b->size || !b->mtime || !b->status) return false;
+    for (int i = 0; i < n; i++) {
+        char *path = w->ready.items[w->ready_head + i];
+        struct stat st;
+        // Captured now so a write during the batch shows up as a change
+        if (stat(path, &st) == 0) {
+            b->hashes[b->files.count] = path_hash(path);
+            b->size[b->files.count] = st.st_size;
+            b->mtime[b->files.count] = mtime_ns(&st);
+            path_list_push(&b->files, path);
+        } else {
+            map_del(&w->queued, path_hash(path));
+        }
+        free(path);
+        w->ready.items[w->ready_head + i] = NULL;
+    }
+    w->ready_head += n;
+    if (w->ready_head == w->ready.count) {
+        w->ready.count = 0;
+        w->ready_head = 0;
+    }
+    if (b->files.count == 0) return false;
+    b->run = run;
+    b->ctx = ctx;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "Watch: %d settled files, %d more waiting\n", b->files.count, w->ready.count - w->ready_head);
+    log_msg(msg);
+    return context_thread_create(&b->thread, batch_thread, b) == 0;
+}
+
+/* Cancelled files stay unfinished in the index and are picked up again */
+static void finish_batch(Watch *w, WatchBatch *b) {
+    pthread_join(b->thread, NULL);
+    for (int i = 0; i < b->files.count; i++) {
+        up60p_error e = b->status[i];
+        if (e != UP60P_ERR_CANCELLED) {
+            set_file(w, b->hashes[i], b->files.items[i], b->size[i], b->mtime[i], e == UP60P_OK ? 'd' : 'f');
+            FileRecord *r = file_record(w, b->hashes[i], false);
+            if (r) journal_file(w, b->hashes[i], r);
+        }
+        map_del(&w->queued, b->hashes[i]);
+    }
+}
+
+static void free_batch(WatchBatch *b) {
+    path_list_free(&b->files);
+    free(b->hashes);
+    free(b->size);
+    free(b->mtime);
+    free(b->status);
+    memset(b, 0, sizeof(*b));
+}
+
+static void free_watch(Watch *w) {
+    if (w->journal) {
+        fflush(w->journal);
+        fsync(fileno(w->journal));
+        fclose(w->journal);
+    }
+    if (w->ifd >= 0) close(w->ifd);
+    for (int i = 0; i < w->nrecords; i++) free(w->records[i].path);
+    for (int i = 0; i < w->ndirs; i++) free(w->dirlist[i].path);
+    for (int i = 0; i < w->npending; i++) free(w->pending[i].path);
+    for (int i = w->ready_head; i < w->ready.count; i++) free(w->ready.items[i]);
+    free(w->ready.items);
+    free(w->records);
+    free(w->dirlist);
+    free(w->pending);
+    map_free(&w->files);
+    map_free(&w->dirs);
+    map_free(&w->pending_map);
+    map_free(&w->queued);
+#ifdef __linux__
+    map_free(&w->wds);
+#endif
+    free(w);
+}
+
+up60p_error watch_directory(const char *root, const char *index_path, int settle_seconds,
+                            watch_batch_fn run, void *ctx) {
+    Watch *w = calloc(1, sizeof(*w));
+    if (!w) return UP60P_ERR_INTERNAL;
+    safe_copy(w->root, root, sizeof(w->root));
+    for (size_t n = strlen(w->root); n > 1 && w->root[n - 1] == '/'; n--) w->root[n - 1] = 0;
+    if (index_path && *index_path) safe_copy(w->index, index_path, sizeof(w->index));
+    else snprintf(w->index, sizeof(w->index), "%s/%s", w->root, WATCH_INDEX_NAME);
+    w->settle_ns = (long long)(settle_seconds > 0 ? settle_seconds : WATCH_SETTLE_DEFAULT) * 1000000000LL;
+    w->ifd = -1;
+#ifdef __linux__
+    w->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->ifd < 0) log_msg("Watch: inotify unavailable, sweeping for changes instead\n");
+#endif
+
+    load_index(w);
+    compact_index(w);
+    if (!w->journal) {
+        char msg[PATH_MAX + 64];
+        snprintf(msg, sizeof(msg), "Watch: can't write the index %s\n", w->index);
+        log_msg(msg);
+        free_watch(w);
+        return UP60P_ERR_IO;
+    }
+
+    // Startup: only directories whose mtime moved are listed again
+    double t0 = mono_s();
+    dir_record(w, w->root, true);
+    sweep(w, true);
+    for (int i = 0; i < w->nrecords; i++) {
+        struct stat st;
+        if (w->records[i].state == 'p' && w->records[i].path && stat(w->records[i].path, &st) == 0) {
+            char *path = strdup(w->records[i].path);
+            if (path) consider(w, path, &st);
+            free(path);
+        }
+    }
+    char msg[192];
+    snprintf(msg, sizeof(msg), "Watch: %s, %d directories and %d files indexed in %.1f s, %d ready\n",
+             w->root, w->ndirs, w->nrecords, mono_s() - t0, w->ready.count - w->ready_head);
+    log_msg(msg);
+
+    WatchBatch batch = {0};
+    bool running = false;
+    double last_sweep = mono_s();
+    double interval = w->ifd >= 0 ? WATCH_RESCAN_SECONDS : WATCH_POLL_SECONDS;
+    while (!up60p_is_cancelled()) {
+        if (w->ifd >= 0) {
+            struct pollfd pfd = { .fd = w->ifd, .events = POLLIN };
+            if (poll(&pfd, 1, 1000) > 0) {
+#ifdef __linux__
+                read_events(w);
+#endif
+            }
+        } else {
+            struct timespec ts = { 1, 0 };
+            nanosleep(&ts, NULL);
+        }
+        settle_pending(w);
+        if (running && __atomic_load_n(&batch.done, __ATOMIC_ACQUIRE)) {
+            finish_batch(w, &batch);
+            free_batch(&batch);
+            running = false;
+        }
+        if (!running && w->ready.count > w->ready_head && !up60p_is_cancelled()) {
+            running = start_batch(w, &batch, run, ctx);
+            if (!running) free_batch(&batch);
+        }
+        if (w->rescan || mono_s() - last_sweep >= interval) {
+            if (w->rescan) log_msg("Watch: event queue overflowed, sweeping for changes\n");
+            sweep(w, false);
+            w->rescan = false;
+            last_sweep = mono_s();
+        }
+        if (w->journal_lines > 2L * (w->nrecords + w->ndirs) + 1024) compact_index(w);
+    }
+    if (running) {
+        finish_batch(w, &batch);
+        free_batch(&batch);
+    }
+    free_watch(w);
+    return UP60P_OK;
+}
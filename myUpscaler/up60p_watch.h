@@ -0,0 +1,30 @@
+#ifndef UP60P_WATCH_H
+#define UP60P_WATCH_H
+
+#include "up60p_common.h"
+#include "up60p_jobs.h"
+
+#define WATCH_INDEX_VERSION 1
+#define WATCH_INDEX_NAME ".up60p_index"
+#define WATCH_SETTLE_DEFAULT 10      /* seconds a file must sit unwritten */
+#define WATCH_BATCH_MAX 4096         /* files handed to one batch */
+#define WATCH_RESCAN_SECONDS 600     /* directory mtime sweep behind inotify */
+#define WATCH_POLL_SECONDS 30        /* the same sweep where there's no inotify */
+
+/* Processes files, filling status[i] for files->items[i] */
+typedef void (*watch_batch_fn)(const PathList *files, up60p_error *status, void *ctx);
+
+/* Watches root until up60p_is_cancelled(), handing restorable files to run
+   once their size and mtime have held still for settle_seconds.
+
+   The index (root/.up60p_index unless index_path is set) is an append-only
+   journal of every file's size, mtime and outcome plus every directory's
+   mtime, compacted when it's mostly superseded lines. A file is processed
+   again only when its size or mtime changes; failures aren't retried until
+   then. On restart only directories whose mtime moved are listed again, so
+   a file rewritten in place while nothing was watching waits for its next
+   change. Files found but not finished are picked up from the index. */
+up60p_error watch_directory(const char *root, const char *index_path, int settle_seconds,
+                            watch_batch_fn run, void *ctx);
+
+#endif
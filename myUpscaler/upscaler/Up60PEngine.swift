@@ -43,6 +43,7 @@ final class Up60PEngine {
     private static var bridgeOverride: Up60PBridge?
     private static var bridge: Up60PBridge { bridgeOverride ?? .live }
     nonisolated(unsafe) private static var currentLogHandler: ((String) -> Void)?
+    nonisolated(unsafe) private static var currentProgressHandler: ((up60p_progress) -> Void)?
     nonisolated private static let logHandlerQueue = DispatchQueue(label: "com.myupscaler.loghandler")
     
     static var shared: Up60PEngine {
@@ -60,6 +61,12 @@ final class Up60PEngine {
         }
     }
     
+    static func setProgressHandler(_ handler: ((up60p_progress) -> Void)?) {
+        logHandlerQueue.sync {
+            currentProgressHandler = handler
+        }
+    }
+    
     private init() {
         // Don't initialize here - do it lazily on first use
     }
@@ -152,6 +159,19 @@ final class Up60PEngine {
             throw mapError(result) ?? .unknownStatus(Int32(result.rawValue))
         }
         
+        // Typed progress from ffmpeg's -progress pipe replaces scraping stats lines
+        up60p_set_progress_callback { progress in
+            guard let progress = progress else { return }
+            let snapshot = progress.pointee
+            Up60PEngine.logHandlerQueue.sync {
+                if let handler = Up60PEngine.currentProgressHandler {
+                    DispatchQueue.main.async {
+                        handler(snapshot)
+                    }
+                }
+            }
+        }
+        
         // Log successful initialization
         Up60PEngine.logHandlerQueue.sync {
             if let handler = Up60PEngine.currentLogHandler {
@@ -28,10 +28,12 @@ typedef struct {
     
     /* Scaler / AI */
     char scaler[16];
-    char ai_backend[16];
+    char ai_backend[16];      /* "sr", "dnn" or "pipe" (raw frames through pipe_cmd / up60p_set_upscaler) */
     char ai_model[PATH_MAX];
     char ai_model_type[16];
     char dnn_backend[32];
+    char pipe_cmd[PATH_MAX];  /* external upscaler for ai_backend "pipe", run by /bin/sh with
+                                 width, height, scale and pix_fmt as $1..$4 */
     
     /* Filters – First Set */
     char denoiser[16];
@@ -93,14 +95,42 @@ typedef struct {
     
     /* Encoder extra */
     char x265_params[256];
+    char target_metric[16];  /* "vmaf", "ssim" or "psnr": encode sample windows at several CRFs and
+                                use the one that scores target_score instead of crf; "" = off */
+    char target_score[16];   /* "" = 93 for vmaf, 0.98 for ssim, 40 (dB) for psnr */
+    char max_bitrate[32];    /* bitrate cap for target-quality encodes, e.g. "8M"; "" = none */
+    int  two_pass;           /* target-quality encodes run two-pass ABR at the predicted bitrate */
     
     /* I/O */
     char outdir[PATH_MAX];
     char audio_bitrate[32];
     char threads[16];
     char movflags[32];
+    char cache_dir[PATH_MAX];   /* reuse results of identical jobs from here, "" = off */
+    int  cache_max_mb;  /* LRU size cap for cache_dir, 0 = 20 GB */
+    char stage_cache_dir[PATH_MAX]; /* keep lossless restore/scale stage outputs here so tweaks
+                                       after the scaler re-run only the post stage, "" = off */
+    int  stage_cache_mb; /* LRU size cap for stage_cache_dir, 0 = 100 GB */
+    char watch_index[PATH_MAX]; /* up60p_watch_path index file, "" = <dir>/.up60p_index */
+    int  watch_settle;  /* seconds a watched file must go unwritten before it's picked up, 0 = 10 */
     int  use10;
     int  preview;
+    int  max_jobs;      /* concurrent ffmpeg children for directories, 0 = auto */
+    int  mem_budget_mb; /* concurrent encodes wait until their predicted peak RSS fits in this,
+                           0 = 80% of RAM or the cgroup limit, -1 = no limit */
+    int  segments;      /* split one video into N keyframe-aligned chunks encoded in parallel, 0/1 = off */
+    int  resume_seconds; /* encode as ~N s segments journaled in <output>.resume/ so a rerun after a
+                            crash or cancel continues where it stopped, 0 = off */
+    int  adaptive;      /* quality pre-pass; clean scenes skip the denoise/deblock stages */
+    int  no_optimize;   /* pass the filter chain to ffmpeg exactly as built */
+    int  fused_post;    /* sharpen, deband, grain and range limit in one native pass over
+                           the upscaled frame instead of separate ffmpeg filters */
+    int  native_frc;    /* drop repeats and interpolate natively in the frame pipe instead of
+                           mpdecimate + minterpolate; needs mi_mode mci */
+    int  no_image_batch; /* directories: one ffmpeg per image instead of one per group of
+                            same-format stills */
+    int  no_cpu_pin;    /* concurrent jobs share every core instead of each getting its own
+                           cores on one NUMA node (Linux) */
     
     /* Toggles */
     int no_deblock;
@@ -116,11 +146,147 @@ typedef struct {
     /* HW */
     char hwaccel[16];
     char encoder[16];
+    int  hw_resident;   /* vaapi/qsv: keep frames on the device, running device filters where they
+                           exist and copying only around software-only stages */
+    char hw_device[64]; /* vaapi/qsv render node, e.g. /dev/dri/renderD129, "" = driver default */
+    
+    /* Engine: "cli" forks the bundled ffmpeg, "libav" runs in-process when built with UP60P_HAVE_LIBAV */
+    char backend[16];
 } up60p_options;
 
 
 typedef void (*up60p_log_callback)(const char *message);
 
+typedef struct {
+    int job_id;               /* submission order within one up60p_process_path call */
+    const char *input_path;
+    const char *output_path;
+    int exit_code;            /* ffmpeg exit status, -1 if it could not be run */
+    up60p_error status;
+} up60p_job_result;
+
+typedef void (*up60p_job_callback)(const up60p_job_result *result);
+
+/* One ffmpeg -progress block; -1 / negative where ffmpeg reported N/A */
+typedef struct {
+    int job_id;               /* same id as up60p_job_result */
+    long long frame;
+    double fps;
+    long long out_time_us;
+    double bitrate_kbps;
+    double speed;             /* realtime multiple */
+    long long dup_frames;
+    long long drop_frames;
+    long long total_size;     /* bytes written so far */
+    bool finished;            /* last block for this child */
+} up60p_progress;
+
+/* Called at most every UP60P_PROGRESS_INTERVAL_MS per child, plus once at the
+   end. Concurrent jobs share the callback; calls are serialized. */
+typedef void (*up60p_progress_callback)(const up60p_progress *progress);
+
+#define UP60P_PROGRESS_INTERVAL_MS 250
+
+/* A cancelled job's ffmpeg children get SIGTERM, then SIGKILL if they are
+   still running this much later */
+#define UP60P_KILL_GRACE_MS 5000
+
+/* One packed RGB frame for ai_backend "pipe": rgb24, or rgb48le with use10 */
+typedef struct {
+    unsigned char *data;
+    int width, height;
+    ptrdiff_t stride;         /* bytes per row */
+    int bytes_per_pixel;      /* 3 or 6 */
+} up60p_frame;
+
+/* Fills out, already sized to the integer scale of in; returns 0 on success.
+   Runs on a pipeline thread, concurrently when several jobs run at once. */
+typedef int (*up60p_upscale_fn)(const up60p_frame *in, up60p_frame *out, void *user);
+
+/* Model inference for one tile: in holds 3 planes (R, G, B) of tile_h rows
+   of tile_w floats in 0..1, out receives the same layout at tile * scale.
+   Returns 0 on success. Called from several threads at once. */
+typedef int (*up60p_tile_infer_fn)(const float *in, float *out, int tile_w, int tile_h,
+                                   int scale, void *user);
+
+typedef struct {
+    int tile_w, tile_h;       /* model input size */
+    int scale;                /* model's native factor */
+    int overlap;              /* source pixels shared by neighbouring tiles, 0 = 16 */
+    int feather;              /* blend ramp in output pixels, 0 = overlap * scale */
+    bool cosine;              /* Hann ramp instead of linear */
+    int threads;              /* 0 = one per core */
+    up60p_tile_infer_fn infer;
+    void *user;
+} up60p_tile_config;
+
+typedef struct up60p_tiler up60p_tiler;
+
+/* Planar RGB for the native restoration kernels: depth 8 uses one byte
+   per sample, 9..16 a native-endian uint16_t. */
+typedef struct {
+    void *plane[3];           /* R, G, B */
+    ptrdiff_t stride[3];      /* bytes per row */
+    int width, height;
+    int depth;                /* bits per sample: 8, 10, 16, ... */
+} up60p_image;
+
+/* CPU ports of the Shaders.ci.metal kernels; params as listed, all in
+   0..1 sample units like the CoreImage versions. */
+typedef enum {
+    UP60P_KERNEL_CAS_SHARPEN,        /* sharpness */
+    UP60P_KERNEL_DEBAND_DITHER,      /* threshold, amount */
+    UP60P_KERNEL_BLUE_NOISE_DEBAND,  /* threshold, amount */
+    UP60P_KERNEL_BILATERAL_DENOISE,  /* sigma_spatial, sigma_range */
+    UP60P_KERNEL_DEHALO,             /* strength */
+    UP60P_KERNEL_MOIRE_SUPPRESS,     /* strength */
+    UP60P_KERNEL_DRIFT_GUARD,        /* threshold, amount; ref = non-AI baseline */
+    UP60P_KERNEL_TEMPORAL_SMOOTH     /* strength; ref = previous output frame */
+} up60p_kernel;
+
+typedef struct {
+    up60p_kernel kind;
+    float params[2];
+} up60p_kernel_op;
+
+typedef struct up60p_kernels up60p_kernels;
+
+/* Source quality, each roughly 0..1 (see QualityAnalyzer.swift thresholds) */
+typedef struct {
+    double noise;
+    double blur;
+    double blockiness;
+    double banding;
+    double grain;             /* noise sigma / 255 from the high-frequency residual of the
+                                 flattest blocks; unlike noise (luma spread, as in Swift)
+                                 texture and contrast barely move it */
+} up60p_quality_metrics;
+
+typedef struct {
+    double start_time;        /* seconds */
+    double end_time;
+    int frames;               /* sampled frames that fell in this scene */
+    up60p_quality_metrics metrics;
+} up60p_scene_metrics;
+
+typedef struct {
+    up60p_quality_metrics overall;
+    int frames_sampled;
+    int scene_count;
+    up60p_scene_metrics *scenes;   /* release with up60p_free_analysis */
+} up60p_analysis;
+
+/* Synthetic-clip benchmark of the filter builders and the full chain.
+   Zeroed fields take the defaults. */
+typedef struct {
+    int width, height;        /* clip size, 0 = 640x360 */
+    int frames;               /* frames per clip, 0 = 48 */
+    int threads[8];           /* thread counts to sweep, 0-terminated; none = 1, 2, 4 .. cores */
+    const char *cases;        /* comma-separated case names, NULL = all */
+    const char *clips;        /* comma-separated of noise, gradient, blocky, motion; NULL = all */
+    const char *work_dir;     /* rendered clips are kept here, NULL = $TMPDIR/up60p-bench */
+} up60p_bench_config;
+
 #ifdef UP60P_LIBRARY_MODE
 extern void (*global_log_cb)(const char *message);
 #endif
@@ -133,10 +299,108 @@ void up60p_default_options(up60p_options *out_opts);
 up60p_error up60p_process_path(const char *input_path,
                                const up60p_options *opts);
 
+/* Processes files as they land under dir and settle, until up60p_request_cancel.
+   What's done is kept in an index, so a restart neither rescans the tree nor
+   redoes finished files. */
+up60p_error up60p_watch_path(const char *dir, const up60p_options *opts);
+
 void up60p_set_dry_run(int enable);
 
+/* ffmpeg binary to run instead of the bundled one; NULL or "" restores the
+   default lookup ($UP60P_FFMPEG, next to the executable, then PATH). */
+up60p_error up60p_set_ffmpeg_path(const char *path);
+
+/* Cancels what the calls without a context are running; jobs in a context
+   are cancelled with up60p_context_cancel. Safe in a signal handler. */
 void up60p_request_cancel(void);
 
+void up60p_set_job_callback(up60p_job_callback cb);
+
+/* With a progress callback set, ffmpeg runs with -nostats and reports
+   through -progress on a private pipe instead of the log. */
+void up60p_set_progress_callback(up60p_progress_callback cb);
+
+/* In-process upscaler for ai_backend "pipe"; used instead of pipe_cmd while
+   set. NULL clears it. */
+void up60p_set_upscaler(up60p_upscale_fn fn, void *user);
+
+/* Tiled upscaling with feathered seams over a thread pool. A tiler owns
+   its threads and recycles canvases between frames; NULL on bad config. */
+up60p_tiler *up60p_tiler_create(const up60p_tile_config *config);
+
+/* Upscales in into out (in * scale, same bytes_per_pixel). Has the
+   up60p_upscale_fn shape, so up60p_set_upscaler(up60p_tiler_upscale, tiler)
+   plugs a tiler into pipe mode. */
+int up60p_tiler_upscale(const up60p_frame *in, up60p_frame *out, void *tiler);
+
+void up60p_tiler_destroy(up60p_tiler *tiler);
+
+/* Runs restoration kernels over row strips on its own threads (0 = one
+   per core), with no ffmpeg involved. */
+up60p_kernels *up60p_kernels_create(int threads);
+
+/* Applies op from src into dst, which must be the same size and depth and
+   must not share memory with src. ref is required by the kinds that name
+   it and ignored otherwise. */
+up60p_error up60p_kernels_apply(up60p_kernels *kernels, const up60p_kernel_op *op,
+                                const up60p_image *src, const up60p_image *ref, up60p_image *dst);
+
+/* Same on packed pipe-mode frames (rgb24 / rgb48le) */
+up60p_error up60p_kernels_apply_frame(up60p_kernels *kernels, const up60p_kernel_op *op,
+                                      const up60p_frame *src, const up60p_frame *ref, up60p_frame *dst);
+
+void up60p_kernels_destroy(up60p_kernels *kernels);
+
+/* Metrics for one 8-bit luma plane, e.g. plane 0 of a decoded frame. */
+void up60p_analyze_plane(const unsigned char *y, int width, int height, ptrdiff_t stride,
+                         up60p_quality_metrics *out);
+
+/* Samples up to max_samples frames spread over the whole input (0 = default)
+   and reports overall and per-scene metrics. */
+up60p_error up60p_analyze(const char *input_path, int max_samples, up60p_analysis *out);
+
+void up60p_free_analysis(up60p_analysis *analysis);
+
+/* Runs every case on every clip at every thread count with the strengths
+   in opts and writes a JSON report to *json_out: per run fps (source
+   frames), CPU seconds per frame, peak RSS and speedup over the first
+   thread count. Runs are sequential so they don't disturb each other. */
+up60p_error up60p_benchmark(const up60p_options *opts, const up60p_bench_config *config,
+                            char **json_out);
+
+void up60p_free_benchmark(char *json);
+
+/* A context holds one job's settings, callbacks, ffmpeg path and cancel
+   token, so jobs in different contexts can run at once from different
+   threads. The calls above without one share a single process-wide
+   context. A context runs one job at a time. */
+typedef struct up60p_context up60p_context;
+
+/* Starts from the default options, with ffmpeg looked up as for
+   up60p_set_ffmpeg_path(NULL). log_cb may be NULL. NULL if out of memory. */
+up60p_context *up60p_context_create(up60p_log_callback log_cb);
+
+/* Not while a job is running in it */
+void up60p_context_destroy(up60p_context *ctx);
+
+up60p_error up60p_context_set_ffmpeg_path(up60p_context *ctx, const char *path);
+void up60p_context_set_dry_run(up60p_context *ctx, int enable);
+void up60p_context_set_job_callback(up60p_context *ctx, up60p_job_callback cb);
+void up60p_context_set_progress_callback(up60p_context *ctx, up60p_progress_callback cb);
+void up60p_context_set_upscaler(up60p_context *ctx, up60p_upscale_fn fn, void *user);
+
+/* up60p_process_path / up60p_watch_path in ctx, on the calling thread.
+   Callbacks are made on the job's threads; a context's are serialized,
+   different contexts' are not. */
+up60p_error up60p_context_process_path(up60p_context *ctx, const char *input_path,
+                                       const up60p_options *opts);
+up60p_error up60p_context_watch_path(up60p_context *ctx, const char *dir, const up60p_options *opts);
+
+/* From any thread or a signal handler. Stops only ctx's job: its ffmpeg
+   children are signalled as described at UP60P_KILL_GRACE_MS and reaped
+   before the call running the job returns UP60P_ERR_CANCELLED. */
+void up60p_context_cancel(up60p_context *ctx);
+
 void up60p_shutdown(void);
 #ifdef __cplusplus
 }